@@ -2,14 +2,32 @@
 out vec4 FragColor;
 
 in vec2 TexCoords;
+flat in int MaterialIndex;
 
-uniform sampler2D texture_diffuse1;
-uniform sampler2D texture_specular1;
-uniform sampler2D texture_normal1;
+// MaterialParams in material.h
+struct Material {
+    vec4 diffuse;       // rgb, opacity in a
+    vec4 specular;      // rgb, shininess in a
+    vec4 emissive;
+    ivec4 layers;       // array layer of the diffuse, specular, normal and height map, -1 without
+    uvec4 features;
+};
+
+layout (std140) uniform Materials {
+    Material materials[128];
+};
+
+uniform sampler2DArray diffuseMaps;
+uniform sampler2DArray specularMaps;
+uniform sampler2DArray normalMaps;
 
 void main()
 {    
-    vec4 texColor = texture(texture_diffuse1, TexCoords);
+    Material material = materials[MaterialIndex];
+    vec4 texColor = material.diffuse;
+    if (material.layers.x >= 0) {
+        texColor = texture(diffuseMaps, vec3(TexCoords, material.layers.x));
+    }
     //FragColor = vec4(TexCoords.r, TexCoords.g, 0.0,1.0);
     if (texColor.a < 0.1) {
         discard;
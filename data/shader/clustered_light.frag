@@ -0,0 +1,158 @@
+#version 330 core
+
+in vec3 oPos;
+in vec3 oNormal;
+in vec2 oTex;
+
+out vec4 FragColor;
+
+struct Material {
+    sampler2D diffuse;
+    sampler2D specular;
+    float shininess;
+};
+
+struct DirLight {
+    vec3 direction;
+	
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+// point lights live in texture buffers, binned per cluster on the CPU:
+// lightData      two texels per light, (position, radius) and (color, intensity)
+// clusterData    (offset, count) into lightIndices for each cluster
+// lightIndices   light ids, one run per cluster
+#define GRID_X 16
+#define GRID_Y 9
+#define GRID_Z 24
+
+struct SpotLight {
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+  
+    float constant;
+    float linear;
+    float quadratic;
+  
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;       
+};
+
+uniform vec3 viewPos;
+uniform Material material;
+uniform DirLight dirLight;
+uniform SpotLight spotLight;
+
+uniform samplerBuffer lightData;
+uniform usamplerBuffer clusterData;
+uniform usamplerBuffer lightIndices;
+uniform mat4 view;
+uniform vec2 screenSize;
+uniform float zNear;
+uniform float zFar;
+
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
+vec3 CalcPointLight(int index, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+
+void main()
+{    
+    // properties
+    vec3 norm = normalize(oNormal);
+    vec3 viewDir = normalize(viewPos - oPos);
+    
+    // == =====================================================
+    // Our lighting is set up in 3 phases: directional, point lights and an optional flashlight
+    // For each phase, a calculate function is defined that calculates the corresponding color
+    // per lamp. In the main() function we take all the calculated colors and sum them up for
+    // this fragment's final color.
+    // == =====================================================
+    // phase 1: directional lighting
+    vec3 result = CalcDirLight(dirLight, norm, viewDir);
+    // phase 2: point lights of this fragment's cluster
+    float depth = -(view * vec4(oPos, 1.0)).z;
+    int slice = int(floor(log(max(depth, zNear) / zNear) * float(GRID_Z) / log(zFar / zNear)));
+    ivec3 cell = ivec3(gl_FragCoord.xy / screenSize * vec2(GRID_X, GRID_Y), slice);
+    cell = clamp(cell, ivec3(0), ivec3(GRID_X - 1, GRID_Y - 1, GRID_Z - 1));
+    uvec2 cluster = texelFetch(clusterData, cell.x + cell.y * GRID_X + cell.z * GRID_X * GRID_Y).xy;
+    for(uint i = 0u; i < cluster.y; i++)
+        result += CalcPointLight(int(texelFetch(lightIndices, int(cluster.x + i)).x), norm, oPos, viewDir);
+    // phase 3: spot light
+    result += CalcSpotLight(spotLight, norm, oPos, viewDir);    
+    
+    FragColor = vec4(result, 1.0);
+}
+
+// calculates the color when using a directional light.
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+{
+    vec3 lightDir = normalize(-light.direction);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    // combine results
+    vec3 ambient = light.ambient * vec3(texture(material.diffuse, oTex));
+    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, oTex));
+    vec3 specular = light.specular * spec * vec3(texture(material.specular, oTex));
+    return (ambient + diffuse + specular);
+}
+
+// calculates the color when using a point light.
+vec3 CalcPointLight(int index, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec4 positionRadius = texelFetch(lightData, index * 2);
+    vec4 colorIntensity = texelFetch(lightData, index * 2 + 1);
+    vec3 color = colorIntensity.rgb * colorIntensity.a;
+
+    vec3 lightDir = normalize(positionRadius.xyz - fragPos);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    // attenuation, windowed so it reaches zero at the light radius the CPU culled with
+    float distance = length(positionRadius.xyz - fragPos);
+    float window = clamp(1.0 - pow(distance / positionRadius.w, 4.0), 0.0, 1.0);
+    float attenuation = window * window / (1.0 + 0.09 * distance + 0.032 * (distance * distance));
+    // combine results
+    vec3 ambient = 0.0625 * color * vec3(texture(material.diffuse, oTex));
+    vec3 diffuse = color * diff * vec3(texture(material.diffuse, oTex));
+    vec3 specular = color * spec * vec3(texture(material.specular, oTex));
+    ambient *= attenuation;
+    diffuse *= attenuation;
+    specular *= attenuation;
+    return (ambient + diffuse + specular);
+}
+
+// calculates the color when using a spot light.
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    // attenuation
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+    // spotlight intensity
+    float theta = dot(lightDir, normalize(-light.direction)); 
+    float epsilon = light.cutOff - light.outerCutOff;
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    // combine results
+    vec3 ambient = light.ambient * vec3(texture(material.diffuse, oTex));
+    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, oTex));
+    vec3 specular = light.specular * spec * vec3(texture(material.specular, oTex));
+    ambient *= attenuation * intensity;
+    diffuse *= attenuation * intensity;
+    specular *= attenuation * intensity;
+    return (ambient + diffuse + specular);
+}
@@ -0,0 +1,31 @@
+#version 430 core
+#extension GL_ARB_shader_draw_parameters : require
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+out vec2 TexCoords;
+flat out int MaterialIndex;
+
+// DrawData in multidraw.h
+struct DrawData {
+    mat4 model;
+    uvec4 material;     // x is the material index
+};
+
+layout (std430, binding = 1) readonly buffer Draws {
+    DrawData draws[];
+};
+
+// first command of this glMultiDrawElementsIndirect, gl_DrawID counts from 0 in every call
+uniform int drawBase;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    DrawData draw = draws[drawBase + gl_DrawIDARB];
+    TexCoords = aTexCoords;    
+    MaterialIndex = int(draw.material.x);
+    gl_Position = projection * view * draw.model * vec4(aPos, 1.0);
+}
@@ -4,13 +4,16 @@ layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
 out vec2 TexCoords;
+flat out int MaterialIndex;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform int materialIndex;
 
 void main()
 {
     TexCoords = aTexCoords;    
+    MaterialIndex = materialIndex;
     gl_Position = projection * view * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -4,6 +4,7 @@ out vec4 FragColor;
 in vec2 TexCoords;
 
 uniform sampler2D screenTexture;
+uniform vec2 uvScale;
 
 const float offset = 1.0 / 300.0;  
 
@@ -31,10 +32,14 @@ void main()
         -1, -1, -1
     );
     
+    // bilinear upscale from the drawn region, kept half a texel inside it so nothing
+    // past the viewport bleeds in at the edges
+    vec2 halfTexel = 0.5 / vec2(textureSize(screenTexture, 0));
     vec3 sampleTex[9];
     for(int i = 0; i < 9; i++)
     {
-        sampleTex[i] = vec3(texture(screenTexture, TexCoords.st + offsets[i]));
+        vec2 uv = clamp(TexCoords.st + offsets[i] * uvScale, halfTexel, uvScale - halfTexel);
+        sampleTex[i] = vec3(texture(screenTexture, uv));
     }
     vec3 col = vec3(0.0);
     for(int i = 0; i < 9; i++)
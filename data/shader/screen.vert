@@ -5,8 +5,11 @@ layout (location = 2) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
+// part of the texture the scene was drawn into, see Model::setScreenRegion
+uniform vec2 uvScale;
+
 void main()
 {
-    TexCoords = aTexCoords;
+    TexCoords = aTexCoords * uvScale;
     gl_Position = vec4(aPos.x, aPos.y, aPos.z, 1.0); 
 }  
@@ -0,0 +1,24 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 Pixel;
+flat in uint Glyph;
+in vec4 Color;
+
+// 5x7 bitmaps of characters 32 to 127, bit y * 5 + x, the low 32 bits in x
+uniform uvec2 glyphs[96];
+
+void main()
+{
+    // a 6x9 cell: the glyph with a column to its right and a row above and below
+    int x = int(Pixel.x);
+    int y = int(Pixel.y) - 1;
+    bool on = false;
+    if (x < 5 && y >= 0 && y < 7) {
+        int bit = y * 5 + x;
+        uvec2 g = glyphs[Glyph - 32u];
+        on = (((bit < 32 ? g.x >> uint(bit) : g.y >> uint(bit - 32)) & 1u) != 0u);
+    }
+    // the dark backing keeps the text readable over any scene
+    FragColor = on ? Color : vec4(0.0, 0.0, 0.0, 0.6);
+}
@@ -0,0 +1,24 @@
+#version 330 core
+// one instance per character, see TextOverlay
+layout (location = 0) in ivec2 aCell;
+layout (location = 1) in uint aGlyph;
+layout (location = 2) in vec4 aColor;
+
+out vec2 Pixel;
+flat out uint Glyph;
+out vec4 Color;
+
+// pixels of a character cell on screen, and the screen size
+uniform vec2 cellSize;
+uniform vec2 screenSize;
+
+void main()
+{
+    // a triangle strip of 4 vertices, top left first
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    Pixel = corner * vec2(6.0, 9.0);
+    Glyph = aGlyph;
+    Color = aColor;
+    vec2 p = (vec2(aCell) + corner) * cellSize + vec2(4.0);
+    gl_Position = vec4(p.x / screenSize.x * 2.0 - 1.0, 1.0 - p.y / screenSize.y * 2.0, 0.0, 1.0);
+}
@@ -3,12 +3,24 @@
 #include "camera.h"
 #include "shader.h"
 #include "texture.h"
+#include "config.h"
+#include "rslib.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <random>
+
+#include "spdlog/spdlog.h"
 
 BasicLighting::BasicLighting()
 {
     VBO = 0;
     cubeVAO = 0;
     lightVAO = 0;
+
+    if (auto jobs = RSLib::instance()->getJobSystem()) {
+        m_lightGrid.setParallelFor(jobs->asParallelFor());
+    }
 }
 
 BasicLighting::~BasicLighting()
@@ -35,7 +47,7 @@ int BasicLighting::prepare()
 
     // build and compile our shader zprogram
     // ------------------------------------
-    m_ObjShader = std::make_shared<Shader>("simple_transform.vert", "simple_light.frag");
+    m_ObjShader = std::make_shared<Shader>("simple_transform.vert", "clustered_light.frag");
     m_LightShader = std::make_shared<Shader>("simple_transform.vert", "constant_color.frag");
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
@@ -114,9 +126,81 @@ int BasicLighting::prepare()
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, s)));
     glEnableVertexAttribArray(2);
+
+    // point lights go through texture buffers, GL 3.3 has no storage buffers
+    loadLights();
+    std::vector<glm::vec4> lightData;
+    for (auto& l : m_lights) {
+        lightData.push_back(glm::vec4(l.position, l.radius));
+        lightData.push_back(glm::vec4(l.color, l.intensity));
+    }
+    const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+    glGenBuffers(3, m_lightBuffers);
+    glGenTextures(3, m_lightTextures);
+    for (int i = 0; i < 3; ++i) {
+        glBindBuffer(GL_TEXTURE_BUFFER, m_lightBuffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, i == 0 ? lightData.size() * sizeof(glm::vec4) : 16, i == 0 ? lightData.data() : nullptr, i == 0 ? GL_STATIC_DRAW : GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, m_lightTextures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], m_lightBuffers[i]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    m_ObjShader->use();
+    m_ObjShader->setInt("lightData", 2);
+    m_ObjShader->setInt("clusterData", 3);
+    m_ObjShader->setInt("lightIndices", 4);
     return 0;
 }
 
+void BasicLighting::loadLights()
+{
+    auto config = RSLib::instance()->getConfig();
+
+    size_t count = config->get_array_size("basic_lighting/lights");
+    for (size_t i = 0; i < count; ++i) {
+        std::string key = "basic_lighting/lights/" + std::to_string(i);
+        auto position = config->get_floats(key + "/position");
+        auto color = config->get_floats(key + "/color");
+        if (position.size() != 3 || color.size() != 3) {
+            spdlog::warn("{0} needs a position and a color", key);
+            continue;
+        }
+        m_lights.push_back({ glm::vec3(position[0], position[1], position[2]), config->get_float(key + "/radius"),
+                             glm::vec3(color[0], color[1], color[2]), config->get_float(key + "/intensity") });
+    }
+
+    // extra lights scattered around the cubes, to load the light culling
+    int extra = config->get_int("basic_lighting/random_lights");
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> x(-5.0f, 5.0f), y(-4.0f, 6.0f), z(-16.0f, 2.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (int i = 0; i < extra; ++i) {
+        m_lights.push_back({ glm::vec3(x(rng), y(rng), z(rng)), 1.0f + 2.0f * unit(rng),
+                             glm::vec3(unit(rng), unit(rng), unit(rng)), 0.5f });
+    }
+    spdlog::info("BasicLighting: {0} point lights", m_lights.size());
+}
+
+void BasicLighting::uploadClusters()
+{
+    auto& clusters = m_lightGrid.clusters();
+    auto& indices = m_lightGrid.indices();
+
+    // orphan and refill, the texture buffers keep pointing at the same buffer objects
+    glBindBuffer(GL_TEXTURE_BUFFER, m_lightBuffers[1]);
+    glBufferData(GL_TEXTURE_BUFFER, clusters.size() * sizeof(glm::uvec2), clusters.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, m_lightBuffers[2]);
+    glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(indices.size(), 1) * sizeof(uint32_t), indices.empty() ? nullptr : indices.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    for (int i = 0; i < 3; ++i) {
+        glActiveTexture(GL_TEXTURE2 + i);
+        glBindTexture(GL_TEXTURE_BUFFER, m_lightTextures[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
 int BasicLighting::render()
 {
     glm::vec3 cubePositions[] = {
@@ -132,13 +216,6 @@ int BasicLighting::render()
         glm::vec3(-1.3f,  1.0f, -1.5f)
     };
 
-    glm::vec3 pointLightPositions[] = {
-        glm::vec3(0.7f,  0.2f,  2.0f),
-        glm::vec3(2.3f, -3.3f, -4.0f),
-        glm::vec3(-4.0f,  2.0f, -12.0f),
-        glm::vec3(0.0f,  0.0f, -3.0f)
-    };
-
     // render loop
     // -----------
     while (!glfwWindowShouldClose(m_window)) {
@@ -179,38 +256,6 @@ int BasicLighting::render()
         m_ObjShader->setVec3("dirLight.ambient", 0.05f, 0.05f, 0.05f);
         m_ObjShader->setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
         m_ObjShader->setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-        // point light 1
-        m_ObjShader->setVec3("pointLights[0].position", pointLightPositions[0]);
-        m_ObjShader->setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-        m_ObjShader->setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-        m_ObjShader->setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-        m_ObjShader->setFloat("pointLights[0].constant", 1.0f);
-        m_ObjShader->setFloat("pointLights[0].linear", 0.09f);
-        m_ObjShader->setFloat("pointLights[0].quadratic", 0.032f);
-        // point light 2
-        m_ObjShader->setVec3("pointLights[1].position", pointLightPositions[1]);
-        m_ObjShader->setVec3("pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
-        m_ObjShader->setVec3("pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
-        m_ObjShader->setVec3("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-        m_ObjShader->setFloat("pointLights[1].constant", 1.0f);
-        m_ObjShader->setFloat("pointLights[1].linear", 0.09f);
-        m_ObjShader->setFloat("pointLights[1].quadratic", 0.032f);
-        // point light 3
-        m_ObjShader->setVec3("pointLights[2].position", pointLightPositions[2]);
-        m_ObjShader->setVec3("pointLights[2].ambient", 0.05f, 0.05f, 0.05f);
-        m_ObjShader->setVec3("pointLights[2].diffuse", 0.8f, 0.8f, 0.8f);
-        m_ObjShader->setVec3("pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-        m_ObjShader->setFloat("pointLights[2].constant", 1.0f);
-        m_ObjShader->setFloat("pointLights[2].linear", 0.09f);
-        m_ObjShader->setFloat("pointLights[2].quadratic", 0.032f);
-        // point light 4
-        m_ObjShader->setVec3("pointLights[3].position", pointLightPositions[3]);
-        m_ObjShader->setVec3("pointLights[3].ambient", 0.05f, 0.05f, 0.05f);
-        m_ObjShader->setVec3("pointLights[3].diffuse", 0.8f, 0.8f, 0.8f);
-        m_ObjShader->setVec3("pointLights[3].specular", 1.0f, 1.0f, 1.0f);
-        m_ObjShader->setFloat("pointLights[3].constant", 1.0f);
-        m_ObjShader->setFloat("pointLights[3].linear", 0.09f);
-        m_ObjShader->setFloat("pointLights[3].quadratic", 0.032f);
         // spotLight
         m_ObjShader->setVec3("spotLight.position", m_camera->Position);
         m_ObjShader->setVec3("spotLight.direction", m_camera->Front);
@@ -233,6 +278,16 @@ int BasicLighting::render()
         glm::mat4 view = m_camera->GetViewMatrix();
         glm::mat4 model = m_camera->GetModelMatrix();
 
+        // bin the point lights into clusters for this view
+        m_lightGrid.setProjection(glm::radians(m_camera->Zoom), m_camera->AspectRatio, 0.1f, 100.0f);
+        m_lightGrid.build(m_lights, view);
+        uploadClusters();
+        m_ObjShader->setVec2("screenSize", (float)m_scr_width, (float)m_scr_height);
+        m_ObjShader->setFloat("zNear", m_lightGrid.zNear());
+        m_ObjShader->setFloat("zFar", m_lightGrid.zFar());
+        m_profiler.count("lights.indices", m_lightGrid.indices().size());
+        m_profiler.count("lights.max_per_cluster", m_lightGrid.maxLightsPerCluster());
+
         m_ObjShader->setMat4("model", model);
         m_ObjShader->setMat4("view", view);
         m_ObjShader->setMat4("projection", projection);
@@ -256,12 +311,9 @@ int BasicLighting::render()
         m_LightShader->setMat4("projection", projection);
 
         glBindVertexArray(lightVAO);
-        for (unsigned int i = 0; i < 4; i++) {
-            lightPos.x = pointLightPositions[i].x * sin(currentFrame);
-            lightPos.y = pointLightPositions[i].y;
-            lightPos.z = pointLightPositions[i].z * cos(currentFrame);
+        for (auto& light : m_lights) {
             model = glm::mat4(1.0f);
-            model = glm::translate(model, lightPos);
+            model = glm::translate(model, light.position);
             model = glm::scale(model, glm::vec3(0.2f)); // Make it a smaller cube
             m_LightShader->setMat4("model", model);
             glDrawArrays(GL_TRIANGLES, 0, 36);
@@ -273,6 +325,9 @@ int BasicLighting::render()
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(m_window);
         glfwPollEvents();
+
+        m_profiler.endFrame();
+        m_fps = m_profiler.fps();
     }
     return 0;
 }
@@ -285,6 +340,8 @@ int BasicLighting::cleanup()
     glDeleteVertexArrays(1, &cubeVAO);
     glDeleteVertexArrays(1, &lightVAO);
     glDeleteBuffers(1, &VBO);
+    glDeleteTextures(3, m_lightTextures);
+    glDeleteBuffers(3, m_lightBuffers);
 
     return 0;
 }
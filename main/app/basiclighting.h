@@ -1,5 +1,6 @@
 #pragma once
 #include "render.h"
+#include "lightgrid.h"
 
 class Shader;
 
@@ -14,9 +15,18 @@ public:
     virtual int cleanup() override;
     
 protected:
+    void loadLights();
+    void uploadClusters();
+
     std::shared_ptr<Shader> m_ObjShader;
     std::shared_ptr<Shader> m_LightShader;
     unsigned VBO;
     unsigned cubeVAO;
     unsigned lightVAO;
+
+    std::vector<PointLight> m_lights;
+    LightGrid m_lightGrid;
+    // texture buffers: light data, per-cluster (offset, count) and the light index list
+    unsigned m_lightBuffers[3] = { 0, 0, 0 };
+    unsigned m_lightTextures[3] = { 0, 0, 0 };
 };
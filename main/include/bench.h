@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+
+// CPU-only micro benchmarks, selected with --bench <name> (or "all").
+// They don't create a window or a GL context. Returns non-zero for an unknown name, or
+// when a benchmark's correctness check failed.
+int runBenchmark(const std::string& name);
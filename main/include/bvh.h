@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "geometry.h"
+#include "culling.h"
+
+// 32-byte node. Interior nodes have count == 0 and their children at index and index + 1,
+// leaves reference count items starting at index in the item order.
+struct BVHNode
+{
+    float minX, minY, minZ;
+    uint32_t index;
+    float maxX, maxY, maxZ;
+    uint32_t count;
+
+    bool leaf() const { return count != 0; }
+};
+static_assert(sizeof(BVHNode) == 32, "BVHNode must stay 32 bytes");
+
+// Bounding volume hierarchy over scene instances stored in one flat node array.
+// build() does a binned SAH build; update() + refit() keep the tree valid when
+// instances move, and the tree is rebuilt automatically once refits degrade it.
+// Leaves hold up to 8 items, a frustum query tests a straddling leaf's items in one
+// cullAABBs block.
+class BVH
+{
+public:
+    BVH();
+
+    void build(const std::vector<AABB>& bounds);
+    void clear();
+
+    // change the bounds of one item, takes effect on the next refit()
+    void update(uint32_t item, const AABB& bounds);
+    // appends a new item, it is placed in the tree by the next refit()
+    uint32_t insert(const AABB& bounds);
+    void refit();
+
+    void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& items) const;
+    // nearest item whose bounds the ray hits, or -1; t is the distance along dir
+    int raycast(const glm::vec3& origin, const glm::vec3& dir, float& t) const;
+
+    size_t size() const { return m_bounds.size(); }
+    size_t nodeCount() const { return m_nodes.size(); }
+    float sahCost() const;
+
+private:
+    void buildNodes(uint32_t itemCount);
+    AABB nodeBounds(const BVHNode& node) const;
+    void collect(uint32_t node, std::vector<uint32_t>& items) const;
+    // the bounds of the items in leaf order into m_leafBounds
+    void fillLeafBounds();
+
+    std::vector<BVHNode> m_nodes;
+    std::vector<uint32_t> m_parents;
+    std::vector<uint32_t> m_items;      // item ids in leaf order
+    std::vector<uint32_t> m_itemLeaf;   // leaf node of every item
+    std::vector<AABB> m_bounds;
+    // m_bounds in m_items order, with 7 boxes of padding so every leaf is one whole block
+    AABBSoA m_leafBounds;
+    std::vector<glm::vec3> m_centers;
+
+    std::vector<uint32_t> m_dirty;
+    bool m_needsRebuild;
+    float m_builtCost;
+};
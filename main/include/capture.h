@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "jobs.h"
+
+class Profiler;
+
+// Asynchronous readback of the render target. read() starts a glReadPixels into one of a
+// ring of pixel pack buffers and fences it, poll() maps the buffers whose fences have
+// signalled and hands the pixels to a worker that encodes and writes them, so neither
+// side ever waits on the GPU. A slot stays busy until its encode is done; when all of them
+// are, the frame is dropped instead of stalling.
+//
+// With a golden directory every capture is also compared against the QOI of the same name
+// there, and written as the reference when there's none yet.
+//
+// With a stream the workers convert captures to YUV 4:2:0 instead and a writer thread appends
+// them to one Y4M file, or stdout, in frame order.
+class FrameCapture
+{
+public:
+    // readbacks in flight plus frames being encoded
+    static const int Slots = 4;
+
+    struct Settings {
+        std::string directory = "capture";
+        // "qoi" or "png"
+        std::string format = "qoi";
+        std::string golden;
+        // channel difference a golden comparison ignores
+        int tolerance = 2;
+        // Y4M file, "-" for stdout; captures go there instead of into directory
+        std::string stream;
+        int fps = 30;
+    };
+
+    FrameCapture() = default;
+    ~FrameCapture();
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    void setup(const Settings& settings);
+
+    // reads width x height from the bound read framebuffer, GL thread. False if every
+    // slot is busy and the frame was dropped.
+    bool read(uint64_t frame, int width, int height);
+    // collects finished readbacks without blocking, GL thread
+    void poll(Profiler& profiler);
+    // blocks until read() has a slot, so that offline rendering never drops a frame; GL thread
+    void waitForSlot();
+    // waits for every readback and encode and logs the totals, for shutdown
+    void finish();
+
+    uint64_t written() const { return m_written.load(); }
+    uint64_t goldenFailures() const { return m_goldenFailures.load(); }
+
+private:
+    // Encoded slots wait for the stream writer
+    enum State { Free, Reading, Encoding, Encoded };
+
+    struct Slot {
+        std::atomic<int> state{ Free };
+        unsigned int buffer = 0;
+        // persistently mapped buffer with GL 4.4, workers read it in place; null otherwise
+        const uint8_t* mapped = nullptr;
+        // GLsync
+        void* fence = nullptr;
+        size_t capacity = 0;
+        uint64_t frame = 0;
+        int width = 0;
+        int height = 0;
+        // copy of the buffer without a persistent mapping, RGBA rows bottom up like GL's
+        std::vector<uint8_t> pixels;
+        // YUV planes for the stream
+        std::vector<uint8_t> encoded;
+    };
+
+    void collect(Slot& slot);
+    void encode(Slot& slot);
+    void release(Slot& slot, State state);
+    void writeStream();
+
+    Settings m_settings;
+    Slot m_slots[Slots];
+    // next slot read() tries, collected in the same order
+    int m_next = 0;
+    int m_oldest = 0;
+    int m_reading = 0;
+    JobCounter m_encoding;
+    // since the last poll()
+    uint64_t m_dropped = 0;
+    // state changes the writer and waitForSlot() wait on
+    std::mutex m_lock;
+    std::condition_variable m_changed;
+    FILE* m_stream = nullptr;
+    std::thread m_writer;
+    bool m_stopWriting = false;
+    std::atomic<uint64_t> m_written{ 0 };
+    std::atomic<uint64_t> m_goldenFailures{ 0 };
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+
+// One recorded GL call, see CommandList for what the arguments hold.
+struct Command
+{
+    enum Op : uint8_t {
+        UseProgram, BindVertexArray, BindTextures, Enable, Disable,
+        Uniform1i, Uniform2f, UniformMatrix4, DrawElements, MultiDrawIndirect
+    };
+
+    Op op;
+    // uniforms: the location, or -1 to look name up
+    int32_t location;
+    const char* name;
+    uint32_t args[5];
+};
+
+// GL calls recorded as data. Recording makes no GL calls, so a list can be built on any
+// thread and handed to the GL thread, which plays it with a CommandExecutor. Names of
+// uniforms are kept as pointers and looked up when the list is played: they have to be
+// string literals, or live as long as the list does.
+//
+// clear() keeps the storage, a list reused every frame stops allocating once it has seen
+// its largest frame.
+class CommandList
+{
+public:
+    void clear();
+    size_t size() const { return m_commands.size(); }
+    bool empty() const { return m_commands.empty(); }
+
+    void useProgram(unsigned int program);
+    void bindVertexArray(unsigned int vao);
+    // count textures of target (GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY) on units from first;
+    // units given 0 keep what they have
+    void bindTextures(unsigned int target, unsigned int first, unsigned int count, const unsigned int* textures);
+    void bindTexture(unsigned int target, unsigned int unit, unsigned int texture) { bindTextures(target, unit, 1, &texture); }
+    void enable(unsigned int cap);
+    void disable(unsigned int cap);
+    // of the program in use when the list is played
+    void uniform(int location, int value);
+    void uniform(const char* name, int value);
+    void uniform(const char* name, const glm::vec2& value);
+    void uniform(const char* name, const glm::mat4& value);
+    void drawElements(unsigned int mode, unsigned int count, unsigned int type, size_t offset, int baseVertex);
+    // count commands from offset bytes into the draw indirect buffer
+    void multiDrawIndirect(unsigned int buffer, unsigned int mode, unsigned int type, size_t offset, unsigned int count);
+
+    const std::vector<Command>& commands() const { return m_commands; }
+    // matrices and texture names the commands point into
+    const std::vector<uint32_t>& data() const { return m_data; }
+
+private:
+    Command& push(Command::Op op);
+    uint32_t store(const void* data, size_t words);
+
+    std::vector<Command> m_commands;
+    std::vector<uint32_t> m_data;
+};
+
+// Plays command lists on the GL thread through a shadow of the state they set: programs,
+// the VAO, texture bindings, the draw indirect buffer, depth test, blending, culling and
+// uniform values. A command that would set what is already set is elided.
+//
+// GL calls made around the executor aren't seen by it; invalidate() forgets the shadow,
+// and has to be called after any such code before the next execute().
+class CommandExecutor
+{
+public:
+    // what the executor keeps counts of, per command
+    enum Kind { Program, VertexArray, Texture, Buffer, Capability, Uniform, Draw, Kinds };
+    static const unsigned MaxUnits = 16;
+
+    struct Stats {
+        std::array<uint64_t, Kinds> issued = {};
+        std::array<uint64_t, Kinds> elided = {};
+        uint64_t totalIssued() const;
+        uint64_t totalElided() const;
+    };
+
+    CommandExecutor();
+
+    void execute(const CommandList& list);
+    void invalidate();
+
+    const Stats& stats() const { return m_stats; }
+    void resetStats() { m_stats = Stats(); }
+
+private:
+    struct UniformValue {
+        uint32_t generation = 0;
+        uint32_t words = 0;
+        uint32_t value[16];
+    };
+    struct NameKey {
+        unsigned int program;
+        const char* name;
+        bool operator==(const NameKey& o) const { return program == o.program && name == o.name; }
+    };
+    struct NameHash {
+        size_t operator()(const NameKey& k) const { return std::hash<const char*>()(k.name) ^ (size_t(k.program) * 0x9e3779b97f4a7c15ull); }
+    };
+
+    void bindTextures(const Command& c, const uint32_t* textures);
+    void setCapability(unsigned int cap, bool on);
+    int location(const Command& c);
+    // true if the uniform already holds value, records it otherwise
+    bool uniformSet(int location, const uint32_t* value, uint32_t words);
+    void count(Kind kind, bool issued) { (issued ? m_stats.issued : m_stats.elided)[kind]++; }
+
+    unsigned int m_program;
+    unsigned int m_vao;
+    unsigned int m_indirectBuffer;
+    unsigned int m_activeUnit;
+    // GL_TEXTURE_2D and GL_TEXTURE_2D_ARRAY of every unit
+    std::array<std::array<unsigned int, MaxUnits>, 2> m_textures;
+    // depth test, blend, cull face: 0 off, 1 on, -1 unknown
+    std::array<int8_t, 3> m_caps;
+    // uniform values are program state, entries from before the last invalidate() are stale
+    uint32_t m_generation = 1;
+    std::unordered_map<uint64_t, UniformValue> m_uniforms;
+    std::unordered_map<NameKey, int, NameHash> m_locations;
+    Stats m_stats;
+};
@@ -26,9 +26,13 @@ public:
 
     bool check_model(std::string attrib);
 
+    bool has(std::string key, std::string prefix = "");
     bool get_bool(std::string key, std::string prefix = "");
     int get_int(std::string key, std::string prefix = "");
     int get_uint(std::string key, std::string prefix = "");
+    float get_float(std::string key, std::string prefix = "");
+    std::vector<float> get_floats(std::string key, std::string prefix = "");
+    size_t get_array_size(std::string key, std::string prefix = "");
     std::string get_string(std::string key, std::string prefix = "");
 
 
@@ -36,7 +40,7 @@ public:
     std::unordered_map<std::string, bool> get_object_settings(std::string key, std::string prefix = "");
 
 protected :
-    rapidjson::Document::ValueType* get_obj(std::string key, std::string prefix = "");
+    rapidjson::Document::ValueType* get_obj(std::string key, std::string prefix = "", bool warn = true);
 
     void set_current(std::string app)
     {
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "geometry.h"
+
+// Six planes (left, right, bottom, top, near, far) with normals pointing inside.
+struct Frustum
+{
+    glm::vec4 planes[6];
+};
+
+Frustum extractFrustum(const glm::mat4& viewProj);
+bool isVisible(const Frustum& frustum, const AABB& box);
+
+// World space boxes in structure-of-arrays layout for the batch tester.
+class AABBSoA
+{
+public:
+    void clear();
+    void push_back(const AABB& box);
+    // new boxes are empty, at the origin
+    void resize(size_t count);
+    void set(size_t i, const AABB& box);
+    size_t size() const { return minX.size(); }
+
+    std::vector<float> minX, minY, minZ;
+    std::vector<float> maxX, maxY, maxZ;
+};
+
+// Tests boxes [first, first + count) against the frustum, 8 boxes per iteration (AVX, or
+// two SSE halves). visible[i] is set to 1 or 0 for box first + i; returns the number of
+// visible boxes. A last block of fewer than 8 is still tested in one go, the lanes past
+// count dropped, as long as the arrays hold 8 boxes from its start.
+size_t cullAABBs(const Frustum& frustum, const AABBSoA& boxes, size_t first, size_t count, uint8_t* visible);
+inline size_t cullAABBs(const Frustum& frustum, const AABBSoA& boxes, uint8_t* visible)
+{
+    return cullAABBs(frustum, boxes, 0, boxes.size(), visible);
+}
@@ -2,8 +2,11 @@
 #include <memory>
 
 class Render;
+class JobSystem;
 
 class Engine {
+    // declared first so it outlives the renderer
+    std::unique_ptr<JobSystem> m_jobs;
     std::unique_ptr<Render> m_pRender;
 public:
     Engine() = delete;
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+// Bump allocator for data that only lives for one frame. Allocation is a pointer bump,
+// nothing is freed individually and reset() drops everything at once. Requests that
+// don't fit go to the heap for the rest of the frame, and the next reset() grows the
+// block to that frame's peak so steady-state frames never touch the heap.
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t capacity = 64 * 1024);
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+    // uninitialized storage for count objects, only for types that need no destructor
+    template <class T>
+    T* allocate(size_t count) { return static_cast<T*>(allocate(count * sizeof(T), alignof(T))); }
+
+    void reset();
+    // makes room for at least bytes before the next overflow
+    void reserve(size_t bytes);
+
+    size_t used() const { return m_used + m_overflowBytes; }
+    size_t capacity() const { return m_capacity; }
+    // allocations that went to the heap since construction
+    size_t overflows() const { return m_overflows; }
+
+private:
+    std::unique_ptr<char[]> m_block;
+    size_t m_capacity;
+    size_t m_used = 0;
+
+    std::vector<std::unique_ptr<char[]>> m_overflow;
+    size_t m_overflowBytes = 0;
+    size_t m_overflows = 0;
+};
+
+// std::pmr view of a FrameArena; deallocate does nothing, memory comes back on reset()
+class FrameResource : public std::pmr::memory_resource
+{
+public:
+    explicit FrameResource(FrameArena& arena) : m_arena(arena) {}
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override { return m_arena.allocate(bytes, alignment); }
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+private:
+    FrameArena& m_arena;
+};
+
+// One arena per frame in flight. Memory handed out during frame N stays valid until
+// the beginFrame() of frame N + frames, so one frame can be read while the next is built.
+class FrameAllocator
+{
+public:
+    explicit FrameAllocator(size_t capacity = 64 * 1024, size_t frames = 2);
+
+    // moves to the oldest arena and resets it
+    void beginFrame();
+    void reserve(size_t bytes);
+
+    FrameArena& arena() { return *m_arenas[m_current]; }
+    std::pmr::memory_resource* resource() { return m_resources[m_current].get(); }
+    size_t frames() const { return m_arenas.size(); }
+
+private:
+    std::vector<std::unique_ptr<FrameArena>> m_arenas;
+    std::vector<std::unique_ptr<FrameResource>> m_resources;
+    size_t m_current = 0;
+};
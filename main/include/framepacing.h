@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Accumulates frame time and hands it out in fixed steps, so the simulation advances the
+// same way at any frame rate. What's left over is how far the frame is between the last two
+// steps, for interpolating what it draws. After a stall at most maxSteps run and the rest
+// of the time is dropped: the simulation slows down rather than spiralling.
+class FixedStep
+{
+public:
+    explicit FixedStep(double step = 1.0 / 120.0, int maxSteps = 8);
+
+    // adds a frame's time, returns the steps to run for it
+    int advance(double seconds);
+
+    double step() const { return m_step; }
+    // 0 at the last step, towards 1 just before the next
+    double alpha() const { return m_accumulator / m_step; }
+    // simulated seconds
+    double time() const { return double(m_steps) * m_step; }
+    uint64_t steps() const { return m_steps; }
+    double dropped() const { return m_dropped; }
+
+private:
+    double m_step;
+    int m_maxSteps;
+    double m_accumulator = 0.0;
+    uint64_t m_steps = 0;
+    double m_dropped = 0.0;
+};
+
+// Holds a target frame rate without vsync. wait() sleeps until shortly before the frame's
+// deadline and spins the rest; how early it stops sleeping is the mean plus one deviation of
+// the sleeps seen so far, so the spin stays short where the timer is fine and grows only
+// where sleeps overshoot. A frame that misses its deadline moves the schedule instead of
+// making the next ones hurry.
+class FramePacer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit FramePacer(double fps = 0.0);
+    ~FramePacer();
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    // 0 turns pacing off
+    void setTarget(double fps);
+    bool enabled() const { return m_period.count() > 0; }
+
+    // blocks until the next frame may start
+    void wait();
+
+    // of the last wait()
+    double sleptMs() const { return m_slept; }
+    double spunMs() const { return m_spun; }
+    // how long before a deadline sleeping stops
+    double spinMarginMs() const { return m_margin; }
+
+private:
+    std::chrono::duration<double, std::milli> m_period{ 0.0 };
+    Clock::time_point m_deadline;
+    bool m_started = false;
+    bool m_fineTimer = false;
+    // running mean and variance of single sleeps of SleepMs (Welford)
+    double m_mean = 1.0;
+    double m_m2 = 0.0;
+    uint64_t m_count = 1;
+    double m_margin = 1.0;
+    double m_slept = 0.0;
+    double m_spun = 0.0;
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cfloat>
+#include <glm/glm.hpp>
+
+struct Vertex{
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+    glm::vec3 Tangent;
+    glm::vec3 Bitangent;
+};
+
+struct AABB
+{
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool valid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 extent() const { return (max - min) * 0.5f; }
+
+    void extend(const glm::vec3& p)
+    {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    void extend(const AABB& b)
+    {
+        min = glm::min(min, b.min);
+        max = glm::max(max, b.max);
+    }
+
+    // bounds of this box after an affine transform (Arvo)
+    AABB transformed(const glm::mat4& m) const
+    {
+        glm::vec3 c = glm::vec3(m * glm::vec4(center(), 1.0f));
+        glm::vec3 e = extent();
+        glm::vec3 r;
+        for (int i = 0; i < 3; ++i) {
+            r[i] = glm::abs(m[0][i]) * e.x + glm::abs(m[1][i]) * e.y + glm::abs(m[2][i]) * e.z;
+        }
+        AABB out;
+        out.min = c - r;
+        out.max = c + r;
+        return out;
+    }
+};
+
+// Location of one mesh inside a GeometryArena. Indices are relative to baseVertex,
+// so meshes with up to 65536 vertices can use 16-bit indices.
+struct GeometryRange
+{
+    uint32_t baseVertex = 0;
+    uint32_t vertexCount = 0;
+    uint32_t indexOffset = 0;   // in bytes, into the shared element buffer
+    uint32_t indexCount = 0;
+    uint32_t indexType = 0;     // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+};
+
+// One vertex buffer, one index buffer and one VAO shared by every mesh of the models
+// that load into it. Meshes are suballocated with add() before upload(), which releases
+// the staging copies, and drawn with glDrawElementsBaseVertex, or all at once with
+// multi-draw indirect. Adding after upload() asserts, the buffers are never grown.
+class GeometryArena
+{
+public:
+    GeometryArena();
+    ~GeometryArena();
+
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    GeometryRange add(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+    // extra index list over the vertices of an existing range (used for LODs)
+    GeometryRange addIndices(const GeometryRange& base, const std::vector<uint32_t>& indices);
+    void upload();
+    void bind();
+    void unbind();
+    unsigned int vao() const { return VAO; }
+
+    size_t vertexCount() const { return m_totalVertices; }
+    size_t indexBytes() const { return m_totalIndexBytes; }
+    bool uploaded() const { return m_uploaded; }
+
+private:
+    uint32_t appendIndices(const std::vector<uint32_t>& indices, bool narrow);
+
+    std::vector<Vertex> m_vertices;
+    std::vector<uint8_t> m_indices;
+    uint32_t m_totalVertices;
+    uint32_t m_totalIndexBytes;
+    bool m_uploaded;
+
+    unsigned int VAO;
+    unsigned int VBO;
+    unsigned int EBO;
+};
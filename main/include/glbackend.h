@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Every GL entry point the engine calls, in the order of GLEntry. Trace files store calls by
+// this index, so entry points are only ever added at the end.
+#define GL_BACKEND_ENTRIES(X) \
+    X(ActiveTexture) X(AttachShader) X(BindBuffer) X(BindBufferBase) X(BindFramebuffer) \
+    X(BindImageTexture) X(BindTexture) X(BindTextures) X(BindVertexArray) X(BlendFunc) \
+    X(BufferData) X(BufferStorage) X(BufferSubData) X(CheckFramebufferStatus) X(Clear) \
+    X(ClearBufferData) X(ClearColor) X(ClientWaitSync) X(CompileShader) X(CreateProgram) \
+    X(CreateShader) X(DeleteBuffers) X(DeleteQueries) X(DeleteShader) X(DeleteSync) \
+    X(DeleteTextures) X(DeleteVertexArrays) X(Disable) X(DispatchCompute) X(DrawArrays) \
+    X(DrawArraysInstanced) X(DrawElements) X(DrawElementsBaseVertex) X(Enable) \
+    X(EnableVertexAttribArray) X(FenceSync) X(FramebufferTexture2D) X(GenBuffers) \
+    X(GenFramebuffers) X(GenQueries) X(GenTextures) X(GenVertexArrays) X(GenerateMipmap) \
+    X(GetIntegerv) X(GetProgramInfoLog) X(GetProgramiv) X(GetQueryObjectiv) \
+    X(GetQueryObjectui64v) X(GetShaderInfoLog) X(GetShaderiv) X(GetUniformBlockIndex) \
+    X(GetUniformLocation) X(IsEnabled) X(LinkProgram) X(MapBufferRange) X(MemoryBarrier) \
+    X(MultiDrawElementsIndirect) X(PixelStorei) X(PolygonMode) X(QueryCounter) X(ReadPixels) \
+    X(ShaderSource) X(TexBuffer) X(TexImage2D) X(TexImage3D) X(TexParameteri) X(TexStorage2D) \
+    X(TexSubImage3D) X(Uniform1f) X(Uniform1i) X(Uniform2f) X(Uniform2fv) X(Uniform2i) \
+    X(Uniform2uiv) X(Uniform3f) X(Uniform3fv) X(Uniform4f) X(Uniform4fv) X(UniformBlockBinding) \
+    X(UniformMatrix2fv) X(UniformMatrix3fv) X(UniformMatrix4fv) X(UnmapBuffer) X(UseProgram) \
+    X(VertexAttribDivisor) X(VertexAttribIPointer) X(VertexAttribPointer) X(Viewport)
+
+enum class GLEntry : uint16_t {
+#define GL_BACKEND_ENUM(name) name,
+    GL_BACKEND_ENTRIES(GL_BACKEND_ENUM)
+#undef GL_BACKEND_ENUM
+    Count
+};
+
+// Where the engine's GL calls go. glad calls through one function pointer per entry point;
+// a backend replaces the pointers of the entry points the engine uses.
+//
+// Null: no call reaches a driver. Object names are made up, shaders compile, framebuffers
+// are complete, syncs are signalled, timer queries return when they were issued and mapped
+// buffers are memory of the mapped size. Loaders, the render queue and culling run without
+// a GPU, and without driver overhead where there is one. Without a loaded context it claims
+// GL 4.4 with multi-bind and draw parameters, so the newest paths run.
+// Trace: calls go on to what was installed before, the driver or a null backend.
+//
+// Both count calls per entry point and can record their order. One backend of each kind
+// can be installed at a time; install() saves the pointers it replaces and uninstall(), or
+// the destructor, puts them back. Counting isn't synchronized, GL is used from one thread
+// at a time.
+class GLBackend
+{
+public:
+    enum class Kind { Null, Trace };
+
+    explicit GLBackend(Kind kind);
+    ~GLBackend();
+    GLBackend(const GLBackend&) = delete;
+    GLBackend& operator=(const GLBackend&) = delete;
+
+    void install();
+    void uninstall();
+    bool installed() const { return m_installed; }
+    Kind kind() const { return m_kind; }
+
+    // the hooked entry points, "glActiveTexture" and so on
+    static size_t entryCount();
+    static const char* entryName(size_t entry);
+
+    uint64_t calls(size_t entry) const { return m_counts[entry]; }
+    uint64_t totalCalls() const { return m_total; }
+    void resetCounts();
+    // "glName count" of the top entry points by calls, most first
+    std::string summary(size_t top = 8) const;
+
+    // entry of every call while recording
+    void setRecording(bool on) { m_recording = on; }
+    const std::vector<uint16_t>& recorded() const { return m_recorded; }
+    void clearRecorded() { m_recorded.clear(); }
+
+private:
+    friend struct GLBackendAccess;
+    using GenericFn = void (*)();
+
+    void count(size_t entry)
+    {
+        m_counts[entry]++;
+        m_total++;
+        if (m_recording) {
+            m_recorded.push_back(uint16_t(entry));
+        }
+    }
+
+    Kind m_kind;
+    bool m_installed = false;
+    std::vector<GenericFn> m_saved;
+    std::vector<int> m_savedFlags;
+    std::vector<uint64_t> m_counts;
+    uint64_t m_total = 0;
+    bool m_recording = false;
+    std::vector<uint16_t> m_recorded;
+
+    // null backend state
+    uint32_t m_names = 0;
+    std::unordered_map<uint32_t, uint32_t> m_bound;
+    std::unordered_map<uint32_t, std::vector<uint8_t>> m_memory;
+    std::unordered_map<uint32_t, uint64_t> m_queries;
+    std::unordered_map<uint32_t, bool> m_enabled;
+};
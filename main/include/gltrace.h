@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "glbackend.h"
+
+// A GL trace is every call of GL_BACKEND_ENTRIES made while recording, with its arguments
+// and what it read from client memory: buffer and texture uploads, uniform arrays, shader
+// sources, bytes written to mapped buffers. Names the driver returned are recorded too, so a
+// replay can map them to the names its own driver returns. Calls before the first frame
+// marker load the scene; each marker after that ends a frame.
+//
+// The file is a header and the calls, each the varint entry index followed by its
+// arguments: integers as zigzag varints, floats as 4 bytes, client memory as a varint size
+// and the bytes. Pixel transfers are assumed to be from client memory, the engine uploads
+// no texture through a pixel unpack buffer, and only mappings that are unmapped again have
+// their writes recorded.
+
+// Hooks every entry point and writes its calls to a file, passing them on to whatever was
+// installed before: the driver, or a GLBackend.
+class GLTraceRecorder
+{
+public:
+    GLTraceRecorder() = default;
+    ~GLTraceRecorder();
+    GLTraceRecorder(const GLTraceRecorder&) = delete;
+    GLTraceRecorder& operator=(const GLTraceRecorder&) = delete;
+
+    // starts recording into path, false if it can't be written
+    bool open(const std::string& path);
+    // ends a frame; the first call ends loading
+    void frame();
+    // flushes the file and puts the hooks back, false if writing failed at some point
+    bool close();
+    bool recording() const { return m_file != nullptr; }
+
+    uint64_t calls() const { return m_calls; }
+    // ended so far, loading not counted
+    uint64_t frames() const { return m_markers ? m_markers - 1 : 0; }
+    // written so far
+    uint64_t bytes() const { return m_bytes + m_buffer.size(); }
+
+private:
+    friend struct GLTraceAccess;
+    using GenericFn = void (*)();
+
+    void flush();
+
+    FILE* m_file = nullptr;
+    bool m_failed = false;
+    std::vector<uint8_t> m_buffer;
+    std::vector<GenericFn> m_saved;
+    uint64_t m_calls = 0;
+    uint64_t m_markers = 0;
+    uint64_t m_bytes = 0;
+    // unpack alignment, for the size of texture uploads
+    int m_unpackAlignment = 4;
+    // mappings by target, their bytes are recorded at the unmap
+    struct Mapping {
+        const uint8_t* data = nullptr;
+        size_t length = 0;
+        bool write = false;
+    };
+    std::unordered_map<uint32_t, Mapping> m_mappings;
+};
+
+// Plays a trace through the current GL pointers. Object names, syncs, uniform locations and
+// block indices are mapped to what this driver returns. Every call is timed on the CPU, so
+// the time per entry point is what the driver costs the submitting thread, plus about the
+// cost of reading the clock twice; the GPU side is left to the caller, e.g. a glFinish()
+// after each frame.
+class GLTracePlayer
+{
+public:
+    struct Stats {
+        std::vector<uint64_t> calls;
+        std::vector<double> ns;
+        double setupMs = 0.0;
+    };
+
+    // false if path isn't a trace
+    bool load(const std::string& path);
+    size_t frameCount() const { return m_frames.size(); }
+    uint64_t callCount() const { return m_callCount; }
+    size_t size() const { return m_data.size(); }
+
+    // the calls before the first frame, timed into setupMs only
+    bool playSetup();
+    // one recorded frame, false if the trace is broken there
+    bool playFrame(size_t frame);
+
+    const Stats& stats() const { return m_stats; }
+    void resetStats();
+    // time per entry point, most expensive in total first
+    std::string report(size_t top = 16) const;
+
+private:
+    // the calls from begin up to the next frame marker
+    bool play(size_t begin, bool timed);
+
+    std::vector<uint8_t> m_data;
+    // the entry index of a frame marker, the entry count of the build that recorded
+    uint64_t m_marker = 0;
+    size_t m_setupBegin = 0;
+    // offset of the first call of every frame
+    std::vector<size_t> m_frames;
+    uint64_t m_callCount = 0;
+    Stats m_stats;
+
+    // recorded value to this driver's, per kind of name
+    std::unordered_map<uint64_t, uint64_t> m_names[8];
+    uint64_t m_program = 0;
+    int m_packAlignment = 4;
+    std::unordered_map<uint32_t, void*> m_mappings;
+    std::vector<uint8_t> m_scratch;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include "culling.h"
+#include "multidraw.h"
+
+class Shader;
+
+// Per-command input of cull.comp, std430. The bounds are world space, w is unused.
+struct CullInput
+{
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
+    // x is the batch of the command
+    glm::uvec4 batch;
+};
+static_assert(sizeof(CullInput) == 48, "CullInput must match the std430 layout");
+
+// Per batch: x is its first command, y is 1 when the batch has to keep its order
+// (blended instances back to front) and culled commands stay in place with no instances.
+struct CullBatch
+{
+    glm::uvec4 info;
+};
+
+// Max-depth pyramid, laid out like the GPU one. The depth buffer is padded to power-of-two
+// sides with 0, which never raises a max; level 0 is half of that and every level keeps the
+// farthest depth of the 2x2 texels below it, so texel (x, y) of level l covers depth pixels
+// [x << (l + 1), (x + 1) << (l + 1)). Sides stop halving at 1.
+struct HiZPyramid
+{
+    std::vector<std::vector<float>> levels;
+    std::vector<glm::ivec2> sizes;
+};
+
+// What the kernel tests against besides its buffers.
+struct CullParams
+{
+    // current camera
+    Frustum frustum;
+    // camera of the frame the pyramid was built from and its depth buffer size
+    glm::mat4 hizViewProj;
+    glm::ivec2 hizSize = glm::ivec2(0, 0);
+    // 0 until there is a pyramid, then only the frustum is tested
+    int hizLevels = 0;
+};
+
+// GPU culling for the multi-draw path. cull.comp tests every command's bounds against the
+// frustum and last frame's Hi-Z pyramid and writes the survivors into the buffers of a
+// MultiDrawBuffers: batches that may be reordered are compacted to their front with an
+// atomic counter each, ordered batches keep their slots. Every other slot is left zeroed,
+// which GL draws as nothing, so draws still cover the whole batch. hiz.comp builds the
+// pyramid from the scene pass' depth texture after the frame is drawn.
+//
+// cullReference() and buildHiZReference() are the same kernels on the CPU, line by line,
+// so results can be validated without a GPU.
+class GpuCuller
+{
+public:
+    static const unsigned LocalSize = 64;
+    // texture unit the pyramid is read from, past the material slots
+    static const unsigned HiZUnit = 4;
+
+    // compute shaders and immutable textures, GL 4.3
+    static bool supported();
+
+    GpuCuller();
+    ~GpuCuller();
+    GpuCuller(const GpuCuller&) = delete;
+    GpuCuller& operator=(const GpuCuller&) = delete;
+
+    // compiles the kernels and allocates the pyramid for a depth buffer of width x height
+    void init(unsigned width, unsigned height);
+    // sizes of the pyramid levels for a depth buffer of width x height
+    static std::vector<glm::ivec2> pyramidSizes(int width, int height);
+
+    // uploads the inputs and runs cull.comp, out then holds count command slots
+    void cull(const DrawElementsIndirectCommand* commands, const DrawData* draws, const CullInput* inputs, size_t count,
+        const CullBatch* batches, size_t batchCount, const CullParams& params, MultiDrawBuffers& out);
+    // rebuilds the pyramid from the depth of the frame just drawn with viewProj into a
+    // viewport of width x height, at most the size given to init()
+    void buildHiZ(unsigned int depthTexture, const glm::mat4& viewProj, int width, int height);
+    // current frustum against the last pyramid
+    CullParams params(const glm::mat4& viewProj) const;
+
+    static bool isVisibleReference(const CullParams& params, const HiZPyramid* hiz, const CullInput& input);
+    // outCommands and outDraws have count slots and have to be zeroed, like the GPU clears them
+    static void cullReference(const DrawElementsIndirectCommand* commands, const DrawData* draws, const CullInput* inputs, size_t count,
+        const CullBatch* batches, size_t batchCount, const CullParams& params, const HiZPyramid* hiz,
+        DrawElementsIndirectCommand* outCommands, DrawData* outDraws);
+    // depth is width x height, row 0 at the bottom
+    static HiZPyramid buildHiZReference(const std::vector<float>& depth, int width, int height);
+
+private:
+    std::unique_ptr<Shader> m_cull;
+    std::unique_ptr<Shader> m_hiz;
+    unsigned int m_inputs[4] = {};
+    unsigned int m_counters = 0;
+    unsigned int m_pyramid = 0;
+    glm::ivec2 m_depthSize = glm::ivec2(0, 0);
+    std::vector<glm::ivec2> m_sizes;
+    glm::mat4 m_hizViewProj;
+    bool m_hizValid = false;
+};
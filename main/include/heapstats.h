@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "profiler.h"
+
+// Counts calls to the global operator new per thread. The replacement operators are only
+// compiled in with TRACK_HEAP_ALLOCATIONS, which debug builds turn on; otherwise every
+// count stays 0. Aligned new isn't replaced and isn't counted.
+#if defined(_DEBUG) && !defined(TRACK_HEAP_ALLOCATIONS)
+#define TRACK_HEAP_ALLOCATIONS
+#endif
+
+namespace HeapStats {
+
+bool enabled();
+// operator new calls made by the calling thread so far
+uint64_t threadAllocations();
+
+// Allocations made for a piece of work, by the thread that set it and by the jobs that
+// thread schedules while it is set; JobSystem hands it on to their workers.
+struct Scope
+{
+    std::atomic<uint64_t> allocations{ 0 };
+};
+Scope* currentScope();
+// makes scope the calling thread's, returns the one it replaces
+Scope* setScope(Scope* scope);
+
+}
+
+// Wraps the per-frame work of one thread, and of the jobs it runs. After the warm-up a
+// steady-state frame must not allocate from the global heap at all: any frame that does
+// asserts, be it a per-frame std::string, a map node or a buffer growing to a new peak.
+// name doubles as the profiler counter.
+class FrameAllocationCheck
+{
+public:
+    FrameAllocationCheck(const char* name, int warmupFrames = 8);
+
+    void begin();
+    // counts the allocations since begin() into profiler, when tracking is compiled in
+    uint64_t end(Profiler& profiler);
+
+private:
+    const char* m_name;
+    int m_warmup;
+    int m_frames = 0;
+    HeapStats::Scope m_scope;
+    HeapStats::Scope* m_previous = nullptr;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "texture.h"
+
+// Encoders for captured frames. Pixels are 8 bit, channels interleaved (3 or 4), rows top
+// to bottom without padding. Nothing here touches GL, so it all runs on worker threads.
+namespace ImageCodec {
+
+// QOI, the format captures default to: lossless and a single pass, fast enough to keep up
+// with a frame per frame on one worker
+void encodeQOI(const uint8_t* pixels, int width, int height, int channels, std::vector<uint8_t>& out);
+// false if data isn't a QOI image; image.pixels gets the decoded channels
+bool decodeQOI(const uint8_t* data, size_t size, Image& image);
+
+// PNG with stored (uncompressed) deflate blocks, there's no zlib in the tree. Large, but
+// every viewer and stbi read it.
+void encodePNG(const uint8_t* pixels, int width, int height, int channels, std::vector<uint8_t>& out);
+
+// encodes by the extension of path, ".png" or anything else as QOI
+bool writeImage(const std::string& path, const uint8_t* pixels, int width, int height, int channels);
+// reads a QOI file, rows top to bottom. Golden images are QOI so that reading them back
+// doesn't depend on stbi's global flip flag.
+bool readQOI(const std::string& path, Image& image);
+
+// BT.601 studio range YUV 4:2:0, the planes back to back in yuv (width * height luma, then a
+// quarter of that per chroma plane); chroma is the mean of each 2x2 block. width and height
+// are even. top is the first row to convert, a negative stride walks a bottom-up image.
+void rgbaToYUV420(const uint8_t* top, ptrdiff_t stride, int width, int height, uint8_t* yuv);
+// one pixel at a time, what the SSE version has to match exactly
+void rgbaToYUV420Reference(const uint8_t* top, ptrdiff_t stride, int width, int height, uint8_t* yuv);
+
+struct Difference
+{
+    // pixels where any channel differs by more than the tolerance
+    size_t pixels = 0;
+    int maxChannel = 0;
+    bool sizeMismatch = false;
+};
+// compares the channels both images have
+Difference compare(const Image& a, const Image& b, int tolerance);
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One device event as the GLFW callbacks deliver it, stamped with the seconds since input
+// started. code and action are GLFW's key or button and GLFW_PRESS/RELEASE/REPEAT; x and
+// y are the cursor position or the scroll offsets.
+struct InputEvent
+{
+    enum Type : uint8_t { Key, MouseButton, CursorPos, Scroll, End };
+
+    double time = 0.0;
+    Type type = End;
+    int16_t code = 0;
+    int8_t action = 0;
+    float x = 0.0f;
+    float y = 0.0f;
+
+    bool operator==(const InputEvent& o) const
+    {
+        return time == o.time && type == o.type && code == o.code && action == o.action && x == o.x && y == o.y;
+    }
+};
+
+// Recorded input of a session. Recording appends events as they arrive; replay hands them
+// back by time, so stepping time by a fixed amount per frame sees the same events on the
+// same frame on every run, whatever the frame rate was when they were recorded.
+//
+// The file is a header and the events, each a varint of microseconds since the previous one,
+// the type and the type's fields; cursor moves, the bulk of a log, take about 11 bytes.
+// An End event carries the length of the session.
+class InputLog
+{
+public:
+    void clear();
+    void record(const InputEvent& event) { m_events.push_back(event); }
+    // appends End at time, so a replay runs as long as the session did
+    void finish(double time);
+
+    void encode(std::vector<uint8_t>& out) const;
+    // false if data isn't an input log; times come back rounded to microseconds
+    bool decode(const uint8_t* data, size_t size);
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+
+    // replay: appends the events up to and including time, in order
+    void replay(double time, std::vector<InputEvent>& out);
+    // replay reached the End event
+    bool finished() const { return m_next >= m_events.size(); }
+    void rewind() { m_next = 0; }
+
+    const std::vector<InputEvent>& events() const { return m_events; }
+    double duration() const { return m_events.empty() ? 0.0 : m_events.back().time; }
+
+private:
+    std::vector<InputEvent> m_events;
+    size_t m_next = 0;
+};
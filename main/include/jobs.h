@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "parallel.h"
+
+class JobSystem;
+struct Job;
+
+// Number of unfinished jobs tied to it. A job can be scheduled to run once a counter
+// drains (runAfter), and wait() helps running other jobs until it does.
+class JobCounter
+{
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    int pending() const { return m_pending.load(std::memory_order_acquire); }
+
+private:
+    friend class JobSystem;
+    std::atomic<int> m_pending{ 0 };
+    std::mutex m_lock;
+    std::vector<Job*> m_continuations;
+};
+
+// Work-stealing scheduler. Every worker and the main thread own a Chase-Lev deque: they
+// push and pop at the bottom, idle threads steal from the top of the others. Threads that
+// aren't part of the system submit through a shared queue. Long-running work, file I/O and
+// encodes, goes to a background queue only workers take from, and only when they find
+// nothing else: wait() and parallelFor() help with frame jobs alone, so a frame never ends
+// up running someone's PNG encode.
+class JobSystem
+{
+public:
+    // workers == 0 uses one per hardware thread besides the main thread, at least one
+    explicit JobSystem(unsigned workers = 0);
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // counter, if given, is incremented now and decremented when fn has returned
+    void run(std::function<void()> fn, JobCounter* counter = nullptr);
+    // like run(), but fn is only scheduled once dependency has drained
+    void runAfter(JobCounter& dependency, std::function<void()> fn, JobCounter* counter = nullptr);
+    // like run(), for jobs that take long; at most half the workers, and at least one, run
+    // them at once
+    void runBackground(std::function<void()> fn, JobCounter* counter = nullptr);
+
+    // runs other jobs, never background ones, until counter drains; the counter may be
+    // destroyed afterwards
+    void wait(JobCounter& counter);
+
+    // splits [0, count) into chunks of at least grain (0 picks one) and waits for all of them;
+    // at most 64 chunks, which live on the stack, so a call doesn't touch the heap
+    void parallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& fn, size_t grain = 0);
+    // parallelFor() in the form systems like the occlusion culler take
+    ParallelFor asParallelFor();
+
+    unsigned workerCount() const { return unsigned(m_workers.size()); }
+
+private:
+    class Deque;
+
+    void schedule(Job* job);
+    Job* findJob();
+    // a background job if fewer than m_backgroundLimit are running, counted as running
+    Job* findBackgroundJob();
+    void execute(Job* job);
+    void finish(JobCounter* counter);
+    void workerLoop(unsigned index);
+
+    // index 0 is the main thread, workers are 1..n
+    std::vector<std::unique_ptr<Deque>> m_deques;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_sharedLock;
+    std::deque<Job*> m_shared;
+    std::mutex m_backgroundLock;
+    std::deque<Job*> m_background;
+    int m_backgroundLimit = 1;
+    std::atomic<int> m_backgroundQueued{ 0 };
+    std::atomic<int> m_backgroundRunning{ 0 };
+
+    std::atomic<int> m_queued{ 0 };
+    std::atomic<int> m_sleeping{ 0 };
+    std::atomic<bool> m_quit{ false };
+    std::mutex m_sleepLock;
+    std::condition_variable m_wake;
+};
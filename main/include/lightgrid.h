@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "parallel.h"
+
+// Point light with a finite range; it contributes nothing beyond radius.
+struct PointLight
+{
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+    float intensity;
+};
+
+// Clustered forward light culling. The view frustum is split into GridX x GridY tiles
+// and GridZ exponential depth slices; every frame each light is binned into the clusters
+// its sphere touches, so a fragment only loops over the lights of its own cluster.
+// Slices are binned in parallel, 16 clusters of a row at a time with SIMD.
+class LightGrid
+{
+public:
+    static const int GridX = 16;
+    static const int GridY = 9;
+    static const int GridZ = 24;
+    static const int ClusterCount = GridX * GridY * GridZ;
+
+    LightGrid();
+
+    void setParallelFor(ParallelFor parallelFor) { m_parallelFor = parallelFor; }
+
+    // cluster bounds only change with the projection, they are rebuilt here
+    void setProjection(float fovY, float aspect, float zNear, float zFar);
+    void build(const std::vector<PointLight>& lights, const glm::mat4& view);
+
+    // per cluster (x + y * GridX + z * GridX * GridY): offset into indices() and light count
+    const std::vector<glm::uvec2>& clusters() const { return m_clusters; }
+    const std::vector<uint32_t>& indices() const { return m_indices; }
+    uint32_t maxLightsPerCluster() const { return m_maxLights; }
+
+    // depth slice of a positive view distance, may be outside [0, GridZ)
+    int slice(float depth) const;
+    float zNear() const { return m_near; }
+    float zFar() const { return m_far; }
+
+private:
+    void binSlice(int z);
+
+    float m_fovY = 0.0f;
+    float m_aspect = 0.0f;
+    float m_near = 0.0f;
+    float m_far = 0.0f;
+    float m_sliceScale = 0.0f;
+
+    // view space cluster bounds, SoA, rows of GridX contiguous clusters
+    std::vector<float> m_minX, m_minY, m_minZ;
+    std::vector<float> m_maxX, m_maxY, m_maxZ;
+
+    // view space center and radius of every light, and its slice range
+    std::vector<glm::vec4> m_viewLights;
+    std::vector<glm::ivec2> m_lightSlices;
+
+    std::vector<std::vector<uint32_t>> m_lists;
+    std::vector<glm::uvec2> m_clusters;
+    std::vector<uint32_t> m_indices;
+    uint32_t m_maxLights = 0;
+
+    ParallelFor m_parallelFor;
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "texturestream.h"
+
+class Shader;
+
+// Texture slots of a material. A slot's texture array is bound to the unit of the same
+// number, so a program samples e.g. "normalMaps" from unit SlotNormal.
+enum MaterialSlot : uint32_t
+{
+    SlotDiffuse,
+    SlotSpecular,
+    SlotNormal,
+    SlotHeight,
+    SlotCount
+};
+
+// shader feature mask, one bit per slot that has a map plus the flags below
+enum MaterialFeature : uint32_t
+{
+    FeatureDiffuseMap = 1 << SlotDiffuse,
+    FeatureSpecularMap = 1 << SlotSpecular,
+    FeatureNormalMap = 1 << SlotNormal,
+    FeatureHeightMap = 1 << SlotHeight,
+    // opacity below 1 or a diffuse map with alpha
+    FeatureTransparent = 1 << 4,
+};
+
+// What a material is made of, as read from an aiMaterial / MTL. Materials with equal
+// descriptions are the same material, no matter which mesh or model they come from.
+struct MaterialDesc
+{
+    glm::vec4 diffuse = glm::vec4(1.0f);    // rgb, opacity in a
+    glm::vec4 specular = glm::vec4(0.0f);   // rgb, shininess in a
+    glm::vec4 emissive = glm::vec4(0.0f);
+    // texture file of every slot, empty if the slot has no map
+    std::string textures[SlotCount];
+
+    uint64_t hash() const;
+    bool operator==(const MaterialDesc& other) const;
+};
+
+// One element of the "Materials" uniform block, std140 layout. Has to match the
+// Material struct in the shaders.
+struct MaterialParams
+{
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    glm::vec4 emissive;
+    // array layer of every slot's map, -1 without one
+    glm::ivec4 layers;
+    // x is the MaterialFeature mask
+    glm::uvec4 features;
+};
+static_assert(sizeof(MaterialParams) == 80, "MaterialParams must match the std140 layout");
+
+// Deduplicated materials of every model the owner loads. Textures are decoded on the job
+// system and packed into GL_TEXTURE_2D_ARRAYs, one per size and channel count, so
+// materials whose maps have matching dimensions bind the same arrays and only differ in
+// their layers, which the shader reads from the material uniform block. Consecutive
+// draws of such materials need no texture binds at all. With streaming enabled the
+// arrays start at their smallest mips and a TextureStreamer refines them as far as the
+// sizes request() reports and its budget allow.
+class MaterialLibrary
+{
+public:
+    // uniform block binding point of "Materials" and the elements it holds
+    static const unsigned UniformBinding = 0;
+    static const unsigned MaxMaterials = 128;
+    // GL 3.3 guarantees 256 array layers, larger groups are split
+    static const unsigned MaxLayers = 256;
+
+    MaterialLibrary() = default;
+    ~MaterialLibrary();
+    MaterialLibrary(const MaterialLibrary&) = delete;
+    MaterialLibrary& operator=(const MaterialLibrary&) = delete;
+
+    // index of the material desc describes, added when there's no equal one yet. Texture
+    // names are resolved with RSLib, so call it on the loading thread; the pixels are
+    // only read by the next upload().
+    uint32_t add(const MaterialDesc& desc);
+
+    // arrays uploaded from now on are streamed; call before the first upload()
+    void enableStreaming(const TextureStreamer::Settings& settings);
+    // null unless streaming is enabled
+    TextureStreamer* streamer() { return m_streamer.get(); }
+    // the material covers pixels on screen this frame, its maps are streamed in to match.
+    // GL thread only, before the flush() of the frame.
+    void request(uint32_t index, float pixels);
+
+    // decodes the textures added since the last upload and packs them into arrays. Arrays
+    // are never resized, textures added later go to new ones. GL thread only.
+    void upload();
+    // once per frame before drawing: anything still pending is uploaded, streamed mips are
+    // updated and the uniform buffer is rewritten if parameters changed. GL thread only.
+    void flush();
+
+    // binds the material's arrays to their slot units, skipping units that already hold them
+    void bind(uint32_t index) { bindArrays(m_slotArrays[index]); }
+    // the same for a set of arrays several materials draw with, 0 leaves a unit alone
+    void bindArrays(const std::array<unsigned int, SlotCount>& arrays);
+    // array of every slot of a material, 0 where it has no map
+    const std::array<unsigned int, SlotCount>& arrays(uint32_t index) const { return m_slotArrays[index]; }
+    // sets the "Materials" block binding and the slot sampler units of a program
+    void setupProgram(Shader& shader);
+
+    size_t size() const { return m_params.size(); }
+    const MaterialDesc& desc(uint32_t index) const { return m_descs[index]; }
+    const MaterialParams& params(uint32_t index) const { return m_params[index]; }
+    // for changing parameters at runtime, the next flush() uploads them
+    MaterialParams& editParams(uint32_t index);
+
+    size_t textureCount() const { return m_textures.size(); }
+    size_t arrayCount() const { return m_arrays.size(); }
+    // add() calls so far, against size() that's how well deduplication works
+    size_t requests() const { return m_requests; }
+    // bind() calls that issued GL calls and ones that found everything bound
+    uint64_t bindsIssued() const { return m_bindsIssued; }
+    uint64_t bindsSkipped() const { return m_bindsSkipped; }
+
+private:
+    struct TextureRecord {
+        std::string path;
+        unsigned int array = 0;
+        int layer = -1;
+        int channels = 0;
+    };
+
+    uint32_t addTexture(const std::string& path);
+    // fills the array, layer and feature fields of a material once its textures are uploaded
+    void resolve(uint32_t index);
+
+    std::vector<MaterialDesc> m_descs;
+    std::vector<MaterialParams> m_params;
+    // texture record of every material slot, NoTexture if unused
+    static const uint32_t NoTexture = ~0u;
+    std::vector<std::array<uint32_t, SlotCount>> m_slots;
+    // array of every material slot, what bind() puts on the units
+    std::vector<std::array<unsigned int, SlotCount>> m_slotArrays;
+    std::unordered_multimap<uint64_t, uint32_t> m_byHash;
+
+    std::vector<TextureRecord> m_textures;
+    std::unordered_map<std::string, uint32_t> m_textureByPath;
+    std::vector<uint32_t> m_pending;
+    std::vector<unsigned int> m_arrays;
+    // reset first by the destructor, its loads finish before the arrays are deleted
+    std::unique_ptr<TextureStreamer> m_streamer;
+
+    unsigned int m_uniforms = 0;
+    bool m_dirty = true;
+    std::array<unsigned int, SlotCount> m_bound = {};
+    size_t m_requests = 0;
+    uint64_t m_bindsIssued = 0;
+    uint64_t m_bindsSkipped = 0;
+};
@@ -5,46 +5,61 @@
 #include <memory>
 #include <glm/glm.hpp>
 #include <shader.h>
+#include "geometry.h"
+#include "simplify.h"
 
-struct Vertex{
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 TexCoords;
-    glm::vec3 Tangent;
-    glm::vec3 Bitangent;
-};
-
-struct Texture_t
-{
-    unsigned int id;
-    std::string type;
-    std::string name;
-};
+class CommandList;
 
 class Mesh
 {
 public:
-    Mesh(std::vector<Vertex> vertices, std::vector<uint32_t> indices, std::vector<Texture_t> textures)
+    Mesh(std::vector<Vertex>&& vertices, std::vector<uint32_t>&& indices, uint32_t material, std::shared_ptr<GeometryArena> arena,
+        const AABB& bounds, bool keep_cpu_geometry = false, LodChain&& lods = LodChain())
+        : vertices(std::move(vertices)), indices(std::move(indices)), m_arena(std::move(arena)), m_material(material),
+          m_bounds(bounds), m_keepCpuGeometry(keep_cpu_geometry)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
-
-        setupMesh();
+        setupMesh(lods);
     }
 
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    Mesh(Mesh&&) noexcept = default;
+    Mesh& operator=(Mesh&&) noexcept = default;
+
     ~Mesh();
 
+    // only populated after setupMesh() when keep_cpu_geometry is set (picking, collision)
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
-    std::vector<Texture_t> textures;
 
-    void Draw(std::shared_ptr<Shader> shader);
+    // index in the MaterialLibrary the owning model loaded it into
+    uint32_t material() { return m_material; }
+
+    // expects the owning arena and the mesh's material to be bound
+    void Draw(unsigned lod = 0);
+    // the same draw, recorded
+    void draw(CommandList& commands, unsigned lod = 0);
+    const GeometryRange& range(unsigned lod = 0) { return m_lods[lod].range; }
+
+    // lod 0 is the full mesh, each following level has roughly half the triangles
+    unsigned lodCount() { return unsigned(m_lods.size()); }
+    // geometric error of a level in model units
+    float lodError(unsigned lod) { return m_lods[lod].error; }
+    glm::vec3 center() { return m_bounds.center(); }
+    float radius() { return glm::length(m_bounds.extent()); }
+    const AABB& bounds() { return m_bounds; }
+
 private:
-    unsigned int VAO;
-    unsigned int VBO;
-    unsigned int EBO;
+    struct Lod {
+        GeometryRange range;
+        float error;
+    };
 
-    void setupMesh();
-};
+    std::shared_ptr<GeometryArena> m_arena;
+    std::vector<Lod> m_lods;
+    uint32_t m_material;
+    AABB m_bounds;
+    bool m_keepCpuGeometry;
 
+    void setupMesh(const LodChain& lods);
+};
@@ -6,13 +6,49 @@
 
 #include <unordered_map>
 #include "mesh.h"
+#include "material.h"
+#include "culling.h"
 class Shader;
+class CommandList;
 
 class Model
 {
 public:
-    Model(std::string model_name, std::string path);
-    void draw(glm::mat4 model  = glm::mat4(1.0), glm::mat4 view = glm::mat4(1.0), glm::mat4 proj = glm::mat4(1.0)) ;
+    // models drawn together share one material library and one geometry arena, so their
+    // meshes can share texture arrays and go into the same multi-draw; the owner uploads both
+    Model(std::string model_name, std::string path, std::shared_ptr<MaterialLibrary> materials, std::shared_ptr<GeometryArena> geometry);
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+    // records one draw call per visible mesh, returns how many; makes no GL calls, so
+    // models can be recorded on any thread
+    size_t draw(CommandList& commands, const glm::mat4& model = glm::mat4(1.0), const glm::mat4& view = glm::mat4(1.0), const glm::mat4& proj = glm::mat4(1.0));
+
+    // calls fn(mesh, lod) for every mesh draw() would draw, with the same culling and LOD
+    // selection; only reads the model, so the indirect path runs it on the main thread.
+    // With cull false every mesh is passed on, for culling on the GPU.
+    template <class Fn>
+    void forEachVisibleMesh(const glm::mat4& model, const glm::mat4& view, const glm::mat4& proj, Fn&& fn, bool cull = true)
+    {
+        glm::mat4 modelView = view * model;
+        // frustum in model space, so mesh bounds can be tested as they are
+        Frustum frustum = extractFrustum(proj * modelView);
+        bool cullMeshes = cull && m_meshes.size() > 1;
+        for (auto& mesh : m_meshes) {
+            if (cullMeshes && !isVisible(frustum, mesh.bounds())) {
+                continue;
+            }
+            fn(mesh, selectLod(mesh, modelView, proj));
+        }
+    }
+    size_t meshCount() { return m_meshes.size(); }
+    // pixels the bounding sphere of a mesh spans on screen seen from its near side, the
+    // largest float when the camera is inside it; texture streaming sizes maps by it
+    float projectedSize(Mesh& mesh, const glm::mat4& modelView, const glm::mat4& proj);
+
+    // shaders of the multi-draw path, no vertex shader if the model's program has no
+    // indirect variant
+    const std::string& indirectVertexShader() { return m_indirectVertexShader; }
+    const std::string& fragmentShader() { return m_fragmentShader; }
 
     std::string name()
     {
@@ -24,24 +60,57 @@ public:
         m_shader->use();
         m_shader->setInt("screenTexture", 0);
     }
+    // part of the framebuffer texture a framebuffer model shows, for a scene drawn into
+    // a viewport smaller than the texture
+    void setScreenRegion(CommandList& commands, const glm::vec2& scale);
     bool enable();
     bool check(std::string attrib);
+
+    // union of all mesh bounds, in model space
+    const AABB& bounds() { return m_bounds; }
+
+    // height in pixels of the target the model is drawn into, used for LOD selection
+    void setViewportHeight(float height) { m_viewportHeight = height; }
+
+    // models flagged "occluder" keep their triangles for the CPU depth rasterizer
+    bool isOccluder() { return !m_occluderIndices.empty(); }
+    const std::vector<glm::vec3>& occluderPositions() { return m_occluderPositions; }
+    const std::vector<uint32_t>& occluderIndices() { return m_occluderIndices; }
 private:
     std::string m_objname;
     std::string m_path;
     std::unordered_map<std::string, bool> m_settings;
 
     std::shared_ptr<Shader> m_shader;
-    std::vector<Texture_t> m_textures;
+    std::string m_fragmentShader;
+    std::string m_indirectVertexShader;
     std::vector<Mesh> m_meshes;
+    std::shared_ptr<MaterialLibrary> m_materials;
+    // "materialIndex" of the program, -1 for programs that don't read materials
+    int m_materialLocation = -1;
+    std::shared_ptr<GeometryArena> m_geometry;
+    AABB m_bounds;
+    unsigned m_lodLevels = 1;
+    float m_lodPixelError = 1.0f;
+    float m_viewportHeight = 800.0f;
+    std::vector<glm::vec3> m_occluderPositions;
+    std::vector<uint32_t> m_occluderIndices;
     std::string directory;
     /*  Functions   */
     void load(std::string model_name);
     void loadShader(std::string path);
     void loadModel(std::string path);
-    void processNode(aiNode* node, const aiScene* scene);
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene);
-    std::vector<Texture_t> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName);
+    unsigned selectLod(Mesh& mesh, const glm::mat4& modelView, const glm::mat4& proj);
+    // CPU side of a mesh, built off the main thread
+    struct MeshData {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        AABB bounds;
+        LodChain lods;
+    };
+    void processNode(aiNode* node, const aiScene* scene, std::vector<aiMesh*>& meshes);
+    MeshData readMesh(aiMesh* mesh);
+    MaterialDesc readMaterial(aiMaterial* material);
 
 };
 
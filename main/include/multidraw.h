@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// layout fixed by GL for glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    uint32_t count;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    uint32_t baseInstance;
+};
+
+// Per-draw data of the indirect path, read by model_indirect.vert at drawBase + gl_DrawID.
+// std430 layout, has to match DrawData there.
+struct DrawData
+{
+    glm::mat4 model;
+    // x is the material index
+    glm::uvec4 material;
+};
+static_assert(sizeof(DrawData) == 80, "DrawData must match the std430 layout");
+
+class CommandList;
+
+// GL buffers of the multi-draw indirect path: the frame's commands in the draw indirect
+// buffer and their DrawData in a shader storage buffer at DrawDataBinding. Both are
+// rewritten once per frame and every pass issues its draws from them.
+class MultiDrawBuffers
+{
+public:
+    static const unsigned DrawDataBinding = 1;
+
+    // GL 4.3 for multi-draw indirect and storage buffers, plus gl_DrawID from
+    // ARB_shader_draw_parameters. Without them Model::draw does one call per mesh.
+    static bool supported();
+
+    MultiDrawBuffers() = default;
+    ~MultiDrawBuffers();
+    MultiDrawBuffers(const MultiDrawBuffers&) = delete;
+    MultiDrawBuffers& operator=(const MultiDrawBuffers&) = delete;
+
+    // replaces the contents; the old storage is orphaned so the GPU can finish with it
+    void upload(const DrawElementsIndirectCommand* commands, const DrawData* draws, size_t count);
+    // orphans both buffers for count commands without filling them, for GpuCuller to write
+    void reserve(size_t count);
+    // records commands [first, first + count) as one call; the bound program has to read
+    // its DrawData at first + gl_DrawID. The buffers must exist, see reserve().
+    void draw(CommandList& list, uint32_t indexType, size_t first, size_t count) const;
+
+    unsigned int commandBuffer() const { return m_commands; }
+    unsigned int drawBuffer() const { return m_draws; }
+
+private:
+    unsigned int m_commands = 0;
+    unsigned int m_draws = 0;
+};
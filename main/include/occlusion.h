@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "geometry.h"
+#include "parallel.h"
+
+// Software occlusion culling. Designated occluder meshes are rasterized on the CPU into
+// a small depth buffer (tile binned, SIMD spans, tiles spread over worker threads),
+// a max-depth hierarchy is built on top and instance bounds are tested against it
+// before any draw is submitted. Nothing here touches GL.
+class OcclusionCuller
+{
+public:
+    static const int TileSize = 32;
+
+    // width is rounded up to a multiple of TileSize
+    OcclusionCuller(int width = 256, int height = 160);
+
+    void setParallelFor(ParallelFor parallelFor) { m_parallelFor = parallelFor; }
+
+    void begin(const glm::mat4& viewProj);
+    void addOccluder(const glm::mat4& model, const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices);
+    // bins and rasterizes every occluder added since begin(), then builds the hierarchy
+    void rasterize();
+    // same result as rasterize(), one triangle at a time with scalar code; reference for tests
+    void rasterizeReference();
+
+    // false only if the box is certainly hidden behind the occluders
+    bool isVisible(const AABB& worldBox) const;
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    size_t triangleCount() const { return m_tris.size(); }
+    // depth in [0, 1], row 0 is the bottom of the screen
+    const std::vector<float>& depth() const { return m_depth; }
+    // the depth buffer at 16 bits, near is white, top row first; depth bunches up near 1,
+    // 8 bits would leave a handful of grey levels
+    std::vector<uint16_t> depthImage() const;
+    // writes depthImage() as a binary 16-bit PGM
+    bool writeDepthImage(const std::string& path) const;
+
+private:
+    struct Triangle {
+        float x[3], y[3], z[3];
+    };
+
+    void addTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+    void addClipped(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+    void rasterizeTile(int tile);
+    void buildHierarchy();
+
+    int m_width;
+    int m_height;
+    int m_tilesX;
+    int m_tilesY;
+
+    glm::mat4 m_viewProj;
+    std::vector<Triangle> m_tris;
+    // clip-space positions of the occluder being added, keeps its capacity between frames
+    std::vector<glm::vec4> m_clip;
+    std::vector<std::vector<uint32_t>> m_bins;
+    std::vector<float> m_depth;
+    // m_levels[0] is a copy of m_depth, every next level keeps the max of 2x2 texels
+    std::vector<std::vector<float>> m_levels;
+    std::vector<glm::ivec2> m_levelSize;
+
+    ParallelFor m_parallelFor;
+};
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <functional>
+#include <cstddef>
+
+// Runs fn over [0, count) in chunks, possibly on several threads. Systems that can split
+// their work take one of these so the engine decides how it gets scheduled.
+using ParallelFor = std::function<void(size_t count, const std::function<void(size_t begin, size_t end)>& fn)>;
+
+// One chunk per hardware thread on short-lived std::threads.
+void threadedFor(size_t count, const std::function<void(size_t begin, size_t end)>& fn);
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <map>
+#include <functional>
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+// Distribution of millisecond timings in logarithmic buckets, 16 per octave from 0.01 ms,
+// so every bucket is within 4.4% of its neighbours from a microsecond-scale query up to a
+// multi-second hitch. Percentiles and lows come from the buckets, the mean and the maximum
+// are exact.
+class Histogram {
+public:
+    static const int BucketsPerOctave = 16;
+    static const int Buckets = 20 * BucketsPerOctave;
+    static constexpr double MinMs = 0.01;
+
+    void add(double ms);
+    void clear();
+
+    uint64_t count() const { return m_count; }
+    double mean() const { return m_count ? m_sum / m_count : 0.0; }
+    double max() const { return m_max; }
+    // value below which a fraction p of the samples are
+    double percentile(double p) const;
+    // mean of the slowest fraction of the samples; the 1% low of frame times is lowMean(0.01)
+    double lowMean(double fraction) const;
+
+    // bounds of bucket i, for dumps
+    static double bucketLow(int i);
+    uint64_t bucket(int i) const { return m_buckets[i]; }
+
+private:
+    uint64_t m_buckets[Buckets] = {};
+    uint64_t m_count = 0;
+    double m_sum = 0.0;
+    double m_max = 0.0;
+};
+
+// Named per-frame counters. Totals are averaged over the frames of each report
+// interval and written to the log, together with the frame rate. Not thread safe,
+// every thread that counts frames keeps its own.
+//
+// Timings that matter by their distribution, not their average, are sampled into
+// histograms instead: one for the report interval and one for the session. The time
+// between endFrame() calls is sampled as "frame_ms".
+class Profiler {
+public:
+    struct Summary {
+        uint64_t count = 0;
+        double mean = 0.0;
+        double p50 = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+        // mean of the slowest 1% and 0.1%
+        double low1 = 0.0;
+        double low01 = 0.0;
+    };
+
+    Profiler(const std::string& name = "Profiler", double interval = 1.0);
+
+    void beginFrame();
+    void endFrame();
+
+    // no allocation once a name has been counted before
+    void count(const char* name, int64_t value);
+    // average per frame over the last report interval
+    double average(const char* name);
+    int fps() { return m_fps; }
+
+    // no allocation once a name has been sampled before
+    void sample(const char* name, double ms);
+    // of the last report interval, zeros for a name never sampled
+    const Summary& summary(const char* name) const;
+    // reports so far, it changes when the summaries do
+    uint64_t reports() const { return m_reports; }
+
+    // counters averaged and histograms of the whole session, as a JSON object
+    std::string json() const;
+
+private:
+    struct Counter {
+        int64_t total = 0;
+        double average = 0.0;
+        int64_t sessionTotal = 0;
+    };
+
+    struct Series {
+        Histogram interval;
+        Histogram session;
+        Summary last;
+    };
+
+    static Summary summarize(const Histogram& h);
+    void report();
+
+    std::string m_name;
+    // transparent compare, lookups by C string don't build a std::string
+    std::map<std::string, Counter, std::less<>> m_counters;
+    std::map<std::string, Series, std::less<>> m_series;
+    std::chrono::steady_clock::time_point m_intervalStart;
+    std::chrono::steady_clock::time_point m_lastFrame;
+    double m_interval;
+    int64_t m_frames;
+    int64_t m_sessionFrames = 0;
+    uint64_t m_reports = 0;
+    int m_fps;
+};
@@ -3,14 +3,41 @@
 #include<fstream>
 #include <string>
 #include <vector>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include "glad/glad.h"
 #define GLFW_DLL
 #include "glfw/glfw3.h"
 
+#include "bvh.h"
+#include "occlusion.h"
+#include "scene.h"
+#include "profiler.h"
+#include "triplebuffer.h"
+#include "framearena.h"
+#include "heapstats.h"
+#include "material.h"
+#include "multidraw.h"
+#include "gpucull.h"
+#include "resolution.h"
+#include "capture.h"
+#include "inputlog.h"
+#include "framepacing.h"
+#include "textoverlay.h"
+#include "commandlist.h"
+#include "gltrace.h"
+
 class Shader;
 class Model;
 class Camera;
+class GLBackend;
 class Render {
 public:
     Render();
@@ -21,6 +48,7 @@ public:
     void mouse_click_callback(GLFWwindow* window, int button, int action, int mode);
     void mouse_move_callback(GLFWwindow* window, double xpos, double ypos);
     void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+    void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 
     void processInput(GLFWwindow* window);
 
@@ -33,10 +61,141 @@ public:
     int clear_exit(std::string message);
 
 protected:
+    // serial: one thread polls, simulates, draws and swaps.
+    // threaded: the main thread polls and simulates, a render thread owns the GL context and
+    //   draws; the main thread builds the next packet while the previous one is drawn.
+    // mailbox: like threaded, but the main thread never waits and the render thread draws
+    //   the newest packet, older ones are dropped. Lowest latency, keeps a core busy.
+    enum class Pipeline { Serial, Threaded, Mailbox };
+
+    struct DrawItem {
+        Model* model;
+        glm::mat4 transform;
+        bool sorted;
+        // position of model in m_model
+        uint32_t modelIndex;
+    };
+
+    // One glMultiDrawElementsIndirect over consecutive commands that share a program, an
+    // index type and texture arrays, or a single instance drawn by Model::draw when its
+    // program has no indirect variant.
+    struct DrawBatch {
+        Shader* program;
+        const DrawItem* direct;
+        uint32_t indexType;
+        uint32_t first;
+        uint32_t count;
+        // framebuffer models in m_model before the batch's model; the second pass draws
+        // the screen quads in between
+        uint32_t segment;
+        std::array<unsigned int, SlotCount> arrays;
+        // has back to front instances, GPU culling must not reorder its commands
+        bool ordered;
+    };
+
+    // everything the render thread reads for one frame, immutable once published
+    struct FramePacket {
+        uint64_t frame = 0;
+        // when the input this frame reflects was sampled
+        std::chrono::steady_clock::time_point inputTime;
+        glm::mat4 view;
+        glm::mat4 projection;
+        unsigned width = 0;
+        unsigned height = 0;
+        // read the render target back into m_capture after the scene pass
+        bool capture = false;
+        // glfwGetTime() when the oldest live input applied for this frame arrived, negative
+        // if there was none
+        double inputEvent = -1.0;
+        // main thread time spent on buildPacket
+        double buildMs = 0.0;
+        // draw the stats overlay
+        bool showStats = false;
+        // visible instances in m_model order, listed instances back to front; the array is
+        // in the frame arena of the main thread, valid until that arena comes round again
+        const DrawItem* draws = nullptr;
+        size_t drawCount = 0;
+        // multi-draw path only: a command and its DrawData per visible mesh, and the
+        // batches submitting them, in the same arena
+        const DrawElementsIndirectCommand* commands = nullptr;
+        const DrawData* drawData = nullptr;
+        size_t commandCount = 0;
+        const DrawBatch* batches = nullptr;
+        size_t batchCount = 0;
+        // GPU culling only: world bounds of every command and a CullBatch per batch
+        const CullInput* cullInputs = nullptr;
+        const CullBatch* cullBatches = nullptr;
+        // the scene pass, played in order; lists of m_sceneCommands, valid as long as the
+        // arena the packet's arrays are in
+        const CommandList* sceneCommands = nullptr;
+        size_t sceneListCount = 0;
+        size_t sceneMeshes = 0;
+        // texture streaming only: the most pixels a mesh of every material spans on screen,
+        // 0 for materials nothing visible uses; in the same arena
+        const float* materialPixels = nullptr;
+        size_t materialCount = 0;
+    };
+    // values of m_drawing besides a frame number
+    static const uint64_t NoPacket = ~uint64_t(0);
+    static const uint64_t TakingPacket = ~uint64_t(0) - 1;
+
+    // what the camera shows, the fixed steps interpolate between two of these
+    struct CameraState {
+        glm::vec3 position;
+        glm::vec3 front;
+        float zoom;
+    };
+
+    // the frame's time step: fixed offline and in a replay, from the clock otherwise
+    void stepTime();
+    CameraState cameraState() const;
+    // waits until at most m_renderAhead frames are queued on the GPU, after a swap
+    void limitRenderAhead(Profiler& profiler);
+    // holds the main loop to the target frame rate, if there is one
+    void pace(Profiler& profiler);
+    // ends a frame of the GL trace after a swap, closes the trace after its last one
+    void traceFrame();
+    // live input from the callbacks, stamped, recorded when recording and dropped in a replay
+    void queueInput(InputEvent event);
+    void applyInput(const InputEvent& event);
+
+    void setupInstances();
+    // scene update, culling and draw list for the current camera, main thread only
+    void buildPacket(FramePacket& packet);
+    void buildCommands(FramePacket& packet);
+    // the materialPixels of packet, what texture streaming refines the maps to
+    void measureTextures(FramePacket& packet);
+    // records the scene pass of packet, draw items in parallel when there are many
+    void recordScene(FramePacket& packet);
+    // GL submission of one packet, on whichever thread owns the context; draw calls and
+    // meshes of the scene pass are counted into profiler
+    void submit(const FramePacket& packet, Profiler& profiler);
+    // records batches [begin, end), returns the draw calls, meshes drawn are added to meshes
+    size_t drawBatches(const FramePacket& packet, size_t begin, size_t end, size_t& meshes, CommandList& commands);
+    void renderLoop();
+    // after the swap: latencies and the main thread's timings of packet, into profiler
+    void countLatency(Profiler& profiler, const FramePacket& packet);
+    // the stats overlay over the finished frame, text from profiler's last report
+    void drawStats(const FramePacket& packet, Profiler& profiler);
+    // blocks while the render thread may still read frame's packet
+    void waitUntilDrawn(uint64_t frame);
+
+    // "gl_backend" in the config: "trace" counts calls per entry point into gl.calls and
+    // logs the busiest at exit, "null" sends no call to the driver, to measure the CPU side
+    // of a frame. First so it is uninstalled after every member that may still call GL.
+    std::unique_ptr<GLBackend> m_glBackend;
+    uint64_t m_glCalls = 0;
+    // "gl_trace" in the config records the GL calls of loading and the first frames into
+    // output, for the replay tool to time on other drivers
+    GLTraceRecorder m_glTrace;
+    uint64_t m_glTraceFrames = 0;
+
     int m_fps;
     unsigned m_scr_width = 1280;
     unsigned m_scr_height = 800;
     
+    // allocated size of the render target, "rt" in the config; with dynamic resolution the
+    // scene is drawn into m_rtViewport of it
     unsigned m_rt_width = 2560;
     unsigned m_rt_height = 1600;
 
@@ -50,11 +209,142 @@ protected:
     float m_deltaTime = 0.0f;	// time between current frame and last frame
     float m_lastFrame = 0.0f;
 
+    // The callbacks queue events and processInput() applies them to the camera, so that a
+    // session can be recorded ("--record <file>", input/record) and replayed ("--replay
+    // <file>", input/replay) with time stepped input/timestep per frame: every replay moves
+    // the camera the same way on the same frame. Main thread only.
+    InputLog m_inputLog;
+    bool m_recordInput = false;
+    bool m_replayInput = false;
+    std::string m_inputPath;
+    float m_inputTimestep = 1.0f / 60.0f;
+    // glfwGetTime() at the first frame, and the input time of the current one
+    double m_inputStart = 0.0;
+    double m_inputTime = 0.0;
+    uint64_t m_inputFrames = 0;
+    std::vector<InputEvent> m_inputEvents;
+    std::bitset<GLFW_KEY_LAST + 1> m_keysDown;
+    // FramePacket::inputEvent of the next packet
+    double m_inputEvent = -1.0;
+
+    // "simulation" in the config: input moves the camera in fixed steps of step_hz, and with
+    // interpolate the frame draws it between the last two, at any frame rate
+    FixedStep m_simulation;
+    bool m_interpolate = true;
+    CameraState m_previousCamera;
+    CameraState m_currentCamera;
+
+    // "frame_pacing" in the config: vsync, a target frame rate the main loop is held to, and
+    // render_ahead, the frames the GL thread may queue before waiting for the GPU (0 leaves
+    // it to the driver)
+    FramePacer m_pacer;
+    int m_renderAhead = 0;
+    std::vector<GLsync> m_frameFences;
+    size_t m_frameFence = 0;
+
     GLFWwindow* m_window;
 
     unsigned int m_frameBuffer;
     unsigned int m_textureColorBuffer;
+    unsigned int m_depthTexture = 0;
 
     std::shared_ptr<Camera> m_camera;
     std::vector<std::shared_ptr<Model>> m_model;
+    std::shared_ptr<MaterialLibrary> m_materials;
+    // "texture_streaming" in the config: material maps start at their smallest mips and are
+    // refined to what the packets measure, within budget_mb; totals as of the last frame
+    TextureStreamer::Stats m_streamStats;
+    std::shared_ptr<GeometryArena> m_geometry;
+
+    Scene m_scene;
+    // drawable scene nodes grouped by model in m_model order, indexed by m_bvh
+    std::vector<DrawItem> m_instances;
+    // instance of every scene node, Scene::None if it isn't drawn
+    std::vector<uint32_t> m_nodeInstance;
+    std::vector<AABB> m_instanceBounds;
+    BVH m_bvh;
+    OcclusionCuller m_occlusion;
+    // per-frame visible instances, same grouping
+    std::vector<uint32_t> m_visibleItems;
+    // transient per-frame data and packet draw lists, built on the main thread
+    FrameAllocator m_frameMemory;
+    // GL calls go through command lists: the scene pass is recorded with the packet, one
+    // set of lists per frame arena, the screen pass on the GL thread. m_executor plays
+    // them there and elides what would not change any state; gl.issued and gl.elided count
+    // its commands per frame.
+    std::vector<std::vector<CommandList>> m_sceneCommands;
+    CommandList m_screenCommands;
+    CommandExecutor m_executor;
+
+    // multi-draw indirect, "multi_draw" in the config and GL 4.3 with draw parameters
+    bool m_multiDraw = false;
+    MultiDrawBuffers m_indirect;
+    // indirect program of every model, nullptr for models drawn one mesh at a time;
+    // models with the same fragment shader share one
+    std::vector<Shader*> m_indirectPrograms;
+    std::vector<std::shared_ptr<Shader>> m_indirectShaders;
+    // DrawBatch::segment of every model
+    std::vector<uint32_t> m_modelSegment;
+    // "gpu_culling" in the config, multi-draw and compute shaders: every mesh becomes a
+    // command and cull.comp decides which are drawn, the BVH and software occlusion are skipped
+    bool m_gpuCulling = false;
+    GpuCuller m_culler;
+
+    // "dynamic_resolution" in the config: the scene pass is timed on the GPU and the
+    // controller scales the viewport to keep it in budget. Render thread only.
+    bool m_dynamicResolution = false;
+    ResolutionController m_resolution;
+    GpuTimer m_sceneTimer;
+    glm::ivec2 m_rtViewport;
+
+    // Frame statistics. Timings go into the profilers as histograms: cpu.build_ms and
+    // cpu.submit_ms, gpu.frame_ms around all of submit(), gpu.scene_ms with dynamic
+    // resolution, latency.input_ms from an event reaching the callbacks to the swap of the
+    // first frame showing it. F3 or stats/overlay shows them over the frame, every report;
+    // stats/dump writes both profilers as JSON at exit.
+    GpuTimer m_frameTimer;
+    TextOverlay m_overlay;
+    int m_overlayScale = 2;
+    uint64_t m_overlayReports = ~uint64_t(0);
+    bool m_statsKeyDown = false;
+    std::string m_statsPath;
+
+    // "capture" in the config captures every interval frames, up to a count (0 for no
+    // limit); F12 captures one frame. m_capture is used by the GL thread only.
+    FrameCapture m_capture;
+    bool m_captureEnabled = false;
+    int m_captureInterval = 1;
+    int m_captureCount = 0;
+    int m_captured = 0;
+    bool m_captureKey = false;
+    bool m_captureKeyDown = false;
+
+    // offline rendering, "--offline <file>" or "offline/output" in the config: time advances
+    // 1/fps per frame instead of with the clock, input is ignored and every frame goes into a
+    // Y4M stream without being dropped, so a run is bound by the GPU rather than real time.
+    // With orbit_seconds the camera circles the scene once in that time, a turntable.
+    bool m_offline = false;
+    int m_offlineFps = 30;
+    uint64_t m_offlineFrames = 0;
+    float m_orbitSeconds = 0.0f;
+    glm::vec3 m_orbitCenter = glm::vec3(0.0f);
+
+    Pipeline m_pipeline = Pipeline::Serial;
+    uint64_t m_frame = 0;
+    TripleBuffer<FramePacket> m_packets;
+    std::thread m_renderThread;
+    // m_published and m_quit are guarded by m_packetLock, m_taken is written by the render
+    // thread; both are the frame of a packet plus one, 0 before the first
+    std::mutex m_packetLock;
+    std::condition_variable m_packetReady;
+    uint64_t m_published = 0;
+    bool m_quit = false;
+    std::atomic<uint64_t> m_taken{ 0 };
+    // frame of the packet the render thread is drawing
+    std::atomic<uint64_t> m_drawing{ NoPacket };
+
+    Profiler m_profiler;
+    Profiler m_renderProfiler{ "Render thread" };
+    FrameAllocationCheck m_buildAllocations{ "heap.build" };
+    FrameAllocationCheck m_submitAllocations{ "heap.submit" };
 };
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Picks the render target scale from measured GPU frame times. The target is allocated
+// once at full size and the scene is drawn into a viewport of scale x that, so changing
+// the scale costs nothing but a different glViewport.
+//
+// Pixel cost goes with the area, so a change aims for scale * sqrt(target / time). Going
+// down reacts within a few frames over budget, going up needs a long run of frames with
+// headroom, and after every change the measurements are ignored until the timer queries
+// have caught up with the new size. That keeps the scale from oscillating around the budget.
+class ResolutionController
+{
+public:
+    // consecutive frames over budget before shrinking and under headroom before growing
+    static const int OverFrames = 3;
+    static const int UnderFrames = 30;
+    // frames ignored after a change, timer results lag a few frames behind
+    static const int Cooldown = 4;
+
+    ResolutionController(float budgetMs = 12.0f, float minScale = 0.5f, float maxScale = 1.0f);
+
+    // one frame's GPU time in ms, returns true if the scale changed
+    bool update(float gpuMs);
+
+    float scale() const { return m_scale; }
+    float budget() const { return m_budget; }
+    // smoothed GPU time the decisions are made on
+    float filtered() const { return m_filtered; }
+    // viewport for a target of width x height at the current scale, sides rounded to
+    // multiples of 8 and never more than the target
+    glm::ivec2 viewport(int width, int height) const;
+
+private:
+    float m_budget;
+    float m_minScale;
+    float m_maxScale;
+    float m_scale;
+    float m_filtered = -1.0f;
+    int m_over = 0;
+    int m_under = 0;
+    int m_cooldown = 0;
+};
+
+// Pairs of GL_TIMESTAMP queries in a ring, so results are read a few frames later without
+// waiting on the GPU. Timestamps, unlike GL_TIME_ELAPSED queries, let timers nest: the
+// frame timer runs around the scene timer.
+class GpuTimer
+{
+public:
+    static const int Queries = 4;
+
+    GpuTimer() = default;
+    ~GpuTimer();
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    void begin();
+    void end();
+    // ms of the newest finished query not returned before, negative if there is none
+    float poll();
+
+private:
+    // begin and end of every ring slot
+    unsigned int m_queries[Queries * 2] = {};
+    // queries begun and queries read so far, the ring slot is the count modulo Queries
+    uint64_t m_begun = 0;
+    uint64_t m_read = 0;
+};
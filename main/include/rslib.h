@@ -7,11 +7,18 @@
 #include <unordered_map>
 
 class Config;
+class JobSystem;
 
 class RSLib {
 public:
     struct args {
         std::string config;
+        std::string bench;
+        // Y4M output of an offline render, "-" for stdout
+        std::string offline;
+        // input log to write, or to play back instead of the devices
+        std::string record;
+        std::string replay;
         int n;
         int k;
         int verbose;
@@ -23,12 +30,22 @@ public:
 
     std::shared_ptr<Config> getConfig();
     std::shared_ptr<Config> initConfig(int argc, char** argv);
+    std::string getBenchmark() { return m_arg.bench; }
+    std::string getOfflineOutput() { return m_arg.offline; }
+    std::string getInputRecording() { return m_arg.record; }
+    std::string getInputReplay() { return m_arg.replay; }
+    // owned by the Engine, null when running without one
+    JobSystem* getJobSystem() { return m_jobs; }
+    void setJobSystem(JobSystem* jobs) { m_jobs = jobs; }
     std::string getConfigFileName(const char* fileName);
     std::string getModelFileName(const char* fileName);
     std::string getShaderFileName(const char* fileName);
     std::string getTextureFileName(const char* fileName);
+    // images the benchmarks compare their results with, in data/reference
+    std::string getReferenceFileName(const char* fileName);
     std::string loadFile(std::string filename);
     int execCmd(std::string & cmd);
+    size_t residentMemory();
     void* glslRead(const char* fileName, size_t& size);
     std::vector<uint32_t> glslCompile(const char* fileName, size_t& size, int shader_type);
     std::stringstream glslCompile(const char* fileName, int shader_type);
@@ -57,6 +74,7 @@ private:
     std::shared_ptr<Config> m_config;
     struct args m_arg;
     bool m_enableSPVDump;
+    JobSystem* m_jobs = nullptr;
 };
 
 
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+class Config;
+
+// Flat, data-oriented scene graph. Local transforms are kept as structure-of-arrays,
+// nodes are stored so that a parent always comes before its children, and update()
+// recomputes the world matrices of dirty nodes in one forward pass: local matrices in
+// SIMD batches first, then parent * local down the array.
+class Scene
+{
+public:
+    static const uint32_t None = 0xffffffffu;
+
+    void clear();
+    void reserve(size_t count);
+
+    // parent must already exist; object is an opaque id for the caller (a model index)
+    uint32_t add(uint32_t object, uint32_t parent = None,
+                 const glm::vec3& position = glm::vec3(0.0f),
+                 const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+                 const glm::vec3& scale = glm::vec3(1.0f));
+
+    // reads an array of { "model", "position", "rotation" (euler degrees), "scale", "parent" }
+    // from the config; "parent" is the index of an earlier entry. Returns the number of nodes added.
+    size_t load(Config& config, const std::string& key, const std::unordered_map<std::string, uint32_t>& objects);
+
+    void setPosition(uint32_t node, const glm::vec3& position);
+    void setRotation(uint32_t node, const glm::quat& rotation);
+    void setScale(uint32_t node, const glm::vec3& scale);
+
+    glm::vec3 position(uint32_t node) const { return glm::vec3(m_posX[node], m_posY[node], m_posZ[node]); }
+    glm::quat rotation(uint32_t node) const { return glm::quat(m_rotW[node], m_rotX[node], m_rotY[node], m_rotZ[node]); }
+    glm::vec3 scale(uint32_t node) const { return glm::vec3(m_scaleX[node], m_scaleY[node], m_scaleZ[node]); }
+    uint32_t parent(uint32_t node) const { return m_parent[node]; }
+    uint32_t object(uint32_t node) const { return m_object[node]; }
+
+    // recomputes dirty nodes and their descendants; returns how many world matrices changed
+    size_t update();
+    // same result as update() for every node, one glm compose at a time; reference for tests
+    void updateReference();
+
+    size_t size() const { return m_parent.size(); }
+    const glm::mat4& world(uint32_t node) const { return m_world[node]; }
+    const std::vector<glm::mat4>& worlds() const { return m_world; }
+    // nodes whose world matrix changed in the last update()
+    const std::vector<uint32_t>& updated() const { return m_updated; }
+
+private:
+    void markDirty(uint32_t node);
+    void computeLocal(size_t first);
+
+    std::vector<float> m_posX, m_posY, m_posZ;
+    std::vector<float> m_rotX, m_rotY, m_rotZ, m_rotW;
+    std::vector<float> m_scaleX, m_scaleY, m_scaleZ;
+    std::vector<uint32_t> m_parent;
+    std::vector<uint32_t> m_object;
+    std::vector<uint8_t> m_dirty;
+    bool m_anyDirty = false;
+
+    std::vector<glm::mat4> m_local;
+    std::vector<glm::mat4> m_world;
+    std::vector<uint32_t> m_updated;
+};
@@ -18,21 +18,24 @@ protected:
 public:
     unsigned int ID;
     Shader(const char* vs, const char* fs, const char* tcs = nullptr, const char* tes = nullptr, const char* gs = nullptr);
+    // compute program
+    explicit Shader(const char* cs);
     // activate the shader
     // ------------------------------------------------------------------------
     void use();
-    void setBool(const std::string &name, bool value) const;
-    void setInt(const std::string &name, int value) const;
-    void setFloat(const std::string &name, float value) const;
-    void setVec2(const std::string &name, const glm::vec2 &value) const;
-    void setVec2(const std::string &name, float x, float y) const;
-    void setVec3(const std::string &name, const glm::vec3 &value) const;
-    void setVec3(const std::string &name, float x, float y, float z) const;
-    void setVec4(const std::string &name, const glm::vec4 &value) const;
-    void setVec4(const std::string &name, float x, float y, float z, float w);
-    void setMat2(const std::string &name, const glm::mat2 &mat) const;
-    void setMat3(const std::string &name, const glm::mat3 &mat) const;
-    void setMat4(const std::string &name, const glm::mat4 &mat) const;
+    // names are C strings so literals don't turn into a std::string on every call
+    void setBool(const char* name, bool value) const;
+    void setInt(const char* name, int value) const;
+    void setFloat(const char* name, float value) const;
+    void setVec2(const char* name, const glm::vec2 &value) const;
+    void setVec2(const char* name, float x, float y) const;
+    void setVec3(const char* name, const glm::vec3 &value) const;
+    void setVec3(const char* name, float x, float y, float z) const;
+    void setVec4(const char* name, const glm::vec4 &value) const;
+    void setVec4(const char* name, float x, float y, float z, float w);
+    void setMat2(const char* name, const glm::mat2 &mat) const;
+    void setMat3(const char* name, const glm::mat3 &mat) const;
+    void setMat4(const char* name, const glm::mat4 &mat) const;
 
 private:
     void loadShader();
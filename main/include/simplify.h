@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "geometry.h"
+
+// Quadric error metric edge-collapse simplifier (Garland & Heckbert).
+// Vertices are only collapsed onto other existing vertices, so every LOD keeps using
+// the original vertex buffer and only needs its own index list. Vertices on open
+// borders or on attribute seams (same position, different normal/uv) are locked, and
+// nothing collapses onto a seam.
+// result_error receives the RMS distance of the worst collapse, in model units.
+std::vector<uint32_t> simplifyMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+    size_t target_index_count, float* result_error = nullptr);
+
+// Index lists of lod 1 onwards, each aiming at half the triangles of the level before it.
+// Stops early once the simplifier can't remove a quarter of the previous level. Errors
+// never decrease along the chain.
+struct LodChain
+{
+    std::vector<std::vector<uint32_t>> indices;
+    std::vector<float> errors;
+};
+
+LodChain buildLodChain(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, unsigned levels);
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class Shader;
+
+// Text over the finished frame in a single instanced draw. Every character is an instance
+// of one quad with its cell, character and colour as instance attributes, and the 5x7 font
+// is a uniform array of bitmaps, so there is no texture and no vertex data per character.
+// Characters 32 to 126 print as ASCII, 127 is a full block for bars, anything else as '?'.
+//
+// print() only fills a CPU array reserved up front; draw() uploads it when it changed.
+// GL calls need the context, the text can be written from any one thread.
+class TextOverlay
+{
+public:
+    // screen pixels of a character cell at scale 1, glyph included
+    static const int CellWidth = 6;
+    static const int CellHeight = 9;
+
+    TextOverlay() = default;
+    ~TextOverlay();
+    TextOverlay(const TextOverlay&) = delete;
+    TextOverlay& operator=(const TextOverlay&) = delete;
+
+    // program and instance buffer for up to capacity characters
+    void init(size_t capacity = 4096);
+
+    void clear();
+    // at a character cell counted from the top left, colour is 0xRRGGBBAA; characters past
+    // the capacity are dropped. Returns the columns written.
+    int print(int column, int row, const char* text, uint32_t color = 0xffffffffu);
+    size_t size() const { return m_chars.size(); }
+
+    // over whatever framebuffer is bound, width x height pixels, cells scale times larger
+    void draw(int width, int height, int scale = 1);
+
+    // the bitmap of a character, bit y * 5 + x
+    static uint64_t glyph(char c);
+
+private:
+    struct Char {
+        int16_t column;
+        int16_t row;
+        uint32_t glyph;
+        uint32_t color;
+    };
+    static_assert(sizeof(Char) == 12, "Char is read as instance attributes");
+
+    std::vector<Char> m_chars;
+    size_t m_capacity = 0;
+    bool m_dirty = false;
+    std::unique_ptr<Shader> m_program;
+    unsigned int m_vao = 0;
+    unsigned int m_buffer = 0;
+};
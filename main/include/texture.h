@@ -1,9 +1,19 @@
 #ifndef _TEXTURE_H
 #define _TEXTURE_H
 
+#include <string>
 #include <vector>
 #include <memory>
 
+// pixels of an image file as stbi decoded them, freed with the last reference
+struct Image
+{
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::shared_ptr<unsigned char> pixels;
+};
+
 class Texture {
 private: 
     int activeTextureId = 0;
@@ -16,6 +26,12 @@ public:
 
     int loadTexture(const char* filename);
     int loadCubemap(std::vector<std::string> faces);
+
+    // reads a file by full path, no GL calls so it can run on any thread
+    static Image decode(const std::string& path);
+    // a GL_TEXTURE_2D_ARRAY with one layer per image, which must all have the same
+    // size and channel count
+    static unsigned int createArray(const std::vector<const Image*>& layers);
 protected:
 
 private:
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "jobs.h"
+#include "texture.h"
+
+// Streams the mip levels of GL_TEXTURE_2D_ARRAYs within a memory budget. An array starts
+// with only its tail, the levels no larger than Settings::tailSize, and is refined as
+// request() asks for finer levels: the files are decoded again on the job system, the
+// missing levels are filtered down from them and uploaded on the GL thread, a bounded
+// amount per frame. GL_TEXTURE_BASE_LEVEL points at the finest level resident, so the
+// array keeps its name and needs no rebinding.
+//
+// Resident bytes never exceed the budget: when a load doesn't fit, the finest levels
+// of arrays that weren't requested down to them for the longest time are evicted first,
+// one level at a time from the top, and a load that can't be made to fit is cut short or
+// refused. Levels a request asked for in the current frame are never evicted. Tails count
+// against the budget but are never evicted.
+class TextureStreamer
+{
+public:
+    // decodes a file, Texture::decode by default; called on the job system
+    using Loader = std::function<Image(const std::string& path)>;
+
+    struct Settings {
+        size_t budget = size_t(256) << 20;
+        // bytes uploaded per update(), at least one finished load is always applied
+        size_t uploadPerFrame = size_t(16) << 20;
+        // levels whose larger side is at most this stay resident from creation on
+        int tailSize = 64;
+        // loads decoding at once
+        unsigned maxLoads = 4;
+        Loader loader;
+    };
+
+    struct Stats {
+        size_t resident = 0;
+        // bytes of loads in flight, already counted against the budget
+        size_t reserved = 0;
+        size_t budget = 0;
+        // what every array at the level requested of it in the last update would take
+        size_t wanted = 0;
+        // totals since creation
+        uint64_t loads = 0;
+        uint64_t evictions = 0;
+        // loads that couldn't be made to fit at all, every update they were tried in
+        uint64_t refused = 0;
+        uint64_t uploadedBytes = 0;
+    };
+
+    // one array's residency, levels are numbered from the full size down
+    struct ArrayInfo {
+        int width = 0;
+        int height = 0;
+        int layers = 0;
+        int channels = 0;
+        int levels = 0;
+        // the finest level resident, and the first level of the tail
+        int base = 0;
+        int tail = 0;
+        // the finest level requested in the last update, tail if it wasn't requested
+        int want = 0;
+        // update() the base level was last requested in, 0 if never
+        uint64_t lastUsed = 0;
+        bool loading = false;
+    };
+
+    explicit TextureStreamer(const Settings& settings);
+    // waits for the loads in flight; the arrays belong to whoever took their names
+    ~TextureStreamer();
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // a GL_TEXTURE_2D_ARRAY of the images, which must all have the same size and channel
+    // count, with only its tail uploaded; paths are what the loader reads them from again.
+    // GL thread only.
+    unsigned int create(const std::vector<std::string>& paths, const std::vector<const Image*>& layers);
+
+    // the array covers pixels on screen this frame, so it needs about pixels * texelScale
+    // texels across. Any thread that isn't racing update().
+    void request(unsigned int array, float pixels);
+    // once per frame: applies finished loads, evicts and starts the loads the requests
+    // since the last update need. GL thread only, leaves GL_TEXTURE_2D_ARRAY unbound.
+    void update();
+
+    void setTexelScale(float scale) { m_texelScale = scale; }
+    // the next update() evicts down to it, as far as levels in use allow
+    void setBudget(size_t bytes) { m_settings.budget = m_stats.budget = bytes; }
+    const Stats& stats() const { return m_stats; }
+    size_t arrayCount() const { return m_arrays.size(); }
+    ArrayInfo info(unsigned int array) const;
+    // loads in flight or waiting for their upload
+    size_t pending() const { return m_loading; }
+    uint64_t frame() const { return m_frame; }
+
+    // bytes of a level of an array that size, as the driver stores it; 3 channels take 4
+    static size_t levelBytes(int width, int height, int layers, int channels, int level);
+    // the next level of every layer, 2x2 box filtered; the last row or column of an odd
+    // size is dropped, as the level sizes round down, and a side of 1 stays 1
+    static std::vector<uint8_t> downsample(const uint8_t* pixels, int width, int height, int layers, int channels);
+
+private:
+    struct Array {
+        unsigned int name = 0;
+        // shared with its loads
+        std::shared_ptr<const std::vector<std::string>> paths;
+        int width = 0;
+        int height = 0;
+        int layers = 0;
+        int channels = 0;
+        int levels = 0;
+        int base = 0;
+        int tail = 0;
+        int want = 0;
+        // finest level asked for since the last update
+        int requested = 0;
+        bool loading = false;
+        // the files didn't decode to what the tail was made from, it isn't refined again
+        bool failed = false;
+        // per level, the update() it was last requested in
+        std::vector<uint64_t> lastUsed;
+    };
+
+    // levels [first, last) of an array, all layers of a level in one block; what the job
+    // needs is copied, create() may move the arrays meanwhile. Loads are pooled; their
+    // levels are freed once uploaded, decode() allocates them again on the job system.
+    struct Load {
+        size_t array = 0;
+        int first = 0;
+        int last = 0;
+        size_t bytes = 0;
+        std::shared_ptr<const std::vector<std::string>> paths;
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        bool failed = false;
+        std::vector<std::vector<uint8_t>> levels;
+    };
+
+    size_t bytes(const Array& a, int from, int to) const;
+    // uploads a finished load, returns its bytes
+    size_t apply(Load& load);
+    // starts loading a's levels down to target, or as many as fit
+    void schedule(size_t index, int target);
+    // bytes evict() could free now, besides array except
+    size_t evictable(size_t except) const;
+    // evicts least recently used levels until bytes more fit, false if they can't
+    bool makeRoom(size_t bytes, size_t except);
+    void evict(Array& a);
+    // job side of schedule(), no GL
+    void decode(Load& load) const;
+
+    Settings m_settings;
+    float m_texelScale = 1.0f;
+    std::vector<Array> m_arrays;
+    std::unordered_map<unsigned int, size_t> m_byName;
+    uint64_t m_frame = 1;
+    size_t m_loading = 0;
+    Stats m_stats;
+
+    // finished by the jobs, applied by update()
+    std::mutex m_lock;
+    std::vector<std::unique_ptr<Load>> m_finished;
+    std::vector<std::unique_ptr<Load>> m_ready;
+    // maxLoads of them, made up front; update() allocates nothing itself
+    std::vector<std::unique_ptr<Load>> m_free;
+    std::vector<size_t> m_wanting;
+    JobCounter m_jobs;
+};
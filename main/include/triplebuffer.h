@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single producer, single consumer hand-off of the newest value. The writer
+// fills its back slot and swaps it with the shared one; the reader swaps its front slot
+// with the shared one whenever that holds something newer. Neither side ever waits and
+// no slot is touched by both threads at once. Slots are reused, so a T holding vectors
+// keeps their capacity from frame to frame.
+template <class T>
+class TripleBuffer
+{
+public:
+    // writer side: the slot to fill for the next publish()
+    T& back() { return m_slots[m_back]; }
+    // returns false if the previously published value was never taken and got replaced
+    bool publish()
+    {
+        uint8_t previous = m_shared.exchange(uint8_t(m_back | FreshBit), std::memory_order_acq_rel);
+        m_back = previous & IndexMask;
+        return (previous & FreshBit) == 0;
+    }
+
+    // reader side: moves to the newest published value, false if there is none since the last take
+    bool take()
+    {
+        if ((m_shared.load(std::memory_order_relaxed) & FreshBit) == 0) {
+            return false;
+        }
+        m_front = m_shared.exchange(m_front, std::memory_order_acq_rel) & IndexMask;
+        return true;
+    }
+    const T& front() const { return m_slots[m_front]; }
+
+private:
+    static const uint8_t IndexMask = 0x3;
+    static const uint8_t FreshBit = 0x4;
+
+    T m_slots[3];
+    uint8_t m_back = 0;
+    uint8_t m_front = 1;
+    std::atomic<uint8_t> m_shared{ 2 };
+};
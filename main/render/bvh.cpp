@@ -0,0 +1,430 @@
+#include "bvh.h"
+
+#include <algorithm>
+
+namespace {
+
+// one cullAABBs block
+const uint32_t kMaxLeafSize = 8;
+const uint32_t kBins = 12;
+const uint32_t kInvalid = 0xffffffff;
+// below this depth SAH may split freely, past it median splits keep the tree within kStackSize
+const uint32_t kMaxSahDepth = 96;
+const int kStackSize = 128;
+
+void assign(BVHNode& node, const AABB& box)
+{
+    node.minX = box.min.x; node.minY = box.min.y; node.minZ = box.min.z;
+    node.maxX = box.max.x; node.maxY = box.max.y; node.maxZ = box.max.z;
+}
+
+float surfaceArea(const AABB& b)
+{
+    if (!b.valid()) {
+        return 0.0f;
+    }
+    glm::vec3 d = b.max - b.min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+enum class Overlap { Outside, Intersect, Inside };
+
+Overlap classify(const Frustum& frustum, const BVHNode& n)
+{
+    Overlap result = Overlap::Inside;
+    for (auto& p : frustum.planes) {
+        float nearX = p.x >= 0.0f ? n.minX : n.maxX;
+        float nearY = p.y >= 0.0f ? n.minY : n.maxY;
+        float nearZ = p.z >= 0.0f ? n.minZ : n.maxZ;
+        float farX = p.x >= 0.0f ? n.maxX : n.minX;
+        float farY = p.y >= 0.0f ? n.maxY : n.minY;
+        float farZ = p.z >= 0.0f ? n.maxZ : n.minZ;
+        if (p.x * farX + p.y * farY + p.z * farZ + p.w < 0.0f) {
+            return Overlap::Outside;
+        }
+        if (p.x * nearX + p.y * nearY + p.z * nearZ + p.w < 0.0f) {
+            result = Overlap::Intersect;
+        }
+    }
+    return result;
+}
+
+bool slab(const BVHNode& n, const glm::vec3& origin, const glm::vec3& invDir, float tmax, float& tnear)
+{
+    float t0x = (n.minX - origin.x) * invDir.x, t1x = (n.maxX - origin.x) * invDir.x;
+    float t0y = (n.minY - origin.y) * invDir.y, t1y = (n.maxY - origin.y) * invDir.y;
+    float t0z = (n.minZ - origin.z) * invDir.z, t1z = (n.maxZ - origin.z) * invDir.z;
+    float tmin = std::max(std::max(std::min(t0x, t1x), std::min(t0y, t1y)), std::max(std::min(t0z, t1z), 0.0f));
+    float tfar = std::min(std::min(std::max(t0x, t1x), std::max(t0y, t1y)), std::min(std::max(t0z, t1z), tmax));
+    tnear = tmin;
+    return tmin <= tfar;
+}
+
+}
+
+BVH::BVH()
+{
+    m_needsRebuild = false;
+    m_builtCost = 0.0f;
+}
+
+void BVH::clear()
+{
+    m_nodes.clear();
+    m_parents.clear();
+    m_items.clear();
+    m_itemLeaf.clear();
+    m_bounds.clear();
+    m_leafBounds.clear();
+    m_centers.clear();
+    m_dirty.clear();
+    m_needsRebuild = false;
+    m_builtCost = 0.0f;
+}
+
+AABB BVH::nodeBounds(const BVHNode& node) const
+{
+    AABB b;
+    b.min = glm::vec3(node.minX, node.minY, node.minZ);
+    b.max = glm::vec3(node.maxX, node.maxY, node.maxZ);
+    return b;
+}
+
+void BVH::build(const std::vector<AABB>& bounds)
+{
+    m_bounds = bounds;
+    m_centers.resize(bounds.size());
+    for (size_t i = 0; i < bounds.size(); ++i) {
+        m_centers[i] = bounds[i].center();
+    }
+
+    m_items.resize(bounds.size());
+    for (uint32_t i = 0; i < m_items.size(); ++i) {
+        m_items[i] = i;
+    }
+    m_itemLeaf.assign(bounds.size(), kInvalid);
+
+    m_nodes.clear();
+    m_parents.clear();
+    m_nodes.reserve(bounds.size() * 2);
+    m_parents.reserve(bounds.size() * 2);
+    m_dirty.clear();
+    m_needsRebuild = false;
+
+    if (!bounds.empty()) {
+        m_nodes.emplace_back();
+        m_parents.push_back(kInvalid);
+        buildNodes(uint32_t(bounds.size()));
+    }
+    fillLeafBounds();
+    m_builtCost = sahCost();
+}
+
+void BVH::fillLeafBounds()
+{
+    m_leafBounds.resize(m_items.size() + kMaxLeafSize - 1);
+    for (size_t i = 0; i < m_items.size(); ++i) {
+        m_leafBounds.set(i, m_bounds[m_items[i]]);
+    }
+}
+
+void BVH::buildNodes(uint32_t itemCount)
+{
+    // nodes are created parent first, so children always follow their parent in the array
+    struct Task {
+        uint32_t node, begin, end, depth;
+    };
+    std::vector<Task> stack;
+    stack.push_back({ 0, 0, itemCount, 0 });
+
+    while (!stack.empty()) {
+        Task task = stack.back();
+        stack.pop_back();
+
+        AABB box, centroids;
+        for (uint32_t i = task.begin; i < task.end; ++i) {
+            box.extend(m_bounds[m_items[i]]);
+            centroids.extend(m_centers[m_items[i]]);
+        }
+        assign(m_nodes[task.node], box);
+
+        uint32_t count = task.end - task.begin;
+        uint32_t split = task.end;
+
+        if (count > kMaxLeafSize) {
+            // binned SAH over the largest centroid axis
+            glm::vec3 extent = centroids.max - centroids.min;
+            int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+            float lo = centroids.min[axis];
+            float width = extent[axis];
+
+            if (width > 0.0f && task.depth < kMaxSahDepth) {
+                AABB binBox[kBins];
+                uint32_t binCount[kBins] = {};
+                float scale = kBins / width;
+                auto binOf = [&](uint32_t item) {
+                    return std::min(kBins - 1, uint32_t((m_centers[item][axis] - lo) * scale));
+                };
+                for (uint32_t i = task.begin; i < task.end; ++i) {
+                    uint32_t b = binOf(m_items[i]);
+                    binBox[b].extend(m_bounds[m_items[i]]);
+                    binCount[b]++;
+                }
+
+                float rightArea[kBins];
+                uint32_t rightCount[kBins];
+                AABB acc;
+                uint32_t n = 0;
+                for (uint32_t b = kBins - 1; b > 0; --b) {
+                    acc.extend(binBox[b]);
+                    n += binCount[b];
+                    rightArea[b] = surfaceArea(acc);
+                    rightCount[b] = n;
+                }
+
+                float best = float(count) * surfaceArea(box);
+                uint32_t bestBin = 0;
+                acc = AABB();
+                n = 0;
+                for (uint32_t b = 1; b < kBins; ++b) {
+                    acc.extend(binBox[b - 1]);
+                    n += binCount[b - 1];
+                    float cost = surfaceArea(acc) * n + rightArea[b] * rightCount[b];
+                    if (n && rightCount[b] && cost < best) {
+                        best = cost;
+                        bestBin = b;
+                    }
+                }
+
+                if (bestBin) {
+                    auto mid = std::partition(m_items.begin() + task.begin, m_items.begin() + task.end,
+                        [&](uint32_t item) { return binOf(item) < bestBin; });
+                    split = uint32_t(mid - m_items.begin());
+                }
+            }
+
+            // SAH found nothing useful but the leaf would be too big: median split
+            if (split == task.end) {
+                split = task.begin + count / 2;
+                std::nth_element(m_items.begin() + task.begin, m_items.begin() + split, m_items.begin() + task.end,
+                    [&](uint32_t a, uint32_t b) { return m_centers[a][axis] < m_centers[b][axis]; });
+            }
+        }
+
+        BVHNode& node = m_nodes[task.node];
+        if (split == task.end) {
+            node.index = task.begin;
+            node.count = count;
+            for (uint32_t i = task.begin; i < task.end; ++i) {
+                m_itemLeaf[m_items[i]] = task.node;
+            }
+        } else {
+            uint32_t left = uint32_t(m_nodes.size());
+            node.index = left;
+            node.count = 0;
+            m_nodes.emplace_back();
+            m_nodes.emplace_back();
+            m_parents.push_back(task.node);
+            m_parents.push_back(task.node);
+            stack.push_back({ left + 1, split, task.end, task.depth + 1 });
+            stack.push_back({ left, task.begin, split, task.depth + 1 });
+        }
+    }
+}
+
+void BVH::update(uint32_t item, const AABB& bounds)
+{
+    m_bounds[item] = bounds;
+    m_centers[item] = bounds.center();
+    uint32_t leaf = m_itemLeaf[item];
+    if (leaf != kInvalid) {
+        m_dirty.push_back(leaf);
+    }
+}
+
+uint32_t BVH::insert(const AABB& bounds)
+{
+    uint32_t item = uint32_t(m_bounds.size());
+    m_bounds.push_back(bounds);
+    m_centers.push_back(bounds.center());
+    m_itemLeaf.push_back(kInvalid);
+    m_needsRebuild = true;
+    return item;
+}
+
+void BVH::refit()
+{
+    if (m_needsRebuild) {
+        std::vector<AABB> bounds;
+        bounds.swap(m_bounds);
+        build(bounds);
+        return;
+    }
+    if (m_dirty.empty()) {
+        return;
+    }
+
+    if (m_dirty.size() * 8 < m_nodes.size()) {
+        // few changes: walk up from each dirty leaf until the bounds stop changing
+        for (uint32_t leaf : m_dirty) {
+            uint32_t node = leaf;
+            while (node != kInvalid) {
+                BVHNode& n = m_nodes[node];
+                AABB box;
+                if (n.leaf()) {
+                    for (uint32_t i = n.index; i < n.index + n.count; ++i) {
+                        box.extend(m_bounds[m_items[i]]);
+                        m_leafBounds.set(i, m_bounds[m_items[i]]);
+                    }
+                } else {
+                    box = nodeBounds(m_nodes[n.index]);
+                    box.extend(nodeBounds(m_nodes[n.index + 1]));
+                }
+                AABB old = nodeBounds(n);
+                assign(n, box);
+                if (node != leaf && old.min == box.min && old.max == box.max) {
+                    break;
+                }
+                node = m_parents[node];
+            }
+        }
+    } else {
+        // children always come after their parent, so one reverse sweep refits everything
+        for (size_t i = m_nodes.size(); i-- > 0;) {
+            BVHNode& n = m_nodes[i];
+            AABB box;
+            if (n.leaf()) {
+                for (uint32_t k = n.index; k < n.index + n.count; ++k) {
+                    box.extend(m_bounds[m_items[k]]);
+                    m_leafBounds.set(k, m_bounds[m_items[k]]);
+                }
+            } else {
+                box = nodeBounds(m_nodes[n.index]);
+                box.extend(nodeBounds(m_nodes[n.index + 1]));
+            }
+            assign(n, box);
+        }
+    }
+    m_dirty.clear();
+
+    // refitting keeps the topology, rebuild once it has drifted too far from a good tree
+    if (sahCost() > m_builtCost * 2.0f) {
+        std::vector<AABB> bounds;
+        bounds.swap(m_bounds);
+        build(bounds);
+    }
+}
+
+float BVH::sahCost() const
+{
+    if (m_nodes.empty()) {
+        return 0.0f;
+    }
+    float root = surfaceArea(nodeBounds(m_nodes[0]));
+    if (root <= 0.0f) {
+        return 0.0f;
+    }
+    float cost = 0.0f;
+    for (auto& n : m_nodes) {
+        float a = surfaceArea(nodeBounds(n)) / root;
+        cost += n.leaf() ? a * n.count : a;
+    }
+    return cost;
+}
+
+void BVH::collect(uint32_t node, std::vector<uint32_t>& items) const
+{
+    uint32_t stack[kStackSize];
+    int top = 0;
+    stack[top++] = node;
+    while (top) {
+        const BVHNode& n = m_nodes[stack[--top]];
+        if (n.leaf()) {
+            items.insert(items.end(), m_items.begin() + n.index, m_items.begin() + n.index + n.count);
+        } else {
+            stack[top++] = n.index + 1;
+            stack[top++] = n.index;
+        }
+    }
+}
+
+void BVH::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& items) const
+{
+    if (m_nodes.empty()) {
+        return;
+    }
+
+    uint32_t stack[kStackSize];
+    int top = 0;
+    stack[top++] = 0;
+    while (top) {
+        uint32_t index = stack[--top];
+        const BVHNode& n = m_nodes[index];
+        Overlap o = classify(frustum, n);
+        if (o == Overlap::Outside) {
+            continue;
+        }
+        if (o == Overlap::Inside) {
+            collect(index, items);
+        } else if (n.leaf()) {
+            uint8_t visible[kMaxLeafSize];
+            cullAABBs(frustum, m_leafBounds, n.index, n.count, visible);
+            for (uint32_t k = 0; k < n.count; ++k) {
+                if (visible[k]) {
+                    items.push_back(m_items[n.index + k]);
+                }
+            }
+        } else {
+            stack[top++] = n.index + 1;
+            stack[top++] = n.index;
+        }
+    }
+}
+
+int BVH::raycast(const glm::vec3& origin, const glm::vec3& dir, float& t) const
+{
+    int hit = -1;
+    t = FLT_MAX;
+    if (m_nodes.empty()) {
+        return hit;
+    }
+
+    glm::vec3 invDir(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+
+    uint32_t stack[kStackSize];
+    int top = 0;
+    stack[top++] = 0;
+    while (top) {
+        const BVHNode& n = m_nodes[stack[--top]];
+        float tnear;
+        if (!slab(n, origin, invDir, t, tnear)) {
+            continue;
+        }
+        if (n.leaf()) {
+            for (uint32_t i = n.index; i < n.index + n.count; ++i) {
+                BVHNode box;
+                assign(box, m_bounds[m_items[i]]);
+                if (slab(box, origin, invDir, t, tnear) && tnear < t) {
+                    t = tnear;
+                    hit = int(m_items[i]);
+                }
+            }
+        } else {
+            // visit the nearer child first so the far one is usually rejected by t
+            const BVHNode& l = m_nodes[n.index];
+            const BVHNode& r = m_nodes[n.index + 1];
+            float tl = FLT_MAX, tr = FLT_MAX;
+            bool hl = slab(l, origin, invDir, t, tl);
+            bool hr = slab(r, origin, invDir, t, tr);
+            if (hl && hr) {
+                stack[top++] = tl < tr ? n.index + 1 : n.index;
+                stack[top++] = tl < tr ? n.index : n.index + 1;
+            } else if (hl) {
+                stack[top++] = n.index;
+            } else if (hr) {
+                stack[top++] = n.index + 1;
+            }
+        }
+    }
+    return hit;
+}
@@ -0,0 +1,314 @@
+#include "glad/glad.h"
+#include "capture.h"
+#include "imagecodec.h"
+#include "profiler.h"
+#include "rslib.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "spdlog/spdlog.h"
+
+FrameCapture::~FrameCapture()
+{
+    // the slots the encodes write from go away with this
+    if (auto jobs = RSLib::instance()->getJobSystem()) {
+        jobs->wait(m_encoding);
+    }
+    if (m_writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_stopWriting = true;
+        }
+        m_changed.notify_all();
+        m_writer.join();
+    }
+    if (m_stream && m_stream != stdout) {
+        fclose(m_stream);
+    }
+    for (auto& slot : m_slots) {
+        if (slot.buffer) {
+            glDeleteBuffers(1, &slot.buffer);
+        }
+    }
+}
+
+void FrameCapture::setup(const Settings& settings)
+{
+    m_settings = settings;
+    std::error_code error;
+    if (!m_settings.stream.empty()) {
+        if (m_settings.stream == "-") {
+#if defined(_WIN32)
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            m_stream = stdout;
+        } else {
+            m_stream = fopen(m_settings.stream.c_str(), "wb");
+        }
+        if (!m_stream) {
+            spdlog::error("Failed to open {0} for writing", m_settings.stream);
+        } else {
+            m_writer = std::thread(&FrameCapture::writeStream, this);
+        }
+        return;
+    }
+    std::filesystem::create_directories(m_settings.directory, error);
+    if (!m_settings.golden.empty()) {
+        std::filesystem::create_directories(m_settings.golden, error);
+    }
+}
+
+bool FrameCapture::read(uint64_t frame, int width, int height)
+{
+    Slot& slot = m_slots[m_next];
+    if (slot.state.load(std::memory_order_acquire) != Free) {
+        m_dropped++;
+        return false;
+    }
+
+    size_t size = size_t(width) * height * 4;
+    if (size > slot.capacity) {
+        // immutable storage can't grow, and deleting the buffer unmaps it
+        if (slot.buffer) {
+            glDeleteBuffers(1, &slot.buffer);
+            slot.mapped = nullptr;
+        }
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        if (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage) {
+            // client storage: the CPU reads every byte, the GPU writes it once
+            GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_PACK_BUFFER, size, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+            slot.mapped = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, flags));
+        } else {
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        }
+        slot.capacity = size;
+    } else {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    }
+    // RGBA rows are 4 byte aligned at any width, the default pack alignment fits
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.frame = frame;
+    slot.width = width;
+    slot.height = height;
+    slot.state.store(Reading, std::memory_order_release);
+
+    m_next = (m_next + 1) % Slots;
+    m_reading++;
+    return true;
+}
+
+void FrameCapture::poll(Profiler& profiler)
+{
+    // readbacks finish in the order they were issued
+    while (m_reading > 0) {
+        Slot& slot = m_slots[m_oldest];
+        GLenum status = glClientWaitSync(static_cast<GLsync>(slot.fence), 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            break;
+        }
+        collect(slot);
+        profiler.count("capture.frames", 1);
+    }
+    profiler.count("capture.dropped", int64_t(m_dropped));
+    m_dropped = 0;
+}
+
+void FrameCapture::waitForSlot()
+{
+    Slot& slot = m_slots[m_next];
+    // slots are taken in ring order, so a slot still reading is the oldest readback
+    while (slot.state.load(std::memory_order_acquire) == Reading) {
+        Slot& oldest = m_slots[m_oldest];
+        glClientWaitSync(static_cast<GLsync>(oldest.fence), GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        collect(oldest);
+    }
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_changed.wait(lock, [&]() { return slot.state.load() == Free; });
+}
+
+void FrameCapture::finish()
+{
+    while (m_reading > 0) {
+        Slot& slot = m_slots[m_oldest];
+        glClientWaitSync(static_cast<GLsync>(slot.fence), GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        collect(slot);
+    }
+    if (auto jobs = RSLib::instance()->getJobSystem()) {
+        jobs->wait(m_encoding);
+    }
+    // every slot is free or encoded now, the writer drains the encoded ones and stops
+    if (m_writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_stopWriting = true;
+        }
+        m_changed.notify_all();
+        m_writer.join();
+        fflush(m_stream);
+    }
+    if (m_written > 0) {
+        std::string target = m_settings.stream.empty() ? m_settings.directory : m_settings.stream;
+        spdlog::info("Capture: {0} frames written to {1}{2}", m_written.load(), target, m_settings.golden.empty() ? std::string() :
+            ", " + std::to_string(m_goldenFailures.load()) + " differ from " + m_settings.golden);
+    }
+}
+
+void FrameCapture::collect(Slot& slot)
+{
+    glDeleteSync(static_cast<GLsync>(slot.fence));
+    slot.fence = nullptr;
+
+    // without a persistent mapping the pixels are copied out as they are, the worker
+    // flips and converts them
+    bool ok = slot.mapped != nullptr;
+    if (!ok) {
+        size_t size = size_t(slot.width) * slot.height * 4;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+        if (mapped) {
+            slot.pixels.resize(size);
+            memcpy(slot.pixels.data(), mapped, size);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            ok = true;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    m_oldest = (m_oldest + 1) % Slots;
+    m_reading--;
+    if (!ok) {
+        spdlog::error("Capture of frame {0} couldn't be mapped", slot.frame);
+        // the writer expects every slot in order, an empty one is skipped
+        slot.encoded.clear();
+        release(slot, m_writer.joinable() ? Encoded : Free);
+        return;
+    }
+
+    slot.state.store(Encoding, std::memory_order_release);
+    if (auto jobs = RSLib::instance()->getJobSystem()) {
+        jobs->runBackground([this, &slot]() { encode(slot); }, &m_encoding);
+    } else {
+        encode(slot);
+    }
+}
+
+void FrameCapture::encode(Slot& slot)
+{
+    const uint8_t* pixels = slot.mapped ? slot.mapped : slot.pixels.data();
+    ptrdiff_t stride = ptrdiff_t(slot.width) * 4;
+    // GL rows start at the bottom
+    const uint8_t* top = pixels + (slot.height - 1) * stride;
+
+    if (m_writer.joinable()) {
+        // 4:2:0 needs even sizes, an odd last column and top row are left out
+        int width = slot.width & ~1;
+        int height = slot.height & ~1;
+        slot.encoded.resize(size_t(width) * height * 3 / 2);
+        ImageCodec::rgbaToYUV420(top, -stride, width, height, slot.encoded.data());
+        release(slot, Encoded);
+        return;
+    }
+
+    std::vector<uint8_t> rgb(size_t(slot.width) * slot.height * 3);
+    for (int y = 0; y < slot.height; ++y) {
+        const uint8_t* src = top - y * stride;
+        uint8_t* dst = &rgb[size_t(y) * slot.width * 3];
+        for (int x = 0; x < slot.width; ++x) {
+            dst[x * 3] = src[x * 4];
+            dst[x * 3 + 1] = src[x * 4 + 1];
+            dst[x * 3 + 2] = src[x * 4 + 2];
+        }
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "frame_%06llu", (unsigned long long) slot.frame);
+    std::string file = m_settings.directory + "/" + name + "." + m_settings.format;
+    if (ImageCodec::writeImage(file, rgb.data(), slot.width, slot.height, 3)) {
+        m_written++;
+    } else {
+        spdlog::error("Failed to write capture {0}", file);
+    }
+
+    if (!m_settings.golden.empty()) {
+        std::string reference = m_settings.golden + "/" + name + ".qoi";
+        Image expected;
+        if (!ImageCodec::readQOI(reference, expected)) {
+            // first run records the references
+            ImageCodec::writeImage(reference, rgb.data(), slot.width, slot.height, 3);
+            spdlog::info("Golden image {0} recorded", reference);
+        } else {
+            Image actual;
+            actual.width = slot.width;
+            actual.height = slot.height;
+            actual.channels = 3;
+            actual.pixels = std::shared_ptr<unsigned char>(rgb.data(), [](unsigned char*) {});
+            ImageCodec::Difference d = ImageCodec::compare(actual, expected, m_settings.tolerance);
+            if (d.sizeMismatch || d.pixels > 0) {
+                m_goldenFailures++;
+                spdlog::error("Golden image {0}: {1}", reference, d.sizeMismatch ? std::string("size differs") :
+                    std::to_string(d.pixels) + " pixels differ, by up to " + std::to_string(d.maxChannel));
+            }
+        }
+    }
+
+    release(slot, Free);
+}
+
+void FrameCapture::release(Slot& slot, State state)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        slot.state.store(state, std::memory_order_release);
+    }
+    m_changed.notify_all();
+}
+
+void FrameCapture::writeStream()
+{
+    // slots are read in ring order, so writing them in ring order keeps the frames in order
+    int next = 0;
+    int width = 0;
+    int height = 0;
+    for (;;) {
+        Slot& slot = m_slots[next];
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_changed.wait(lock, [&]() { return slot.state.load() == Encoded || m_stopWriting; });
+            if (slot.state.load() != Encoded) {
+                break;
+            }
+        }
+
+        if (!slot.encoded.empty()) {
+            int w = slot.width & ~1;
+            int h = slot.height & ~1;
+            if (width == 0) {
+                // studio range BT.601 like rgbaToYUV420 writes, chroma centred like JPEG
+                width = w;
+                height = h;
+                fprintf(m_stream, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, m_settings.fps);
+            }
+            if (w != width || h != height) {
+                spdlog::error("Capture of frame {0} is {1}x{2}, the stream is {3}x{4}", slot.frame, w, h, width, height);
+            } else if (fwrite("FRAME\n", 1, 6, m_stream) == 6 && fwrite(slot.encoded.data(), 1, slot.encoded.size(), m_stream) == slot.encoded.size()) {
+                m_written++;
+            } else {
+                spdlog::error("Failed to write frame {0} to {1}", slot.frame, m_settings.stream);
+            }
+        }
+
+        release(slot, Free);
+        next = (next + 1) % Slots;
+    }
+}
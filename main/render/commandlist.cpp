@@ -0,0 +1,345 @@
+#include "commandlist.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "glad/glad.h"
+
+namespace {
+
+const unsigned int Unknown = ~0u;
+
+int textureTarget(unsigned int target)
+{
+    return target == GL_TEXTURE_2D_ARRAY ? 1 : 0;
+}
+
+int capability(unsigned int cap)
+{
+    switch (cap) {
+    case GL_DEPTH_TEST:
+        return 0;
+    case GL_BLEND:
+        return 1;
+    case GL_CULL_FACE:
+        return 2;
+    default:
+        return -1;
+    }
+}
+
+uint32_t bits(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+}
+
+void CommandList::clear()
+{
+    m_commands.clear();
+    m_data.clear();
+}
+
+Command& CommandList::push(Command::Op op)
+{
+    m_commands.push_back(Command());
+    Command& c = m_commands.back();
+    c.op = op;
+    c.location = -1;
+    c.name = nullptr;
+    return c;
+}
+
+uint32_t CommandList::store(const void* data, size_t words)
+{
+    uint32_t offset = uint32_t(m_data.size());
+    m_data.resize(m_data.size() + words);
+    memcpy(&m_data[offset], data, words * sizeof(uint32_t));
+    return offset;
+}
+
+void CommandList::useProgram(unsigned int program)
+{
+    push(Command::UseProgram).args[0] = program;
+}
+
+void CommandList::bindVertexArray(unsigned int vao)
+{
+    push(Command::BindVertexArray).args[0] = vao;
+}
+
+void CommandList::bindTextures(unsigned int target, unsigned int first, unsigned int count, const unsigned int* textures)
+{
+    uint32_t offset = store(textures, count);
+    Command& c = push(Command::BindTextures);
+    c.args[0] = target;
+    c.args[1] = first;
+    c.args[2] = count;
+    c.args[3] = offset;
+}
+
+void CommandList::enable(unsigned int cap)
+{
+    push(Command::Enable).args[0] = cap;
+}
+
+void CommandList::disable(unsigned int cap)
+{
+    push(Command::Disable).args[0] = cap;
+}
+
+void CommandList::uniform(int location, int value)
+{
+    Command& c = push(Command::Uniform1i);
+    c.location = location;
+    c.args[0] = uint32_t(value);
+}
+
+void CommandList::uniform(const char* name, int value)
+{
+    Command& c = push(Command::Uniform1i);
+    c.name = name;
+    c.args[0] = uint32_t(value);
+}
+
+void CommandList::uniform(const char* name, const glm::vec2& value)
+{
+    Command& c = push(Command::Uniform2f);
+    c.name = name;
+    c.args[0] = bits(value.x);
+    c.args[1] = bits(value.y);
+}
+
+void CommandList::uniform(const char* name, const glm::mat4& value)
+{
+    uint32_t offset = store(&value[0][0], 16);
+    Command& c = push(Command::UniformMatrix4);
+    c.name = name;
+    c.args[0] = offset;
+}
+
+void CommandList::drawElements(unsigned int mode, unsigned int count, unsigned int type, size_t offset, int baseVertex)
+{
+    Command& c = push(Command::DrawElements);
+    c.args[0] = mode;
+    c.args[1] = count;
+    c.args[2] = type;
+    c.args[3] = uint32_t(offset);
+    c.args[4] = uint32_t(baseVertex);
+}
+
+void CommandList::multiDrawIndirect(unsigned int buffer, unsigned int mode, unsigned int type, size_t offset, unsigned int count)
+{
+    Command& c = push(Command::MultiDrawIndirect);
+    c.args[0] = buffer;
+    c.args[1] = mode;
+    c.args[2] = type;
+    c.args[3] = uint32_t(offset);
+    c.args[4] = count;
+}
+
+uint64_t CommandExecutor::Stats::totalIssued() const
+{
+    uint64_t n = 0;
+    for (uint64_t v : issued) {
+        n += v;
+    }
+    return n;
+}
+
+uint64_t CommandExecutor::Stats::totalElided() const
+{
+    uint64_t n = 0;
+    for (uint64_t v : elided) {
+        n += v;
+    }
+    return n;
+}
+
+CommandExecutor::CommandExecutor()
+{
+    invalidate();
+}
+
+void CommandExecutor::invalidate()
+{
+    m_program = Unknown;
+    m_vao = Unknown;
+    m_indirectBuffer = Unknown;
+    m_activeUnit = Unknown;
+    for (auto& units : m_textures) {
+        units.fill(Unknown);
+    }
+    m_caps.fill(-1);
+    m_generation++;
+}
+
+void CommandExecutor::execute(const CommandList& list)
+{
+    const uint32_t* data = list.data().data();
+    for (const Command& c : list.commands()) {
+        switch (c.op) {
+        case Command::UseProgram:
+            count(Program, c.args[0] != m_program);
+            if (c.args[0] != m_program) {
+                m_program = c.args[0];
+                glUseProgram(m_program);
+            }
+            break;
+
+        case Command::BindVertexArray:
+            count(VertexArray, c.args[0] != m_vao);
+            if (c.args[0] != m_vao) {
+                m_vao = c.args[0];
+                glBindVertexArray(m_vao);
+            }
+            break;
+
+        case Command::BindTextures:
+            bindTextures(c, data + c.args[3]);
+            break;
+
+        case Command::Enable:
+        case Command::Disable:
+            setCapability(c.args[0], c.op == Command::Enable);
+            break;
+
+        case Command::Uniform1i: {
+            int l = location(c);
+            bool elide = l < 0 || uniformSet(l, c.args, 1);
+            count(Uniform, !elide);
+            if (!elide) {
+                glUniform1i(l, int(c.args[0]));
+            }
+            break;
+        }
+
+        case Command::Uniform2f: {
+            int l = location(c);
+            bool elide = l < 0 || uniformSet(l, c.args, 2);
+            count(Uniform, !elide);
+            if (!elide) {
+                float v[2];
+                memcpy(v, c.args, sizeof(v));
+                glUniform2fv(l, 1, v);
+            }
+            break;
+        }
+
+        case Command::UniformMatrix4: {
+            int l = location(c);
+            const uint32_t* value = data + c.args[0];
+            bool elide = l < 0 || uniformSet(l, value, 16);
+            count(Uniform, !elide);
+            if (!elide) {
+                glUniformMatrix4fv(l, 1, GL_FALSE, reinterpret_cast<const float*>(value));
+            }
+            break;
+        }
+
+        case Command::DrawElements:
+            count(Draw, true);
+            glDrawElementsBaseVertex(c.args[0], GLsizei(c.args[1]), c.args[2], (const void*) size_t(c.args[3]), int(c.args[4]));
+            break;
+
+        case Command::MultiDrawIndirect:
+            count(Buffer, c.args[0] != m_indirectBuffer);
+            if (c.args[0] != m_indirectBuffer) {
+                m_indirectBuffer = c.args[0];
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+            }
+            count(Draw, true);
+            glMultiDrawElementsIndirect(c.args[1], c.args[2], (const void*) size_t(c.args[3]), GLsizei(c.args[4]), 0);
+            break;
+        }
+    }
+}
+
+void CommandExecutor::bindTextures(const Command& c, const uint32_t* textures)
+{
+    unsigned int target = c.args[0];
+    auto& bound = m_textures[textureTarget(target)];
+    unsigned int first = c.args[1];
+    unsigned int end = std::min(first + c.args[2], MaxUnits);
+    bool issued = false;
+    // one call per run of units that change, given units only
+    for (unsigned int u = first; u < end;) {
+        unsigned int t = textures[u - first];
+        if (!t || t == bound[u]) {
+            u++;
+            continue;
+        }
+        unsigned int runEnd = u + 1;
+        while (runEnd < end && textures[runEnd - first] && textures[runEnd - first] != bound[runEnd]) {
+            runEnd++;
+        }
+        if (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_multi_bind) {
+            glBindTextures(u, runEnd - u, textures + (u - first));
+        } else {
+            for (unsigned int v = u; v < runEnd; ++v) {
+                if (m_activeUnit != v) {
+                    m_activeUnit = v;
+                    glActiveTexture(GL_TEXTURE0 + v);
+                }
+                glBindTexture(target, textures[v - first]);
+            }
+        }
+        for (unsigned int v = u; v < runEnd; ++v) {
+            bound[v] = textures[v - first];
+        }
+        issued = true;
+        u = runEnd;
+    }
+    count(Texture, issued);
+}
+
+void CommandExecutor::setCapability(unsigned int cap, bool on)
+{
+    int i = capability(cap);
+    if (i >= 0 && m_caps[i] == int8_t(on)) {
+        count(Capability, false);
+        return;
+    }
+    if (i >= 0) {
+        m_caps[i] = int8_t(on);
+    }
+    count(Capability, true);
+    if (on) {
+        glEnable(cap);
+    } else {
+        glDisable(cap);
+    }
+}
+
+int CommandExecutor::location(const Command& c)
+{
+    if (m_program == Unknown) {
+        // the list didn't start with a program, ask GL which one the uniforms go to
+        GLint program = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+        m_program = unsigned(program);
+    }
+    if (!c.name) {
+        return c.location;
+    }
+    auto it = m_locations.find({ m_program, c.name });
+    if (it == m_locations.end()) {
+        it = m_locations.emplace(NameKey{ m_program, c.name }, glGetUniformLocation(m_program, c.name)).first;
+    }
+    return it->second;
+}
+
+bool CommandExecutor::uniformSet(int location, const uint32_t* value, uint32_t words)
+{
+    UniformValue& u = m_uniforms[(uint64_t(m_program) << 32) | uint32_t(location)];
+    if (u.generation == m_generation && u.words == words && memcmp(u.value, value, words * sizeof(uint32_t)) == 0) {
+        return true;
+    }
+    u.generation = m_generation;
+    u.words = words;
+    memcpy(u.value, value, words * sizeof(uint32_t));
+    return false;
+}
@@ -0,0 +1,143 @@
+#include "culling.h"
+
+#include <algorithm>
+#include <immintrin.h>
+
+Frustum extractFrustum(const glm::mat4& viewProj)
+{
+    // Gribb/Hartmann on the rows of the column-major matrix
+    glm::vec4 row0(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+    glm::vec4 row1(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+    glm::vec4 row2(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]);
+    glm::vec4 row3(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+
+    Frustum f;
+    f.planes[0] = row3 + row0;
+    f.planes[1] = row3 - row0;
+    f.planes[2] = row3 + row1;
+    f.planes[3] = row3 - row1;
+    f.planes[4] = row3 + row2;
+    f.planes[5] = row3 - row2;
+
+    for (auto& p : f.planes) {
+        float len = glm::length(glm::vec3(p));
+        if (len > 0.0f) {
+            p /= len;
+        }
+    }
+    return f;
+}
+
+bool isVisible(const Frustum& frustum, const AABB& box)
+{
+    for (auto& p : frustum.planes) {
+        // farthest corner along the plane normal
+        float x = p.x >= 0.0f ? box.max.x : box.min.x;
+        float y = p.y >= 0.0f ? box.max.y : box.min.y;
+        float z = p.z >= 0.0f ? box.max.z : box.min.z;
+        if (p.x * x + p.y * y + p.z * z + p.w < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void AABBSoA::clear()
+{
+    minX.clear(); minY.clear(); minZ.clear();
+    maxX.clear(); maxY.clear(); maxZ.clear();
+}
+
+void AABBSoA::push_back(const AABB& box)
+{
+    minX.push_back(box.min.x); minY.push_back(box.min.y); minZ.push_back(box.min.z);
+    maxX.push_back(box.max.x); maxY.push_back(box.max.y); maxZ.push_back(box.max.z);
+}
+
+void AABBSoA::resize(size_t count)
+{
+    minX.resize(count); minY.resize(count); minZ.resize(count);
+    maxX.resize(count); maxY.resize(count); maxZ.resize(count);
+}
+
+void AABBSoA::set(size_t i, const AABB& box)
+{
+    minX[i] = box.min.x; minY[i] = box.min.y; minZ[i] = box.min.z;
+    maxX[i] = box.max.x; maxY[i] = box.max.y; maxZ[i] = box.max.z;
+}
+
+size_t cullAABBs(const Frustum& frustum, const AABBSoA& boxes, size_t first, size_t count, uint8_t* visible)
+{
+    // the sign of each plane normal picks min or max per axis, so choose the arrays once
+    const float* px[6];
+    const float* py[6];
+    const float* pz[6];
+    for (int i = 0; i < 6; ++i) {
+        const glm::vec4& p = frustum.planes[i];
+        px[i] = (p.x >= 0.0f ? boxes.maxX.data() : boxes.minX.data()) + first;
+        py[i] = (p.y >= 0.0f ? boxes.maxY.data() : boxes.minY.data()) + first;
+        pz[i] = (p.z >= 0.0f ? boxes.maxZ.data() : boxes.minZ.data()) + first;
+    }
+
+    // blocks of 8, the last one partial if 8 boxes can be read from it
+    const size_t readable = boxes.size() - first;
+    auto block = [&](size_t at) { return at + 8 <= count || (at < count && at + 8 <= readable); };
+    size_t visibleCount = 0;
+    size_t i = 0;
+
+#if defined(__AVX__)
+    for (; block(i); i += 8) {
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int k = 0; k < 6; ++k) {
+            const glm::vec4& p = frustum.planes[k];
+            __m256 d = _mm256_set1_ps(p.w);
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p.x), _mm256_loadu_ps(px[k] + i)));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p.y), _mm256_loadu_ps(py[k] + i)));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p.z), _mm256_loadu_ps(pz[k] + i)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        int mask = _mm256_movemask_ps(inside);
+        size_t lanes = std::min<size_t>(8, count - i);
+        mask &= (1 << lanes) - 1;
+        for (size_t b = 0; b < lanes; ++b) {
+            visible[i + b] = uint8_t((mask >> b) & 1);
+        }
+        visibleCount += _mm_popcnt_u32(unsigned(mask));
+    }
+#else
+    for (; block(i); i += 8) {
+        __m128 inside0 = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        __m128 inside1 = inside0;
+        for (int k = 0; k < 6; ++k) {
+            const glm::vec4& p = frustum.planes[k];
+            __m128 nx = _mm_set1_ps(p.x), ny = _mm_set1_ps(p.y), nz = _mm_set1_ps(p.z), nw = _mm_set1_ps(p.w);
+            __m128 d0 = _mm_add_ps(nw, _mm_mul_ps(nx, _mm_loadu_ps(px[k] + i)));
+            __m128 d1 = _mm_add_ps(nw, _mm_mul_ps(nx, _mm_loadu_ps(px[k] + i + 4)));
+            d0 = _mm_add_ps(d0, _mm_mul_ps(ny, _mm_loadu_ps(py[k] + i)));
+            d1 = _mm_add_ps(d1, _mm_mul_ps(ny, _mm_loadu_ps(py[k] + i + 4)));
+            d0 = _mm_add_ps(d0, _mm_mul_ps(nz, _mm_loadu_ps(pz[k] + i)));
+            d1 = _mm_add_ps(d1, _mm_mul_ps(nz, _mm_loadu_ps(pz[k] + i + 4)));
+            inside0 = _mm_and_ps(inside0, _mm_cmpge_ps(d0, _mm_setzero_ps()));
+            inside1 = _mm_and_ps(inside1, _mm_cmpge_ps(d1, _mm_setzero_ps()));
+        }
+        int mask = _mm_movemask_ps(inside0) | (_mm_movemask_ps(inside1) << 4);
+        size_t lanes = std::min<size_t>(8, count - i);
+        for (size_t b = 0; b < lanes; ++b) {
+            visible[i + b] = uint8_t((mask >> b) & 1);
+            visibleCount += (mask >> b) & 1;
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        bool inside = true;
+        for (int k = 0; k < 6 && inside; ++k) {
+            const glm::vec4& p = frustum.planes[k];
+            inside = p.x * px[k][i] + p.y * py[k][i] + p.z * pz[k][i] + p.w >= 0.0f;
+        }
+        visible[i] = inside ? 1 : 0;
+        visibleCount += inside ? 1 : 0;
+    }
+
+    return visibleCount;
+}
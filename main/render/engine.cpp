@@ -1,6 +1,8 @@
 #include "engine.h"
 #include "render.h"
 #include "rslib.h"
+#include "bench.h"
+#include "jobs.h"
 
 Engine::Engine(int argc, char** argv)
 {
@@ -8,6 +10,9 @@ Engine::Engine(int argc, char** argv)
 
     auto config = RSLib::instance()->initConfig(argc, argv);
 
+    m_jobs = std::make_unique<JobSystem>();
+    RSLib::instance()->setJobSystem(m_jobs.get());
+
     if (config) {
         m_pRender = std::unique_ptr<Render>(new Render());
     }
@@ -19,6 +24,8 @@ Engine::~Engine()
     if (m_bWindow) {
         closeWindow();
     }
+    m_pRender.reset();
+    RSLib::instance()->setJobSystem(nullptr);
 }
 
 int Engine::initWindow()
@@ -33,6 +40,11 @@ int Engine::closeWindow()
 
 int Engine::run()
 {
+    auto bench = RSLib::instance()->getBenchmark();
+    if (!bench.empty()) {
+        return runBenchmark(bench);
+    }
+
     if (m_pRender) {
         return m_pRender->run();
     } else {
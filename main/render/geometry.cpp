@@ -0,0 +1,123 @@
+#include "glad/glad.h"
+#include "geometry.h"
+
+#include <cassert>
+#include <cstring>
+
+GeometryArena::GeometryArena()
+{
+    m_totalVertices = 0;
+    m_totalIndexBytes = 0;
+    m_uploaded = false;
+    VAO = 0;
+    VBO = 0;
+    EBO = 0;
+}
+
+GeometryArena::~GeometryArena()
+{
+    if (VAO) {
+        glDeleteVertexArrays(1, &VAO);
+    }
+    if (VBO) {
+        glDeleteBuffers(1, &VBO);
+    }
+    if (EBO) {
+        glDeleteBuffers(1, &EBO);
+    }
+}
+
+GeometryRange GeometryArena::add(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+    assert(!m_uploaded && "GeometryArena::add after upload");
+    GeometryRange range;
+    range.baseVertex = static_cast<uint32_t>(m_vertices.size());
+    range.vertexCount = static_cast<uint32_t>(vertices.size());
+    range.indexCount = static_cast<uint32_t>(indices.size());
+
+    // pick the narrowest index type that can address every vertex of this mesh
+    bool narrow = vertices.size() <= 0x10000;
+    range.indexType = narrow ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    range.indexOffset = appendIndices(indices, narrow);
+
+    m_vertices.insert(m_vertices.end(), vertices.begin(), vertices.end());
+
+    return range;
+}
+
+GeometryRange GeometryArena::addIndices(const GeometryRange& base, const std::vector<uint32_t>& indices)
+{
+    assert(!m_uploaded && "GeometryArena::addIndices after upload");
+    GeometryRange range = base;
+    range.indexCount = static_cast<uint32_t>(indices.size());
+    range.indexOffset = appendIndices(indices, base.indexType == GL_UNSIGNED_SHORT);
+    return range;
+}
+
+uint32_t GeometryArena::appendIndices(const std::vector<uint32_t>& indices, bool narrow)
+{
+    size_t stride = narrow ? sizeof(uint16_t) : sizeof(uint32_t);
+
+    // keep every range aligned to its own index size
+    size_t offset = (m_indices.size() + stride - 1) & ~(stride - 1);
+    m_indices.resize(offset + indices.size() * stride);
+
+    if (narrow) {
+        uint16_t* dst = reinterpret_cast<uint16_t*>(m_indices.data() + offset);
+        for (size_t i = 0; i < indices.size(); ++i) {
+            dst[i] = static_cast<uint16_t>(indices[i]);
+        }
+    } else if (indices.size()) {
+        memcpy(m_indices.data() + offset, indices.data(), indices.size() * stride);
+    }
+
+    return static_cast<uint32_t>(offset);
+}
+
+void GeometryArena::upload()
+{
+    if (m_uploaded) {
+        return;
+    }
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(Vertex), m_vertices.data(), GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size(), m_indices.data(), GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void*) offsetof(Vertex, Position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void*) offsetof(Vertex, Normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void*) offsetof(Vertex, TexCoords));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void*) offsetof(Vertex, Tangent));
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void*) offsetof(Vertex, Bitangent));
+
+    glBindVertexArray(0);
+
+    m_totalVertices = static_cast<uint32_t>(m_vertices.size());
+    m_totalIndexBytes = static_cast<uint32_t>(m_indices.size());
+    m_uploaded = true;
+
+    std::vector<Vertex>().swap(m_vertices);
+    std::vector<uint8_t>().swap(m_indices);
+}
+
+void GeometryArena::bind()
+{
+    glBindVertexArray(VAO);
+}
+
+void GeometryArena::unbind()
+{
+    glBindVertexArray(0);
+}
@@ -0,0 +1,404 @@
+#include "glbackend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <string>
+
+#include "glad/glad.h"
+
+namespace {
+
+const size_t EntryCount = size_t(GLEntry::Count);
+
+// capability flags the null backend raises without a context
+int* const Flags[] = {
+    &GLAD_GL_VERSION_1_0, &GLAD_GL_VERSION_1_1, &GLAD_GL_VERSION_1_2, &GLAD_GL_VERSION_1_3,
+    &GLAD_GL_VERSION_1_4, &GLAD_GL_VERSION_1_5, &GLAD_GL_VERSION_2_0, &GLAD_GL_VERSION_2_1,
+    &GLAD_GL_VERSION_3_0, &GLAD_GL_VERSION_3_1, &GLAD_GL_VERSION_3_2, &GLAD_GL_VERSION_3_3,
+    &GLAD_GL_VERSION_4_0, &GLAD_GL_VERSION_4_1, &GLAD_GL_VERSION_4_2, &GLAD_GL_VERSION_4_3,
+    &GLAD_GL_VERSION_4_4, &GLAD_GL_ARB_multi_bind, &GLAD_GL_ARB_shader_draw_parameters,
+};
+
+GLBackend* g_null = nullptr;
+GLBackend* g_trace = nullptr;
+
+}
+
+struct GLBackendAccess
+{
+    static void count(GLBackend* backend, GLEntry entry) { backend->count(size_t(entry)); }
+    static GLBackend& null() { return *g_null; }
+    static uint32_t name() { return ++g_null->m_names; }
+    static uint32_t& bound(GLenum target) { return g_null->m_bound[target]; }
+    static std::vector<uint8_t>& memory(GLuint buffer) { return g_null->m_memory[buffer]; }
+    static uint64_t& query(GLuint id) { return g_null->m_queries[id]; }
+    static bool& enabled(GLenum cap) { return g_null->m_enabled[cap]; }
+};
+
+namespace {
+
+// the generic hooks of an entry point: trace counts and forwards, null counts and returns
+// zero of whatever the entry point returns
+template <GLEntry Id, class F>
+struct Hook;
+
+template <GLEntry Id, class R, class... A>
+struct Hook<Id, R (APIENTRY*)(A...)>
+{
+    static inline R (APIENTRY* next)(A...) = nullptr;
+
+    static R APIENTRY trace(A... a)
+    {
+        GLBackendAccess::count(g_trace, Id);
+        return next(a...);
+    }
+
+    static R APIENTRY null(A...)
+    {
+        GLBackendAccess::count(g_null, Id);
+        return R();
+    }
+};
+
+using GenericFn = void (*)();
+
+struct EntryOps {
+    const char* name;
+    GenericFn (*get)();
+    void (*set)(GenericFn);
+    void (*null)();
+    void (*trace)();
+};
+
+#define GL_BACKEND_OPS(name) { "gl" #name, \
+    []() { return reinterpret_cast<GenericFn>(glad_gl##name); }, \
+    [](GenericFn f) { glad_gl##name = reinterpret_cast<decltype(glad_gl##name)>(f); }, \
+    []() { glad_gl##name = &Hook<GLEntry::name, decltype(glad_gl##name)>::null; }, \
+    []() { Hook<GLEntry::name, decltype(glad_gl##name)>::next = glad_gl##name; glad_gl##name = &Hook<GLEntry::name, decltype(glad_gl##name)>::trace; } },
+
+const EntryOps Entries[] = {
+    GL_BACKEND_ENTRIES(GL_BACKEND_OPS)
+};
+static_assert(sizeof(Entries) / sizeof(Entries[0]) == EntryCount, "an entry point without its ops");
+
+// null entry points that have to produce something
+namespace nullgl {
+
+using A = GLBackendAccess;
+
+void gen(GLEntry entry, GLsizei n, GLuint* names)
+{
+    A::count(g_null, entry);
+    for (GLsizei i = 0; i < n; ++i) {
+        names[i] = A::name();
+    }
+}
+
+void APIENTRY genBuffers(GLsizei n, GLuint* names) { gen(GLEntry::GenBuffers, n, names); }
+void APIENTRY genTextures(GLsizei n, GLuint* names) { gen(GLEntry::GenTextures, n, names); }
+void APIENTRY genVertexArrays(GLsizei n, GLuint* names) { gen(GLEntry::GenVertexArrays, n, names); }
+void APIENTRY genFramebuffers(GLsizei n, GLuint* names) { gen(GLEntry::GenFramebuffers, n, names); }
+void APIENTRY genQueries(GLsizei n, GLuint* names) { gen(GLEntry::GenQueries, n, names); }
+
+GLuint APIENTRY createShader(GLenum)
+{
+    A::count(g_null, GLEntry::CreateShader);
+    return A::name();
+}
+
+GLuint APIENTRY createProgram()
+{
+    A::count(g_null, GLEntry::CreateProgram);
+    return A::name();
+}
+
+// compiled and linked, with empty logs
+void APIENTRY getShaderiv(GLuint, GLenum pname, GLint* params)
+{
+    A::count(g_null, GLEntry::GetShaderiv);
+    *params = pname == GL_COMPILE_STATUS ? GL_TRUE : 0;
+}
+
+void APIENTRY getProgramiv(GLuint, GLenum pname, GLint* params)
+{
+    A::count(g_null, GLEntry::GetProgramiv);
+    *params = pname == GL_LINK_STATUS ? GL_TRUE : 0;
+}
+
+void APIENTRY getShaderInfoLog(GLuint, GLsizei size, GLsizei* length, GLchar* log)
+{
+    A::count(g_null, GLEntry::GetShaderInfoLog);
+    if (length) {
+        *length = 0;
+    }
+    if (size > 0) {
+        log[0] = 0;
+    }
+}
+
+void APIENTRY getProgramInfoLog(GLuint, GLsizei size, GLsizei* length, GLchar* log)
+{
+    A::count(g_null, GLEntry::GetProgramInfoLog);
+    if (length) {
+        *length = 0;
+    }
+    if (size > 0) {
+        log[0] = 0;
+    }
+}
+
+void APIENTRY getIntegerv(GLenum pname, GLint* data)
+{
+    A::count(g_null, GLEntry::GetIntegerv);
+    switch (pname) {
+    case GL_MAX_TEXTURE_SIZE:
+        *data = 16384;
+        break;
+    case GL_MAX_ARRAY_TEXTURE_LAYERS:
+        *data = 2048;
+        break;
+    default:
+        *data = 0;
+        break;
+    }
+}
+
+// different names get different locations, the same name always the same one
+GLint APIENTRY getUniformLocation(GLuint, const GLchar* name)
+{
+    A::count(g_null, GLEntry::GetUniformLocation);
+    return GLint(std::hash<std::string>()(name) & 0x7fff);
+}
+
+GLenum APIENTRY checkFramebufferStatus(GLenum)
+{
+    A::count(g_null, GLEntry::CheckFramebufferStatus);
+    return GL_FRAMEBUFFER_COMPLETE;
+}
+
+GLsync APIENTRY fenceSync(GLenum, GLbitfield)
+{
+    A::count(g_null, GLEntry::FenceSync);
+    return reinterpret_cast<GLsync>(uintptr_t(A::name()));
+}
+
+GLenum APIENTRY clientWaitSync(GLsync, GLbitfield, GLuint64)
+{
+    A::count(g_null, GLEntry::ClientWaitSync);
+    return GL_ALREADY_SIGNALED;
+}
+
+void APIENTRY bindBuffer(GLenum target, GLuint buffer)
+{
+    A::count(g_null, GLEntry::BindBuffer);
+    A::bound(target) = buffer;
+}
+
+void APIENTRY bufferData(GLenum target, GLsizeiptr size, const void* data, GLenum)
+{
+    A::count(g_null, GLEntry::BufferData);
+    std::vector<uint8_t>& memory = A::memory(A::bound(target));
+    // only what's mapped needs backing, and only once it is
+    if (!memory.empty()) {
+        memory.resize(size_t(size));
+    }
+    (void)data;
+}
+
+void APIENTRY bufferStorage(GLenum target, GLsizeiptr size, const void*, GLbitfield)
+{
+    A::count(g_null, GLEntry::BufferStorage);
+    A::memory(A::bound(target)).resize(size_t(size));
+}
+
+void* APIENTRY mapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield)
+{
+    A::count(g_null, GLEntry::MapBufferRange);
+    std::vector<uint8_t>& memory = A::memory(A::bound(target));
+    if (memory.size() < size_t(offset + length)) {
+        memory.resize(size_t(offset + length));
+    }
+    return memory.data() + offset;
+}
+
+GLboolean APIENTRY unmapBuffer(GLenum)
+{
+    A::count(g_null, GLEntry::UnmapBuffer);
+    return GL_TRUE;
+}
+
+// timestamps are CPU time at the call, so GPU timers measure the CPU side
+void APIENTRY queryCounter(GLuint id, GLenum)
+{
+    A::count(g_null, GLEntry::QueryCounter);
+    A::query(id) = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void APIENTRY getQueryObjectiv(GLuint id, GLenum pname, GLint* params)
+{
+    A::count(g_null, GLEntry::GetQueryObjectiv);
+    *params = pname == GL_QUERY_RESULT_AVAILABLE ? GL_TRUE : GLint(A::query(id));
+}
+
+void APIENTRY getQueryObjectui64v(GLuint id, GLenum, GLuint64* params)
+{
+    A::count(g_null, GLEntry::GetQueryObjectui64v);
+    *params = A::query(id);
+}
+
+void APIENTRY enable(GLenum cap)
+{
+    A::count(g_null, GLEntry::Enable);
+    A::enabled(cap) = true;
+}
+
+void APIENTRY disable(GLenum cap)
+{
+    A::count(g_null, GLEntry::Disable);
+    A::enabled(cap) = false;
+}
+
+GLboolean APIENTRY isEnabled(GLenum cap)
+{
+    A::count(g_null, GLEntry::IsEnabled);
+    return A::enabled(cap) ? GL_TRUE : GL_FALSE;
+}
+
+// into client memory the pixels are black, into a pack buffer nothing happens
+void APIENTRY readPixels(GLint, GLint, GLsizei width, GLsizei height, GLenum format, GLenum, void* pixels)
+{
+    A::count(g_null, GLEntry::ReadPixels);
+    if (!A::bound(GL_PIXEL_PACK_BUFFER) && pixels) {
+        size_t channels = format == GL_RGBA || format == GL_BGRA ? 4 : format == GL_RGB || format == GL_BGR ? 3 : 4;
+        memset(pixels, 0, size_t(width) * height * channels);
+    }
+}
+
+}
+
+}
+
+GLBackend::GLBackend(Kind kind)
+    : m_kind(kind), m_counts(EntryCount, 0)
+{
+}
+
+GLBackend::~GLBackend()
+{
+    uninstall();
+}
+
+void GLBackend::install()
+{
+    GLBackend*& slot = m_kind == Kind::Null ? g_null : g_trace;
+    if (m_installed || slot) {
+        return;
+    }
+    slot = this;
+    m_saved.resize(EntryCount);
+    for (size_t i = 0; i < EntryCount; ++i) {
+        m_saved[i] = Entries[i].get();
+        if (m_kind == Kind::Null) {
+            Entries[i].null();
+        } else {
+            Entries[i].trace();
+        }
+    }
+
+    if (m_kind == Kind::Null) {
+        glad_glGenBuffers = nullgl::genBuffers;
+        glad_glGenTextures = nullgl::genTextures;
+        glad_glGenVertexArrays = nullgl::genVertexArrays;
+        glad_glGenFramebuffers = nullgl::genFramebuffers;
+        glad_glGenQueries = nullgl::genQueries;
+        glad_glCreateShader = nullgl::createShader;
+        glad_glCreateProgram = nullgl::createProgram;
+        glad_glGetShaderiv = nullgl::getShaderiv;
+        glad_glGetProgramiv = nullgl::getProgramiv;
+        glad_glGetShaderInfoLog = nullgl::getShaderInfoLog;
+        glad_glGetProgramInfoLog = nullgl::getProgramInfoLog;
+        glad_glGetIntegerv = nullgl::getIntegerv;
+        glad_glGetUniformLocation = nullgl::getUniformLocation;
+        glad_glCheckFramebufferStatus = nullgl::checkFramebufferStatus;
+        glad_glFenceSync = nullgl::fenceSync;
+        glad_glClientWaitSync = nullgl::clientWaitSync;
+        glad_glBindBuffer = nullgl::bindBuffer;
+        glad_glBufferData = nullgl::bufferData;
+        glad_glBufferStorage = nullgl::bufferStorage;
+        glad_glMapBufferRange = nullgl::mapBufferRange;
+        glad_glUnmapBuffer = nullgl::unmapBuffer;
+        glad_glQueryCounter = nullgl::queryCounter;
+        glad_glGetQueryObjectiv = nullgl::getQueryObjectiv;
+        glad_glGetQueryObjectui64v = nullgl::getQueryObjectui64v;
+        glad_glEnable = nullgl::enable;
+        glad_glDisable = nullgl::disable;
+        glad_glIsEnabled = nullgl::isEnabled;
+        glad_glReadPixels = nullgl::readPixels;
+
+        m_savedFlags.clear();
+        for (int* flag : Flags) {
+            m_savedFlags.push_back(*flag);
+        }
+        if (!GLAD_GL_VERSION_1_0) {
+            for (int* flag : Flags) {
+                *flag = 1;
+            }
+        }
+    }
+    m_installed = true;
+}
+
+void GLBackend::uninstall()
+{
+    if (!m_installed) {
+        return;
+    }
+    for (size_t i = 0; i < EntryCount; ++i) {
+        Entries[i].set(m_saved[i]);
+    }
+    if (m_kind == Kind::Null) {
+        for (size_t i = 0; i < m_savedFlags.size(); ++i) {
+            *Flags[i] = m_savedFlags[i];
+        }
+        g_null = nullptr;
+    } else {
+        g_trace = nullptr;
+    }
+    m_installed = false;
+}
+
+size_t GLBackend::entryCount()
+{
+    return EntryCount;
+}
+
+const char* GLBackend::entryName(size_t entry)
+{
+    return Entries[entry].name;
+}
+
+void GLBackend::resetCounts()
+{
+    std::fill(m_counts.begin(), m_counts.end(), 0);
+    m_total = 0;
+}
+
+std::string GLBackend::summary(size_t top) const
+{
+    std::vector<size_t> order;
+    for (size_t i = 0; i < EntryCount; ++i) {
+        if (m_counts[i]) {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return m_counts[a] > m_counts[b] || (m_counts[a] == m_counts[b] && a < b);
+    });
+    std::string text;
+    for (size_t i = 0; i < std::min(top, order.size()); ++i) {
+        text += (i ? ", " : "") + std::string(Entries[order[i]].name) + " " + std::to_string(m_counts[order[i]]);
+    }
+    return text;
+}
@@ -0,0 +1,891 @@
+#include "gltrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "glad/glad.h"
+
+namespace {
+
+const char Magic[4] = { 'G', 'L', 'T', 'R' };
+const uint8_t Version = 1;
+const size_t EntryCount = size_t(GLEntry::Count);
+const size_t MaxArgs = 12;
+// the recorder writes to the file in chunks of about this size
+const size_t FlushBytes = 1 << 20;
+
+// What the result and each argument of an entry point are, result first:
+//   -  nothing (no result)       i  integer                f  float
+//   o  offset into a buffer      x  written by GL, not recorded
+//   b t v g q p s  a buffer, texture, vertex array, framebuffer, query, shader or program, sync
+//   B T V G Q  as many of those as the argument before says
+//   l  uniform location          k  uniform block index
+//   d  client memory read by GL, its size from the other arguments
+//   n  a string                  S  as many strings as the argument before says
+//   z  lengths of the strings    r  pixels read back, an offset with a pack buffer bound
+//   u  the target of an unmap, with what was written to its mapping
+//   m  (result) a mapping
+#define GL_TRACE_SIGNATURES(X) \
+    X(ActiveTexture, "-i") X(AttachShader, "-pp") X(BindBuffer, "-ib") X(BindBufferBase, "-iib") \
+    X(BindFramebuffer, "-ig") X(BindImageTexture, "-itiiiii") X(BindTexture, "-it") \
+    X(BindTextures, "-iiT") X(BindVertexArray, "-v") X(BlendFunc, "-ii") X(BufferData, "-iodi") \
+    X(BufferStorage, "-iodi") X(BufferSubData, "-iood") X(CheckFramebufferStatus, "ii") \
+    X(Clear, "-i") X(ClearBufferData, "-iiiid") X(ClearColor, "-ffff") X(ClientWaitSync, "isii") \
+    X(CompileShader, "-p") X(CreateProgram, "p") X(CreateShader, "pi") X(DeleteBuffers, "-iB") \
+    X(DeleteQueries, "-iQ") X(DeleteShader, "-p") X(DeleteSync, "-s") X(DeleteTextures, "-iT") \
+    X(DeleteVertexArrays, "-iV") X(Disable, "-i") X(DispatchCompute, "-iii") X(DrawArrays, "-iii") \
+    X(DrawArraysInstanced, "-iiii") X(DrawElements, "-iiio") X(DrawElementsBaseVertex, "-iiioi") \
+    X(Enable, "-i") X(EnableVertexAttribArray, "-i") X(FenceSync, "sii") \
+    X(FramebufferTexture2D, "-iiiti") X(GenBuffers, "-iB") X(GenFramebuffers, "-iG") \
+    X(GenQueries, "-iQ") X(GenTextures, "-iT") X(GenVertexArrays, "-iV") X(GenerateMipmap, "-i") \
+    X(GetIntegerv, "-ix") X(GetProgramInfoLog, "-pixx") X(GetProgramiv, "-pix") \
+    X(GetQueryObjectiv, "-qix") X(GetQueryObjectui64v, "-qix") X(GetShaderInfoLog, "-pixx") \
+    X(GetShaderiv, "-pix") X(GetUniformBlockIndex, "kpn") X(GetUniformLocation, "lpn") \
+    X(IsEnabled, "ii") X(LinkProgram, "-p") X(MapBufferRange, "miooi") X(MemoryBarrier, "-i") \
+    X(MultiDrawElementsIndirect, "-iioii") X(PixelStorei, "-ii") X(PolygonMode, "-ii") \
+    X(QueryCounter, "-qi") X(ReadPixels, "-iiiiiir") X(ShaderSource, "-piSz") X(TexBuffer, "-iib") \
+    X(TexImage2D, "-iiiiiiiid") X(TexImage3D, "-iiiiiiiiid") X(TexParameteri, "-iii") \
+    X(TexStorage2D, "-iiiii") X(TexSubImage3D, "-iiiiiiiiiid") X(Uniform1f, "-lf") \
+    X(Uniform1i, "-li") X(Uniform2f, "-lff") X(Uniform2fv, "-lid") X(Uniform2i, "-lii") \
+    X(Uniform2uiv, "-lid") X(Uniform3f, "-lfff") X(Uniform3fv, "-lid") X(Uniform4f, "-lffff") \
+    X(Uniform4fv, "-lid") X(UniformBlockBinding, "-pki") X(UniformMatrix2fv, "-liid") \
+    X(UniformMatrix3fv, "-liid") X(UniformMatrix4fv, "-liid") X(UnmapBuffer, "iu") \
+    X(UseProgram, "-p") X(VertexAttribDivisor, "-ii") X(VertexAttribIPointer, "-iiiio") \
+    X(VertexAttribPointer, "-iiiiio") X(Viewport, "-iiii")
+
+template <class F>
+struct Arity;
+
+template <class R, class... A>
+struct Arity<R (APIENTRY*)(A...)> {
+    static const size_t value = sizeof...(A);
+};
+
+// arguments travel as 64 bit slots: integers extended, floats as their bits, pointers as
+// addresses
+template <class T>
+uint64_t toSlot(T v)
+{
+    if constexpr (std::is_pointer_v<T>) {
+        return uint64_t(uintptr_t(v));
+    } else if constexpr (std::is_floating_point_v<T>) {
+        float f = float(v);
+        uint32_t bits;
+        memcpy(&bits, &f, 4);
+        return bits;
+    } else {
+        return uint64_t(v);
+    }
+}
+
+template <class T>
+T fromSlot(uint64_t slot)
+{
+    if constexpr (std::is_pointer_v<T>) {
+        return reinterpret_cast<T>(uintptr_t(slot));
+    } else if constexpr (std::is_floating_point_v<T>) {
+        uint32_t bits = uint32_t(slot);
+        float f;
+        memcpy(&f, &bits, 4);
+        return T(f);
+    } else {
+        return T(slot);
+    }
+}
+
+template <class R, class... A, size_t... I>
+uint64_t invokeWith(R (APIENTRY* fn)(A...), const uint64_t* slots, std::index_sequence<I...>)
+{
+    if constexpr (std::is_void_v<R>) {
+        fn(fromSlot<A>(slots[I])...);
+        return 0;
+    } else {
+        return toSlot(fn(fromSlot<A>(slots[I])...));
+    }
+}
+
+template <class R, class... A>
+uint64_t invoke(R (APIENTRY* fn)(A...), const uint64_t* slots)
+{
+    return invokeWith(fn, slots, std::index_sequence_for<A...>());
+}
+
+struct EntryInfo {
+    const char* signature;
+    void (*hook)();
+    void (*set)(void (*)());
+    void (*(*get)())();
+    uint64_t (*play)(const uint64_t* slots);
+};
+
+void putVarint(std::vector<uint8_t>& out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out.push_back(uint8_t(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(uint8_t(v));
+}
+
+void putZigzag(std::vector<uint8_t>& out, uint64_t slot)
+{
+    int64_t v = int64_t(slot);
+    putVarint(out, (uint64_t(v) << 1) ^ uint64_t(v >> 63));
+}
+
+void putBytes(std::vector<uint8_t>& out, const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v)
+{
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool getZigzag(const uint8_t*& p, const uint8_t* end, uint64_t& slot)
+{
+    uint64_t v;
+    if (!getVarint(p, end, v)) {
+        return false;
+    }
+    slot = (v >> 1) ^ (~(v & 1) + 1);
+    return true;
+}
+
+// bytes of one pixel of format and type
+size_t texelSize(uint64_t format, uint64_t type)
+{
+    switch (type) {
+    case GL_UNSIGNED_SHORT_5_6_5:
+    case GL_UNSIGNED_SHORT_4_4_4_4:
+    case GL_UNSIGNED_SHORT_5_5_5_1:
+        return 2;
+    case GL_UNSIGNED_INT_8_8_8_8:
+    case GL_UNSIGNED_INT_8_8_8_8_REV:
+    case GL_UNSIGNED_INT_2_10_10_10_REV:
+    case GL_UNSIGNED_INT_24_8:
+    case GL_UNSIGNED_INT_10F_11F_11F_REV:
+        return 4;
+    case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+        return 8;
+    }
+    size_t channels = 1;
+    switch (format) {
+    case GL_RG:
+    case GL_RG_INTEGER:
+        channels = 2;
+        break;
+    case GL_RGB:
+    case GL_BGR:
+    case GL_RGB_INTEGER:
+        channels = 3;
+        break;
+    case GL_RGBA:
+    case GL_BGRA:
+    case GL_RGBA_INTEGER:
+        channels = 4;
+        break;
+    }
+    size_t bytes = 1;
+    switch (type) {
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+    case GL_HALF_FLOAT:
+        bytes = 2;
+        break;
+    case GL_INT:
+    case GL_UNSIGNED_INT:
+    case GL_FLOAT:
+        bytes = 4;
+        break;
+    }
+    return channels * bytes;
+}
+
+// rows padded to alignment, all but the last
+size_t imageSize(uint64_t width, uint64_t height, uint64_t depth, uint64_t format, uint64_t type, int alignment)
+{
+    if (!width || !height || !depth) {
+        return 0;
+    }
+    size_t row = size_t(width) * texelSize(format, type);
+    size_t stride = (row + alignment - 1) / alignment * alignment;
+    return stride * size_t(height * depth - 1) + row;
+}
+
+// size of the 'd' argument of entry
+size_t payloadSize(GLEntry entry, const uint64_t* s, int unpackAlignment)
+{
+    switch (entry) {
+    case GLEntry::BufferData:
+    case GLEntry::BufferStorage:
+        return size_t(s[1]);
+    case GLEntry::BufferSubData:
+        return size_t(s[2]);
+    case GLEntry::ClearBufferData:
+        return texelSize(s[2], s[3]);
+    case GLEntry::TexImage2D:
+        return imageSize(s[3], s[4], 1, s[6], s[7], unpackAlignment);
+    case GLEntry::TexImage3D:
+        return imageSize(s[3], s[4], s[5], s[7], s[8], unpackAlignment);
+    case GLEntry::TexSubImage3D:
+        return imageSize(s[5], s[6], s[7], s[8], s[9], unpackAlignment);
+    case GLEntry::Uniform2fv:
+    case GLEntry::Uniform2uiv:
+        return size_t(s[1]) * 8;
+    case GLEntry::Uniform3fv:
+        return size_t(s[1]) * 12;
+    case GLEntry::Uniform4fv:
+    case GLEntry::UniformMatrix2fv:
+        return size_t(s[1]) * 16;
+    case GLEntry::UniformMatrix3fv:
+        return size_t(s[1]) * 36;
+    case GLEntry::UniformMatrix4fv:
+        return size_t(s[1]) * 64;
+    default:
+        return 0;
+    }
+}
+
+// kinds of names the player maps, indices into m_names
+int nameKind(char code)
+{
+    switch (code) {
+    case 'b': case 'B': return 0;
+    case 't': case 'T': return 1;
+    case 'v': case 'V': return 2;
+    case 'g': case 'G': return 3;
+    case 'q': case 'Q': return 4;
+    case 'p': return 5;
+    case 's': return 6;
+    case 'l': case 'k': return 7;
+    default: return -1;
+    }
+}
+
+bool isGen(GLEntry entry)
+{
+    return entry == GLEntry::GenBuffers || entry == GLEntry::GenFramebuffers || entry == GLEntry::GenQueries
+        || entry == GLEntry::GenTextures || entry == GLEntry::GenVertexArrays;
+}
+
+// locations and block indices are per program
+uint64_t uniformKey(char code, uint64_t program, uint64_t value)
+{
+    return (code == 'k' ? uint64_t(1) << 63 : 0) | (program << 32) | uint32_t(value);
+}
+
+GLTraceRecorder* g_recorder = nullptr;
+
+}
+
+struct GLTraceAccess
+{
+    // encodes a call from its argument slots and result
+    static void record(GLEntry entry, const uint64_t* s, uint64_t result);
+};
+
+namespace {
+
+template <GLEntry Id, class F>
+struct Hook;
+
+template <GLEntry Id, class R, class... A>
+struct Hook<Id, R (APIENTRY*)(A...)>
+{
+    static inline R (APIENTRY* next)(A...) = nullptr;
+
+    static R APIENTRY capture(A... a)
+    {
+        uint64_t slots[sizeof...(A) + 1] = { toSlot(a)... };
+        if constexpr (Id == GLEntry::UnmapBuffer) {
+            // the mapping is gone after the call
+            GLTraceAccess::record(Id, slots, 0);
+            return next(a...);
+        } else if constexpr (std::is_void_v<R>) {
+            next(a...);
+            GLTraceAccess::record(Id, slots, 0);
+        } else {
+            R r = next(a...);
+            GLTraceAccess::record(Id, slots, toSlot(r));
+            return r;
+        }
+    }
+};
+
+#define GL_TRACE_INFO(name, sig) \
+    static_assert(Arity<decltype(glad_gl##name)>::value + 2 == sizeof(sig), "signature of gl" #name); \
+    info[size_t(GLEntry::name)] = { sig, \
+        []() { Hook<GLEntry::name, decltype(glad_gl##name)>::next = glad_gl##name; glad_gl##name = &Hook<GLEntry::name, decltype(glad_gl##name)>::capture; }, \
+        [](void (*f)()) { glad_gl##name = reinterpret_cast<decltype(glad_gl##name)>(f); }, \
+        []() { return reinterpret_cast<void (*)()>(glad_gl##name); }, \
+        [](const uint64_t* slots) { return invoke(glad_gl##name, slots); } };
+
+const EntryInfo* entries()
+{
+    static const std::vector<EntryInfo> table = []() {
+        std::vector<EntryInfo> info(EntryCount, EntryInfo{ nullptr, nullptr, nullptr, nullptr, nullptr });
+        GL_TRACE_SIGNATURES(GL_TRACE_INFO)
+        return info;
+    }();
+    return table.data();
+}
+
+}
+
+void GLTraceAccess::record(GLEntry entry, const uint64_t* s, uint64_t result)
+{
+    GLTraceRecorder& r = *g_recorder;
+    std::vector<uint8_t>& out = r.m_buffer;
+    const char* sig = entries()[size_t(entry)].signature;
+    putVarint(out, uint64_t(entry));
+    for (size_t i = 0; sig[i + 1]; ++i) {
+        char code = sig[i + 1];
+        switch (code) {
+        case 'f': {
+            uint32_t bits = uint32_t(s[i]);
+            putBytes(out, &bits, 4);
+            break;
+        }
+        case 'o':
+        case 'r':
+        case 'b': case 't': case 'v': case 'g': case 'q': case 'p': case 's':
+            putVarint(out, s[i]);
+            break;
+        case 'B': case 'T': case 'V': case 'G': case 'Q': {
+            const GLuint* names = fromSlot<const GLuint*>(s[i]);
+            for (uint64_t j = 0; j < uint32_t(s[i - 1]); ++j) {
+                putVarint(out, names ? names[j] : 0);
+            }
+            break;
+        }
+        case 'd': {
+            const void* data = fromSlot<const void*>(s[i]);
+            size_t size = payloadSize(entry, s, r.m_unpackAlignment);
+            putVarint(out, data ? size + 1 : 0);
+            if (data) {
+                putBytes(out, data, size);
+            }
+            break;
+        }
+        case 'n': {
+            const char* text = fromSlot<const char*>(s[i]);
+            size_t length = strlen(text);
+            putVarint(out, length);
+            putBytes(out, text, length);
+            break;
+        }
+        case 'S': {
+            const GLchar* const* strings = fromSlot<const GLchar* const*>(s[i]);
+            const GLint* lengths = fromSlot<const GLint*>(s[i + 1]);
+            for (uint64_t j = 0; j < uint32_t(s[i - 1]); ++j) {
+                size_t length = lengths && lengths[j] >= 0 ? size_t(lengths[j]) : strlen(strings[j]);
+                putVarint(out, length);
+                putBytes(out, strings[j], length);
+            }
+            break;
+        }
+        case 'u': {
+            putZigzag(out, s[i]);
+            auto it = r.m_mappings.find(uint32_t(s[i]));
+            bool written = it != r.m_mappings.end() && it->second.write && it->second.data;
+            putVarint(out, written ? it->second.length + 1 : 0);
+            if (written) {
+                putBytes(out, it->second.data, it->second.length);
+            }
+            if (it != r.m_mappings.end()) {
+                r.m_mappings.erase(it);
+            }
+            break;
+        }
+        case 'x':
+        case 'z':
+            break;
+        default:
+            putZigzag(out, s[i]);
+            break;
+        }
+    }
+    switch (sig[0]) {
+    case 'p':
+    case 's':
+        putVarint(out, result);
+        break;
+    case 'l':
+    case 'k':
+        putZigzag(out, result);
+        break;
+    }
+
+    if (entry == GLEntry::PixelStorei && s[0] == GL_UNPACK_ALIGNMENT) {
+        r.m_unpackAlignment = std::max(1, int(s[1]));
+    } else if (entry == GLEntry::MapBufferRange) {
+        GLTraceRecorder::Mapping& m = r.m_mappings[uint32_t(s[0])];
+        m.data = fromSlot<const uint8_t*>(result);
+        m.length = size_t(s[2]);
+        m.write = (s[3] & GL_MAP_WRITE_BIT) != 0;
+    }
+    r.m_calls++;
+    if (out.size() >= FlushBytes) {
+        r.flush();
+    }
+}
+
+GLTraceRecorder::~GLTraceRecorder()
+{
+    close();
+}
+
+bool GLTraceRecorder::open(const std::string& path)
+{
+    if (m_file || g_recorder) {
+        return false;
+    }
+    m_file = fopen(path.c_str(), "wb");
+    if (!m_file) {
+        return false;
+    }
+    m_failed = false;
+    m_calls = 0;
+    m_markers = 0;
+    m_bytes = 0;
+    m_unpackAlignment = 4;
+    m_mappings.clear();
+    m_buffer.clear();
+    m_buffer.insert(m_buffer.end(), Magic, Magic + 4);
+    m_buffer.push_back(Version);
+    putVarint(m_buffer, EntryCount);
+
+    g_recorder = this;
+    const EntryInfo* info = entries();
+    m_saved.resize(EntryCount);
+    for (size_t i = 0; i < EntryCount; ++i) {
+        m_saved[i] = info[i].get();
+        info[i].hook();
+    }
+    return true;
+}
+
+void GLTraceRecorder::frame()
+{
+    if (!m_file) {
+        return;
+    }
+    putVarint(m_buffer, EntryCount);
+    m_markers++;
+    flush();
+}
+
+void GLTraceRecorder::flush()
+{
+    if (m_buffer.empty()) {
+        return;
+    }
+    if (fwrite(m_buffer.data(), 1, m_buffer.size(), m_file) != m_buffer.size()) {
+        m_failed = true;
+    }
+    m_bytes += m_buffer.size();
+    m_buffer.clear();
+}
+
+bool GLTraceRecorder::close()
+{
+    if (!m_file) {
+        return !m_failed;
+    }
+    const EntryInfo* info = entries();
+    for (size_t i = 0; i < EntryCount; ++i) {
+        info[i].set(m_saved[i]);
+    }
+    g_recorder = nullptr;
+    flush();
+    if (fclose(m_file) != 0) {
+        m_failed = true;
+    }
+    m_file = nullptr;
+    return !m_failed;
+}
+
+bool GLTracePlayer::load(const std::string& path)
+{
+    m_data.clear();
+    m_frames.clear();
+    m_callCount = 0;
+    resetStats();
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp) {
+        return false;
+    }
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        m_data.insert(m_data.end(), buffer, buffer + n);
+    }
+    fclose(fp);
+
+    const uint8_t* p = m_data.data();
+    const uint8_t* end = p + m_data.size();
+    uint64_t entryCount;
+    if (m_data.size() < 6 || memcmp(p, Magic, 4) != 0 || p[4] != Version) {
+        return false;
+    }
+    p += 5;
+    // a trace of a later build may call entry points this one doesn't know
+    if (!getVarint(p, end, entryCount) || entryCount > EntryCount) {
+        return false;
+    }
+    m_marker = entryCount;
+    m_setupBegin = size_t(p - m_data.data());
+
+    // find the frames: each starts after a marker and has to end in one
+    const EntryInfo* info = entries();
+    std::vector<size_t> starts;
+    while (p < end) {
+        uint64_t entry;
+        if (!getVarint(p, end, entry) || entry > m_marker) {
+            return false;
+        }
+        if (entry == m_marker) {
+            starts.push_back(size_t(p - m_data.data()));
+            continue;
+        }
+        m_callCount++;
+        const char* sig = info[entry].signature;
+        uint64_t previous = 0;
+        for (size_t i = 0; sig[i + 1]; ++i) {
+            char code = sig[i + 1];
+            uint64_t v = 0;
+            bool ok = true;
+            switch (code) {
+            case 'f':
+                ok = end - p >= 4;
+                p += ok ? 4 : 0;
+                break;
+            case 'x':
+            case 'z':
+                break;
+            case 'B': case 'T': case 'V': case 'G': case 'Q':
+                for (uint64_t j = 0; ok && j < uint32_t(previous); ++j) {
+                    ok = getVarint(p, end, v);
+                }
+                break;
+            case 'n':
+            case 'd':
+            case 'u':
+                if (code == 'u') {
+                    ok = getZigzag(p, end, v);
+                }
+                ok = ok && getVarint(p, end, v);
+                if (ok && code != 'n') {
+                    v = v ? v - 1 : 0;
+                }
+                ok = ok && uint64_t(end - p) >= v;
+                p += ok ? size_t(v) : 0;
+                break;
+            case 'S':
+                for (uint64_t j = 0; ok && j < uint32_t(previous); ++j) {
+                    ok = getVarint(p, end, v) && uint64_t(end - p) >= v;
+                    p += ok ? size_t(v) : 0;
+                }
+                break;
+            default:
+                ok = getVarint(p, end, v);
+                if (ok && nameKind(code) < 0 && code != 'o' && code != 'r') {
+                    v = (v >> 1) ^ (~(v & 1) + 1);
+                }
+                break;
+            }
+            if (!ok) {
+                return false;
+            }
+            previous = v;
+        }
+        uint64_t result;
+        if ((sig[0] == 'p' || sig[0] == 's' || sig[0] == 'l' || sig[0] == 'k') && !getVarint(p, end, result)) {
+            return false;
+        }
+    }
+    if (!starts.empty()) {
+        starts.pop_back();
+    }
+    m_frames = std::move(starts);
+    return true;
+}
+
+void GLTracePlayer::resetStats()
+{
+    m_stats = Stats();
+    m_stats.calls.assign(EntryCount, 0);
+    m_stats.ns.assign(EntryCount, 0.0);
+}
+
+bool GLTracePlayer::playSetup()
+{
+    auto start = std::chrono::steady_clock::now();
+    bool ok = m_setupBegin && play(m_setupBegin, false);
+    m_stats.setupMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return ok;
+}
+
+bool GLTracePlayer::playFrame(size_t frame)
+{
+    return frame < m_frames.size() && play(m_frames[frame], true);
+}
+
+bool GLTracePlayer::play(size_t begin, bool timed)
+{
+    using Clock = std::chrono::steady_clock;
+    const EntryInfo* info = entries();
+    const uint8_t* p = m_data.data() + begin;
+    const uint8_t* end = m_data.data() + m_data.size();
+
+    uint64_t recorded[MaxArgs];
+    uint64_t slots[MaxArgs];
+    std::vector<GLuint> names;
+    std::vector<const GLchar*> strings;
+    std::vector<GLint> lengths;
+    std::vector<std::string> texts;
+    texts.reserve(4);
+    while (p < end) {
+        uint64_t e;
+        if (!getVarint(p, end, e) || e > m_marker) {
+            return false;
+        }
+        if (e == m_marker) {
+            return true;
+        }
+        GLEntry entry = GLEntry(e);
+        const char* sig = info[e].signature;
+        uint64_t program = m_program;
+        bool programSet = false;
+        const uint8_t* unmapData = nullptr;
+        size_t unmapSize = 0;
+        texts.clear();
+        names.clear();
+
+        for (size_t i = 0; sig[i + 1]; ++i) {
+            char code = sig[i + 1];
+            uint64_t v = 0;
+            bool ok = true;
+            switch (code) {
+            case 'f': {
+                uint32_t bits = 0;
+                ok = end - p >= 4;
+                if (ok) {
+                    memcpy(&bits, p, 4);
+                    p += 4;
+                }
+                recorded[i] = slots[i] = bits;
+                break;
+            }
+            case 'o':
+                ok = getVarint(p, end, v);
+                recorded[i] = slots[i] = v;
+                break;
+            case 'r': {
+                ok = getVarint(p, end, v);
+                recorded[i] = v;
+                GLint pack = 0;
+                glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &pack);
+                if (pack) {
+                    slots[i] = v;
+                } else {
+                    m_scratch.resize(std::max(m_scratch.size(), imageSize(slots[2], slots[3], 1, slots[4], slots[5], m_packAlignment)));
+                    slots[i] = toSlot(m_scratch.data());
+                }
+                break;
+            }
+            case 'x':
+                m_scratch.resize(std::max<size_t>(m_scratch.size(), 65536));
+                recorded[i] = slots[i] = toSlot(m_scratch.data());
+                break;
+            case 'B': case 'T': case 'V': case 'G': case 'Q': {
+                auto& map = m_names[nameKind(code)];
+                size_t count = uint32_t(recorded[i - 1]);
+                size_t first = names.size();
+                for (size_t j = 0; ok && j < count; ++j) {
+                    ok = getVarint(p, end, v);
+                    auto it = map.find(v);
+                    names.push_back(GLuint(isGen(entry) || it == map.end() ? v : it->second));
+                }
+                recorded[i] = first;
+                slots[i] = 0;
+                break;
+            }
+            case 'd':
+            case 'n':
+            case 'u': {
+                if (code == 'u') {
+                    ok = getZigzag(p, end, v);
+                    recorded[i] = slots[i] = v;
+                }
+                uint64_t size = 0;
+                ok = ok && getVarint(p, end, size);
+                bool present = code == 'n' || size > 0;
+                if (code != 'n' && size) {
+                    size--;
+                }
+                ok = ok && uint64_t(end - p) >= size;
+                if (!ok) {
+                    break;
+                }
+                if (code == 'n') {
+                    texts.emplace_back(reinterpret_cast<const char*>(p), size_t(size));
+                    recorded[i] = slots[i] = toSlot(texts.back().c_str());
+                } else if (code == 'u') {
+                    unmapData = present ? p : nullptr;
+                    unmapSize = size_t(size);
+                } else {
+                    recorded[i] = slots[i] = present ? toSlot(p) : 0;
+                }
+                p += size_t(size);
+                break;
+            }
+            case 'S': {
+                size_t count = uint32_t(recorded[i - 1]);
+                strings.clear();
+                lengths.clear();
+                for (size_t j = 0; ok && j < count; ++j) {
+                    ok = getVarint(p, end, v) && uint64_t(end - p) >= v;
+                    if (ok) {
+                        strings.push_back(reinterpret_cast<const GLchar*>(p));
+                        lengths.push_back(GLint(v));
+                        p += size_t(v);
+                    }
+                }
+                recorded[i] = slots[i] = toSlot(strings.data());
+                break;
+            }
+            case 'z':
+                recorded[i] = slots[i] = toSlot(lengths.data());
+                break;
+            default: {
+                int kind = nameKind(code);
+                ok = code == 'l' || code == 'k' || kind < 0 ? getZigzag(p, end, v) : getVarint(p, end, v);
+                recorded[i] = v;
+                if (code == 'p' && !programSet) {
+                    // the program the uniforms of this call belong to
+                    program = v;
+                    programSet = true;
+                }
+                if (code == 'l' || code == 'k') {
+                    auto it = m_names[kind].find(uniformKey(code, program, v));
+                    slots[i] = it == m_names[kind].end() ? v : it->second;
+                } else if (kind >= 0) {
+                    auto it = m_names[kind].find(v);
+                    slots[i] = it == m_names[kind].end() ? v : it->second;
+                } else {
+                    slots[i] = v;
+                }
+                break;
+            }
+            }
+            if (!ok) {
+                return false;
+            }
+        }
+        // arrays last, names may have grown while they were read
+        for (size_t i = 0; sig[i + 1]; ++i) {
+            char c = sig[i + 1];
+            if (c == 'B' || c == 'T' || c == 'V' || c == 'G' || c == 'Q') {
+                slots[i] = toSlot(names.data() + recorded[i]);
+            }
+        }
+        std::vector<GLuint> generated;
+        if (isGen(entry)) {
+            generated.assign(names.begin(), names.end());
+            slots[1] = toSlot(generated.data());
+        }
+        uint64_t recordedResult = 0;
+        if (sig[0] == 'p' || sig[0] == 's') {
+            if (!getVarint(p, end, recordedResult)) {
+                return false;
+            }
+        } else if (sig[0] == 'l' || sig[0] == 'k') {
+            if (!getZigzag(p, end, recordedResult)) {
+                return false;
+            }
+        }
+        if (unmapData) {
+            auto it = m_mappings.find(uint32_t(slots[0]));
+            if (it != m_mappings.end() && it->second) {
+                memcpy(it->second, unmapData, unmapSize);
+            }
+        }
+
+        uint64_t result;
+        if (timed) {
+            auto start = Clock::now();
+            result = info[e].play(slots);
+            m_stats.ns[e] += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+            m_stats.calls[e]++;
+        } else {
+            result = info[e].play(slots);
+        }
+
+        // what this driver returned, for the calls after
+        switch (sig[0]) {
+        case 'p':
+        case 's':
+            m_names[nameKind(sig[0])][recordedResult] = result;
+            break;
+        case 'l':
+        case 'k':
+            m_names[7][uniformKey(sig[0], program, recordedResult)] = uint32_t(result);
+            break;
+        case 'm':
+            m_mappings[uint32_t(slots[0])] = fromSlot<void*>(result);
+            break;
+        }
+        if (isGen(entry)) {
+            auto& map = m_names[nameKind(sig[2])];
+            for (size_t j = 0; j < names.size(); ++j) {
+                map[names[j]] = generated[j];
+            }
+        }
+        if (entry == GLEntry::UseProgram) {
+            m_program = recorded[0];
+        } else if (entry == GLEntry::UnmapBuffer) {
+            m_mappings.erase(uint32_t(slots[0]));
+        } else if (entry == GLEntry::PixelStorei && slots[0] == GL_PACK_ALIGNMENT) {
+            m_packAlignment = std::max(1, int(slots[1]));
+        }
+    }
+    return true;
+}
+
+std::string GLTracePlayer::report(size_t top) const
+{
+    std::vector<size_t> order;
+    double total = 0.0;
+    for (size_t i = 0; i < EntryCount; ++i) {
+        if (m_stats.calls[i]) {
+            order.push_back(i);
+            total += m_stats.ns[i];
+        }
+    }
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) { return m_stats.ns[a] > m_stats.ns[b]; });
+    std::string text;
+    char line[160];
+    for (size_t i = 0; i < std::min(top, order.size()); ++i) {
+        size_t e = order[i];
+        snprintf(line, sizeof(line), "%-28s %10llu calls %10.3f ms %8.1f ns/call %5.1f%%\n", GLBackend::entryName(e),
+            (unsigned long long)m_stats.calls[e], m_stats.ns[e] * 1e-6, m_stats.ns[e] / m_stats.calls[e], total > 0.0 ? 100.0 * m_stats.ns[e] / total : 0.0);
+        text += line;
+    }
+    return text;
+}
@@ -0,0 +1,288 @@
+#include "glad/glad.h"
+#include "gpucull.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <string>
+
+namespace {
+
+// same as OcclusionCuller
+const float kNearW = 1e-5f;
+
+// shader storage bindings of cull.comp besides MultiDrawBuffers::DrawDataBinding
+enum CullBinding : unsigned
+{
+    BindCommands = 2,
+    BindDraws = 3,
+    BindInputs = 4,
+    BindBatches = 5,
+    BindCounters = 6,
+    BindOutCommands = 7,
+};
+
+int nextPowerOfTwo(int v)
+{
+    int p = 1;
+    while (p < v) {
+        p <<= 1;
+    }
+    return p;
+}
+
+// orphans buffer and fills it with size bytes of data
+void uploadStorage(unsigned int buffer, const void* data, size_t size)
+{
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, data);
+}
+
+}
+
+bool GpuCuller::supported()
+{
+    return GLAD_GL_VERSION_4_3;
+}
+
+GpuCuller::GpuCuller() = default;
+
+GpuCuller::~GpuCuller()
+{
+    if (m_inputs[0]) {
+        glDeleteBuffers(4, m_inputs);
+        glDeleteBuffers(1, &m_counters);
+    }
+    if (m_pyramid) {
+        glDeleteTextures(1, &m_pyramid);
+    }
+}
+
+std::vector<glm::ivec2> GpuCuller::pyramidSizes(int width, int height)
+{
+    std::vector<glm::ivec2> sizes;
+    glm::ivec2 size(std::max(1, nextPowerOfTwo(width) / 2), std::max(1, nextPowerOfTwo(height) / 2));
+    sizes.push_back(size);
+    while (size.x > 1 || size.y > 1) {
+        size = glm::ivec2(std::max(1, size.x / 2), std::max(1, size.y / 2));
+        sizes.push_back(size);
+    }
+    return sizes;
+}
+
+void GpuCuller::init(unsigned width, unsigned height)
+{
+    m_cull = std::make_unique<Shader>("cull.comp");
+    m_hiz = std::make_unique<Shader>("hiz.comp");
+
+    glGenBuffers(4, m_inputs);
+    glGenBuffers(1, &m_counters);
+
+    // mip sizes of a power-of-two texture halve exactly, the GL chain is pyramidSizes()
+    m_depthSize = glm::ivec2(int(width), int(height));
+    m_sizes = pyramidSizes(m_depthSize.x, m_depthSize.y);
+    glGenTextures(1, &m_pyramid);
+    glBindTexture(GL_TEXTURE_2D, m_pyramid);
+    glTexStorage2D(GL_TEXTURE_2D, GLsizei(m_sizes.size()), GL_R32F, m_sizes[0].x, m_sizes[0].y);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_hizValid = false;
+}
+
+void GpuCuller::cull(const DrawElementsIndirectCommand* commands, const DrawData* draws, const CullInput* inputs, size_t count,
+    const CullBatch* batches, size_t batchCount, const CullParams& params, MultiDrawBuffers& out)
+{
+    out.reserve(count);
+    if (!count) {
+        return;
+    }
+
+    uploadStorage(m_inputs[0], commands, count * sizeof(DrawElementsIndirectCommand));
+    uploadStorage(m_inputs[1], draws, count * sizeof(DrawData));
+    uploadStorage(m_inputs[2], inputs, count * sizeof(CullInput));
+    uploadStorage(m_inputs[3], batches, batchCount * sizeof(CullBatch));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_counters);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, batchCount * sizeof(uint32_t), nullptr, GL_STREAM_DRAW);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    // culled slots have to read as zero-instance commands
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, out.commandBuffer());
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MultiDrawBuffers::DrawDataBinding, out.drawBuffer());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BindCommands, m_inputs[0]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BindDraws, m_inputs[1]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BindInputs, m_inputs[2]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BindBatches, m_inputs[3]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BindCounters, m_counters);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BindOutCommands, out.commandBuffer());
+
+    m_cull->use();
+    for (int i = 0; i < 6; ++i) {
+        std::string name = "planes[" + std::to_string(i) + "]";
+        m_cull->setVec4(name.c_str(), params.frustum.planes[i]);
+    }
+    m_cull->setMat4("hizViewProj", params.hizViewProj);
+    glUniform2i(glGetUniformLocation(m_cull->ID, "hizSize"), params.hizSize.x, params.hizSize.y);
+    m_cull->setInt("hizLevels", params.hizLevels);
+    m_cull->setInt("hiz", int(HiZUnit));
+    m_cull->setInt("count", int(count));
+    glActiveTexture(GL_TEXTURE0 + HiZUnit);
+    glBindTexture(GL_TEXTURE_2D, m_pyramid);
+    glActiveTexture(GL_TEXTURE0);
+
+    glDispatchCompute(GLuint((count + LocalSize - 1) / LocalSize), 1, 1);
+    // the commands are read by the indirect draws, the draw data by the vertex shader
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void GpuCuller::buildHiZ(unsigned int depthTexture, const glm::mat4& viewProj, int width, int height)
+{
+    // depth past the viewport reads as 0 like the padding, the levels stay as allocated
+    m_depthSize = glm::ivec2(width, height);
+    m_hiz->use();
+    m_hiz->setInt("depthTexture", int(HiZUnit));
+    glUniform2i(glGetUniformLocation(m_hiz->ID, "depthSize"), m_depthSize.x, m_depthSize.y);
+    glActiveTexture(GL_TEXTURE0 + HiZUnit);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    glm::ivec2 srcSize(m_sizes[0].x * 2, m_sizes[0].y * 2);
+    for (size_t level = 0; level < m_sizes.size(); ++level) {
+        if (level > 0) {
+            glBindImageTexture(0, m_pyramid, GLint(level - 1), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        }
+        glBindImageTexture(1, m_pyramid, GLint(level), GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        m_hiz->setInt("level", int(level));
+        glUniform2i(glGetUniformLocation(m_hiz->ID, "srcSize"), srcSize.x, srcSize.y);
+        glDispatchCompute(GLuint((m_sizes[level].x + 7) / 8), GLuint((m_sizes[level].y + 7) / 8), 1);
+        // the next level reads this one
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        srcSize = m_sizes[level];
+    }
+    // next frame's cull samples it
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    m_hizViewProj = viewProj;
+    m_hizValid = true;
+}
+
+CullParams GpuCuller::params(const glm::mat4& viewProj) const
+{
+    CullParams p;
+    p.frustum = extractFrustum(viewProj);
+    p.hizViewProj = m_hizViewProj;
+    p.hizSize = m_depthSize;
+    p.hizLevels = m_hizValid ? int(m_sizes.size()) : 0;
+    return p;
+}
+
+bool GpuCuller::isVisibleReference(const CullParams& params, const HiZPyramid* hiz, const CullInput& input)
+{
+    glm::vec3 bmin(input.boundsMin), bmax(input.boundsMax);
+    for (auto& p : params.frustum.planes) {
+        // farthest corner along the plane normal
+        float x = p.x >= 0.0f ? bmax.x : bmin.x;
+        float y = p.y >= 0.0f ? bmax.y : bmin.y;
+        float z = p.z >= 0.0f ? bmax.z : bmin.z;
+        if (p.x * x + p.y * y + p.z * z + p.w < 0.0f) {
+            return false;
+        }
+    }
+    if (params.hizLevels == 0 || !hiz) {
+        return true;
+    }
+
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, minZ = FLT_MAX;
+    for (int i = 0; i < 8; ++i) {
+        glm::vec4 corner((i & 1) ? bmax.x : bmin.x, (i & 2) ? bmax.y : bmin.y, (i & 4) ? bmax.z : bmin.z, 1.0f);
+        glm::vec4 clip = params.hizViewProj * corner;
+        if (clip.w <= kNearW || clip.z < -clip.w) {
+            // crosses the near plane, can't be occluded by anything in front of it
+            return true;
+        }
+        float x = (clip.x / clip.w * 0.5f + 0.5f) * params.hizSize.x;
+        float y = (clip.y / clip.w * 0.5f + 0.5f) * params.hizSize.y;
+        float z = clip.z / clip.w * 0.5f + 0.5f;
+        minX = std::min(minX, x); maxX = std::max(maxX, x);
+        minY = std::min(minY, y); maxY = std::max(maxY, y);
+        minZ = std::min(minZ, z);
+    }
+
+    // clamped before the conversion, a corner close to w = 0 lands far off screen
+    int x0 = std::max(0, int(std::floor(std::max(minX, -1.0f))));
+    int x1 = std::min(params.hizSize.x - 1, int(std::floor(std::min(maxX, float(params.hizSize.x)))));
+    int y0 = std::max(0, int(std::floor(std::max(minY, -1.0f))));
+    int y1 = std::min(params.hizSize.y - 1, int(std::floor(std::min(maxY, float(params.hizSize.y)))));
+    if (x0 > x1 || y0 > y1) {
+        // off screen, leave that to the frustum test
+        return true;
+    }
+
+    // coarsest level where the rectangle covers at most 4x4 texels; level l halves the
+    // depth buffer l + 1 times
+    int level = 0;
+    while (level + 1 < params.hizLevels && (((x1 - x0) >> (level + 1)) > 3 || ((y1 - y0) >> (level + 1)) > 3)) {
+        level++;
+    }
+    const std::vector<float>& texels = hiz->levels[level];
+    int w = hiz->sizes[level].x;
+    for (int y = y0 >> (level + 1); y <= (y1 >> (level + 1)); ++y) {
+        for (int x = x0 >> (level + 1); x <= (x1 >> (level + 1)); ++x) {
+            if (texels[size_t(y) * w + x] >= minZ) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void GpuCuller::cullReference(const DrawElementsIndirectCommand* commands, const DrawData* draws, const CullInput* inputs, size_t count,
+    const CullBatch* batches, size_t batchCount, const CullParams& params, const HiZPyramid* hiz,
+    DrawElementsIndirectCommand* outCommands, DrawData* outDraws)
+{
+    std::vector<uint32_t> counters(batchCount, 0);
+    for (size_t i = 0; i < count; ++i) {
+        if (!isVisibleReference(params, hiz, inputs[i])) {
+            continue;
+        }
+        const CullBatch& batch = batches[inputs[i].batch.x];
+        // the GPU takes counters in any order, which the reference doesn't model
+        size_t slot = batch.info.y ? i : batch.info.x + counters[inputs[i].batch.x]++;
+        outCommands[slot] = commands[i];
+        outDraws[slot] = draws[i];
+    }
+}
+
+HiZPyramid GpuCuller::buildHiZReference(const std::vector<float>& depth, int width, int height)
+{
+    HiZPyramid hiz;
+    hiz.sizes = pyramidSizes(width, height);
+    hiz.levels.resize(hiz.sizes.size());
+
+    glm::ivec2 srcSize(hiz.sizes[0].x * 2, hiz.sizes[0].y * 2);
+    for (size_t l = 0; l < hiz.levels.size(); ++l) {
+        glm::ivec2 size = hiz.sizes[l];
+        std::vector<float>& dst = hiz.levels[l];
+        dst.assign(size_t(size.x) * size.y, 0.0f);
+        auto fetch = [&](int x, int y) {
+            if (l == 0) {
+                // outside the viewport never occludes
+                return x < width && y < height ? depth[size_t(y) * width + x] : 0.0f;
+            }
+            return hiz.levels[l - 1][size_t(y) * srcSize.x + x];
+        };
+        for (int y = 0; y < size.y; ++y) {
+            int sy0 = std::min(y * 2, srcSize.y - 1), sy1 = std::min(y * 2 + 1, srcSize.y - 1);
+            for (int x = 0; x < size.x; ++x) {
+                int sx0 = std::min(x * 2, srcSize.x - 1), sx1 = std::min(x * 2 + 1, srcSize.x - 1);
+                dst[size_t(y) * size.x + x] = std::max(std::max(fetch(sx0, sy0), fetch(sx1, sy0)), std::max(fetch(sx0, sy1), fetch(sx1, sy1)));
+            }
+        }
+        srcSize = size;
+    }
+    return hiz;
+}
@@ -0,0 +1,163 @@
+#include "lightgrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+
+namespace {
+
+// bit x is set when the sphere touches cluster x of a row of GridX clusters
+unsigned testRow(const float* minX, const float* minY, const float* minZ,
+                 const float* maxX, const float* maxY, const float* maxZ, const glm::vec4& sphere)
+{
+    unsigned mask = 0;
+#if defined(__AVX__)
+    const int width = 8;
+    __m256 cx = _mm256_set1_ps(sphere.x), cy = _mm256_set1_ps(sphere.y), cz = _mm256_set1_ps(sphere.z);
+    __m256 r2 = _mm256_set1_ps(sphere.w * sphere.w);
+    __m256 zero = _mm256_setzero_ps();
+    for (int i = 0; i < LightGrid::GridX; i += width) {
+        // squared distance from the center to the box
+        __m256 dx = _mm256_add_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(minX + i), cx), zero),
+                                  _mm256_max_ps(_mm256_sub_ps(cx, _mm256_loadu_ps(maxX + i)), zero));
+        __m256 dy = _mm256_add_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(minY + i), cy), zero),
+                                  _mm256_max_ps(_mm256_sub_ps(cy, _mm256_loadu_ps(maxY + i)), zero));
+        __m256 dz = _mm256_add_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(minZ + i), cz), zero),
+                                  _mm256_max_ps(_mm256_sub_ps(cz, _mm256_loadu_ps(maxZ + i)), zero));
+        __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+        mask |= unsigned(_mm256_movemask_ps(_mm256_cmp_ps(d2, r2, _CMP_LE_OQ))) << i;
+    }
+#else
+    const int width = 4;
+    __m128 cx = _mm_set1_ps(sphere.x), cy = _mm_set1_ps(sphere.y), cz = _mm_set1_ps(sphere.z);
+    __m128 r2 = _mm_set1_ps(sphere.w * sphere.w);
+    __m128 zero = _mm_setzero_ps();
+    for (int i = 0; i < LightGrid::GridX; i += width) {
+        __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minX + i), cx), zero),
+                               _mm_max_ps(_mm_sub_ps(cx, _mm_loadu_ps(maxX + i)), zero));
+        __m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minY + i), cy), zero),
+                               _mm_max_ps(_mm_sub_ps(cy, _mm_loadu_ps(maxY + i)), zero));
+        __m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minZ + i), cz), zero),
+                               _mm_max_ps(_mm_sub_ps(cz, _mm_loadu_ps(maxZ + i)), zero));
+        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        mask |= unsigned(_mm_movemask_ps(_mm_cmple_ps(d2, r2))) << i;
+    }
+#endif
+    return mask;
+}
+
+}
+
+LightGrid::LightGrid()
+{
+    m_minX.resize(ClusterCount); m_minY.resize(ClusterCount); m_minZ.resize(ClusterCount);
+    m_maxX.resize(ClusterCount); m_maxY.resize(ClusterCount); m_maxZ.resize(ClusterCount);
+    m_lists.resize(ClusterCount);
+    m_clusters.resize(ClusterCount);
+    m_parallelFor = threadedFor;
+}
+
+void LightGrid::setProjection(float fovY, float aspect, float zNear, float zFar)
+{
+    if (fovY == m_fovY && aspect == m_aspect && zNear == m_near && zFar == m_far) {
+        return;
+    }
+    m_fovY = fovY;
+    m_aspect = aspect;
+    m_near = zNear;
+    m_far = zFar;
+    m_sliceScale = GridZ / std::log(zFar / zNear);
+
+    float tanY = std::tan(fovY * 0.5f);
+    float tanX = tanY * aspect;
+    for (int z = 0; z < GridZ; ++z) {
+        // exponential slices, so clusters stay roughly cubic with distance
+        float d0 = zNear * std::pow(zFar / zNear, float(z) / GridZ);
+        float d1 = zNear * std::pow(zFar / zNear, float(z + 1) / GridZ);
+        for (int y = 0; y < GridY; ++y) {
+            float y0 = (-1.0f + 2.0f * y / GridY) * tanY;
+            float y1 = (-1.0f + 2.0f * (y + 1) / GridY) * tanY;
+            for (int x = 0; x < GridX; ++x) {
+                float x0 = (-1.0f + 2.0f * x / GridX) * tanX;
+                float x1 = (-1.0f + 2.0f * (x + 1) / GridX) * tanX;
+                size_t c = size_t(z) * GridX * GridY + size_t(y) * GridX + x;
+                m_minX[c] = std::min(x0 * d0, x0 * d1);
+                m_maxX[c] = std::max(x1 * d0, x1 * d1);
+                m_minY[c] = std::min(y0 * d0, y0 * d1);
+                m_maxY[c] = std::max(y1 * d0, y1 * d1);
+                // the camera looks down -z
+                m_minZ[c] = -d1;
+                m_maxZ[c] = -d0;
+            }
+        }
+    }
+}
+
+int LightGrid::slice(float depth) const
+{
+    if (depth <= m_near) {
+        return depth < m_near ? -1 : 0;
+    }
+    return int(std::floor(std::log(depth / m_near) * m_sliceScale));
+}
+
+void LightGrid::build(const std::vector<PointLight>& lights, const glm::mat4& view)
+{
+    m_viewLights.resize(lights.size());
+    m_lightSlices.resize(lights.size());
+    for (size_t i = 0; i < lights.size(); ++i) {
+        glm::vec3 p = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+        float depth = -p.z;
+        float r = lights[i].radius;
+        m_viewLights[i] = glm::vec4(p, r);
+        if (depth + r < m_near || depth - r > m_far) {
+            m_lightSlices[i] = glm::ivec2(1, 0);
+        } else {
+            m_lightSlices[i] = glm::ivec2(std::max(slice(depth - r), 0), std::min(slice(depth + r), GridZ - 1));
+        }
+    }
+
+    // slices own disjoint clusters, so they bin without any locking
+    m_parallelFor(GridZ, [this](size_t begin, size_t end) {
+        for (size_t z = begin; z < end; ++z) {
+            binSlice(int(z));
+        }
+    });
+
+    m_indices.clear();
+    m_maxLights = 0;
+    for (size_t c = 0; c < m_lists.size(); ++c) {
+        m_clusters[c] = glm::uvec2(uint32_t(m_indices.size()), uint32_t(m_lists[c].size()));
+        m_indices.insert(m_indices.end(), m_lists[c].begin(), m_lists[c].end());
+        m_maxLights = std::max(m_maxLights, uint32_t(m_lists[c].size()));
+    }
+}
+
+void LightGrid::binSlice(int z)
+{
+    const size_t first = size_t(z) * GridX * GridY;
+    for (size_t c = first; c < first + GridX * GridY; ++c) {
+        m_lists[c].clear();
+    }
+
+    for (uint32_t i = 0; i < m_viewLights.size(); ++i) {
+        if (z < m_lightSlices[i].x || z > m_lightSlices[i].y) {
+            continue;
+        }
+        const glm::vec4& sphere = m_viewLights[i];
+        for (int y = 0; y < GridY; ++y) {
+            size_t row = first + size_t(y) * GridX;
+            // a row spans the whole slice horizontally, reject it on y first
+            float dy = std::max(std::max(m_minY[row] - sphere.y, sphere.y - m_maxY[row]), 0.0f);
+            if (dy > sphere.w) {
+                continue;
+            }
+            unsigned mask = testRow(&m_minX[row], &m_minY[row], &m_minZ[row], &m_maxX[row], &m_maxY[row], &m_maxZ[row], sphere);
+            for (int x = 0; mask; ++x, mask >>= 1) {
+                if (mask & 1) {
+                    m_lists[row + x].push_back(i);
+                }
+            }
+        }
+    }
+}
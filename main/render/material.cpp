@@ -0,0 +1,308 @@
+#include "glad/glad.h"
+#include "material.h"
+#include "texture.h"
+#include "shader.h"
+#include "rslib.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <tuple>
+
+#include "spdlog/spdlog.h"
+
+namespace {
+
+// FNV-1a
+uint64_t hashBytes(uint64_t h, const void* data, size_t size)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+const char* const SamplerNames[SlotCount] = { "diffuseMaps", "specularMaps", "normalMaps", "heightMaps" };
+
+}
+
+uint64_t MaterialDesc::hash() const
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    h = hashBytes(h, &diffuse, sizeof(diffuse));
+    h = hashBytes(h, &specular, sizeof(specular));
+    h = hashBytes(h, &emissive, sizeof(emissive));
+    for (auto& t : textures) {
+        // the terminator keeps "ab" + "" apart from "a" + "b"
+        h = hashBytes(h, t.c_str(), t.size() + 1);
+    }
+    return h;
+}
+
+bool MaterialDesc::operator==(const MaterialDesc& other) const
+{
+    return diffuse == other.diffuse && specular == other.specular && emissive == other.emissive &&
+        std::equal(std::begin(textures), std::end(textures), std::begin(other.textures));
+}
+
+MaterialLibrary::~MaterialLibrary()
+{
+    m_streamer.reset();
+    if (!m_arrays.empty()) {
+        glDeleteTextures(GLsizei(m_arrays.size()), m_arrays.data());
+    }
+    if (m_uniforms) {
+        glDeleteBuffers(1, &m_uniforms);
+    }
+}
+
+uint32_t MaterialLibrary::add(const MaterialDesc& desc)
+{
+    m_requests++;
+
+    // the same file name means different textures in different model folders
+    MaterialDesc resolved = desc;
+    for (auto& t : resolved.textures) {
+        if (!t.empty()) {
+            std::string path = RSLib::instance()->getTextureFileName(t.c_str());
+            if (path.empty()) {
+                spdlog::error("Material texture {0} not found", t);
+            }
+            t = path;
+        }
+    }
+
+    uint64_t h = resolved.hash();
+    auto range = m_byHash.equal_range(h);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (m_descs[it->second] == resolved) {
+            return it->second;
+        }
+    }
+
+    if (m_descs.size() == MaxMaterials) {
+        spdlog::error("More than {0} materials, the rest use material 0", unsigned(MaxMaterials));
+        return 0;
+    }
+
+    uint32_t index = uint32_t(m_descs.size());
+    std::array<uint32_t, SlotCount> slots;
+    for (uint32_t s = 0; s < SlotCount; ++s) {
+        slots[s] = resolved.textures[s].empty() ? NoTexture : addTexture(resolved.textures[s]);
+    }
+    m_descs.push_back(std::move(resolved));
+    m_slots.push_back(slots);
+    m_slotArrays.push_back({});
+    m_byHash.emplace(h, index);
+
+    MaterialParams params;
+    params.diffuse = m_descs[index].diffuse;
+    params.specular = m_descs[index].specular;
+    params.emissive = m_descs[index].emissive;
+    params.layers = glm::ivec4(-1);
+    params.features = glm::uvec4(0);
+    m_params.push_back(params);
+    resolve(index);
+    return index;
+}
+
+uint32_t MaterialLibrary::addTexture(const std::string& path)
+{
+    auto it = m_textureByPath.find(path);
+    if (it != m_textureByPath.end()) {
+        return it->second;
+    }
+    uint32_t index = uint32_t(m_textures.size());
+    m_textures.push_back({ path });
+    m_textureByPath.emplace(path, index);
+    m_pending.push_back(index);
+    return index;
+}
+
+void MaterialLibrary::enableStreaming(const TextureStreamer::Settings& settings)
+{
+    m_streamer = std::make_unique<TextureStreamer>(settings);
+}
+
+void MaterialLibrary::request(uint32_t index, float pixels)
+{
+    if (!m_streamer || index >= m_slotArrays.size()) {
+        return;
+    }
+    for (unsigned int array : m_slotArrays[index]) {
+        if (array) {
+            m_streamer->request(array, pixels);
+        }
+    }
+}
+
+void MaterialLibrary::upload()
+{
+    if (m_pending.empty()) {
+        return;
+    }
+
+    // decoding is most of the load time and needs no GL
+    std::vector<Image> images(m_pending.size());
+    auto decode = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            images[i] = Texture::decode(m_textures[m_pending[i]].path);
+        }
+    };
+    if (auto jobs = RSLib::instance()->getJobSystem()) {
+        jobs->parallelFor(m_pending.size(), decode, 1);
+    } else {
+        decode(0, m_pending.size());
+    }
+
+    // one array per size and channel count
+    std::map<std::tuple<int, int, int>, std::vector<size_t>> groups;
+    for (size_t i = 0; i < images.size(); ++i) {
+        if (!images[i].pixels) {
+            spdlog::error("Failed to load texture {0}", m_textures[m_pending[i]].path);
+            continue;
+        }
+        groups[std::make_tuple(images[i].width, images[i].height, images[i].channels)].push_back(i);
+    }
+
+    std::vector<const Image*> layers;
+    std::vector<std::string> paths;
+    for (auto& group : groups) {
+        auto& members = group.second;
+        for (size_t first = 0; first < members.size(); first += MaxLayers) {
+            size_t count = std::min<size_t>(members.size() - first, MaxLayers);
+            layers.clear();
+            for (size_t k = 0; k < count; ++k) {
+                layers.push_back(&images[members[first + k]]);
+            }
+            unsigned int array = 0;
+            if (m_streamer) {
+                paths.clear();
+                for (size_t k = 0; k < count; ++k) {
+                    paths.push_back(m_textures[m_pending[members[first + k]]].path);
+                }
+                array = m_streamer->create(paths, layers);
+            } else {
+                array = Texture::createArray(layers);
+            }
+            m_arrays.push_back(array);
+            for (size_t k = 0; k < count; ++k) {
+                size_t i = members[first + k];
+                TextureRecord& t = m_textures[m_pending[i]];
+                t.array = array;
+                t.layer = int(k);
+                t.channels = images[i].channels;
+            }
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    m_bound = {};
+
+    spdlog::info("Materials: {0} from {1} requests, {2} textures in {3} arrays",
+        m_descs.size(), m_requests, m_textures.size(), m_arrays.size());
+    if (m_streamer) {
+        spdlog::info("Texture streaming: tails of {0:.1f} MB resident, budget {1:.1f} MB",
+            m_streamer->stats().resident / 1048576.0, m_streamer->stats().budget / 1048576.0);
+    }
+
+    m_pending.clear();
+    for (uint32_t i = 0; i < m_descs.size(); ++i) {
+        resolve(i);
+    }
+}
+
+void MaterialLibrary::resolve(uint32_t index)
+{
+    MaterialParams& params = m_params[index];
+    uint32_t features = params.diffuse.a < 1.0f ? uint32_t(FeatureTransparent) : 0u;
+    for (uint32_t s = 0; s < SlotCount; ++s) {
+        uint32_t t = m_slots[index][s];
+        if (t == NoTexture || !m_textures[t].array) {
+            params.layers[s] = -1;
+            m_slotArrays[index][s] = 0;
+            continue;
+        }
+        params.layers[s] = m_textures[t].layer;
+        m_slotArrays[index][s] = m_textures[t].array;
+        features |= 1u << s;
+        if (s == SlotDiffuse && m_textures[t].channels == 4) {
+            features |= FeatureTransparent;
+        }
+    }
+    params.features.x = features;
+    m_dirty = true;
+}
+
+void MaterialLibrary::flush()
+{
+    upload();
+    if (m_streamer) {
+        m_streamer->update();
+        // it bound the arrays it changed on the active unit
+        m_bound = {};
+    }
+    if (!m_dirty) {
+        return;
+    }
+    if (!m_uniforms) {
+        // the binding point is ours alone, it only needs setting once
+        glGenBuffers(1, &m_uniforms);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_uniforms);
+        glBufferData(GL_UNIFORM_BUFFER, MaxMaterials * sizeof(MaterialParams), nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, UniformBinding, m_uniforms);
+    } else {
+        glBindBuffer(GL_UNIFORM_BUFFER, m_uniforms);
+    }
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, m_params.size() * sizeof(MaterialParams), m_params.data());
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    m_dirty = false;
+}
+
+MaterialParams& MaterialLibrary::editParams(uint32_t index)
+{
+    m_dirty = true;
+    return m_params[index];
+}
+
+void MaterialLibrary::bindArrays(const std::array<unsigned int, SlotCount>& arrays)
+{
+    // slots without a map keep whatever is bound, the shader doesn't sample them
+    unsigned int first = SlotCount;
+    unsigned int last = 0;
+    for (unsigned int s = 0; s < SlotCount; ++s) {
+        if (arrays[s] && arrays[s] != m_bound[s]) {
+            first = std::min(first, s);
+            last = s;
+            m_bound[s] = arrays[s];
+        }
+    }
+    if (first == SlotCount) {
+        m_bindsSkipped++;
+        return;
+    }
+    m_bindsIssued++;
+
+    if (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_multi_bind) {
+        glBindTextures(first, last - first + 1, &m_bound[first]);
+    } else {
+        for (unsigned int s = first; s <= last; ++s) {
+            glActiveTexture(GL_TEXTURE0 + s);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, m_bound[s]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+}
+
+void MaterialLibrary::setupProgram(Shader& shader)
+{
+    unsigned int block = glGetUniformBlockIndex(shader.ID, "Materials");
+    if (block != GL_INVALID_INDEX) {
+        glUniformBlockBinding(shader.ID, block, UniformBinding);
+    }
+    shader.use();
+    for (unsigned int s = 0; s < SlotCount; ++s) {
+        shader.setInt(SamplerNames[s], int(s));
+    }
+}
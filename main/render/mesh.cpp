@@ -1,72 +1,38 @@
 #include "glad/glad.h"
-#include "shader.h"
 #include "Mesh.h"
+#include "commandlist.h"
+
+#include <algorithm>
 
 Mesh::~Mesh()
 {
+    // the GL buffers live in the arena, which goes away with the last mesh referencing it
+    m_arena.reset();
 }
 
-void Mesh::setupMesh()
+void Mesh::setupMesh(const LodChain& lods)
 {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void*) offsetof(Vertex, Position));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void*) offsetof(Vertex, Normal));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void*) offsetof(Vertex, TexCoords));
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void*) offsetof(Vertex, Tangent));
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void*) offsetof(Vertex, Bitangent));
+    m_lods.push_back({ m_arena->add(vertices, indices), 0.0f });
+    // simplified levels share the vertices of lod 0
+    for (size_t i = 0; i < lods.indices.size(); ++i) {
+        m_lods.push_back({ m_arena->addIndices(m_lods[0].range, lods.indices[i]), lods.errors[i] });
+    }
 
-    glBindVertexArray(0);
+    if (!m_keepCpuGeometry) {
+        std::vector<Vertex>().swap(vertices);
+        std::vector<unsigned int>().swap(indices);
+    }
 }
 
-void Mesh::Draw(std::shared_ptr<Shader> shader)
+void Mesh::Draw(unsigned lod)
 {
-    // bind appropriate textures
-    unsigned int diffuseNr = 1;
-    unsigned int specularNr = 1;
-    unsigned int normalNr = 1;
-    unsigned int heightNr = 1;
-    for (unsigned int i = 0; i < textures.size(); i++) {
-        glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-        // retrieve texture number (the N in diffuse_textureN)
-        std::string number;
-        std::string name = textures[i].type;
-        if (name == "texture_diffuse")
-            number = std::to_string(diffuseNr++);
-        else if (name == "texture_specular")
-            number = std::to_string(specularNr++); // transfer unsigned int to stream
-        else if (name == "texture_normal")
-            number = std::to_string(normalNr++); // transfer unsigned int to stream
-        else if (name == "texture_height")
-            number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-                                                 // now set the sampler to the correct texture unit
-        glUniform1i(glGetUniformLocation(shader->ID, (name + number).c_str()), i);
-        // and finally bind the texture
-        glBindTexture(GL_TEXTURE_2D, textures[i].id);
-
-    }
-#
     // draw mesh
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-
+    const GeometryRange& range = m_lods[std::min(lod, lodCount() - 1)].range;
+    glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, range.indexType, ( void*) size_t(range.indexOffset), range.baseVertex);
+}
 
-    // always good practice to set everything back to defaults once configured.
-    glActiveTexture(GL_TEXTURE0);
+void Mesh::draw(CommandList& commands, unsigned lod)
+{
+    const GeometryRange& range = m_lods[std::min(lod, lodCount() - 1)].range;
+    commands.drawElements(GL_TRIANGLES, range.indexCount, range.indexType, range.indexOffset, range.baseVertex);
 }
@@ -1,52 +1,140 @@
 #include <iostream>
+#include <limits>
 #include "rslib.h"
 #include "config.h"
 #include "Model.h"
+#include "glad/glad.h"
 #include "texture.h"
 #include "shader.h"
+#include "culling.h"
+#include "commandlist.h"
+#include "jobs.h"
 
-Model::Model(std::string model_name, std::string path)
+#include "spdlog/spdlog.h"
+
+Model::Model(std::string model_name, std::string path, std::shared_ptr<MaterialLibrary> materials, std::shared_ptr<GeometryArena> geometry)
 {
     m_objname = model_name;
     m_path = path;
+    m_materials = std::move(materials);
+    m_geometry = std::move(geometry);
 
     auto config = RSLib::instance()->getConfig();
 
     m_settings = config->get_object_settings(path);
 
     if (enable()) {
+        // "lod": true builds three simplified levels per mesh at load time
+        if (check("lod")) {
+            m_lodLevels = 4;
+            int pixels = config->get_int("lod_error_pixels");
+            if (pixels > 0) {
+                m_lodPixelError = float(pixels);
+            }
+        }
+
         std::string model_resource = path + "/resource";
         std::string shader_vs = path + "/shader/vs";
         std::string shader_fs = path + "/shader/fs";
 
         std::string model_path = RSLib::instance()->getModelFileName(config->get_string(model_resource).c_str());
+        size_t rss_before = RSLib::instance()->residentMemory();
         loadModel(model_path);
+        size_t rss_after = RSLib::instance()->residentMemory();
+        spdlog::info("Model {0}: resident memory {1:.1f} MB -> {2:.1f} MB", m_objname, rss_before / 1048576.0, rss_after / 1048576.0);
 
         auto vs = config->get_string(shader_vs);
         auto fs = config->get_string(shader_fs);
         m_shader = std::make_shared<Shader>(vs.c_str(),fs.c_str());
+        m_fragmentShader = fs;
+        // model_indirect.vert is model_loading.vert with the transform and material per draw
+        if (vs == "model_loading.vert") {
+            m_indirectVertexShader = "model_indirect.vert";
+        }
         
+        // sampler units never change for a program, assign them here instead of every draw
+        m_materials->setupProgram(*m_shader);
+        m_materialLocation = glGetUniformLocation(m_shader->ID, "materialIndex");
         if (check("framebuffer")) {
-            m_shader->use();
             m_shader->setInt("screenTexture", 0);
+            m_shader->setVec2("uvScale", glm::vec2(1.0f));
         }
     }
     
 }
 
-void Model::draw(glm::mat4 model, glm::mat4 view, glm::mat4 proj)
+void Model::setScreenRegion(CommandList& commands, const glm::vec2& scale)
 {
+    commands.useProgram(m_shader->ID);
+    commands.uniform("uvScale", scale);
+}
+
+size_t Model::draw(CommandList& commands, const glm::mat4& model, const glm::mat4& view, const glm::mat4& proj)
+{
+    size_t draws = 0;
     if (enable()) {
-        m_shader->use();
+        commands.useProgram(m_shader->ID);
+        commands.uniform("projection", proj);
+        commands.uniform("view", view);
+        commands.uniform("model", model);
+
+        // the executor knows the arena is bound, nothing is unbound in between
+        commands.bindVertexArray(m_geometry->vao());
+        int material = -1;
+        forEachVisibleMesh(model, view, proj, [&](Mesh& mesh, unsigned lod) {
+            // meshes whose maps share arrays only differ in the material index; units
+            // already holding their array are skipped when the list is played
+            commands.bindTextures(GL_TEXTURE_2D_ARRAY, 0, SlotCount, m_materials->arrays(mesh.material()).data());
+            if (int(mesh.material()) != material) {
+                material = int(mesh.material());
+                commands.uniform(m_materialLocation, material);
+            }
+            mesh.draw(commands, lod);
+            draws++;
+        });
+    }
+    return draws;
+}
+
+unsigned Model::selectLod(Mesh& mesh, const glm::mat4& modelView, const glm::mat4& proj)
+{
+    if (mesh.lodCount() < 2) {
+        return 0;
+    }
+
+    // model matrices may scale, errors are in model units
+    float scale = glm::max(glm::length(glm::vec3(modelView[0])), glm::max(glm::length(glm::vec3(modelView[1])), glm::length(glm::vec3(modelView[2]))));
+    glm::vec4 center = modelView * glm::vec4(mesh.center(), 1.0f);
+    float distance = -center.z - mesh.radius() * scale;
+    if (distance <= 0.0f) {
+        return 0;
+    }
 
-        m_shader->setMat4("projection", proj);
-        m_shader->setMat4("view", view);
-        m_shader->setMat4("model", model);
+    // projected size of one world unit at this distance, in pixels
+    float pixelsPerUnit = proj[1][1] * 0.5f * m_viewportHeight / distance;
 
-        for (auto& mesh : m_meshes) {
-            mesh.Draw(m_shader);
+    unsigned lod = 0;
+    for (unsigned i = 1; i < mesh.lodCount(); ++i) {
+        if (mesh.lodError(i) * scale * pixelsPerUnit > m_lodPixelError) {
+            break;
         }
+        lod = i;
     }
+    return lod;
+}
+
+float Model::projectedSize(Mesh& mesh, const glm::mat4& modelView, const glm::mat4& proj)
+{
+    // the same distance selectLod measures
+    float scale = glm::max(glm::length(glm::vec3(modelView[0])), glm::max(glm::length(glm::vec3(modelView[1])), glm::length(glm::vec3(modelView[2]))));
+    glm::vec4 center = modelView * glm::vec4(mesh.center(), 1.0f);
+    float radius = mesh.radius() * scale;
+    float distance = -center.z - radius;
+    if (distance <= 0.0f) {
+        return std::numeric_limits<float>::max();
+    }
+    // the diameter times the pixels per unit at that distance
+    return 2.0f * radius * proj[1][1] * 0.5f * m_viewportHeight / distance;
 }
 
 bool Model::enable() {
@@ -68,33 +156,85 @@ void Model::loadModel(std::string path)
     }
 
     directory = path.substr(0, path.find_last_of("/"));
-    processNode(scene->mRootNode, scene);
+
+    std::vector<aiMesh*> meshes;
+    processNode(scene->mRootNode, scene, meshes);
+
+    // attribute conversion and LOD simplification touch no GL state, every mesh is a job
+    std::vector<MeshData> data(meshes.size());
+    auto readMeshes = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            data[i] = readMesh(meshes[i]);
+        }
+    };
+    if (auto jobs = RSLib::instance()->getJobSystem()) {
+        jobs->parallelFor(meshes.size(), readMeshes, 1);
+    } else {
+        readMeshes(0, meshes.size());
+    }
+
+    // materials are shared by many meshes, describe each once; their textures are decoded
+    // and packed when the owner uploads the library
+    std::vector<uint32_t> materials(scene->mNumMaterials);
+    for (unsigned i = 0; i < scene->mNumMaterials; ++i) {
+        materials[i] = m_materials->add(readMaterial(scene->mMaterials[i]));
+    }
+
+    // the arena is a GL object, that stays on this thread
+    bool occluder = check("occluder");
+    bool keep = check("keep_cpu_geometry");
+    size_t vertexCount = 0;
+    m_meshes.reserve(meshes.size());
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        MeshData& d = data[i];
+        m_bounds.extend(d.bounds);
+        vertexCount += d.vertices.size();
+
+        if (occluder) {
+            // keep a position-only copy for the software occlusion rasterizer
+            uint32_t base = uint32_t(m_occluderPositions.size());
+            for (auto& v : d.vertices) {
+                m_occluderPositions.push_back(v.Position);
+            }
+            for (auto index : d.indices) {
+                m_occluderIndices.push_back(base + index);
+            }
+        }
+
+        uint32_t material = meshes[i]->mMaterialIndex < materials.size() ? materials[meshes[i]->mMaterialIndex] : m_materials->add(MaterialDesc());
+        m_meshes.emplace_back(std::move(d.vertices), std::move(d.indices), material, m_geometry, d.bounds, keep, std::move(d.lods));
+    }
+
+    spdlog::info("Model {0}: {1} meshes, {2} vertices", m_objname, m_meshes.size(), vertexCount);
 
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene)
+void Model::processNode(aiNode* node, const aiScene* scene, std::vector<aiMesh*>& meshes)
 {
     for (unsigned int i = 0; i < node->mNumMeshes; ++i) 
     {
-        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        m_meshes.push_back(processMesh(mesh, scene));
+        meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
     }
 
     for (unsigned int i = 0; i < node->mNumChildren; ++i) 
     {
-        processNode(node->mChildren[i], scene);
+        processNode(node->mChildren[i], scene, meshes);
     }
 }
 
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
+Model::MeshData Model::readMesh(aiMesh* mesh)
 {
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
-    std::vector<Texture_t> textures;
+    MeshData d;
+    std::vector<Vertex>& vertices = d.vertices;
+    std::vector<uint32_t>& indices = d.indices;
+
+    vertices.reserve(mesh->mNumVertices);
+    indices.reserve(size_t(mesh->mNumFaces) * 3);
 
     for (unsigned int i = 0; i < mesh->mNumVertices; ++i) {
         Vertex vertex;
         vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+        d.bounds.extend(vertex.Position);
         if (mesh->HasNormals()) {
             vertex.Normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
         }
@@ -118,57 +258,40 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
         }
     }
 
-    if (mesh->mMaterialIndex >= 0) {
-        // process materials
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-        // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
-        // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
-        // Same applies to other texture as the following list summarizes:
-        // diffuse: texture_diffuseN
-        // specular: texture_specularN
-        // normal: texture_normalN
-
-        // 1. diffuse maps
-        std::vector<Texture_t> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        // 2. specular maps
-        std::vector<Texture_t> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-        // 3. normal maps
-        std::vector<Texture_t> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-        // 4. height maps
-        std::vector<Texture_t> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-    }
-
-    return Mesh(vertices, indices, textures);
+    d.lods = buildLodChain(vertices, indices, m_lodLevels);
+    return d;
 }
 
-std::vector<Texture_t> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
+MaterialDesc Model::readMaterial(aiMaterial* material)
 {
-    std::vector<Texture_t> textures;
-    for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
-        aiString str;
-        mat->GetTexture(type, i, &str);
-        // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-        bool skip = false;
-        for (unsigned int j = 0; j < m_textures.size(); j++) {
-            if (std::strcmp(m_textures[j].name.data(), str.C_Str()) == 0) {
-                textures.push_back(m_textures[j]);
-                skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                break;
-            }
-        }
-        if (!skip) {   // if texture hasn't been loaded already, load it
-            Texture_t texture;
-            Texture tex;
-            texture.id = tex.loadTexture(str.C_Str());
-            texture.type = typeName;
-            texture.name = str.C_Str();
-            textures.push_back(texture);
-            m_textures.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+    MaterialDesc desc;
+    aiColor3D color;
+    float value;
+    if (material->Get(AI_MATKEY_COLOR_DIFFUSE, color) == aiReturn_SUCCESS) {
+        desc.diffuse = glm::vec4(color.r, color.g, color.b, 1.0f);
+    }
+    if (material->Get(AI_MATKEY_OPACITY, value) == aiReturn_SUCCESS) {
+        desc.diffuse.a = value;
+    }
+    if (material->Get(AI_MATKEY_COLOR_SPECULAR, color) == aiReturn_SUCCESS) {
+        desc.specular = glm::vec4(color.r, color.g, color.b, 0.0f);
+    }
+    if (material->Get(AI_MATKEY_SHININESS, value) == aiReturn_SUCCESS) {
+        desc.specular.a = value;
+    }
+    if (material->Get(AI_MATKEY_COLOR_EMISSIVE, color) == aiReturn_SUCCESS) {
+        desc.emissive = glm::vec4(color.r, color.g, color.b, 1.0f);
+    }
+
+    // assimp reports an OBJ map_Bump as a height map and map_Ka as ambient, those
+    // are the normal and height maps of this data set. Shaders only read the first
+    // map of each kind.
+    const aiTextureType types[SlotCount] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_HEIGHT, aiTextureType_AMBIENT };
+    for (unsigned s = 0; s < SlotCount; ++s) {
+        aiString path;
+        if (material->GetTextureCount(types[s]) > 0 && material->GetTexture(types[s], 0, &path) == aiReturn_SUCCESS) {
+            desc.textures[s] = path.C_Str();
         }
     }
-    return textures;
+    return desc;
 }
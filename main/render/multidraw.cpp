@@ -0,0 +1,52 @@
+#include "glad/glad.h"
+#include "multidraw.h"
+#include "commandlist.h"
+
+bool MultiDrawBuffers::supported()
+{
+    return GLAD_GL_VERSION_4_3 && GLAD_GL_ARB_shader_draw_parameters;
+}
+
+MultiDrawBuffers::~MultiDrawBuffers()
+{
+    if (m_commands) {
+        glDeleteBuffers(1, &m_commands);
+    }
+    if (m_draws) {
+        glDeleteBuffers(1, &m_draws);
+    }
+}
+
+void MultiDrawBuffers::reserve(size_t count)
+{
+    if (!m_commands) {
+        glGenBuffers(1, &m_commands);
+        glGenBuffers(1, &m_draws);
+    }
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commands);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, count * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_draws);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(DrawData), nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void MultiDrawBuffers::upload(const DrawElementsIndirectCommand* commands, const DrawData* draws, size_t count)
+{
+    reserve(count);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commands);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, count * sizeof(DrawElementsIndirectCommand), commands);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_draws);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(DrawData), draws);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    // binding a zero-sized buffer range is an error, an empty frame draws nothing anyway
+    if (count) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DrawDataBinding, m_draws);
+    }
+}
+
+void MultiDrawBuffers::draw(CommandList& list, uint32_t indexType, size_t first, size_t count) const
+{
+    list.multiDrawIndirect(m_commands, GL_TRIANGLES, indexType, first * sizeof(DrawElementsIndirectCommand), unsigned(count));
+}
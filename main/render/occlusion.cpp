@@ -0,0 +1,362 @@
+#include "occlusion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cstdio>
+#include <immintrin.h>
+
+namespace {
+
+const float kNearW = 1e-5f;
+
+struct Setup {
+    // edge functions e = a * x + b * y + c, positive inside; depth = za * x + zb * y + zc
+    float a[3], b[3], c[3];
+    float za, zb, zc;
+    int minX, minY, maxX, maxY;
+};
+
+bool setupTriangle(const float* x, const float* y, const float* z, Setup& s)
+{
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (area == 0.0f) {
+        return false;
+    }
+    // both windings occlude
+    int i1 = area > 0.0f ? 1 : 2;
+    int i2 = area > 0.0f ? 2 : 1;
+    float vx[3] = { x[0], x[i1], x[i2] };
+    float vy[3] = { y[0], y[i1], y[i2] };
+    float vz[3] = { z[0], z[i1], z[i2] };
+    area = std::abs(area);
+
+    for (int e = 0; e < 3; ++e) {
+        int p = e, q = (e + 1) % 3;
+        s.a[e] = -(vy[q] - vy[p]);
+        s.b[e] = vx[q] - vx[p];
+        s.c[e] = -(s.a[e] * vx[p] + s.b[e] * vy[p]);
+    }
+
+    float dx1 = vx[1] - vx[0], dy1 = vy[1] - vy[0], dz1 = vz[1] - vz[0];
+    float dx2 = vx[2] - vx[0], dy2 = vy[2] - vy[0], dz2 = vz[2] - vz[0];
+    s.za = (dz1 * dy2 - dz2 * dy1) / area;
+    s.zb = (dz2 * dx1 - dz1 * dx2) / area;
+    s.zc = vz[0] - s.za * vx[0] - s.zb * vy[0];
+
+    s.minX = int(std::floor(std::min(vx[0], std::min(vx[1], vx[2]))));
+    s.maxX = int(std::ceil(std::max(vx[0], std::max(vx[1], vx[2]))));
+    s.minY = int(std::floor(std::min(vy[0], std::min(vy[1], vy[2]))));
+    s.maxY = int(std::ceil(std::max(vy[0], std::max(vy[1], vy[2]))));
+    return true;
+}
+
+}
+
+OcclusionCuller::OcclusionCuller(int width, int height)
+{
+    m_width = (std::max(width, TileSize) + TileSize - 1) / TileSize * TileSize;
+    m_height = std::max(height, 1);
+    m_tilesX = m_width / TileSize;
+    m_tilesY = (m_height + TileSize - 1) / TileSize;
+    m_bins.resize(size_t(m_tilesX) * m_tilesY);
+    m_depth.assign(size_t(m_width) * m_height, 1.0f);
+    m_viewProj = glm::mat4(1.0f);
+    m_parallelFor = threadedFor;
+
+    glm::ivec2 size(m_width, m_height);
+    m_levelSize.push_back(size);
+    while (size.x > 1 || size.y > 1) {
+        size = glm::ivec2(std::max(1, (size.x + 1) / 2), std::max(1, (size.y + 1) / 2));
+        m_levelSize.push_back(size);
+    }
+    m_levels.resize(m_levelSize.size());
+    for (size_t i = 0; i < m_levels.size(); ++i) {
+        m_levels[i].assign(size_t(m_levelSize[i].x) * m_levelSize[i].y, 1.0f);
+    }
+}
+
+void OcclusionCuller::begin(const glm::mat4& viewProj)
+{
+    m_viewProj = viewProj;
+    m_tris.clear();
+}
+
+void OcclusionCuller::addOccluder(const glm::mat4& model, const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices)
+{
+    glm::mat4 mvp = m_viewProj * model;
+    m_clip.resize(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) {
+        m_clip[i] = mvp * glm::vec4(positions[i], 1.0f);
+    }
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        addClipped(m_clip[indices[i]], m_clip[indices[i + 1]], m_clip[indices[i + 2]]);
+    }
+}
+
+void OcclusionCuller::addClipped(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+{
+    // clip against the near plane (z >= -w); the other planes are handled by the tile bounds
+    const glm::vec4* in[3] = { &a, &b, &c };
+    float d[3];
+    int inside = 0;
+    for (int i = 0; i < 3; ++i) {
+        d[i] = in[i]->z + in[i]->w;
+        inside += d[i] >= 0.0f ? 1 : 0;
+    }
+    if (inside == 0) {
+        return;
+    }
+    if (inside == 3) {
+        addTriangle(a, b, c);
+        return;
+    }
+
+    glm::vec4 poly[4];
+    int n = 0;
+    for (int i = 0; i < 3; ++i) {
+        int j = (i + 1) % 3;
+        if (d[i] >= 0.0f) {
+            poly[n++] = *in[i];
+        }
+        if ((d[i] >= 0.0f) != (d[j] >= 0.0f)) {
+            float t = d[i] / (d[i] - d[j]);
+            poly[n++] = *in[i] + (*in[j] - *in[i]) * t;
+        }
+    }
+    for (int i = 1; i + 1 < n; ++i) {
+        addTriangle(poly[0], poly[i], poly[i + 1]);
+    }
+}
+
+void OcclusionCuller::addTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+{
+    const glm::vec4* v[3] = { &a, &b, &c };
+    Triangle t;
+    for (int i = 0; i < 3; ++i) {
+        float w = std::max(v[i]->w, kNearW);
+        t.x[i] = (v[i]->x / w * 0.5f + 0.5f) * m_width;
+        t.y[i] = (v[i]->y / w * 0.5f + 0.5f) * m_height;
+        t.z[i] = v[i]->z / w * 0.5f + 0.5f;
+    }
+    float minX = std::min(t.x[0], std::min(t.x[1], t.x[2]));
+    float maxX = std::max(t.x[0], std::max(t.x[1], t.x[2]));
+    float minY = std::min(t.y[0], std::min(t.y[1], t.y[2]));
+    float maxY = std::max(t.y[0], std::max(t.y[1], t.y[2]));
+    if (maxX < 0.0f || maxY < 0.0f || minX > m_width || minY > m_height) {
+        return;
+    }
+    m_tris.push_back(t);
+}
+
+void OcclusionCuller::rasterize()
+{
+    for (auto& bin : m_bins) {
+        bin.clear();
+    }
+    for (uint32_t i = 0; i < m_tris.size(); ++i) {
+        const Triangle& t = m_tris[i];
+        int x0 = int(std::min(t.x[0], std::min(t.x[1], t.x[2]))) / TileSize;
+        int x1 = int(std::max(t.x[0], std::max(t.x[1], t.x[2]))) / TileSize;
+        int y0 = int(std::min(t.y[0], std::min(t.y[1], t.y[2]))) / TileSize;
+        int y1 = int(std::max(t.y[0], std::max(t.y[1], t.y[2]))) / TileSize;
+        x0 = std::max(x0, 0); y0 = std::max(y0, 0);
+        x1 = std::min(x1, m_tilesX - 1); y1 = std::min(y1, m_tilesY - 1);
+        for (int ty = y0; ty <= y1; ++ty) {
+            for (int tx = x0; tx <= x1; ++tx) {
+                m_bins[size_t(ty) * m_tilesX + tx].push_back(i);
+            }
+        }
+    }
+
+    // tiles don't share pixels, so they can be rasterized concurrently
+    m_parallelFor(m_bins.size(), [this](size_t begin, size_t end) {
+        for (size_t tile = begin; tile < end; ++tile) {
+            rasterizeTile(int(tile));
+        }
+    });
+
+    buildHierarchy();
+}
+
+void OcclusionCuller::rasterizeTile(int tile)
+{
+    int tileX = (tile % m_tilesX) * TileSize;
+    int tileY = (tile / m_tilesX) * TileSize;
+    int tileEndX = tileX + TileSize;
+    int tileEndY = std::min(tileY + TileSize, m_height);
+
+    for (int y = tileY; y < tileEndY; ++y) {
+        std::fill(m_depth.begin() + size_t(y) * m_width + tileX, m_depth.begin() + size_t(y) * m_width + tileEndX, 1.0f);
+    }
+
+    for (uint32_t index : m_bins[tile]) {
+        const Triangle& t = m_tris[index];
+        Setup s;
+        if (!setupTriangle(t.x, t.y, t.z, s)) {
+            continue;
+        }
+        // spans start on a multiple of 8, tile widths are multiples of 8 too
+        int x0 = std::max(s.minX, tileX) & ~7;
+        int x1 = std::min(s.maxX, tileEndX - 1);
+        int y0 = std::max(s.minY, tileY);
+        int y1 = std::min(s.maxY, tileEndY - 1);
+
+        for (int y = y0; y <= y1; ++y) {
+            float py = y + 0.5f;
+            float* row = &m_depth[size_t(y) * m_width];
+            for (int x = x0; x <= x1; x += 8) {
+#if defined(__AVX__)
+                __m256 px = _mm256_add_ps(_mm256_set1_ps(x + 0.5f), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+                __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+                for (int e = 0; e < 3; ++e) {
+                    __m256 ev = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(s.a[e]), px), _mm256_set1_ps(s.b[e] * py + s.c[e]));
+                    mask = _mm256_and_ps(mask, _mm256_cmp_ps(ev, _mm256_setzero_ps(), _CMP_GE_OQ));
+                }
+                if (_mm256_movemask_ps(mask) == 0) {
+                    continue;
+                }
+                __m256 z = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(s.za), px), _mm256_set1_ps(s.zb * py + s.zc));
+                __m256 old = _mm256_loadu_ps(row + x);
+                __m256 nearer = _mm256_min_ps(old, z);
+                _mm256_storeu_ps(row + x, _mm256_blendv_ps(old, nearer, mask));
+#else
+                for (int half = 0; half < 8; half += 4) {
+                    __m128 px = _mm_add_ps(_mm_set1_ps(x + half + 0.5f), _mm_setr_ps(0, 1, 2, 3));
+                    __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                    for (int e = 0; e < 3; ++e) {
+                        __m128 ev = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(s.a[e]), px), _mm_set1_ps(s.b[e] * py + s.c[e]));
+                        mask = _mm_and_ps(mask, _mm_cmpge_ps(ev, _mm_setzero_ps()));
+                    }
+                    if (_mm_movemask_ps(mask) == 0) {
+                        continue;
+                    }
+                    __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(s.za), px), _mm_set1_ps(s.zb * py + s.zc));
+                    __m128 old = _mm_loadu_ps(row + x + half);
+                    __m128 nearer = _mm_min_ps(old, z);
+                    _mm_storeu_ps(row + x + half, _mm_or_ps(_mm_and_ps(mask, nearer), _mm_andnot_ps(mask, old)));
+                }
+#endif
+            }
+        }
+    }
+}
+
+void OcclusionCuller::rasterizeReference()
+{
+    std::fill(m_depth.begin(), m_depth.end(), 1.0f);
+    for (auto& t : m_tris) {
+        Setup s;
+        if (!setupTriangle(t.x, t.y, t.z, s)) {
+            continue;
+        }
+        for (int y = std::max(s.minY, 0); y <= std::min(s.maxY, m_height - 1); ++y) {
+            for (int x = std::max(s.minX, 0); x <= std::min(s.maxX, m_width - 1); ++x) {
+                float px = x + 0.5f, py = y + 0.5f;
+                bool inside = true;
+                for (int e = 0; e < 3; ++e) {
+                    inside = inside && (s.a[e] * px + (s.b[e] * py + s.c[e])) >= 0.0f;
+                }
+                if (inside) {
+                    float z = s.za * px + (s.zb * py + s.zc);
+                    float& d = m_depth[size_t(y) * m_width + x];
+                    d = std::min(d, z);
+                }
+            }
+        }
+    }
+    buildHierarchy();
+}
+
+void OcclusionCuller::buildHierarchy()
+{
+    m_levels[0] = m_depth;
+    for (size_t l = 1; l < m_levels.size(); ++l) {
+        const std::vector<float>& src = m_levels[l - 1];
+        glm::ivec2 srcSize = m_levelSize[l - 1];
+        glm::ivec2 size = m_levelSize[l];
+        std::vector<float>& dst = m_levels[l];
+        for (int y = 0; y < size.y; ++y) {
+            int sy0 = std::min(y * 2, srcSize.y - 1), sy1 = std::min(y * 2 + 1, srcSize.y - 1);
+            for (int x = 0; x < size.x; ++x) {
+                int sx0 = std::min(x * 2, srcSize.x - 1), sx1 = std::min(x * 2 + 1, srcSize.x - 1);
+                float m = std::max(std::max(src[size_t(sy0) * srcSize.x + sx0], src[size_t(sy0) * srcSize.x + sx1]),
+                                   std::max(src[size_t(sy1) * srcSize.x + sx0], src[size_t(sy1) * srcSize.x + sx1]));
+                dst[size_t(y) * size.x + x] = m;
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::isVisible(const AABB& box) const
+{
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, minZ = FLT_MAX;
+    for (int i = 0; i < 8; ++i) {
+        glm::vec4 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z, 1.0f);
+        glm::vec4 clip = m_viewProj * corner;
+        if (clip.w <= kNearW || clip.z < -clip.w) {
+            // crosses the near plane, can't be occluded by anything in front of it
+            return true;
+        }
+        float x = (clip.x / clip.w * 0.5f + 0.5f) * m_width;
+        float y = (clip.y / clip.w * 0.5f + 0.5f) * m_height;
+        float z = clip.z / clip.w * 0.5f + 0.5f;
+        minX = std::min(minX, x); maxX = std::max(maxX, x);
+        minY = std::min(minY, y); maxY = std::max(maxY, y);
+        minZ = std::min(minZ, z);
+    }
+
+    int x0 = std::max(0, int(std::floor(minX))), x1 = std::min(m_width - 1, int(std::floor(maxX)));
+    int y0 = std::max(0, int(std::floor(minY))), y1 = std::min(m_height - 1, int(std::floor(maxY)));
+    if (x0 > x1 || y0 > y1) {
+        // off screen, leave that to the frustum test
+        return true;
+    }
+
+    // coarsest level where the rectangle covers at most 4x4 texels
+    size_t level = 0;
+    while (level + 1 < m_levels.size() && (((x1 - x0) >> level) > 3 || ((y1 - y0) >> level) > 3)) {
+        level++;
+    }
+    const std::vector<float>& hiz = m_levels[level];
+    int w = m_levelSize[level].x;
+    for (int y = y0 >> level; y <= (y1 >> level); ++y) {
+        for (int x = x0 >> level; x <= (x1 >> level); ++x) {
+            if (hiz[size_t(y) * w + x] >= minZ) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+std::vector<uint16_t> OcclusionCuller::depthImage() const
+{
+    std::vector<uint16_t> image(size_t(m_width) * m_height);
+    uint16_t* out = image.data();
+    for (int y = m_height - 1; y >= 0; --y) {
+        for (int x = 0; x < m_width; ++x) {
+            *out++ = uint16_t(65535.0f * (1.0f - glm::clamp(m_depth[size_t(y) * m_width + x], 0.0f, 1.0f)) + 0.5f);
+        }
+    }
+    return image;
+}
+
+bool OcclusionCuller::writeDepthImage(const std::string& path) const
+{
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+    fprintf(fp, "P5\n%d %d\n65535\n", m_width, m_height);
+    // PGM samples wider than a byte are big-endian
+    std::vector<uint16_t> image = depthImage();
+    std::vector<unsigned char> bytes(image.size() * 2);
+    for (size_t i = 0; i < image.size(); ++i) {
+        bytes[2 * i] = (unsigned char)(image[i] >> 8);
+        bytes[2 * i + 1] = (unsigned char)(image[i] & 0xff);
+    }
+    fwrite(bytes.data(), 1, bytes.size(), fp);
+    fclose(fp);
+    return true;
+}
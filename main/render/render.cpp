@@ -9,17 +9,24 @@
 #include "camera.h"
 
 #include "model.h"
+#include "jobs.h"
+#include "culling.h"
+#include "glbackend.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
 
 
 #include <map>
+#include <algorithm>
 #include <unordered_map>
 #include <iostream>
 #include <fstream>
 #include <streambuf>
 #include <string>
+#include <cstring>
+#include <new>
 
 #include "stb_image.h"
 
@@ -31,12 +38,21 @@ Render::Render()
     auto config = RSLib::instance()->getConfig();
     m_scr_width = config->width();
     m_scr_height = config->height();
+    if (config->rt_width() > 0 && config->rt_height() > 0) {
+        m_rt_width = config->rt_width();
+        m_rt_height = config->rt_height();
+    }
+    m_rtViewport = glm::ivec2(m_rt_width, m_rt_height);
     m_camera = std::make_shared<Camera>(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f, 1.0f, 0.0f), float(m_scr_width)/m_scr_height);
 
     m_lastX = m_scr_width / 2.0f;
     m_lastY = m_scr_height / 2.0f;
 
     m_firstMouse = true;
+
+    if (auto jobs = RSLib::instance()->getJobSystem()) {
+        m_occlusion.setParallelFor(jobs->asParallelFor());
+    }
     m_pressedMouseButton = 0;
     m_show_fhps = false;
 
@@ -54,58 +70,211 @@ void Render::fb_resize_callback(GLFWwindow* window, int width, int height)
 {
     m_scr_width = width;
     m_scr_height = height;
-    glViewport(0, 0, width, height);
+    // with a render thread this runs without a context, the next packet carries the size
+    if (glfwGetCurrentContext() == window) {
+        glViewport(0, 0, width, height);
+    }
 }
 
 void Render::mouse_click_callback(GLFWwindow* window, int button, int action, int mode)
 {
     printf("Button: %x %x %x\n", button, action, mode);
-    if (action) {
-        m_pressedMouseButton = 1 << button;
-    } else {
-        m_pressedMouseButton = 0;
-    }
+    InputEvent event;
+    event.type = InputEvent::MouseButton;
+    event.code = int16_t(button);
+    event.action = int8_t(action);
+    queueInput(event);
 }
 
 void Render::mouse_move_callback(GLFWwindow* window, double xpos, double ypos)
 {
-    if (m_firstMouse) {
-        m_lastX = float(xpos);
-        m_lastY = float(ypos);
-        m_firstMouse = false;
+    InputEvent event;
+    event.type = InputEvent::CursorPos;
+    event.x = float(xpos);
+    event.y = float(ypos);
+    queueInput(event);
+}
+
+void Render::scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+    InputEvent event;
+    event.type = InputEvent::Scroll;
+    event.x = float(xoffset);
+    event.y = float(yoffset);
+    queueInput(event);
+}
+
+void Render::key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    // repeats don't change what's held
+    if (key < 0 || key > GLFW_KEY_LAST || action == GLFW_REPEAT) {
+        return;
+    }
+    InputEvent event;
+    event.type = InputEvent::Key;
+    event.code = int16_t(key);
+    event.action = int8_t(action);
+    queueInput(event);
+}
+
+void Render::queueInput(InputEvent event)
+{
+    if (m_replayInput) {
+        return;
+    }
+    event.time = glfwGetTime() - m_inputStart;
+    m_inputEvents.push_back(event);
+    if (m_recordInput) {
+        m_inputLog.record(event);
+    }
+}
+
+void Render::applyInput(const InputEvent& event)
+{
+    switch (event.type) {
+    case InputEvent::Key:
+        m_keysDown[event.code] = event.action != GLFW_RELEASE;
+        break;
+
+    case InputEvent::MouseButton:
+        if (event.action) {
+            m_pressedMouseButton = 1 << event.code;
+        } else {
+            m_pressedMouseButton = 0;
+        }
+        break;
+
+    case InputEvent::CursorPos: {
+        if (m_firstMouse) {
+            m_lastX = event.x;
+            m_lastY = event.y;
+            m_firstMouse = false;
+        }
+
+        float xoffset = event.x - m_lastX;
+        float yoffset = m_lastY - event.y; // reversed since y-coordinates go from bottom to top
+
+        m_lastX = event.x;
+        m_lastY = event.y;
+
+        if (m_pressedMouseButton == 1) {
+            m_camera->Rotate(int(event.x), int(event.y), int(xoffset), int(yoffset), m_rt_width, m_rt_height);
+        } else {
+            m_camera->ProcessMouseMovement(xoffset, yoffset);
+        }
+        break;
     }
 
-    float xoffset = float(xpos) - m_lastX;
-    float yoffset = m_lastY - float(ypos); // reversed since y-coordinates go from bottom to top
+    case InputEvent::Scroll:
+        m_camera->ProcessMouseScroll(event.y);
+        break;
 
-    m_lastX = float(xpos);
-    m_lastY = float(ypos);
+    case InputEvent::End:
+        break;
+    }
+}
 
-    if (m_pressedMouseButton == 1) {
-        m_camera->Rotate(int(xpos), int(ypos), int(xoffset), int(yoffset), m_rt_width, m_rt_height); 
+void Render::stepTime()
+{
+    if (m_offline) {
+        m_deltaTime = 1.0f / m_offlineFps;
+    } else if (m_replayInput) {
+        m_deltaTime = m_inputTimestep;
     } else {
-        m_camera->ProcessMouseMovement(xoffset, yoffset);
+        float currentFrame = static_cast<float>(glfwGetTime());
+        m_deltaTime = currentFrame - m_lastFrame;
+        m_lastFrame = currentFrame;
+    }
+    // summed in double, a float would drift from the recording over a long replay
+    if (m_offline || m_replayInput) {
+        m_inputTime += m_deltaTime;
+    } else {
+        m_inputTime = glfwGetTime() - m_inputStart;
     }
 }
 
-void Render::scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+Render::CameraState Render::cameraState() const
 {
-    m_camera->ProcessMouseScroll(float(yoffset));
+    return { m_camera->Position, m_camera->Front, m_camera->Zoom };
+}
+
+void Render::limitRenderAhead(Profiler& profiler)
+{
+    if (m_frameFences.empty()) {
+        return;
+    }
+    // the fence in this slot is the frame m_renderAhead swaps ago
+    GLsync& fence = m_frameFences[m_frameFence];
+    if (fence) {
+        auto start = std::chrono::steady_clock::now();
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        glDeleteSync(fence);
+        profiler.count("gpu.ahead_wait_us", std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_frameFence = (m_frameFence + 1) % m_frameFences.size();
+}
+
+void Render::pace(Profiler& profiler)
+{
+    if (!m_pacer.enabled()) {
+        return;
+    }
+    m_pacer.wait();
+    profiler.count("pacing.sleep_us", int64_t(m_pacer.sleptMs() * 1000.0));
+    profiler.count("pacing.spin_us", int64_t(m_pacer.spunMs() * 1000.0));
 }
 
 void Render::processInput(GLFWwindow* window)
 {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    // a replay hands over what was recorded up to the same point in time
+    if (m_replayInput) {
+        m_inputLog.replay(m_inputTime, m_inputEvents);
+        if (m_inputLog.finished()) {
+            spdlog::info("Input: replay of {0} finished after {1} frames", m_inputPath, m_inputFrames);
+            glfwSetWindowShouldClose(window, true);
+        }
+    }
+    m_inputFrames++;
+
+    // the camera moves in fixed steps whatever the frame time; events wait for the next step
+    int steps = m_simulation.advance(m_deltaTime);
+    float step = float(m_simulation.step());
+    for (int i = 0; i < steps; ++i) {
+        m_previousCamera = m_currentCamera;
+        // input latency runs from the oldest event the frame shows, replays have none
+        if (!m_replayInput && !m_inputEvents.empty() && m_inputEvent < 0.0) {
+            m_inputEvent = m_inputStart + m_inputEvents.front().time;
+        }
+        for (auto& event : m_inputEvents) {
+            applyInput(event);
+        }
+        m_inputEvents.clear();
+
+        if (m_keysDown[GLFW_KEY_W])
+            m_camera->ProcessKeyboard(CameraMovement::FORWARD, step);
+        if (m_keysDown[GLFW_KEY_S])
+            m_camera->ProcessKeyboard(CameraMovement::BACKWARD, step);
+        if (m_keysDown[GLFW_KEY_A])
+            m_camera->ProcessKeyboard(CameraMovement::LEFT, step);
+        if (m_keysDown[GLFW_KEY_D])
+            m_camera->ProcessKeyboard(CameraMovement::RIGHT, step);
+        m_currentCamera = cameraState();
+    }
+
+    if (m_keysDown[GLFW_KEY_ESCAPE])
         glfwSetWindowShouldClose(window, true);
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        m_camera->ProcessKeyboard(CameraMovement::FORWARD, m_deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        m_camera->ProcessKeyboard(CameraMovement::BACKWARD, m_deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        m_camera->ProcessKeyboard(CameraMovement::LEFT, m_deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        m_camera->ProcessKeyboard(CameraMovement::RIGHT, m_deltaTime);
+    // one capture per press
+    bool capture = m_keysDown[GLFW_KEY_F12];
+    m_captureKey = m_captureKey || (capture && !m_captureKeyDown);
+    m_captureKeyDown = capture;
+
+    bool stats = m_keysDown[GLFW_KEY_F3];
+    if (stats && !m_statsKeyDown) {
+        m_show_fhps = !m_show_fhps;
+    }
+    m_statsKeyDown = stats;
 }
 int Render::run()
 {
@@ -133,6 +302,13 @@ int Render::init()
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // uncomment this statement to fix compilation on OS X
 #endif
 
+    // a replay needs no one watching, e.g. on a CI machine; it still needs a GL context
+    auto config = RSLib::instance()->getConfig();
+    bool replay = !RSLib::instance()->getInputReplay().empty() || (config->has("input/replay") && !config->get_string("input/replay").empty());
+    if (replay && config->has("input/hidden") && config->get_bool("input/hidden")) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
+
     // glfw window creation
     // --------------------
     m_window = glfwCreateWindow(m_scr_width, m_scr_height, "OpenGL", NULL, NULL);
@@ -166,6 +342,11 @@ int Render::init()
     };
     glfwSetScrollCallback(m_window, scroll_cb);
 
+    auto key_cb = [](GLFWwindow* w, int key, int scancode, int action, int mods) {
+        reinterpret_cast<Render*>(glfwGetWindowUserPointer(w))->key_callback(w, key, scancode, action, mods);
+    };
+    glfwSetKeyCallback(m_window, key_cb);
+
     // tell GLFW to capture our mouse
     glfwSetInputMode(m_window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
@@ -175,6 +356,25 @@ int Render::init()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    if (config->has("gl_backend")) {
+        std::string backend = config->get_string("gl_backend");
+        if (backend == "trace" || backend == "null") {
+            m_glBackend = std::make_unique<GLBackend>(backend == "null" ? GLBackend::Kind::Null : GLBackend::Kind::Trace);
+            m_glBackend->install();
+            spdlog::info("GL: {0} backend", backend);
+        } else if (backend != "driver") {
+            spdlog::warn("GL: unknown backend {0}, using the driver", backend);
+        }
+    }
+    if (config->has("gl_trace/output") && !config->get_string("gl_trace/output").empty()) {
+        std::string path = config->get_string("gl_trace/output");
+        m_glTraceFrames = config->has("gl_trace/frames") ? uint64_t(std::max(1, config->get_int("gl_trace/frames"))) : 10;
+        if (m_glTrace.open(path)) {
+            spdlog::info("GL trace: recording loading and {0} frames into {1}", m_glTraceFrames, path);
+        } else {
+            spdlog::error("GL trace: can't write {0}", path);
+        }
+    }
 
     stbi_set_flip_vertically_on_load(true);
 
@@ -194,11 +394,173 @@ int Render::prepare()
     auto config = RSLib::instance()->getConfig();
 
     // load model
+    m_materials = std::make_shared<MaterialLibrary>();
+    if (config->has("texture_streaming/enable") && config->get_bool("texture_streaming/enable")) {
+        TextureStreamer::Settings settings;
+        if (config->has("texture_streaming/budget_mb")) {
+            settings.budget = size_t(std::max(1, config->get_int("texture_streaming/budget_mb"))) << 20;
+        }
+        if (config->has("texture_streaming/upload_mb_per_frame")) {
+            settings.uploadPerFrame = size_t(std::max(1, config->get_int("texture_streaming/upload_mb_per_frame"))) << 20;
+        }
+        if (config->has("texture_streaming/tail_size")) {
+            settings.tailSize = std::max(1, config->get_int("texture_streaming/tail_size"));
+        }
+        m_materials->enableStreaming(settings);
+        if (config->has("texture_streaming/texel_scale")) {
+            m_materials->streamer()->setTexelScale(config->get_float("texture_streaming/texel_scale"));
+        }
+    }
+    m_geometry = std::make_shared<GeometryArena>();
     auto models = config->get_object_keys("model");
     for (auto& m : models) {
         std::string path = "model/" + m;
-        m_model.emplace_back(std::make_shared<Model>(m, path));
+        m_model.emplace_back(std::make_shared<Model>(m, path, m_materials, m_geometry));
+        m_model.back()->setViewportHeight(float(m_rt_height));
     }
+    // every model is in, one upload for all the geometry; maps of equal size go into one array
+    m_geometry->upload();
+    spdlog::info("Geometry: {0} vertices, {1} index bytes in one arena", m_geometry->vertexCount(), m_geometry->indexBytes());
+    m_materials->upload();
+    m_materials->flush();
+
+    // models sharing a fragment shader share an indirect program, so they can share a multi-draw
+    bool multiDraw = config->has("multi_draw") && config->get_bool("multi_draw");
+    m_multiDraw = multiDraw && MultiDrawBuffers::supported();
+    m_indirectPrograms.assign(m_model.size(), nullptr);
+    if (m_multiDraw) {
+        std::map<std::string, Shader*> programs;
+        for (size_t i = 0; i < m_model.size(); ++i) {
+            auto& m = m_model[i];
+            if (!m->enable() || m->indirectVertexShader().empty()) {
+                continue;
+            }
+            Shader*& program = programs[m->fragmentShader()];
+            if (!program) {
+                m_indirectShaders.push_back(std::make_shared<Shader>(m->indirectVertexShader().c_str(), m->fragmentShader().c_str()));
+                program = m_indirectShaders.back().get();
+                m_materials->setupProgram(*program);
+            }
+            m_indirectPrograms[i] = program;
+        }
+    }
+    spdlog::info("Multi-draw indirect: {0}", m_multiDraw ? "on" : (multiDraw ? "needs GL 4.3 and ARB_shader_draw_parameters, one draw per mesh" : "off"));
+
+    bool gpuCulling = config->has("gpu_culling") && config->get_bool("gpu_culling");
+    m_gpuCulling = gpuCulling && m_multiDraw && GpuCuller::supported();
+    if (m_multiDraw) {
+        // packets are recorded before the GL thread uploads anything, the names must exist
+        m_indirect.reserve(0);
+    }
+    if (m_gpuCulling) {
+        m_culler.init(m_rt_width, m_rt_height);
+    }
+    spdlog::info("GPU culling: {0}", m_gpuCulling ? "on" : (gpuCulling ? "needs the multi-draw path and compute shaders" : "off"));
+
+    std::string record = RSLib::instance()->getInputRecording();
+    if (record.empty() && config->has("input/record")) {
+        record = config->get_string("input/record");
+    }
+    std::string replay = RSLib::instance()->getInputReplay();
+    if (replay.empty() && config->has("input/replay")) {
+        replay = config->get_string("input/replay");
+    }
+    if (config->has("input/timestep")) {
+        m_inputTimestep = std::max(0.001f, config->get_float("input/timestep"));
+    }
+    if (!replay.empty()) {
+        m_replayInput = m_inputLog.load(replay);
+        if (m_replayInput) {
+            m_inputPath = replay;
+            spdlog::info("Input: replaying {0} events, {1:.1f} s of {2}, {3:.1f} ms per frame", m_inputLog.events().size(), m_inputLog.duration(), replay, m_inputTimestep * 1000.0f);
+        } else {
+            spdlog::error("Input: {0} isn't an input log, using the devices", replay);
+        }
+    } else if (!record.empty()) {
+        m_recordInput = true;
+        m_inputPath = record;
+        spdlog::info("Input: recording to {0}", record);
+    }
+
+    double stepHz = config->has("simulation/step_hz") ? std::max(1.0f, config->get_float("simulation/step_hz")) : 120.0;
+    int maxSteps = config->has("simulation/max_steps") ? config->get_int("simulation/max_steps") : 8;
+    m_simulation = FixedStep(1.0 / stepHz, maxSteps);
+    m_interpolate = !config->has("simulation/interpolate") || config->get_bool("simulation/interpolate");
+    m_previousCamera = m_currentCamera = cameraState();
+    spdlog::info("Simulation: {0:.0f} Hz, up to {1} steps per frame{2}", stepHz, maxSteps, m_interpolate ? ", interpolated" : "");
+
+    // the context is current here, the swap interval stays with it on the render thread
+    bool vsync = !config->has("frame_pacing/vsync") || config->get_bool("frame_pacing/vsync");
+    glfwSwapInterval(vsync ? 1 : 0);
+    double targetFps = config->has("frame_pacing/target_fps") ? config->get_float("frame_pacing/target_fps") : 0.0;
+    m_pacer.setTarget(targetFps);
+    m_renderAhead = config->has("frame_pacing/render_ahead") ? std::max(0, config->get_int("frame_pacing/render_ahead")) : 0;
+    m_frameFences.assign(m_renderAhead, nullptr);
+    spdlog::info("Frame pacing: vsync {0}, {1}, render ahead {2}", vsync ? "on" : "off",
+        m_pacer.enabled() ? std::to_string(int(targetFps)) + " fps target" : std::string("no target"),
+        m_renderAhead > 0 ? std::to_string(m_renderAhead) + " frames" : std::string("left to the driver"));
+
+    std::string offline = RSLib::instance()->getOfflineOutput();
+    if (offline.empty() && config->has("offline/output")) {
+        offline = config->get_string("offline/output");
+    }
+    m_offline = !offline.empty();
+    if (m_offline) {
+        m_offlineFps = config->has("offline/fps") ? std::max(1, config->get_int("offline/fps")) : 30;
+        m_orbitSeconds = config->has("offline/orbit_seconds") ? config->get_float("offline/orbit_seconds") : 0.0f;
+        int frames = config->has("offline/frames") ? config->get_int("offline/frames") : 0;
+        // no count renders one orbit
+        m_offlineFrames = frames > 0 ? uint64_t(frames) : uint64_t(std::max(1.0f, m_orbitSeconds * m_offlineFps));
+        spdlog::info("Offline: {0} frames at {1} fps to {2}", m_offlineFrames, m_offlineFps, offline);
+        if (m_orbitSeconds > 0.0f) {
+            spdlog::info("Offline: orbiting the scene every {0:.1f} s", m_orbitSeconds);
+        }
+    }
+
+    // the target stays allocated at full size, only the viewport into it is scaled. Offline
+    // the size is fixed: a Y4M stream has one, and scaling by GPU time isn't repeatable.
+    m_dynamicResolution = !m_offline && config->has("dynamic_resolution/enable") && config->get_bool("dynamic_resolution/enable");
+    if (m_dynamicResolution) {
+        float budget = config->has("dynamic_resolution/budget_ms") ? config->get_float("dynamic_resolution/budget_ms") : 12.0f;
+        float minScale = config->has("dynamic_resolution/min_scale") ? config->get_float("dynamic_resolution/min_scale") : 0.5f;
+        m_resolution = ResolutionController(budget, minScale, 1.0f);
+        spdlog::info("Dynamic resolution: {0:.1f} ms budget, {1}x{2} down to {3:.0f}%", budget, m_rt_width, m_rt_height, minScale * 100.0f);
+    }
+
+    FrameCapture::Settings capture;
+    if (config->has("capture/directory")) {
+        capture.directory = config->get_string("capture/directory");
+    }
+    if (config->has("capture/format")) {
+        capture.format = config->get_string("capture/format");
+    }
+    if (config->has("capture/golden")) {
+        capture.golden = config->get_string("capture/golden");
+    }
+    if (config->has("capture/tolerance")) {
+        capture.tolerance = config->get_int("capture/tolerance");
+    }
+    if (m_offline) {
+        capture.stream = offline;
+        capture.fps = m_offlineFps;
+    }
+    m_capture.setup(capture);
+    m_captureEnabled = config->has("capture/enable") && config->get_bool("capture/enable");
+    if (m_offline) {
+        m_captureEnabled = true;
+        m_captureInterval = 1;
+        m_captureCount = 0;
+    } else if (m_captureEnabled) {
+        m_captureInterval = config->has("capture/interval") ? std::max(1, config->get_int("capture/interval")) : 1;
+        m_captureCount = config->has("capture/count") ? config->get_int("capture/count") : 0;
+        spdlog::info("Capture: every {0} frames to {1} as {2}{3}", m_captureInterval, capture.directory, capture.format,
+            capture.golden.empty() ? "" : ", compared with " + capture.golden);
+    }
+
+    m_show_fhps = config->has("stats/overlay") && config->get_bool("stats/overlay");
+    m_overlayScale = config->has("stats/scale") ? std::max(1, config->get_int("stats/scale")) : 2;
+    m_statsPath = config->has("stats/dump") ? config->get_string("stats/dump") : "";
+    m_overlay.init();
 
     // configure global opengl state
     // -----------------------------
@@ -218,11 +580,14 @@ int Render::prepare()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_textureColorBuffer, 0);
 
-    unsigned int rbo;
-    glGenRenderbuffers(1, &rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, m_rt_width, m_rt_height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
+    // a texture rather than a renderbuffer, the GPU culler builds its Hi-Z pyramid from it
+    glGenTextures(1, &m_depthTexture);
+    glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, m_rt_width, m_rt_height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_depthTexture, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
 
 
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
@@ -233,121 +598,850 @@ int Render::prepare()
     return 0;
 }
 
-int Render::render()
+void Render::setupInstances()
 {
-    std::unordered_map<std::string, std::vector<glm::vec3>> offset_table;
+    // instances come from the app's "instances" list, a model without any gets one at the origin
+    auto config = RSLib::instance()->getConfig();
+    std::unordered_map<std::string, uint32_t> objects;
+    for (uint32_t i = 0; i < m_model.size(); ++i) {
+        objects[m_model[i]->name()] = i;
+    }
+    m_scene.clear();
+    size_t listed = config->has("instances") ? m_scene.load(*config, "instances", objects) : 0;
+    std::vector<bool> placed(m_model.size(), false);
+    for (uint32_t n = 0; n < m_scene.size(); ++n) {
+        if (m_scene.object(n) != Scene::None) {
+            placed[m_scene.object(n)] = true;
+        }
+    }
+    for (uint32_t i = 0; i < m_model.size(); ++i) {
+        if (!placed[i]) {
+            m_scene.add(i);
+        }
+    }
+    m_scene.update();
+
+    // listed instances are drawn back to front within their model
+    m_instances.clear();
+    m_nodeInstance.assign(m_scene.size(), Scene::None);
+    for (uint32_t i = 0; i < m_model.size(); ++i) {
+        auto& m = m_model[i];
+        if (m->check("framebuffer") || !m->enable() || !m->bounds().valid()) {
+            continue;
+        }
+        for (uint32_t n = 0; n < m_scene.size(); ++n) {
+            if (m_scene.object(n) == i) {
+                m_nodeInstance[n] = uint32_t(m_instances.size());
+                m_instances.push_back({ m.get(), m_scene.world(n), n < listed, i });
+            }
+        }
+    }
 
-    offset_table["cube"] = 
-        {   glm::vec3(-1.0f, 0.0f, -1.0f),
-            glm::vec3(2.0f, 0.0f, 0.0f),
-        };
+    m_modelSegment.assign(m_model.size(), 0);
+    for (uint32_t i = 1; i < m_model.size(); ++i) {
+        m_modelSegment[i] = m_modelSegment[i - 1] + (m_model[i - 1]->check("framebuffer") ? 1 : 0);
+    }
 
-    offset_table["panel"] = 
-        {   glm::vec3(-1.5f, 0.0f, -0.48f),
-            glm::vec3(1.5f, 0.0f, 0.51f),
-            glm::vec3(0.0f, 0.0f, 0.7f),
-            glm::vec3(-0.3f, 0.0f, -2.3f),
-            glm::vec3(0.5f, 0.0f, -0.6f) 
+    m_instanceBounds.clear();
+    size_t meshes = 0;
+    for (auto& inst : m_instances) {
+        m_instanceBounds.push_back(inst.model->bounds().transformed(inst.transform));
+        meshes += inst.model->meshCount();
+    }
+    m_bvh.build(m_instanceBounds);
+
+    // sized for every instance being visible, so frames don't grow anything
+    m_visibleItems.reserve(m_instances.size());
+    size_t commandBytes = m_multiDraw ? meshes * (sizeof(DrawElementsIndirectCommand) + sizeof(DrawData) + sizeof(DrawBatch)) + m_instances.size() * sizeof(DrawBatch) : 0;
+    if (m_gpuCulling) {
+        commandBytes += meshes * (sizeof(CullInput) + sizeof(CullBatch)) + m_instances.size() * sizeof(CullBatch);
+    }
+    m_frameMemory.reserve(m_instances.size() * (sizeof(DrawItem) + 32) + commandBytes + 4096);
+    m_sceneCommands.resize(m_frameMemory.frames());
+}
+
+void Render::buildPacket(FramePacket& packet)
+{
+    auto start = std::chrono::steady_clock::now();
+    m_frameMemory.beginFrame();
+
+    glm::mat4 projection = glm::perspective(glm::radians(m_camera->Zoom), (float)m_scr_width/ (float)m_scr_height, 0.1f, 100.0f);
+    glm::mat4 view = m_camera->GetViewMatrix();
+    // where view looks from, culling and the depth sort see the same camera
+    glm::vec3 eye = m_camera->Position;
+    if (m_interpolate) {
+        // the same basis Camera builds, between the last two steps
+        float alpha = float(m_simulation.alpha());
+        glm::vec3 position = glm::mix(m_previousCamera.position, m_currentCamera.position, alpha);
+        glm::vec3 front = glm::normalize(glm::mix(m_previousCamera.front, m_currentCamera.front, alpha));
+        glm::vec3 right = glm::normalize(glm::cross(front, m_camera->WorldUp));
+        view = glm::lookAt(position, position + front, glm::normalize(glm::cross(right, front)));
+        eye = position;
+        float zoom = glm::mix(m_previousCamera.zoom, m_currentCamera.zoom, alpha);
+        projection = glm::perspective(glm::radians(zoom), (float)m_scr_width/ (float)m_scr_height, 0.1f, 100.0f);
+    }
+    if (m_offline && m_orbitSeconds > 0.0f) {
+        // from the frame number rather than summed steps, frame n is the same on every run
+        double seconds = double(m_frame) / m_offlineFps;
+        float angle = float(glm::two_pi<double>() * seconds / m_orbitSeconds);
+        glm::vec3 offset = glm::vec3(glm::rotate(glm::mat4(1.0f), angle, m_camera->WorldUp) * glm::vec4(m_camera->Position - m_orbitCenter, 0.0f));
+        eye = m_orbitCenter + offset;
+        view = glm::lookAt(eye, m_orbitCenter, m_camera->WorldUp);
+    }
+
+    packet.frame = m_frame++;
+    packet.inputTime = std::chrono::steady_clock::now();
+    packet.view = view;
+    packet.projection = projection;
+    packet.width = m_scr_width;
+    packet.height = m_scr_height;
+    packet.inputEvent = m_inputEvent;
+    m_inputEvent = -1.0;
+    packet.showStats = m_show_fhps;
+    packet.capture = m_captureKey;
+    m_captureKey = false;
+    if (m_captureEnabled && (m_captureCount == 0 || m_captured < m_captureCount) && packet.frame % m_captureInterval == 0) {
+        packet.capture = true;
+        m_captured++;
+    }
+
+    // moved nodes update their instances and refit the BVH
+    if (m_scene.update() > 0) {
+        for (uint32_t n : m_scene.updated()) {
+            uint32_t i = m_nodeInstance[n];
+            if (i != Scene::None) {
+                m_instances[i].transform = m_scene.world(n);
+                m_instanceBounds[i] = m_instances[i].model->bounds().transformed(m_instances[i].transform);
+                m_bvh.update(i, m_instanceBounds[i]);
+            }
+        }
+        m_bvh.refit();
+    }
+
+    std::pmr::memory_resource* frame = m_frameMemory.resource();
+
+    // with GPU culling every instance is a candidate, cull.comp tests their meshes
+    m_visibleItems.clear();
+    if (m_gpuCulling) {
+        for (uint32_t i = 0; i < m_instances.size(); ++i) {
+            m_visibleItems.push_back(i);
+        }
+    } else {
+        m_bvh.queryFrustum(extractFrustum(projection * view), m_visibleItems);
+    }
+    size_t inFrustum = m_visibleItems.size();
+
+    // occluders are drawn into the CPU depth buffer, everything else is tested against it
+    m_occlusion.begin(projection * view);
+    for (uint32_t i : m_visibleItems) {
+        Model* model = m_instances[i].model;
+        if (model->isOccluder() && !m_gpuCulling) {
+            m_occlusion.addOccluder(m_instances[i].transform, model->occluderPositions(), model->occluderIndices());
+        }
+    }
+    if (m_occlusion.triangleCount() > 0) {
+        m_occlusion.rasterize();
+        // the tests only read the hierarchy, so they split across the workers
+        std::pmr::vector<uint8_t> occluded(m_visibleItems.size(), 0, frame);
+        auto testOcclusion = [this, &occluded](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+                uint32_t i = m_visibleItems[k];
+                occluded[k] = !m_instances[i].model->isOccluder() && !m_occlusion.isVisible(m_instanceBounds[i]);
+            }
         };
-    
-    // render loop
-    // -----------
-    while (!glfwWindowShouldClose(m_window)) {
-        // per-frame time logic
-        // --------------------
-        float currentFrame = static_cast<float>(glfwGetTime());
-        m_deltaTime = currentFrame - m_lastFrame;
-        m_lastFrame = currentFrame;
+        if (auto jobs = RSLib::instance()->getJobSystem()) {
+            jobs->parallelFor(m_visibleItems.size(), testOcclusion, 64);
+        } else {
+            testOcclusion(0, m_visibleItems.size());
+        }
+        size_t kept = 0;
+        for (size_t k = 0; k < m_visibleItems.size(); ++k) {
+            if (!occluded[k]) {
+                m_visibleItems[kept++] = m_visibleItems[k];
+            }
+        }
+        m_visibleItems.resize(kept);
+    }
+    if (!m_gpuCulling) {
+        m_profiler.count("instances.drawn", m_visibleItems.size());
+        m_profiler.count("instances.culled", m_instances.size() - inFrustum);
+        m_profiler.count("instances.occluded", inFrustum - m_visibleItems.size());
+    }
 
-        glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
-        lightPos.x = 2.0f * sin(currentFrame);
-        lightPos.y = -0.3f; // *sin(currentFrame) + cos(currentFrame);
-        lightPos.z = 1.5f * cos(currentFrame);
-        // input
-        // -----
-        processInput(m_window);
+    // m_model order first, then listed instances back to front and the rest in instance order
+    struct SortKey {
+        uint64_t key;
+        uint32_t item;
+    };
+    std::pmr::vector<SortKey> keys(frame);
+    keys.reserve(m_visibleItems.size());
+    for (uint32_t i : m_visibleItems) {
+        const DrawItem& d = m_instances[i];
+        uint32_t order = i;
+        if (d.sorted) {
+            // non-negative floats order like their bits, inverted for farthest first
+            float distance = glm::length(eye - glm::vec3(d.transform[3]));
+            uint32_t bits;
+            std::memcpy(&bits, &distance, sizeof(bits));
+            order = ~bits;
+        }
+        keys.push_back({ (uint64_t(d.modelIndex) << 32) | order, i });
+    }
+    std::sort(keys.begin(), keys.end(), [](const SortKey& a, const SortKey& b) {
+        return a.key < b.key || (a.key == b.key && a.item < b.item);
+    });
 
-        // render
-        // ------
-        glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffer);
-        glViewport(0, 0, m_rt_width, m_rt_height);
-        glEnable(GL_DEPTH_TEST);
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-
-        glm::mat4 projection = glm::perspective(glm::radians(m_camera->Zoom), (float)m_scr_width/ (float)m_scr_height, 0.1f, 100.0f);
-        glm::mat4 view = m_camera->GetViewMatrix();
-        // render the loaded model
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f)); // it's a bit too big for our scene, so scale it down
-
-        for (auto& m : m_model) {
-            if (m->check("framebuffer")) {
-                continue;
-            } else {
-                if (offset_table.find(m->name()) != offset_table.end()) {
-                    std::map<float, glm::vec3> ordered;
-                    for (auto& t : offset_table[m->name()]) {
-                        float distance = glm::length(m_camera->Position - t);
-                        ordered[distance] = t;
-                    }
-                    for (auto it = ordered.rbegin(); it != ordered.rend();it++) {
-                        model = glm::mat4(1.0f);
-                        model = glm::translate(model, it->second);
-
-                        m->draw(model, view, projection);
-                    }
-
-                } else {
-                    model = glm::mat4(1.0f);
-                    m->draw(model, view, projection);
+    DrawItem* draws = m_frameMemory.arena().allocate<DrawItem>(keys.size());
+    for (size_t k = 0; k < keys.size(); ++k) {
+        new (&draws[k]) DrawItem(m_instances[keys[k].item]);
+    }
+    packet.draws = draws;
+    packet.drawCount = keys.size();
+
+    buildCommands(packet);
+    measureTextures(packet);
+    recordScene(packet);
+    packet.buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+namespace {
+
+// the arrays of two batches can be bound at once when no slot needs two different ones
+bool mergeArrays(std::array<unsigned int, SlotCount>& into, const std::array<unsigned int, SlotCount>& arrays)
+{
+    for (unsigned int s = 0; s < SlotCount; ++s) {
+        if (into[s] && arrays[s] && into[s] != arrays[s]) {
+            return false;
+        }
+    }
+    for (unsigned int s = 0; s < SlotCount; ++s) {
+        if (arrays[s]) {
+            into[s] = arrays[s];
+        }
+    }
+    return true;
+}
+
+}
+
+void Render::buildCommands(FramePacket& packet)
+{
+    packet.commandCount = 0;
+    packet.batchCount = 0;
+    if (!m_multiDraw) {
+        return;
+    }
+
+    size_t capacity = 0;
+    for (size_t k = 0; k < packet.drawCount; ++k) {
+        capacity += packet.draws[k].model->meshCount();
+    }
+    FrameArena& arena = m_frameMemory.arena();
+    DrawElementsIndirectCommand* commands = arena.allocate<DrawElementsIndirectCommand>(capacity);
+    DrawData* drawData = arena.allocate<DrawData>(capacity);
+    DrawBatch* batches = arena.allocate<DrawBatch>(capacity + packet.drawCount);
+    CullInput* cullInputs = m_gpuCulling ? arena.allocate<CullInput>(capacity) : nullptr;
+    // instances drawn without the indirect path aren't seen by cull.comp
+    Frustum frustum = extractFrustum(packet.projection * packet.view);
+
+    // same order as the draw list, so transparent instances stay back to front
+    size_t count = 0;
+    size_t batchCount = 0;
+    for (size_t k = 0; k < packet.drawCount; ++k) {
+        const DrawItem& d = packet.draws[k];
+        uint32_t segment = m_modelSegment[d.modelIndex];
+        Shader* program = m_indirectPrograms[d.modelIndex];
+        if (!program) {
+            if (!m_gpuCulling || isVisible(frustum, d.model->bounds().transformed(d.transform))) {
+                batches[batchCount++] = { nullptr, &d, 0, 0, 0, segment, {}, false };
+            }
+            continue;
+        }
+        d.model->forEachVisibleMesh(d.transform, packet.view, packet.projection, [&](Mesh& mesh, unsigned lod) {
+            const GeometryRange& r = mesh.range(lod);
+            uint32_t indexSize = r.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+            commands[count] = { r.indexCount, 1, r.indexOffset / indexSize, int32_t(r.baseVertex), 0 };
+            drawData[count].model = d.transform;
+            drawData[count].material = glm::uvec4(mesh.material());
+
+            DrawBatch* batch = batchCount ? &batches[batchCount - 1] : nullptr;
+            if (!batch || batch->direct || batch->program != program || batch->indexType != r.indexType ||
+                batch->segment != segment || !mergeArrays(batch->arrays, m_materials->arrays(mesh.material()))) {
+                batches[batchCount++] = { program, nullptr, r.indexType, uint32_t(count), 0, segment, m_materials->arrays(mesh.material()), false };
+            }
+            batches[batchCount - 1].count++;
+            batches[batchCount - 1].ordered |= d.sorted;
+            if (cullInputs) {
+                AABB box = mesh.bounds().transformed(d.transform);
+                cullInputs[count].boundsMin = glm::vec4(box.min, 0.0f);
+                cullInputs[count].boundsMax = glm::vec4(box.max, 0.0f);
+                cullInputs[count].batch = glm::uvec4(uint32_t(batchCount - 1), 0, 0, 0);
+            }
+            count++;
+        }, !m_gpuCulling);
+    }
+
+    packet.commands = commands;
+    packet.drawData = drawData;
+    packet.commandCount = count;
+    packet.batches = batches;
+    packet.batchCount = batchCount;
+    packet.cullInputs = cullInputs;
+    packet.cullBatches = nullptr;
+    if (m_gpuCulling) {
+        CullBatch* cullBatches = arena.allocate<CullBatch>(batchCount);
+        for (size_t b = 0; b < batchCount; ++b) {
+            cullBatches[b].info = glm::uvec4(batches[b].first, batches[b].ordered ? 1 : 0, 0, 0);
+        }
+        packet.cullBatches = cullBatches;
+        m_profiler.count("gpucull.candidates", count);
+    }
+}
+
+void Render::measureTextures(FramePacket& packet)
+{
+    packet.materialPixels = nullptr;
+    packet.materialCount = 0;
+    if (!m_materials->streamer()) {
+        return;
+    }
+
+    size_t count = m_materials->size();
+    float* pixels = m_frameMemory.arena().allocate<float>(count);
+    std::fill(pixels, pixels + count, 0.0f);
+    // with GPU culling the draw list holds every instance, only visible ones count here
+    Frustum frustum = extractFrustum(packet.projection * packet.view);
+    for (size_t k = 0; k < packet.drawCount; ++k) {
+        const DrawItem& d = packet.draws[k];
+        if (m_gpuCulling && !isVisible(frustum, d.model->bounds().transformed(d.transform))) {
+            continue;
+        }
+        glm::mat4 modelView = packet.view * d.transform;
+        d.model->forEachVisibleMesh(d.transform, packet.view, packet.projection, [&](Mesh& mesh, unsigned) {
+            if (mesh.material() < count) {
+                float& p = pixels[mesh.material()];
+                p = std::max(p, d.model->projectedSize(mesh, modelView, packet.projection));
+            }
+        });
+    }
+    packet.materialPixels = pixels;
+    packet.materialCount = count;
+}
+
+void Render::recordScene(FramePacket& packet)
+{
+    std::vector<CommandList>& lists = m_sceneCommands[packet.frame % m_sceneCommands.size()];
+    // lists are only ever added, a list keeps its storage from frame to frame
+    size_t count = 1;
+    size_t meshes = 0;
+    if (m_multiDraw) {
+        lists.resize(std::max<size_t>(lists.size(), 1));
+        lists[0].clear();
+        drawBatches(packet, 0, packet.batchCount, meshes, lists[0]);
+    } else {
+        // every item is a program, its matrices and a draw per mesh; chunks of them are
+        // recorded by the workers into lists of their own, played in order
+        const size_t itemsPerList = 64;
+        count = std::max<size_t>(1, (packet.drawCount + itemsPerList - 1) / itemsPerList);
+        lists.resize(std::max(lists.size(), count));
+        std::atomic<size_t> drawn{ 0 };
+        auto record = [&](size_t begin, size_t end) {
+            for (size_t l = begin; l < end; ++l) {
+                CommandList& commands = lists[l];
+                commands.clear();
+                size_t calls = 0;
+                for (size_t i = l * itemsPerList; i < std::min(packet.drawCount, (l + 1) * itemsPerList); ++i) {
+                    calls += packet.draws[i].model->draw(commands, packet.draws[i].transform, packet.view, packet.projection);
                 }
+                drawn += calls;
             }
+        };
+        auto jobs = RSLib::instance()->getJobSystem();
+        if (jobs && count > 1) {
+            // by reference, a std::function of the lambda itself would be allocated
+            jobs->parallelFor(count, std::ref(record), 1);
+        } else {
+            record(0, count);
+        }
+        meshes = drawn.load();
+    }
+    packet.sceneCommands = lists.data();
+    packet.sceneListCount = count;
+    packet.sceneMeshes = meshes;
+}
+
+void Render::submit(const FramePacket& packet, Profiler& profiler)
+{
+    const glm::mat4& view = packet.view;
+    const glm::mat4& projection = packet.projection;
+    auto start = std::chrono::steady_clock::now();
+
+    float gpuMs = m_frameTimer.poll();
+    if (gpuMs >= 0.0f) {
+        profiler.sample("gpu.frame_ms", gpuMs);
+    }
+    m_frameTimer.begin();
+
+    for (size_t i = 0; i < packet.materialCount; ++i) {
+        if (packet.materialPixels[i] > 0.0f) {
+            m_materials->request(uint32_t(i), packet.materialPixels[i]);
+        }
+    }
+    m_materials->flush();
+    if (TextureStreamer* streamer = m_materials->streamer()) {
+        const TextureStreamer::Stats& stats = streamer->stats();
+        profiler.count("stream.resident_mb", int64_t(stats.resident >> 20));
+        profiler.count("stream.wanted_mb", int64_t(stats.wanted >> 20));
+        profiler.count("stream.loads", int64_t(stats.loads - m_streamStats.loads));
+        profiler.count("stream.evictions", int64_t(stats.evictions - m_streamStats.evictions));
+        profiler.count("stream.upload_kb", int64_t((stats.uploadedBytes - m_streamStats.uploadedBytes) >> 10));
+        m_streamStats = stats;
+    }
+    if (m_gpuCulling) {
+        // batches keep their full size, culled commands draw no instances
+        m_culler.cull(packet.commands, packet.drawData, packet.cullInputs, packet.commandCount,
+            packet.cullBatches, packet.batchCount, m_culler.params(projection * view), m_indirect);
+    } else if (m_multiDraw) {
+        m_indirect.upload(packet.commands, packet.drawData, packet.commandCount);
+    }
+
+    // results of earlier frames decide this one's size
+    if (m_dynamicResolution) {
+        float ms = m_sceneTimer.poll();
+        if (ms >= 0.0f) {
+            m_resolution.update(ms);
+            profiler.count("gpu.scene_us", int64_t(ms * 1000.0f));
+            profiler.sample("gpu.scene_ms", ms);
         }
+        m_rtViewport = m_resolution.viewport(int(m_rt_width), int(m_rt_height));
+    }
+    profiler.count("rt.width", m_rtViewport.x);
+    profiler.count("rt.height", m_rtViewport.y);
+    profiler.count("rt.scale_pct", int64_t(100.0f * m_rtViewport.x / m_rt_width + 0.5f));
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffer);
+    glViewport(0, 0, m_rtViewport.x, m_rtViewport.y);
+    glEnable(GL_DEPTH_TEST);
+    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (m_dynamicResolution) {
+        m_sceneTimer.begin();
+    }
+
+    //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+    // everything above went to GL directly
+    m_executor.resetStats();
+    m_executor.invalidate();
+    for (size_t i = 0; i < packet.sceneListCount; ++i) {
+        m_executor.execute(packet.sceneCommands[i]);
+    }
+    // without the multi-draw path every mesh is a draw call
+    size_t calls = size_t(m_executor.stats().issued[CommandExecutor::Draw]);
+    size_t meshes = packet.sceneMeshes;
+    if (m_dynamicResolution) {
+        m_sceneTimer.end();
+    }
+    if (packet.capture) {
+        m_capture.read(packet.frame, m_rtViewport.x, m_rtViewport.y);
+    }
+    profiler.count("draw.calls", calls);
+    profiler.count("draw.meshes", meshes);
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0, 0, m_scr_width, m_scr_height);
-        glClearColor(1.0f, 1.0f, 1.0f, 1.0f); // set clear color to white (not really necessery actually, since we won't be able to see behind the quad anyways)
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        for (auto& m : m_model) {
-            if (m->check("framebuffer")) {
-                glDisable(GL_DEPTH_TEST);
-                glBindTexture(GL_TEXTURE_2D, m_textureColorBuffer);
-                m->draw();
-            } else {
-                if (offset_table.find(m->name()) != offset_table.end()) {
-                    std::map<float, glm::vec3> ordered;
-                    for (auto& t : offset_table[m->name()]) {
-                        float distance = glm::length(m_camera->Position - t);
-                        ordered[distance] = t;
-                    }
-                    for (auto it = ordered.rbegin(); it != ordered.rend();it++) {
-                        model = glm::mat4(1.0f);
-                        model = glm::translate(model, it->second);
-
-                        m->draw(model, view, projection);
-                    }
-
-                } else {
-                    model = glm::mat4(1.0f);
-                    m->draw(model, view, projection);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (m_gpuCulling) {
+        // occluders for the next frame; the framebuffer models below don't write this depth
+        m_culler.buildHiZ(m_depthTexture, projection * view, m_rtViewport.x, m_rtViewport.y);
+    }
+    glViewport(0, 0, packet.width, packet.height);
+    glClearColor(1.0f, 1.0f, 1.0f, 1.0f); // set clear color to white (not really necessery actually, since we won't be able to see behind the quad anyways)
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // the screen pass depends on this frame's viewport, it's recorded here
+    CommandList& commands = m_screenCommands;
+    commands.clear();
+    size_t item = 0;
+    size_t batch = 0;
+    for (uint32_t i = 0; i < m_model.size(); ++i) {
+        auto& m = m_model[i];
+        if (m->check("framebuffer")) {
+            if (m_multiDraw) {
+                // batches of the models before this one
+                size_t end = batch;
+                while (end < packet.batchCount && packet.batches[end].segment <= m_modelSegment[i]) {
+                    end++;
                 }
+                drawBatches(packet, batch, end, meshes, commands);
+                batch = end;
             }
+            commands.disable(GL_DEPTH_TEST);
+            commands.bindTexture(GL_TEXTURE_2D, 0, m_textureColorBuffer);
+            m->setScreenRegion(commands, glm::vec2(m_rtViewport) / glm::vec2(float(m_rt_width), float(m_rt_height)));
+            m->draw(commands);
+        }
+        for (; !m_multiDraw && item < packet.drawCount && packet.draws[item].model == m.get(); ++item) {
+            m->draw(commands, packet.draws[item].transform, view, projection);
+        }
+    }
+    if (m_multiDraw) {
+        drawBatches(packet, batch, packet.batchCount, meshes, commands);
+    }
+    // once per frame, for GL code after this that doesn't expect the arena bound
+    commands.bindVertexArray(0);
+    // the Hi-Z build in between switched programs and textures
+    m_executor.invalidate();
+    m_executor.execute(commands);
+    profiler.count("gl.issued", int64_t(m_executor.stats().totalIssued()));
+    profiler.count("gl.elided", int64_t(m_executor.stats().totalElided()));
+    if (m_glBackend) {
+        profiler.count("gl.calls", int64_t(m_glBackend->totalCalls() - m_glCalls));
+        m_glCalls = m_glBackend->totalCalls();
+    }
+    m_frameTimer.end();
+    profiler.sample("cpu.submit_ms", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+size_t Render::drawBatches(const FramePacket& packet, size_t begin, size_t end, size_t& meshes, CommandList& commands)
+{
+    size_t calls = 0;
+    Shader* program = nullptr;
+    for (size_t i = begin; i < end; ++i) {
+        const DrawBatch& b = packet.batches[i];
+        if (b.direct) {
+            size_t drawn = b.direct->model->draw(commands, b.direct->transform, packet.view, packet.projection);
+            calls += drawn;
+            meshes += drawn;
+            // Model::draw switched programs
+            program = nullptr;
+            continue;
         }
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
+        if (b.program != program) {
+            program = b.program;
+            commands.useProgram(program->ID);
+            commands.uniform("view", packet.view);
+            commands.uniform("projection", packet.projection);
+            commands.bindVertexArray(m_geometry->vao());
+        }
+        commands.uniform("drawBase", int(b.first));
+        commands.bindTextures(GL_TEXTURE_2D_ARRAY, 0, SlotCount, b.arrays.data());
+        m_indirect.draw(commands, b.indexType, b.first, b.count);
+        calls++;
+        meshes += b.count;
+    }
+    return calls;
+}
+
+void Render::countLatency(Profiler& profiler, const FramePacket& packet)
+{
+    // input sample to swap; the swap returning is as close to scan-out as GL lets us see
+    auto latency = std::chrono::steady_clock::now() - packet.inputTime;
+    profiler.count("latency.us", std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+    profiler.sample("latency.sample_ms", std::chrono::duration<double, std::milli>(latency).count());
+    if (packet.inputEvent >= 0.0) {
+        profiler.sample("latency.input_ms", (glfwGetTime() - packet.inputEvent) * 1000.0);
+    }
+    // the packet was built on the main thread, its time goes with the frame that shows it
+    profiler.sample("cpu.build_ms", packet.buildMs);
+}
+
+void Render::drawStats(const FramePacket& packet, Profiler& profiler)
+{
+    if (!packet.showStats) {
+        return;
+    }
+    // the text changes with every report, in between the same characters are drawn again
+    if (profiler.reports() != m_overlayReports) {
+        m_overlayReports = profiler.reports();
+        const Profiler::Summary& frame = profiler.summary("frame_ms");
+        const Profiler::Summary& build = profiler.summary("cpu.build_ms");
+        const Profiler::Summary& submit = profiler.summary("cpu.submit_ms");
+        const Profiler::Summary& gpu = profiler.summary("gpu.frame_ms");
+        const Profiler::Summary& scene = profiler.summary("gpu.scene_ms");
+        const Profiler::Summary& input = profiler.summary("latency.input_ms");
+        const Profiler::Summary& sample = profiler.summary("latency.sample_ms");
+        // green within a 60 Hz frame, yellow within two, red past that
+        uint32_t color = frame.p99 <= 1000.0 / 60.0 ? 0x80ff80ffu : frame.p99 <= 2000.0 / 60.0 ? 0xffff60ffu : 0xff6060ffu;
+        char line[128];
+        int row = 0;
+
+        m_overlay.clear();
+        snprintf(line, sizeof(line), "%d fps  1%% low %.0f  0.1%% low %.0f", profiler.fps(),
+            frame.low1 > 0.0 ? 1000.0 / frame.low1 : 0.0, frame.low01 > 0.0 ? 1000.0 / frame.low01 : 0.0);
+        m_overlay.print(0, row++, line, color);
+        snprintf(line, sizeof(line), "frame  %6.2f ms  p50 %6.2f  p99 %6.2f  max %6.2f", frame.mean, frame.p50, frame.p99, frame.max);
+        m_overlay.print(0, row++, line);
+        snprintf(line, sizeof(line), "build  %6.2f ms  p99 %6.2f", build.mean, build.p99);
+        m_overlay.print(0, row++, line);
+        snprintf(line, sizeof(line), "submit %6.2f ms  p99 %6.2f", submit.mean, submit.p99);
+        m_overlay.print(0, row++, line);
+        snprintf(line, sizeof(line), "gpu    %6.2f ms  p99 %6.2f", gpu.mean, gpu.p99);
+        m_overlay.print(0, row++, line);
+        if (scene.count) {
+            snprintf(line, sizeof(line), "scene  %6.2f ms  p99 %6.2f  %d%%", scene.mean, scene.p99, int(100.0f * m_rtViewport.x / m_rt_width + 0.5f));
+            m_overlay.print(0, row++, line);
+        }
+        if (input.count) {
+            snprintf(line, sizeof(line), "input  %6.2f ms  p99 %6.2f  max %6.2f", input.mean, input.p99, input.max);
+        } else {
+            snprintf(line, sizeof(line), "input       - ms");
+        }
+        m_overlay.print(0, row++, line);
+        snprintf(line, sizeof(line), "sample %6.2f ms  p99 %6.2f", sample.mean, sample.p99);
+        m_overlay.print(0, row++, line);
+    }
+    m_overlay.draw(int(packet.width), int(packet.height), m_overlayScale);
+}
+
+void Render::waitUntilDrawn(uint64_t frame)
+{
+    // a packet being taken could be any frame, wait for the render thread to say which
+    for (;;) {
+        uint64_t drawing = m_drawing.load();
+        if (drawing != frame && drawing != TakingPacket) {
+            return;
+        }
+        std::this_thread::yield();
+    }
+}
+
+void Render::traceFrame()
+{
+    if (!m_glTrace.recording()) {
+        return;
+    }
+    m_glTrace.frame();
+    if (m_glTrace.frames() >= m_glTraceFrames) {
+        uint64_t calls = m_glTrace.calls();
+        uint64_t bytes = m_glTrace.bytes();
+        if (m_glTrace.close()) {
+            spdlog::info("GL trace: {0} calls over {1} frames, {2:.1f} MB", calls, m_glTraceFrames, bytes / 1048576.0);
+        } else {
+            spdlog::error("GL trace: writing failed");
+        }
+    }
+}
+
+void Render::renderLoop()
+{
+    glfwMakeContextCurrent(m_window);
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_packetLock);
+            m_packetReady.wait(lock, [this]() { return m_quit || m_published > m_taken.load(); });
+            if (m_quit) {
+                break;
+            }
+        }
+
+        // take the newest packet and let the main thread start on the next one; a packet
+        // already drawn is never drawn again, its arena may be reset by now
+        m_drawing.store(TakingPacket);
+        if (!m_packets.take()) {
+            m_drawing.store(NoPacket);
+            continue;
+        }
+        const FramePacket& packet = m_packets.front();
+        m_drawing.store(packet.frame);
+        m_taken.store(packet.frame + 1);
+        glfwPostEmptyEvent();
+
+        m_submitAllocations.begin();
+        submit(packet, m_renderProfiler);
+        m_submitAllocations.end(m_renderProfiler);
+        drawStats(packet, m_renderProfiler);
         glfwSwapBuffers(m_window);
+        traceFrame();
+        m_drawing.store(NoPacket);
+        limitRenderAhead(m_renderProfiler);
+
+        countLatency(m_renderProfiler, packet);
+        // outside the allocation check, every collected capture schedules a job
+        m_capture.poll(m_renderProfiler);
+        m_renderProfiler.endFrame();
+    }
+
+    m_capture.finish();
+    glfwMakeContextCurrent(nullptr);
+}
+
+int Render::render()
+{
+    setupInstances();
+    if (m_glTrace.recording()) {
+        // the scene is loaded, frames follow
+        m_glTrace.frame();
+    }
+
+    auto config = RSLib::instance()->getConfig();
+    std::string pipeline = config->has("frame_pipeline") ? config->get_string("frame_pipeline") : "serial";
+    if (pipeline == "threaded" && !m_offline) {
+        m_pipeline = Pipeline::Threaded;
+    } else if (pipeline == "mailbox" && !m_offline) {
+        m_pipeline = Pipeline::Mailbox;
+    } else {
+        if (pipeline != "serial") {
+            spdlog::warn("Frame pipeline: {0} {1}, running serial", pipeline, m_offline ? "isn't used offline" : "is unknown");
+        }
+        m_pipeline = Pipeline::Serial;
+    }
+    spdlog::info("Frame pipeline: {0}", m_pipeline == Pipeline::Serial ? "serial" : pipeline);
+
+    if (m_offline) {
+        // the orbit is around the middle of the scene, at the camera's distance from it
+        AABB scene;
+        for (auto& bounds : m_instanceBounds) {
+            scene.extend(bounds);
+        }
+        m_orbitCenter = scene.valid() ? scene.center() : glm::vec3(0.0f);
+        // frames are paced by the GPU and the readback, not the display
+        glfwSwapInterval(0);
+        m_pacer.setTarget(0.0);
+    }
+
+    m_inputStart = glfwGetTime();
+    m_lastFrame = float(m_inputStart);
+
+    if (m_pipeline == Pipeline::Serial) {
+        while (!glfwWindowShouldClose(m_window)) {
+            // per-frame time logic
+            // --------------------
+            stepTime();
+
+            // input; offline frames only take it from a replay
+            // -----
+            if (!m_offline || m_replayInput) {
+                processInput(m_window);
+            }
+
+            FramePacket& packet = m_packets.back();
+            m_buildAllocations.begin();
+            buildPacket(packet);
+            m_buildAllocations.end(m_profiler);
+            if (m_offline) {
+                // a full ring means the readbacks or the encoders are behind, wait for them
+                // rather than drop the frame
+                auto waitStart = std::chrono::steady_clock::now();
+                m_capture.waitForSlot();
+                m_profiler.count("capture.wait_us", std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - waitStart).count());
+            }
+            m_submitAllocations.begin();
+            submit(packet, m_profiler);
+            m_submitAllocations.end(m_profiler);
+            drawStats(packet, m_profiler);
+
+            // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+            // -------------------------------------------------------------------------------
+            glfwSwapBuffers(m_window);
+            traceFrame();
+            limitRenderAhead(m_profiler);
+            countLatency(m_profiler, packet);
+            m_capture.poll(m_profiler);
+            glfwPollEvents();
+
+            pace(m_profiler);
+            m_profiler.endFrame();
+            m_fps = m_profiler.fps();
+            if (m_offline && m_frame >= m_offlineFrames) {
+                glfwSetWindowShouldClose(m_window, true);
+            }
+        }
+        m_capture.finish();
+        return 0;
+    }
+
+    // the render thread owns the context until it quits
+    glfwMakeContextCurrent(nullptr);
+    m_quit = false;
+    m_renderThread = std::thread(&Render::renderLoop, this);
+
+    while (!glfwWindowShouldClose(m_window)) {
         glfwPollEvents();
+
+        stepTime();
+        processInput(m_window);
+
+        // the arena this frame resets backs the packet from frames() frames ago, which only
+        // a mailbox render thread can still be drawing
+        if (m_frame >= m_frameMemory.frames()) {
+            waitUntilDrawn(m_frame - m_frameMemory.frames());
+        }
+        m_buildAllocations.begin();
+        buildPacket(m_packets.back());
+        m_buildAllocations.end(m_profiler);
+        if (!m_packets.publish()) {
+            m_profiler.count("packets.dropped", 1);
+        }
+        // buildPacket() numbered the packet m_frame - 1
+        uint64_t published = m_frame;
+        {
+            std::lock_guard<std::mutex> lock(m_packetLock);
+            m_published = published;
+        }
+        m_packetReady.notify_one();
+
+        pace(m_profiler);
+        m_profiler.endFrame();
+        m_fps = m_profiler.fps();
+
+        // keep handling events, but build the next packet only once this one is being drawn;
+        // the render thread posts an empty event when it takes a packet
+        if (m_pipeline == Pipeline::Threaded) {
+            while (m_taken.load() < published && !glfwWindowShouldClose(m_window)) {
+                glfwWaitEvents();
+            }
+        }
     }
+
+    {
+        std::lock_guard<std::mutex> lock(m_packetLock);
+        m_quit = true;
+    }
+    m_packetReady.notify_one();
+    m_renderThread.join();
+    glfwMakeContextCurrent(m_window);
     return 0;
 }
 
 int Render::cleanup()
 {
+    if (m_recordInput) {
+        m_inputLog.finish(m_inputTime);
+        if (m_inputLog.save(m_inputPath)) {
+            spdlog::info("Input: {0} events over {1:.1f} s recorded to {2}", m_inputLog.events().size() - 1, m_inputLog.duration(), m_inputPath);
+        } else {
+            spdlog::error("Input: failed to write {0}", m_inputPath);
+        }
+    }
+
+    if (!m_statsPath.empty()) {
+        // the render thread's profiler only has frames in the threaded pipelines
+        std::string json = "{\"profilers\":[" + m_profiler.json();
+        if (m_pipeline != Pipeline::Serial) {
+            json += "," + m_renderProfiler.json();
+        }
+        json += "]}\n";
+        std::ofstream out(m_statsPath, std::ios::binary);
+        if (out.write(json.data(), json.size())) {
+            spdlog::info("Stats: written to {0}", m_statsPath);
+        } else {
+            spdlog::error("Stats: failed to write {0}", m_statsPath);
+        }
+    }
+
+    if (m_glTrace.recording()) {
+        spdlog::info("GL trace: closed after {0} of {1} frames", m_glTrace.frames(), m_glTraceFrames);
+        m_glTrace.close();
+    }
+    if (TextureStreamer* streamer = m_materials ? m_materials->streamer() : nullptr) {
+        const TextureStreamer::Stats& stats = streamer->stats();
+        spdlog::info("Texture streaming: {0:.1f} of {1:.1f} MB resident, {2:.1f} MB wanted; {3} loads of {4:.1f} MB, {5} evictions, {6} refused",
+            stats.resident / 1048576.0, stats.budget / 1048576.0, stats.wanted / 1048576.0,
+            stats.loads, stats.uploadedBytes / 1048576.0, stats.evictions, stats.refused);
+    }
+    if (m_glBackend) {
+        spdlog::info("GL: {0} calls, {1}", m_glBackend->totalCalls(), m_glBackend->summary());
+    }
 
     return 0;
 }
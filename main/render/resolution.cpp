@@ -0,0 +1,114 @@
+#include "glad/glad.h"
+#include "resolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// smoothing of the GPU time, about the last ten frames
+const float kFilter = 0.1f;
+// growing only starts below this part of the budget, and changes aim a bit under it
+const float kHeadroom = 0.8f;
+const float kTarget = 0.9f;
+// largest change of one step
+const float kMaxShrink = 0.75f;
+const float kMaxGrow = 1.1f;
+
+}
+
+ResolutionController::ResolutionController(float budgetMs, float minScale, float maxScale)
+{
+    m_budget = budgetMs;
+    m_minScale = std::min(minScale, maxScale);
+    m_maxScale = maxScale;
+    m_scale = maxScale;
+}
+
+bool ResolutionController::update(float gpuMs)
+{
+    if (m_cooldown > 0) {
+        // measured at a size that's gone already
+        m_cooldown--;
+        m_filtered = -1.0f;
+        return false;
+    }
+    m_filtered = m_filtered < 0.0f ? gpuMs : m_filtered + (gpuMs - m_filtered) * kFilter;
+
+    // the raw time counts too, so a sudden spike is seen before the filter catches up
+    bool over = m_filtered > m_budget || gpuMs > m_budget * 1.5f;
+    bool under = m_filtered < m_budget * kHeadroom;
+    m_over = over ? m_over + 1 : 0;
+    m_under = under ? m_under + 1 : 0;
+
+    float scale = m_scale;
+    if (m_over >= OverFrames && m_scale > m_minScale) {
+        float time = std::max(m_filtered, gpuMs);
+        scale = m_scale * std::max(kMaxShrink, std::sqrt(m_budget * kTarget / time));
+    } else if (m_under >= UnderFrames && m_scale < m_maxScale) {
+        scale = m_scale * std::min(kMaxGrow, std::sqrt(m_budget * kTarget / std::max(m_filtered, 0.001f)));
+    }
+    scale = glm::clamp(scale, m_minScale, m_maxScale);
+    // steps too small to change the viewport aren't worth the cooldown
+    if (std::abs(scale - m_scale) < 0.01f) {
+        return false;
+    }
+
+    m_scale = scale;
+    m_over = 0;
+    m_under = 0;
+    m_cooldown = Cooldown;
+    return true;
+}
+
+glm::ivec2 ResolutionController::viewport(int width, int height) const
+{
+    int w = std::min(width, std::max(8, int(width * m_scale + 4.0f) & ~7));
+    int h = std::min(height, std::max(8, int(height * m_scale + 4.0f) & ~7));
+    return glm::ivec2(w, h);
+}
+
+GpuTimer::~GpuTimer()
+{
+    if (m_queries[0]) {
+        glDeleteQueries(Queries * 2, m_queries);
+    }
+}
+
+void GpuTimer::begin()
+{
+    if (!m_queries[0]) {
+        glGenQueries(Queries * 2, m_queries);
+    }
+    // a full ring drops the oldest result instead of waiting for it
+    if (m_begun - m_read == Queries) {
+        m_read++;
+    }
+    glQueryCounter(m_queries[(m_begun % Queries) * 2], GL_TIMESTAMP);
+}
+
+void GpuTimer::end()
+{
+    glQueryCounter(m_queries[(m_begun % Queries) * 2 + 1], GL_TIMESTAMP);
+    m_begun++;
+}
+
+float GpuTimer::poll()
+{
+    float ms = -1.0f;
+    while (m_read < m_begun) {
+        const unsigned int* pair = &m_queries[(m_read % Queries) * 2];
+        // the end timestamp lands after the begin one
+        GLint available = 0;
+        glGetQueryObjectiv(pair[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(pair[0], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(pair[1], GL_QUERY_RESULT, &end);
+        ms = float((end - begin) / 1e6);
+        m_read++;
+    }
+    return ms;
+}
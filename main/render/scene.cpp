@@ -0,0 +1,276 @@
+#include "scene.h"
+#include "config.h"
+
+#include <algorithm>
+#include <immintrin.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "spdlog/spdlog.h"
+
+namespace {
+
+const size_t kBatch = 8;
+
+// out = a * b, column by column
+void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+{
+    __m128 a0 = _mm_loadu_ps(&a[0][0]);
+    __m128 a1 = _mm_loadu_ps(&a[1][0]);
+    __m128 a2 = _mm_loadu_ps(&a[2][0]);
+    __m128 a3 = _mm_loadu_ps(&a[3][0]);
+    for (int j = 0; j < 4; ++j) {
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(b[j][0]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[j][1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[j][2])));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[j][3])));
+        _mm_storeu_ps(&out[j][0], r);
+    }
+}
+
+}
+
+void Scene::clear()
+{
+    m_posX.clear(); m_posY.clear(); m_posZ.clear();
+    m_rotX.clear(); m_rotY.clear(); m_rotZ.clear(); m_rotW.clear();
+    m_scaleX.clear(); m_scaleY.clear(); m_scaleZ.clear();
+    m_parent.clear();
+    m_object.clear();
+    m_dirty.clear();
+    m_local.clear();
+    m_world.clear();
+    m_updated.clear();
+    m_anyDirty = false;
+}
+
+void Scene::reserve(size_t count)
+{
+    m_posX.reserve(count); m_posY.reserve(count); m_posZ.reserve(count);
+    m_rotX.reserve(count); m_rotY.reserve(count); m_rotZ.reserve(count); m_rotW.reserve(count);
+    m_scaleX.reserve(count); m_scaleY.reserve(count); m_scaleZ.reserve(count);
+    m_parent.reserve(count);
+    m_object.reserve(count);
+    m_dirty.reserve(count);
+    m_local.reserve(count);
+    m_world.reserve(count);
+}
+
+uint32_t Scene::add(uint32_t object, uint32_t parent, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+{
+    uint32_t node = uint32_t(m_parent.size());
+    if (parent != None && parent >= node) {
+        spdlog::warn("Scene: parent {0} of node {1} doesn't exist yet, adding it as a root", parent, node);
+        parent = None;
+    }
+    glm::quat q = glm::normalize(rotation);
+    m_posX.push_back(position.x); m_posY.push_back(position.y); m_posZ.push_back(position.z);
+    m_rotX.push_back(q.x); m_rotY.push_back(q.y); m_rotZ.push_back(q.z); m_rotW.push_back(q.w);
+    m_scaleX.push_back(scale.x); m_scaleY.push_back(scale.y); m_scaleZ.push_back(scale.z);
+    m_parent.push_back(parent);
+    m_object.push_back(object);
+    m_dirty.push_back(1);
+    m_local.emplace_back(1.0f);
+    m_world.emplace_back(1.0f);
+    m_anyDirty = true;
+    return node;
+}
+
+size_t Scene::load(Config& config, const std::string& key, const std::unordered_map<std::string, uint32_t>& objects)
+{
+    size_t count = config.get_array_size(key);
+    uint32_t base = uint32_t(size());
+    reserve(base + count);
+
+    for (size_t i = 0; i < count; ++i) {
+        std::string entry = key + "/" + std::to_string(i);
+
+        uint32_t object = None;
+        if (config.has(entry + "/model")) {
+            auto found = objects.find(config.get_string(entry + "/model"));
+            if (found == objects.end()) {
+                spdlog::warn("Scene: unknown model in {0}", entry);
+            } else {
+                object = found->second;
+            }
+        }
+
+        uint32_t parent = None;
+        if (config.has(entry + "/parent")) {
+            parent = base + uint32_t(config.get_int(entry + "/parent"));
+        }
+
+        glm::vec3 position(0.0f), euler(0.0f), scale(1.0f);
+        auto readVec3 = [&](const std::string& name, glm::vec3& v) {
+            if (config.has(entry + "/" + name)) {
+                auto f = config.get_floats(entry + "/" + name);
+                if (f.size() == 3) {
+                    v = glm::vec3(f[0], f[1], f[2]);
+                } else if (f.size() == 1) {
+                    v = glm::vec3(f[0]);
+                }
+            }
+        };
+        readVec3("position", position);
+        readVec3("rotation", euler);
+        readVec3("scale", scale);
+
+        add(object, parent, position, glm::quat(glm::radians(euler)), scale);
+    }
+    return count;
+}
+
+void Scene::markDirty(uint32_t node)
+{
+    m_dirty[node] = 1;
+    m_anyDirty = true;
+}
+
+void Scene::setPosition(uint32_t node, const glm::vec3& position)
+{
+    m_posX[node] = position.x; m_posY[node] = position.y; m_posZ[node] = position.z;
+    markDirty(node);
+}
+
+void Scene::setRotation(uint32_t node, const glm::quat& rotation)
+{
+    glm::quat q = glm::normalize(rotation);
+    m_rotX[node] = q.x; m_rotY[node] = q.y; m_rotZ[node] = q.z; m_rotW[node] = q.w;
+    markDirty(node);
+}
+
+void Scene::setScale(uint32_t node, const glm::vec3& scale)
+{
+    m_scaleX[node] = scale.x; m_scaleY[node] = scale.y; m_scaleZ[node] = scale.z;
+    markDirty(node);
+}
+
+void Scene::computeLocal(size_t first)
+{
+    // T * R * S for kBatch nodes; the twelve non-constant matrix elements are
+    // computed lane-parallel from the SoA arrays and then scattered out per node
+    float m[12][kBatch];
+    size_t count = std::min(kBatch, size() - first);
+
+    if (count == kBatch) {
+#if defined(__AVX__)
+        const int lanes = 8;
+#define LOAD(v) _mm256_loadu_ps(&v[first + lane])
+#define SET1(x) _mm256_set1_ps(x)
+#define MUL _mm256_mul_ps
+#define ADD _mm256_add_ps
+#define SUB _mm256_sub_ps
+#define STORE(i, v) _mm256_storeu_ps(&m[i][lane], v)
+        using simd = __m256;
+#else
+        const int lanes = 4;
+#define LOAD(v) _mm_loadu_ps(&v[first + lane])
+#define SET1(x) _mm_set1_ps(x)
+#define MUL _mm_mul_ps
+#define ADD _mm_add_ps
+#define SUB _mm_sub_ps
+#define STORE(i, v) _mm_storeu_ps(&m[i][lane], v)
+        using simd = __m128;
+#endif
+        for (int lane = 0; lane < int(kBatch); lane += lanes) {
+            simd x = LOAD(m_rotX), y = LOAD(m_rotY), z = LOAD(m_rotZ), w = LOAD(m_rotW);
+            simd sx = LOAD(m_scaleX), sy = LOAD(m_scaleY), sz = LOAD(m_scaleZ);
+            simd two = SET1(2.0f), one = SET1(1.0f);
+            simd xx = MUL(x, x), yy = MUL(y, y), zz = MUL(z, z);
+            simd xy = MUL(x, y), xz = MUL(x, z), yz = MUL(y, z);
+            simd wx = MUL(w, x), wy = MUL(w, y), wz = MUL(w, z);
+
+            STORE(0, MUL(SUB(one, MUL(two, ADD(yy, zz))), sx));
+            STORE(1, MUL(MUL(two, ADD(xy, wz)), sx));
+            STORE(2, MUL(MUL(two, SUB(xz, wy)), sx));
+            STORE(3, MUL(MUL(two, SUB(xy, wz)), sy));
+            STORE(4, MUL(SUB(one, MUL(two, ADD(xx, zz))), sy));
+            STORE(5, MUL(MUL(two, ADD(yz, wx)), sy));
+            STORE(6, MUL(MUL(two, ADD(xz, wy)), sz));
+            STORE(7, MUL(MUL(two, SUB(yz, wx)), sz));
+            STORE(8, MUL(SUB(one, MUL(two, ADD(xx, yy))), sz));
+            STORE(9, LOAD(m_posX));
+            STORE(10, LOAD(m_posY));
+            STORE(11, LOAD(m_posZ));
+        }
+#undef LOAD
+#undef SET1
+#undef MUL
+#undef ADD
+#undef SUB
+#undef STORE
+    } else {
+        for (size_t lane = 0; lane < count; ++lane) {
+            size_t i = first + lane;
+            float x = m_rotX[i], y = m_rotY[i], z = m_rotZ[i], w = m_rotW[i];
+            m[0][lane] = (1.0f - 2.0f * (y * y + z * z)) * m_scaleX[i];
+            m[1][lane] = 2.0f * (x * y + w * z) * m_scaleX[i];
+            m[2][lane] = 2.0f * (x * z - w * y) * m_scaleX[i];
+            m[3][lane] = 2.0f * (x * y - w * z) * m_scaleY[i];
+            m[4][lane] = (1.0f - 2.0f * (x * x + z * z)) * m_scaleY[i];
+            m[5][lane] = 2.0f * (y * z + w * x) * m_scaleY[i];
+            m[6][lane] = 2.0f * (x * z + w * y) * m_scaleZ[i];
+            m[7][lane] = 2.0f * (y * z - w * x) * m_scaleZ[i];
+            m[8][lane] = (1.0f - 2.0f * (x * x + y * y)) * m_scaleZ[i];
+            m[9][lane] = m_posX[i];
+            m[10][lane] = m_posY[i];
+            m[11][lane] = m_posZ[i];
+        }
+    }
+
+    for (size_t lane = 0; lane < count; ++lane) {
+        glm::mat4& local = m_local[first + lane];
+        local[0] = glm::vec4(m[0][lane], m[1][lane], m[2][lane], 0.0f);
+        local[1] = glm::vec4(m[3][lane], m[4][lane], m[5][lane], 0.0f);
+        local[2] = glm::vec4(m[6][lane], m[7][lane], m[8][lane], 0.0f);
+        local[3] = glm::vec4(m[9][lane], m[10][lane], m[11][lane], 1.0f);
+    }
+}
+
+size_t Scene::update()
+{
+    m_updated.clear();
+    if (!m_anyDirty) {
+        return 0;
+    }
+
+    const size_t count = size();
+    for (size_t first = 0; first < count; first += kBatch) {
+        size_t end = std::min(first + kBatch, count);
+        if (std::any_of(m_dirty.begin() + first, m_dirty.begin() + end, [](uint8_t d) { return d != 0; })) {
+            computeLocal(first);
+        }
+    }
+
+    // parents come first, so one forward pass sees every parent already updated
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t p = m_parent[i];
+        if (p != None && m_dirty[p]) {
+            m_dirty[i] = 1;
+        }
+        if (!m_dirty[i]) {
+            continue;
+        }
+        if (p == None) {
+            m_world[i] = m_local[i];
+        } else {
+            multiply(m_world[p], m_local[i], m_world[i]);
+        }
+        m_updated.push_back(uint32_t(i));
+    }
+
+    std::fill(m_dirty.begin(), m_dirty.end(), 0);
+    m_anyDirty = false;
+    return m_updated.size();
+}
+
+void Scene::updateReference()
+{
+    for (size_t i = 0; i < size(); ++i) {
+        glm::mat4 local = glm::translate(glm::mat4(1.0f), position(uint32_t(i))) * glm::mat4_cast(rotation(uint32_t(i)));
+        local = glm::scale(local, scale(uint32_t(i)));
+        m_local[i] = local;
+        m_world[i] = m_parent[i] == None ? local : m_world[m_parent[i]] * local;
+    }
+    std::fill(m_dirty.begin(), m_dirty.end(), 0);
+    m_anyDirty = false;
+}
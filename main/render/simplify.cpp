@@ -0,0 +1,347 @@
+#include "simplify.h"
+
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+#include <cmath>
+
+namespace {
+
+struct Quadric
+{
+    // upper triangle of the symmetric 4x4 plane matrix, plus the accumulated area
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    double a11 = 0, a12 = 0, a13 = 0;
+    double a22 = 0, a23 = 0;
+    double a33 = 0;
+    double w = 0;
+
+    void addPlane(double a, double b, double c, double d, double weight)
+    {
+        a00 += weight * a * a; a01 += weight * a * b; a02 += weight * a * c; a03 += weight * a * d;
+        a11 += weight * b * b; a12 += weight * b * c; a13 += weight * b * d;
+        a22 += weight * c * c; a23 += weight * c * d;
+        a33 += weight * d * d;
+        w += weight;
+    }
+
+    void add(const Quadric& q)
+    {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+        a11 += q.a11; a12 += q.a12; a13 += q.a13;
+        a22 += q.a22; a23 += q.a23;
+        a33 += q.a33;
+        w += q.w;
+    }
+
+    double evaluate(const glm::vec3& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double r = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+                 + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+                 + a22 * z * z + 2 * a23 * z
+                 + a33;
+        return r > 0 ? r : 0;
+    }
+};
+
+struct Collapse
+{
+    uint32_t from;
+    uint32_t to;
+    float cost;
+};
+
+uint32_t resolve(std::vector<uint32_t>& remap, uint32_t v)
+{
+    uint32_t r = v;
+    while (remap[r] != r) {
+        r = remap[r];
+    }
+    // path compression, chains grow with every pass
+    while (remap[v] != r) {
+        uint32_t next = remap[v];
+        remap[v] = r;
+        v = next;
+    }
+    return r;
+}
+
+// weld vertices sharing a position; canon[v] is the lowest index with the same position
+std::vector<uint32_t> weldPositions(const std::vector<Vertex>& vertices, std::vector<uint32_t>& wedges)
+{
+    std::vector<uint32_t> order(vertices.size());
+    std::iota(order.begin(), order.end(), 0);
+    auto less = [&](uint32_t a, uint32_t b) {
+        const glm::vec3& pa = vertices[a].Position;
+        const glm::vec3& pb = vertices[b].Position;
+        if (pa.x != pb.x) return pa.x < pb.x;
+        if (pa.y != pb.y) return pa.y < pb.y;
+        if (pa.z != pb.z) return pa.z < pb.z;
+        return a < b;
+    };
+    std::sort(order.begin(), order.end(), less);
+
+    std::vector<uint32_t> canon(vertices.size());
+    wedges.assign(vertices.size(), 0);
+    for (size_t i = 0; i < order.size();) {
+        size_t j = i;
+        uint32_t rep = order[i];
+        while (j < order.size() && vertices[order[j]].Position == vertices[rep].Position) {
+            canon[order[j]] = rep;
+            ++j;
+        }
+
+        // identical wedges (same normal and uv) don't make a seam
+        uint32_t distinct = 0;
+        for (size_t k = i; k < j; ++k) {
+            const Vertex& a = vertices[order[k]];
+            bool unique = true;
+            for (size_t l = i; l < k; ++l) {
+                const Vertex& b = vertices[order[l]];
+                if (a.Normal == b.Normal && a.TexCoords == b.TexCoords) {
+                    unique = false;
+                    break;
+                }
+            }
+            distinct += unique ? 1 : 0;
+        }
+        wedges[rep] = distinct;
+        i = j;
+    }
+    return canon;
+}
+
+glm::vec3 triangleNormal(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2)
+{
+    return glm::cross(p1 - p0, p2 - p0);
+}
+
+}
+
+std::vector<uint32_t> simplifyMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+    size_t target_index_count, float* result_error)
+{
+    if (result_error) {
+        *result_error = 0.0f;
+    }
+    if (target_index_count >= indices.size() || vertices.empty()) {
+        return indices;
+    }
+
+    const uint32_t vertex_count = static_cast<uint32_t>(vertices.size());
+
+    std::vector<uint32_t> wedges;
+    std::vector<uint32_t> canon = weldPositions(vertices, wedges);
+
+    // triangles over welded vertices
+    std::vector<uint32_t> tris;
+    tris.reserve(indices.size());
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        uint32_t a = canon[indices[i]], b = canon[indices[i + 1]], c = canon[indices[i + 2]];
+        if (a != b && b != c && a != c) {
+            tris.push_back(a);
+            tris.push_back(b);
+            tris.push_back(c);
+        }
+    }
+
+    // lock seams and open borders
+    std::vector<char> locked(vertex_count, 0);
+    std::unordered_map<uint64_t, uint32_t> edge_use;
+    edge_use.reserve(tris.size());
+    for (size_t t = 0; t < tris.size(); t += 3) {
+        for (int e = 0; e < 3; ++e) {
+            uint32_t a = tris[t + e], b = tris[t + (e + 1) % 3];
+            uint64_t key = (uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+            edge_use[key]++;
+        }
+    }
+    for (auto& e : edge_use) {
+        if (e.second == 1) {
+            locked[uint32_t(e.first >> 32)] = 1;
+            locked[uint32_t(e.first & 0xffffffff)] = 1;
+        }
+    }
+    for (uint32_t v = 0; v < vertex_count; ++v) {
+        if (wedges[v] > 1) {
+            locked[v] = 1;
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertex_count);
+    for (size_t t = 0; t < tris.size(); t += 3) {
+        const glm::vec3& p0 = vertices[tris[t]].Position;
+        const glm::vec3& p1 = vertices[tris[t + 1]].Position;
+        const glm::vec3& p2 = vertices[tris[t + 2]].Position;
+        glm::vec3 n = triangleNormal(p0, p1, p2);
+        float len = glm::length(n);
+        if (len <= 0.0f) {
+            continue;
+        }
+        n /= len;
+        double d = -glm::dot(n, p0);
+        for (int k = 0; k < 3; ++k) {
+            quadrics[tris[t + k]].addPlane(n.x, n.y, n.z, d, len * 0.5);
+        }
+    }
+
+    std::vector<uint32_t> remap(vertex_count);
+    std::iota(remap.begin(), remap.end(), 0);
+
+    const size_t target_tris = target_index_count / 3;
+    double max_error = 0.0;
+
+    std::vector<Collapse> candidates;
+    std::vector<uint32_t> adj_offset(vertex_count + 1);
+    std::vector<uint32_t> adj_tris;
+    std::vector<char> touched(vertex_count);
+
+    for (int pass = 0; pass < 32 && tris.size() / 3 > target_tris; ++pass) {
+        // vertex -> triangle adjacency of the current mesh
+        std::fill(adj_offset.begin(), adj_offset.end(), 0);
+        for (uint32_t v : tris) {
+            adj_offset[v + 1]++;
+        }
+        for (uint32_t v = 0; v < vertex_count; ++v) {
+            adj_offset[v + 1] += adj_offset[v];
+        }
+        adj_tris.resize(tris.size());
+        {
+            std::vector<uint32_t> fill(adj_offset.begin(), adj_offset.end() - 1);
+            for (size_t i = 0; i < tris.size(); ++i) {
+                adj_tris[fill[tris[i]]++] = uint32_t(i / 3);
+            }
+        }
+
+        candidates.clear();
+        for (size_t t = 0; t < tris.size(); t += 3) {
+            for (int e = 0; e < 3; ++e) {
+                uint32_t a = tris[t + e], b = tris[t + (e + 1) % 3];
+                for (int dir = 0; dir < 2; ++dir) {
+                    uint32_t from = dir ? b : a;
+                    uint32_t to = dir ? a : b;
+                    // nor onto a seam, which of its wedges a moved corner belongs to isn't known
+                    if (locked[from] || wedges[to] > 1) {
+                        continue;
+                    }
+                    Quadric q = quadrics[from];
+                    q.add(quadrics[to]);
+                    double cost = q.w > 0 ? q.evaluate(vertices[to].Position) / q.w : 0.0;
+                    candidates.push_back({ from, to, float(cost) });
+                }
+            }
+        }
+        if (candidates.empty()) {
+            break;
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const Collapse& l, const Collapse& r) { return l.cost < r.cost; });
+
+        std::fill(touched.begin(), touched.end(), 0);
+        size_t live_tris = tris.size() / 3;
+        size_t collapsed = 0;
+
+        for (auto& c : candidates) {
+            if (live_tris <= target_tris) {
+                break;
+            }
+            if (touched[c.from] || touched[c.to]) {
+                continue;
+            }
+
+            // reject collapses that flip a triangle around the removed vertex
+            const glm::vec3& target = vertices[c.to].Position;
+            bool flips = false;
+            size_t removed = 0;
+            for (uint32_t i = adj_offset[c.from]; i < adj_offset[c.from + 1]; ++i) {
+                const uint32_t* t = &tris[size_t(adj_tris[i]) * 3];
+                if (t[0] == c.to || t[1] == c.to || t[2] == c.to) {
+                    removed++;
+                    continue;
+                }
+                glm::vec3 p[3], q[3];
+                for (int k = 0; k < 3; ++k) {
+                    p[k] = vertices[t[k]].Position;
+                    q[k] = (t[k] == c.from) ? target : p[k];
+                }
+                glm::vec3 n0 = triangleNormal(p[0], p[1], p[2]);
+                glm::vec3 n1 = triangleNormal(q[0], q[1], q[2]);
+                if (glm::dot(n0, n1) <= 0.0f) {
+                    flips = true;
+                    break;
+                }
+            }
+            if (flips) {
+                continue;
+            }
+
+            remap[c.from] = c.to;
+            quadrics[c.to].add(quadrics[c.from]);
+            max_error = std::max(max_error, double(c.cost));
+
+            // keep the neighbourhood stable for the rest of this pass
+            for (uint32_t i = adj_offset[c.from]; i < adj_offset[c.from + 1]; ++i) {
+                const uint32_t* t = &tris[size_t(adj_tris[i]) * 3];
+                touched[t[0]] = touched[t[1]] = touched[t[2]] = 1;
+            }
+            live_tris -= removed;
+            collapsed++;
+        }
+
+        if (collapsed == 0) {
+            break;
+        }
+
+        size_t write = 0;
+        for (size_t t = 0; t < tris.size(); t += 3) {
+            uint32_t a = resolve(remap, tris[t]), b = resolve(remap, tris[t + 1]), c = resolve(remap, tris[t + 2]);
+            if (a != b && b != c && a != c) {
+                tris[write++] = a;
+                tris[write++] = b;
+                tris[write++] = c;
+            }
+        }
+        tris.resize(write);
+    }
+
+    // map back to the original vertices; untouched corners keep their own wedge, moved ones
+    // landed on a position with a single wedge
+    std::vector<uint32_t> result;
+    result.reserve(tris.size());
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        uint32_t out[3];
+        uint32_t key[3];
+        for (int k = 0; k < 3; ++k) {
+            uint32_t rep = canon[indices[i + k]];
+            uint32_t dst = resolve(remap, rep);
+            key[k] = dst;
+            out[k] = (dst == rep) ? indices[i + k] : dst;
+        }
+        if (key[0] != key[1] && key[1] != key[2] && key[0] != key[2]) {
+            result.insert(result.end(), out, out + 3);
+        }
+    }
+
+    if (result_error) {
+        *result_error = float(std::sqrt(max_error));
+    }
+    return result;
+}
+
+LodChain buildLodChain(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, unsigned levels)
+{
+    LodChain chain;
+    const std::vector<uint32_t>* previous = &indices;
+    for (unsigned level = 1; level < levels; ++level) {
+        float error = 0.0f;
+        size_t target = (previous->size() / 2) / 3 * 3;
+        std::vector<uint32_t> simplified = simplifyMesh(vertices, *previous, target, &error);
+        if (simplified.empty() || simplified.size() > previous->size() * 3 / 4) {
+            break;
+        }
+        chain.errors.push_back(chain.errors.empty() ? error : std::max(error, chain.errors.back()));
+        chain.indices.push_back(std::move(simplified));
+        previous = &chain.indices.back();
+    }
+    return chain;
+}
@@ -0,0 +1,126 @@
+#include "textoverlay.h"
+
+#include <algorithm>
+#include <cstddef>
+
+#include <glad/glad.h>
+
+#include "shader.h"
+
+namespace {
+
+// 5x7 bitmaps of characters 32 to 127 as the uvec2 pairs text.frag reads, bit y * 5 + x of
+// the glyph, the low 32 bits first
+const uint32_t Font[96 * 2] = {
+    0x00000000, 0x0, 0x00421084, 0x1, 0x0000294a, 0x0, 0x95f57d4a, 0x2,
+    0x1f4717c4, 0x1, 0x32222263, 0x6, 0x93511526, 0x5, 0x00000886, 0x0,
+    0x08210888, 0x2, 0x88842082, 0x0, 0x09575480, 0x0, 0x084f9080, 0x0,
+    0x88600000, 0x0, 0x000f8000, 0x0, 0x8c000000, 0x1, 0x02222200, 0x0,
+    0xa33ae62e, 0x3, 0x884210c4, 0x3, 0xc444422e, 0x7, 0xa304111f, 0x3,
+    0x11f4a988, 0x2, 0xa3083c3f, 0x3, 0xa317844c, 0x3, 0x8422221f, 0x0,
+    0xa317462e, 0x3, 0x910f462e, 0x1, 0x0c6018c0, 0x0, 0x886018c0, 0x0,
+    0x08208888, 0x2, 0x01f07c00, 0x0, 0x88882082, 0x0, 0x0044422e, 0x1,
+    0xab5b422e, 0x3, 0x63f8c62e, 0x4, 0xe317c62f, 0x3, 0xa210862e, 0x3,
+    0xd318c527, 0x1, 0xc217843f, 0x7, 0x4217843f, 0x0, 0xa31e862e, 0x7,
+    0x631fc631, 0x4, 0x8842108e, 0x3, 0x9284211c, 0x1, 0x52519531, 0x4,
+    0xc2108421, 0x7, 0x631ad771, 0x4, 0x639ace31, 0x4, 0xa318c62e, 0x3,
+    0x4217c62f, 0x0, 0x9358c62e, 0x5, 0x5257c62f, 0x4, 0xe107043e, 0x3,
+    0x0842109f, 0x1, 0xa318c631, 0x3, 0x1518c631, 0x1, 0xab5ac631, 0x2,
+    0x62a22a31, 0x4, 0x08454631, 0x1, 0xc222221f, 0x7, 0x8421084e, 0x3,
+    0x20820820, 0x0, 0x9084210e, 0x3, 0x00004544, 0x0, 0xc0000000, 0x7,
+    0x00002082, 0x0, 0xa3e83800, 0x7, 0xe319b421, 0x3, 0xa210b800, 0x3,
+    0xa31cda10, 0x7, 0x83f8b800, 0x3, 0x84238a4c, 0x0, 0xa1e8c7c0, 0x3,
+    0x6319b421, 0x4, 0x88421804, 0x3, 0x92843008, 0x1, 0x4a32a421, 0x2,
+    0x88421086, 0x3, 0x635aac00, 0x4, 0x6319b400, 0x4, 0xa318b800, 0x3,
+    0x42f8bc00, 0x0, 0x21ecd800, 0x4, 0x4219b400, 0x0, 0xe0e0b800, 0x3,
+    0x24211c42, 0x3, 0xb318c400, 0x5, 0x1518c400, 0x1, 0xab58c400, 0x2,
+    0x54454400, 0x4, 0xa1e8c400, 0x3, 0xc4447c00, 0x7, 0x08411088, 0x2,
+    0x08421084, 0x1, 0x88441082, 0x0, 0x008a8800, 0x0, 0xffffffff, 0x7,
+};
+
+}
+
+TextOverlay::~TextOverlay()
+{
+    if (m_buffer) {
+        glDeleteBuffers(1, &m_buffer);
+        glDeleteVertexArrays(1, &m_vao);
+    }
+}
+
+void TextOverlay::init(size_t capacity)
+{
+    m_capacity = capacity;
+    m_chars.reserve(capacity);
+    m_program = std::make_unique<Shader>("text.vert", "text.frag");
+    m_program->use();
+    glUniform2uiv(glGetUniformLocation(m_program->ID, "glyphs"), 96, Font);
+
+    glGenVertexArrays(1, &m_vao);
+    glGenBuffers(1, &m_buffer);
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(Char), nullptr, GL_DYNAMIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribIPointer(0, 2, GL_SHORT, sizeof(Char), (void*)offsetof(Char, column));
+    glVertexAttribDivisor(0, 1);
+    glEnableVertexAttribArray(1);
+    glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(Char), (void*)offsetof(Char, glyph));
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Char), (void*)offsetof(Char, color));
+    glVertexAttribDivisor(2, 1);
+    glBindVertexArray(0);
+}
+
+void TextOverlay::clear()
+{
+    m_chars.clear();
+    m_dirty = true;
+}
+
+int TextOverlay::print(int column, int row, const char* text, uint32_t color)
+{
+    // R, G, B, A in memory
+    uint32_t rgba = (color >> 24) | (color >> 8 & 0xff00u) | (color << 8 & 0xff0000u) | (color << 24);
+    int written = 0;
+    for (const char* c = text; *c && m_chars.size() < m_capacity; ++c, ++written) {
+        uint8_t ch = uint8_t(*c);
+        m_chars.push_back({ int16_t(column + written), int16_t(row), ch >= 32 && ch < 128 ? ch : uint32_t('?'), rgba });
+    }
+    m_dirty = true;
+    return written;
+}
+
+void TextOverlay::draw(int width, int height, int scale)
+{
+    if (m_chars.empty() || !m_program) {
+        return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    if (m_dirty) {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, m_chars.size() * sizeof(Char), m_chars.data());
+        m_dirty = false;
+    }
+
+    GLboolean depth = glIsEnabled(GL_DEPTH_TEST);
+    glDisable(GL_DEPTH_TEST);
+    m_program->use();
+    m_program->setVec2("cellSize", float(CellWidth * scale), float(CellHeight * scale));
+    m_program->setVec2("screenSize", float(width), float(height));
+    glBindVertexArray(m_vao);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(m_chars.size()));
+    glBindVertexArray(0);
+    if (depth) {
+        glEnable(GL_DEPTH_TEST);
+    }
+}
+
+uint64_t TextOverlay::glyph(char c)
+{
+    uint8_t ch = uint8_t(c);
+    if (ch < 32 || ch >= 128) {
+        ch = '?';
+    }
+    return Font[(ch - 32) * 2] | uint64_t(Font[(ch - 32) * 2 + 1]) << 32;
+}
@@ -53,6 +53,48 @@ int Texture::loadTexture(const char* filename)
     return texID;
 }
 
+Image Texture::decode(const std::string& path)
+{
+    Image image;
+    unsigned char* data = stbi_load(path.c_str(), &image.width, &image.height, &image.channels, 0);
+    if (data) {
+        image.pixels = std::shared_ptr<unsigned char>(data, stbi_image_free);
+    }
+    return image;
+}
+
+unsigned int Texture::createArray(const std::vector<const Image*>& layers)
+{
+    const Image& first = *layers[0];
+    GLenum format = GL_RGBA;
+    if (first.channels == 1)
+        format = GL_RED;
+    else if (first.channels == 2)
+        format = GL_RG;
+    else if (first.channels == 3)
+        format = GL_RGB;
+
+    unsigned int texID;
+    glGenTextures(1, &texID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texID);
+    // rows of 1 and 3 channel images aren't 4 byte aligned in general
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format, first.width, first.height, GLsizei(layers.size()), 0, format, GL_UNSIGNED_BYTE, nullptr);
+    for (size_t i = 0; i < layers.size(); ++i) {
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, GLint(i), first.width, first.height, 1, format, GL_UNSIGNED_BYTE, layers[i]->pixels.get());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+    // same sampling as loadTexture
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    return texID;
+}
+
 int Texture::loadCubemap(std::vector<std::string> faces)
 {
     unsigned int texID;
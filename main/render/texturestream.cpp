@@ -0,0 +1,418 @@
+#include "glad/glad.h"
+#include "texturestream.h"
+#include "rslib.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "spdlog/spdlog.h"
+
+namespace {
+
+GLenum formatOf(int channels)
+{
+    if (channels == 1)
+        return GL_RED;
+    if (channels == 2)
+        return GL_RG;
+    if (channels == 3)
+        return GL_RGB;
+    return GL_RGBA;
+}
+
+int levelSize(int size, int level)
+{
+    return std::max(1, size >> level);
+}
+
+// bytes of a level as uploaded, rows tightly packed
+size_t packedBytes(int width, int height, int channels, int level)
+{
+    return size_t(levelSize(width, level)) * levelSize(height, level) * channels;
+}
+
+const size_t NoArray = ~size_t(0);
+
+}
+
+TextureStreamer::TextureStreamer(const Settings& settings)
+    : m_settings(settings)
+{
+    if (!m_settings.loader) {
+        m_settings.loader = Texture::decode;
+    }
+    m_settings.maxLoads = std::max(1u, m_settings.maxLoads);
+    m_stats.budget = m_settings.budget;
+    for (unsigned i = 0; i < m_settings.maxLoads; ++i) {
+        m_free.push_back(std::make_unique<Load>());
+    }
+    m_finished.reserve(m_settings.maxLoads);
+    m_ready.reserve(m_settings.maxLoads);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    // the jobs write into loads they were handed and push them to m_finished
+    if (auto jobs = RSLib::instance()->getJobSystem()) {
+        jobs->wait(m_jobs);
+    }
+}
+
+size_t TextureStreamer::levelBytes(int width, int height, int layers, int channels, int level)
+{
+    // drivers pad RGB8 to four bytes a texel
+    int texel = channels == 3 ? 4 : channels;
+    return size_t(levelSize(width, level)) * levelSize(height, level) * layers * texel;
+}
+
+std::vector<uint8_t> TextureStreamer::downsample(const uint8_t* pixels, int width, int height, int layers, int channels)
+{
+    int w = std::max(1, width / 2);
+    int h = std::max(1, height / 2);
+    std::vector<uint8_t> out(size_t(w) * h * layers * channels);
+    size_t srcLayer = size_t(width) * height * channels;
+    size_t dstLayer = size_t(w) * h * channels;
+    for (int l = 0; l < layers; ++l) {
+        const uint8_t* src = pixels + l * srcLayer;
+        uint8_t* dst = out.data() + l * dstLayer;
+        for (int y = 0; y < h; ++y) {
+            const uint8_t* row0 = src + size_t(std::min(2 * y, height - 1)) * width * channels;
+            const uint8_t* row1 = src + size_t(std::min(2 * y + 1, height - 1)) * width * channels;
+            for (int x = 0; x < w; ++x) {
+                int x0 = std::min(2 * x, width - 1) * channels;
+                int x1 = std::min(2 * x + 1, width - 1) * channels;
+                for (int c = 0; c < channels; ++c) {
+                    *dst++ = uint8_t((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+                }
+            }
+        }
+    }
+    return out;
+}
+
+unsigned int TextureStreamer::create(const std::vector<std::string>& paths, const std::vector<const Image*>& layers)
+{
+    const Image& first = *layers[0];
+    Array a;
+    a.paths = std::make_shared<const std::vector<std::string>>(paths);
+    a.width = first.width;
+    a.height = first.height;
+    a.layers = int(layers.size());
+    a.channels = first.channels;
+    a.levels = 1 + int(std::log2(double(std::max(a.width, a.height))));
+    while (a.tail < a.levels - 1 && std::max(levelSize(a.width, a.tail), levelSize(a.height, a.tail)) > m_settings.tailSize) {
+        a.tail++;
+    }
+    a.base = a.want = a.requested = a.tail;
+    a.lastUsed.assign(a.levels, 0);
+
+    // the tail of every layer, filtered down from the full size
+    std::vector<std::vector<uint8_t>> tail(a.levels - a.tail);
+    for (int l = a.tail; l < a.levels; ++l) {
+        tail[l - a.tail].resize(packedBytes(a.width, a.height, a.channels, l) * a.layers);
+    }
+    auto filter = [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            std::vector<uint8_t> current;
+            const uint8_t* src = layers[k]->pixels.get();
+            for (int l = 0; l < a.levels; ++l) {
+                if (l >= a.tail) {
+                    size_t size = packedBytes(a.width, a.height, a.channels, l);
+                    memcpy(tail[l - a.tail].data() + k * size, src, size);
+                }
+                if (l + 1 < a.levels) {
+                    current = downsample(src, levelSize(a.width, l), levelSize(a.height, l), 1, a.channels);
+                    src = current.data();
+                }
+            }
+        }
+    };
+    if (auto jobs = RSLib::instance()->getJobSystem()) {
+        jobs->parallelFor(layers.size(), filter, 1);
+    } else {
+        filter(0, layers.size());
+    }
+
+    GLenum format = formatOf(a.channels);
+    glGenTextures(1, &a.name);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, a.name);
+    // rows of 1 and 3 channel images aren't 4 byte aligned in general
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int l = a.tail; l < a.levels; ++l) {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, l, format, levelSize(a.width, l), levelSize(a.height, l), a.layers, 0, format, GL_UNSIGNED_BYTE, tail[l - a.tail].data());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, a.tail);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, a.levels - 1);
+    // same sampling as Texture::createArray
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    m_stats.resident += bytes(a, a.tail, a.levels);
+    m_byName.emplace(a.name, m_arrays.size());
+    m_arrays.push_back(std::move(a));
+    m_wanting.reserve(m_arrays.size());
+    return m_arrays.back().name;
+}
+
+void TextureStreamer::request(unsigned int array, float pixels)
+{
+    auto it = m_byName.find(array);
+    if (it == m_byName.end() || !(pixels > 0.0f)) {
+        return;
+    }
+    Array& a = m_arrays[it->second];
+    // the finest level with at least the texels needed across
+    float texels = pixels * m_texelScale;
+    float size = float(std::max(a.width, a.height));
+    int level = texels >= size ? 0 : int(std::floor(std::log2(size / texels)));
+    a.requested = std::min(a.requested, std::min(level, a.tail));
+}
+
+TextureStreamer::ArrayInfo TextureStreamer::info(unsigned int array) const
+{
+    ArrayInfo info;
+    auto it = m_byName.find(array);
+    if (it == m_byName.end()) {
+        return info;
+    }
+    const Array& a = m_arrays[it->second];
+    info.width = a.width;
+    info.height = a.height;
+    info.layers = a.layers;
+    info.channels = a.channels;
+    info.levels = a.levels;
+    info.base = a.base;
+    info.tail = a.tail;
+    info.want = a.want;
+    info.lastUsed = a.lastUsed[a.base];
+    info.loading = a.loading;
+    return info;
+}
+
+size_t TextureStreamer::bytes(const Array& a, int from, int to) const
+{
+    size_t total = 0;
+    for (int l = from; l < to; ++l) {
+        total += levelBytes(a.width, a.height, a.layers, a.channels, l);
+    }
+    return total;
+}
+
+void TextureStreamer::update()
+{
+    // what was requested since the last update is in use this frame, down to the tail
+    m_stats.wanted = 0;
+    for (Array& a : m_arrays) {
+        a.want = a.requested;
+        a.requested = a.tail;
+        for (int l = a.want; l < a.tail; ++l) {
+            a.lastUsed[l] = m_frame;
+        }
+        m_stats.wanted += bytes(a, a.want, a.levels);
+    }
+
+    // a lowered budget
+    makeRoom(0, NoArray);
+
+    // finished loads in the order they finished, up to the upload budget
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (auto& load : m_finished) {
+            m_ready.push_back(std::move(load));
+        }
+        m_finished.clear();
+    }
+    size_t uploaded = 0;
+    size_t applied = 0;
+    while (applied < m_ready.size() && (applied == 0 || uploaded + m_ready[applied]->bytes <= m_settings.uploadPerFrame)) {
+        uploaded += apply(*m_ready[applied]);
+        m_free.push_back(std::move(m_ready[applied]));
+        applied++;
+    }
+    m_ready.erase(m_ready.begin(), m_ready.begin() + applied);
+
+    // the arrays furthest from what they need first, in creation order among equals
+    m_wanting.clear();
+    for (size_t i = 0; i < m_arrays.size(); ++i) {
+        const Array& a = m_arrays[i];
+        if (a.want < a.base && !a.loading && !a.failed) {
+            m_wanting.push_back(i);
+        }
+    }
+    std::sort(m_wanting.begin(), m_wanting.end(), [this](size_t x, size_t y) {
+        int dx = m_arrays[x].base - m_arrays[x].want;
+        int dy = m_arrays[y].base - m_arrays[y].want;
+        return dx > dy || (dx == dy && x < y);
+    });
+    for (size_t i : m_wanting) {
+        if (m_loading >= m_settings.maxLoads) {
+            break;
+        }
+        schedule(i, m_arrays[i].want);
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    m_frame++;
+}
+
+size_t TextureStreamer::apply(Load& load)
+{
+    Array& a = m_arrays[load.array];
+    a.loading = false;
+    m_loading--;
+    m_stats.reserved -= load.bytes;
+    if (load.failed) {
+        a.failed = true;
+        spdlog::error("Texture streaming: {0} no longer decodes to {1}x{2} with {3} channels, array {4} stays at level {5}",
+            load.paths->front(), a.width, a.height, a.channels, a.name, a.base);
+        return 0;
+    }
+
+    GLenum format = formatOf(a.channels);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, a.name);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int l = load.last - 1; l >= load.first; --l) {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, l, format, levelSize(a.width, l), levelSize(a.height, l), a.layers, 0, format, GL_UNSIGNED_BYTE, load.levels[l - load.first].data());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    // complete down to the new base, sampling switches to it now
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, load.first);
+    load.levels.clear();
+
+    a.base = load.first;
+    m_stats.resident += load.bytes;
+    m_stats.loads++;
+    m_stats.uploadedBytes += load.bytes;
+    return load.bytes;
+}
+
+void TextureStreamer::schedule(size_t index, int target)
+{
+    Array& a = m_arrays[index];
+    size_t used = m_stats.resident + m_stats.reserved;
+    size_t room = (used < m_settings.budget ? m_settings.budget - used : 0) + evictable(index);
+    int first = target;
+    while (first < a.base && bytes(a, first, a.base) > room) {
+        first++;
+    }
+    if (first == a.base) {
+        m_stats.refused++;
+        return;
+    }
+
+    std::unique_ptr<Load> load = std::move(m_free.back());
+    m_free.pop_back();
+    load->array = index;
+    load->first = first;
+    load->last = a.base;
+    load->bytes = bytes(a, first, a.base);
+    load->paths = a.paths;
+    load->width = a.width;
+    load->height = a.height;
+    load->channels = a.channels;
+    load->failed = false;
+    makeRoom(load->bytes, index);
+    m_stats.reserved += load->bytes;
+    a.loading = true;
+    m_loading++;
+
+    Load* raw = load.release();
+    auto work = [this, raw]() {
+        decode(*raw);
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_finished.emplace_back(raw);
+    };
+    if (auto jobs = RSLib::instance()->getJobSystem()) {
+        jobs->runBackground(work, &m_jobs);
+    } else {
+        work();
+    }
+}
+
+size_t TextureStreamer::evictable(size_t except) const
+{
+    size_t total = 0;
+    for (size_t i = 0; i < m_arrays.size(); ++i) {
+        const Array& a = m_arrays[i];
+        if (i == except || a.loading) {
+            continue;
+        }
+        for (int l = a.base; l < a.tail && a.lastUsed[l] < m_frame; ++l) {
+            total += levelBytes(a.width, a.height, a.layers, a.channels, l);
+        }
+    }
+    return total;
+}
+
+bool TextureStreamer::makeRoom(size_t bytes, size_t except)
+{
+    while (m_stats.resident + m_stats.reserved + bytes > m_settings.budget) {
+        // the finest level requested longest ago, the larger one of a tie
+        Array* victim = nullptr;
+        size_t victimBytes = 0;
+        for (size_t i = 0; i < m_arrays.size(); ++i) {
+            Array& a = m_arrays[i];
+            if (i == except || a.loading || a.base >= a.tail || a.lastUsed[a.base] >= m_frame) {
+                continue;
+            }
+            size_t size = levelBytes(a.width, a.height, a.layers, a.channels, a.base);
+            if (!victim || a.lastUsed[a.base] < victim->lastUsed[victim->base] ||
+                (a.lastUsed[a.base] == victim->lastUsed[victim->base] && size > victimBytes)) {
+                victim = &a;
+                victimBytes = size;
+            }
+        }
+        if (!victim) {
+            return false;
+        }
+        evict(*victim);
+    }
+    return true;
+}
+
+void TextureStreamer::evict(Array& a)
+{
+    GLenum format = formatOf(a.channels);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, a.name);
+    // sampling moves off the level before it goes; a level of size zero frees its storage
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, a.base + 1);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, a.base, format, 0, 0, 0, 0, format, GL_UNSIGNED_BYTE, nullptr);
+    m_stats.resident -= levelBytes(a.width, a.height, a.layers, a.channels, a.base);
+    m_stats.evictions++;
+    a.base++;
+}
+
+void TextureStreamer::decode(Load& load) const
+{
+    int layers = int(load.paths->size());
+    load.levels.resize(load.last - load.first);
+    for (int l = load.first; l < load.last; ++l) {
+        load.levels[l - load.first].resize(packedBytes(load.width, load.height, load.channels, l) * layers);
+    }
+    // every refinement decodes the files again, the full size is never kept around
+    for (int k = 0; k < layers; ++k) {
+        Image image = m_settings.loader((*load.paths)[k]);
+        if (!image.pixels || image.width != load.width || image.height != load.height || image.channels != load.channels) {
+            load.failed = true;
+            load.levels.clear();
+            return;
+        }
+        std::vector<uint8_t> current;
+        const uint8_t* src = image.pixels.get();
+        for (int l = 0; l < load.last; ++l) {
+            if (l >= load.first) {
+                size_t size = packedBytes(load.width, load.height, load.channels, l);
+                memcpy(load.levels[l - load.first].data() + k * size, src, size);
+            }
+            if (l + 1 < load.last) {
+                current = downsample(src, levelSize(load.width, l), levelSize(load.height, l), 1, load.channels);
+                src = current.data();
+            }
+        }
+    }
+}
@@ -0,0 +1,1919 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <random>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <cmath>
+#include <atomic>
+#include <thread>
+#include <tuple>
+#include <numeric>
+#include <map>
+#include <set>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "glad/glad.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "spdlog/spdlog.h"
+
+#include "culling.h"
+#include "bvh.h"
+#include "occlusion.h"
+#include "lightgrid.h"
+#include "scene.h"
+#include "jobs.h"
+#include "rslib.h"
+#include "triplebuffer.h"
+#include "framearena.h"
+#include "heapstats.h"
+#include "mesh.h"
+#include "material.h"
+#include "gpucull.h"
+#include "resolution.h"
+#include "imagecodec.h"
+#include "inputlog.h"
+#include "framepacing.h"
+#include "profiler.h"
+#include "textoverlay.h"
+#include "commandlist.h"
+#include "glbackend.h"
+#include "gltrace.h"
+#include "texturestream.h"
+#include "simplify.h"
+#include "rapidjson/document.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// correctness checks that failed in this run, runBenchmark returns non-zero after any
+int failedChecks = 0;
+
+// a benchmark's own correctness check: a failure is logged and fails the run, the timings
+// are still reported
+void check(bool passed, const std::string& what)
+{
+    if (!passed) {
+        spdlog::error("Check failed: {0}", what);
+        failedChecks++;
+    }
+}
+
+// uniform in [lo, hi) from the generator's bits alone; the std distributions differ between
+// standard libraries, and a scene compared with a checked-in image can't
+float portableUniform(std::mt19937& rng, float lo, float hi)
+{
+    return lo + (hi - lo) * float(rng() >> 8) * (1.0f / 16777216.0f);
+}
+
+// a 16-bit binary PGM as OcclusionCuller::writeDepthImage stores it, empty if it can't be read
+std::vector<uint16_t> readPGM(const std::string& path, int& width, int& height)
+{
+    std::vector<uint16_t> pixels;
+    FILE* fp = path.empty() ? nullptr : fopen(path.c_str(), "rb");
+    if (!fp) {
+        return pixels;
+    }
+    int maxValue = 0;
+    if (fscanf(fp, "P5 %d %d %d", &width, &height, &maxValue) == 3 && maxValue == 65535 && width > 0 && height > 0 && fgetc(fp) != EOF) {
+        std::vector<unsigned char> bytes(size_t(width) * height * 2);
+        if (fread(bytes.data(), 1, bytes.size(), fp) == bytes.size()) {
+            pixels.resize(bytes.size() / 2);
+            for (size_t i = 0; i < pixels.size(); ++i) {
+                pixels[i] = uint16_t((bytes[2 * i] << 8) | bytes[2 * i + 1]);
+            }
+        }
+    }
+    fclose(fp);
+    return pixels;
+}
+
+// random unit-ish boxes scattered around the origin
+std::vector<AABB> randomBoxes(size_t count, float range, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> pos(-range, range);
+    std::uniform_real_distribution<float> size(0.1f, 2.0f);
+
+    std::vector<AABB> boxes(count);
+    for (auto& b : boxes) {
+        glm::vec3 c(pos(rng), pos(rng), pos(rng));
+        glm::vec3 e(size(rng), size(rng), size(rng));
+        b.min = c - e;
+        b.max = c + e;
+    }
+    return boxes;
+}
+
+void benchBVH()
+{
+    glm::mat4 proj = glm::perspective(glm::radians(45.0f), 16.0f / 10.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum = extractFrustum(proj * view);
+
+    for (size_t count = 1000; count <= 1000000; count *= 10) {
+        // keep the density constant so the visible fraction shrinks as the world grows
+        float range = 10.0f * std::cbrt(float(count) / 1000.0f);
+        std::vector<AABB> boxes = randomBoxes(count, range, 2);
+
+        BVH bvh;
+        auto start = Clock::now();
+        bvh.build(boxes);
+        double buildMs = elapsedMs(start);
+
+        std::vector<uint32_t> items;
+        const int iterations = 20;
+        start = Clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            items.clear();
+            bvh.queryFrustum(frustum, items);
+        }
+        double queryMs = elapsedMs(start) / iterations;
+        size_t treeVisible = items.size();
+
+        // the instance list without the tree, box by box and 8 boxes at a time
+        size_t flatVisible = 0;
+        start = Clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            flatVisible = 0;
+            for (auto& b : boxes) {
+                flatVisible += isVisible(frustum, b) ? 1 : 0;
+            }
+        }
+        double flatMs = elapsedMs(start) / iterations;
+
+        AABBSoA soa;
+        for (auto& b : boxes) {
+            soa.push_back(b);
+        }
+        std::vector<uint8_t> visible(count);
+        size_t simdVisible = 0;
+        start = Clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            simdVisible = cullAABBs(frustum, soa, visible.data());
+        }
+        double simdMs = elapsedMs(start) / iterations;
+
+        // move 10% of the instances a little and refit
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<float> jitter(-0.5f, 0.5f);
+        start = Clock::now();
+        for (size_t i = 0; i < count; i += 10) {
+            AABB b = boxes[i];
+            glm::vec3 d(jitter(rng), jitter(rng), jitter(rng));
+            b.min += d;
+            b.max += d;
+            bvh.update(uint32_t(i), b);
+            boxes[i] = b;
+        }
+        bvh.refit();
+        double refitMs = elapsedMs(start);
+
+        // the refitted tree sees the moved boxes
+        items.clear();
+        bvh.queryFrustum(frustum, items);
+        size_t movedVisible = 0;
+        for (auto& b : boxes) {
+            movedVisible += isVisible(frustum, b) ? 1 : 0;
+        }
+
+        const int rays = 1000;
+        std::uniform_real_distribution<float> dir(-1.0f, 1.0f);
+        int hits = 0;
+        start = Clock::now();
+        for (int i = 0; i < rays; ++i) {
+            float t;
+            glm::vec3 d = glm::normalize(glm::vec3(dir(rng), dir(rng), dir(rng)) + glm::vec3(0.0f, 0.0f, 0.001f));
+            hits += bvh.raycast(glm::vec3(0.0f), d, t) >= 0 ? 1 : 0;
+        }
+        double rayUs = elapsedMs(start) * 1000.0 / rays;
+
+        spdlog::info("bvh: {0} items, {1} nodes, build {2:.2f} ms, frustum {3:.3f} ms ({4} visible) vs flat {5:.3f} ms scalar, {6:.3f} ms 8-wide ({7}), refit 10% {8:.2f} ms, ray {9:.2f} us ({10} hits)",
+            count, bvh.nodeCount(), buildMs, queryMs, treeVisible, flatMs, simdMs, flatVisible, refitMs, rayUs, hits);
+        check(treeVisible == flatVisible && simdVisible == flatVisible, "bvh: " + std::to_string(count) + " items, " + std::to_string(treeVisible) +
+            " visible through the tree, " + std::to_string(simdVisible) + " 8-wide, " + std::to_string(flatVisible) + " box by box");
+        check(items.size() == movedVisible, "bvh: after the refit " + std::to_string(items.size()) + " visible through the tree, " +
+            std::to_string(movedVisible) + " box by box");
+    }
+}
+
+// unit cube as an occluder mesh
+void cubeMesh(std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices)
+{
+    positions.clear();
+    for (int i = 0; i < 8; ++i) {
+        positions.push_back(glm::vec3((i & 1) ? 0.5f : -0.5f, (i & 2) ? 0.5f : -0.5f, (i & 4) ? 0.5f : -0.5f));
+    }
+    indices = {
+        0, 2, 1, 1, 2, 3,   4, 5, 6, 5, 7, 6,
+        0, 1, 4, 1, 5, 4,   2, 6, 3, 3, 6, 7,
+        0, 4, 2, 2, 4, 6,   1, 3, 5, 3, 7, 5,
+    };
+}
+
+void benchOcclusion()
+{
+    glm::mat4 proj = glm::perspective(glm::radians(45.0f), 16.0f / 10.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    cubeMesh(positions, indices);
+
+    // a few hundred scattered occluders plus a wall in front of the camera, the same scene
+    // with every standard library
+    std::mt19937 rng(4);
+    std::vector<glm::mat4> occluders;
+    for (int i = 0; i < 500; ++i) {
+        float x = portableUniform(rng, -8.0f, 8.0f);
+        float y = portableUniform(rng, -8.0f, 8.0f);
+        float z = portableUniform(rng, -8.0f, 8.0f) - 10.0f;
+        glm::mat4 m = glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
+        occluders.push_back(glm::scale(m, glm::vec3(portableUniform(rng, 0.3f, 1.5f))));
+    }
+    occluders.push_back(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 0.0f, -2.0f)), glm::vec3(2.0f, 2.0f, 0.2f)));
+
+    OcclusionCuller culler;
+    culler.begin(proj * view);
+    for (auto& m : occluders) {
+        culler.addOccluder(m, positions, indices);
+    }
+
+    const int iterations = 20;
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        culler.rasterize();
+    }
+    double binnedMs = elapsedMs(start) / iterations;
+    std::vector<float> binned = culler.depth();
+
+    start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        culler.rasterizeReference();
+    }
+    double referenceMs = elapsedMs(start) / iterations;
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < binned.size(); ++i) {
+        mismatches += std::abs(binned[i] - culler.depth()[i]) > 1e-5f ? 1 : 0;
+    }
+
+    // the binned buffer against data/reference/occlusion_depth.pgm, off by no more than the
+    // float tolerance above at 16 bits; this run's goes to occlusion_binned.pgm, to look at or
+    // to replace the reference with
+    culler.rasterize();
+    std::vector<uint16_t> binnedImage = culler.depthImage();
+    culler.writeDepthImage("occlusion_binned.pgm");
+    int imageWidth = 0;
+    int imageHeight = 0;
+    std::vector<uint16_t> stored = readPGM(RSLib::instance()->getReferenceFileName("occlusion_depth.pgm"), imageWidth, imageHeight);
+    bool sameSize = imageWidth == culler.width() && imageHeight == culler.height() && stored.size() == binnedImage.size();
+    size_t imageMismatches = 0;
+    for (size_t i = 0; sameSize && i < stored.size(); ++i) {
+        imageMismatches += std::abs(int(stored[i]) - int(binnedImage[i])) > 1 ? 1 : 0;
+    }
+
+    std::vector<AABB> boxes = randomBoxes(100000, 10.0f, 5);
+    for (auto& b : boxes) {
+        b.min.z -= 12.0f;
+        b.max.z -= 12.0f;
+    }
+    size_t occluded = 0;
+    start = Clock::now();
+    for (auto& b : boxes) {
+        occluded += culler.isVisible(b) ? 0 : 1;
+    }
+    double testMs = elapsedMs(start);
+
+    spdlog::info("occlusion: {0}x{1}, {2} triangles, binned {3:.3f} ms vs reference {4:.3f} ms, {5} mismatching pixels, {6} boxes tested in {7:.2f} ms, {8} occluded",
+        culler.width(), culler.height(), culler.triangleCount(), binnedMs, referenceMs, mismatches, boxes.size(), testMs, occluded);
+    check(mismatches == 0, "occlusion: binned and scalar rasterizers differ in " + std::to_string(mismatches) + " pixels");
+    if (stored.empty()) {
+        check(false, "occlusion: no readable reference/occlusion_depth.pgm");
+    } else {
+        check(sameSize, "occlusion: reference depth image is " + std::to_string(imageWidth) + "x" + std::to_string(imageHeight));
+        check(imageMismatches == 0, "occlusion: " + std::to_string(imageMismatches) + " pixels differ from the reference depth image");
+    }
+}
+
+void benchLights()
+{
+    const float fovY = glm::radians(45.0f), aspect = 16.0f / 9.0f;
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    for (size_t count : { size_t(10), size_t(1000), size_t(10000) }) {
+        std::mt19937 rng(6);
+        std::uniform_real_distribution<float> pos(-20.0f, 20.0f), radius(0.5f, 3.0f);
+        std::vector<PointLight> lights(count);
+        for (auto& l : lights) {
+            l.position = glm::vec3(pos(rng), pos(rng), pos(rng) - 20.0f);
+            l.radius = radius(rng);
+            l.color = glm::vec3(1.0f);
+            l.intensity = 1.0f;
+        }
+
+        LightGrid grid;
+        grid.setProjection(fovY, aspect, 0.1f, 100.0f);
+        const int iterations = 20;
+        grid.setParallelFor([](size_t n, const std::function<void(size_t, size_t)>& fn) { fn(0, n); });
+        auto start = Clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            grid.build(lights, view);
+        }
+        double serialMs = elapsedMs(start) / iterations;
+
+        grid.setParallelFor(threadedFor);
+        start = Clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            grid.build(lights, view);
+        }
+        double parallelMs = elapsedMs(start) / iterations;
+
+        // every light that reaches a point in view must be in the list of the point's cluster
+        size_t missed = 0;
+        std::uniform_real_distribution<float> ndc(-0.999f, 0.999f), dist(0.2f, 60.0f);
+        for (int i = 0; i < 100000; ++i) {
+            float d = dist(rng), nx = ndc(rng), ny = ndc(rng);
+            glm::vec3 p(nx * d * std::tan(fovY * 0.5f) * aspect, ny * d * std::tan(fovY * 0.5f), -d);
+            int x = int((nx * 0.5f + 0.5f) * LightGrid::GridX), y = int((ny * 0.5f + 0.5f) * LightGrid::GridY);
+            int z = std::min(std::max(grid.slice(d), 0), LightGrid::GridZ - 1);
+            glm::uvec2 cluster = grid.clusters()[x + y * LightGrid::GridX + z * LightGrid::GridX * LightGrid::GridY];
+            for (uint32_t l = 0; l < count; ++l) {
+                glm::vec3 c = glm::vec3(view * glm::vec4(lights[l].position, 1.0f));
+                if (glm::length(c - p) > lights[l].radius) {
+                    continue;
+                }
+                auto first = grid.indices().begin() + cluster.x;
+                missed += std::find(first, first + cluster.y, l) == first + cluster.y ? 1 : 0;
+            }
+        }
+
+        size_t occupied = 0;
+        for (auto& c : grid.clusters()) {
+            occupied += c.y > 0 ? 1 : 0;
+        }
+        spdlog::info("lights: {0} lights, bin serial {1:.3f} ms, parallel {2:.3f} ms, {3} indices, {4:.1f} per occupied cluster (max {5}) vs {0} per pixel unculled, {6} missed",
+            count, serialMs, parallelMs, grid.indices().size(), occupied ? double(grid.indices().size()) / occupied : 0.0, grid.maxLightsPerCluster(), missed);
+        check(missed == 0, "lights: " + std::to_string(missed) + " lights reaching a point missing from its cluster, of " + std::to_string(count));
+    }
+}
+
+void benchScene()
+{
+    const size_t count = 1000000;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> pos(-100.0f, 100.0f), angle(-3.14f, 3.14f), size(0.5f, 2.0f);
+
+    // a root every 4 nodes with three children below it
+    Scene scene;
+    scene.reserve(count);
+    uint32_t root = Scene::None;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t parent = (i % 4 == 0) ? Scene::None : root;
+        uint32_t node = scene.add(0, parent, glm::vec3(pos(rng), pos(rng), pos(rng)),
+                                  glm::quat(glm::vec3(angle(rng), angle(rng), angle(rng))), glm::vec3(size(rng)));
+        if (parent == Scene::None) {
+            root = node;
+        }
+    }
+
+    auto start = Clock::now();
+    scene.update();
+    double fullMs = elapsedMs(start);
+    std::vector<glm::mat4> batched = scene.worlds();
+
+    start = Clock::now();
+    scene.updateReference();
+    double referenceMs = elapsedMs(start);
+
+    float maxError = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            for (int r = 0; r < 4; ++r) {
+                float d = std::abs(batched[i][c][r] - scene.world(uint32_t(i))[c][r]);
+                maxError = std::max(maxError, d / std::max(1.0f, std::abs(batched[i][c][r])));
+            }
+        }
+    }
+
+    // move 10% of the roots, their children follow
+    for (size_t i = 0; i < count; i += 40) {
+        scene.setPosition(uint32_t(i), scene.position(uint32_t(i)) + glm::vec3(1.0f));
+    }
+    start = Clock::now();
+    size_t changed = scene.update();
+    double partialMs = elapsedMs(start);
+
+    spdlog::info("scene: {0} nodes, batched update {1:.2f} ms vs glm reference {2:.2f} ms (max relative error {3}), 10% of roots moved: {4} nodes in {5:.2f} ms",
+        count, fullMs, referenceMs, maxError, changed, partialMs);
+    check(maxError <= 1e-5f, "scene: batched world matrices off the glm reference by " + std::to_string(maxError));
+}
+
+void benchJobs()
+{
+    std::unique_ptr<JobSystem> local;
+    JobSystem* jobs = RSLib::instance()->getJobSystem();
+    if (!jobs) {
+        local = std::make_unique<JobSystem>();
+        jobs = local.get();
+    }
+
+    // spawn and wait on empty jobs
+    const int count = 100000;
+    auto start = Clock::now();
+    {
+        JobCounter counter;
+        for (int i = 0; i < count; ++i) {
+            jobs->run([]() {}, &counter);
+        }
+        jobs->wait(counter);
+    }
+    double emptyNs = elapsedMs(start) * 1e6 / count;
+
+    // a chain where every job depends on the previous one
+    const int links = 10000;
+    start = Clock::now();
+    {
+        std::vector<std::unique_ptr<JobCounter>> counters;
+        counters.emplace_back(new JobCounter);
+        jobs->run([]() {}, counters.back().get());
+        for (int i = 1; i < links; ++i) {
+            counters.emplace_back(new JobCounter);
+            jobs->runAfter(*counters[i - 1], []() {}, counters.back().get());
+        }
+        jobs->wait(*counters.back());
+        for (auto& c : counters) {
+            jobs->wait(*c);
+        }
+    }
+    double chainNs = elapsedMs(start) * 1e6 / links;
+
+    // parallel for over a cheap loop body against short-lived threads and a plain loop
+    std::vector<float> data(1 << 22, 1.0f);
+    auto body = [&data](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            data[i] = std::sqrt(data[i] * 1.0001f + 1.0f);
+        }
+    };
+    const int iterations = 20;
+    start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        body(0, data.size());
+    }
+    double serialMs = elapsedMs(start) / iterations;
+    start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        jobs->parallelFor(data.size(), body);
+    }
+    double jobsMs = elapsedMs(start) / iterations;
+    start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        threadedFor(data.size(), body);
+    }
+    double threadsMs = elapsedMs(start) / iterations;
+
+    // tiny parallel-fors, where the scheduling cost dominates
+    start = Clock::now();
+    for (int i = 0; i < 10000; ++i) {
+        jobs->parallelFor(64, body, 8);
+    }
+    double smallUs = elapsedMs(start) * 1000.0 / 10000;
+
+    // slow background jobs queued ahead of a parallel for: the waiting thread must not
+    // pick any of them up, the workers run them
+    std::atomic<int> helped{ 0 };
+    std::thread::id caller = std::this_thread::get_id();
+    JobCounter background;
+    for (int i = 0; i < 4; ++i) {
+        jobs->runBackground([&helped, caller]() {
+            helped += std::this_thread::get_id() == caller;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }, &background);
+    }
+    start = Clock::now();
+    for (int i = 0; i < 100; ++i) {
+        jobs->parallelFor(64, body, 8);
+    }
+    double besideUs = elapsedMs(start) * 1000.0 / 100;
+    jobs->wait(background);
+
+    spdlog::info("jobs: {0} workers, empty job {1:.0f} ns, dependency link {2:.0f} ns, parallel for 4M: serial {3:.2f} ms, jobs {4:.2f} ms, std::thread {5:.2f} ms, 8-chunk parallel for {6:.2f} us",
+        jobs->workerCount(), emptyNs, chainNs, serialMs, jobsMs, threadsMs, smallUs);
+    spdlog::info("jobs: 8-chunk parallel for beside 20 ms background jobs {0:.2f} us, background jobs run by the waiting thread: {1}",
+        besideUs, helped.load());
+    check(helped.load() == 0, "jobs: the thread waiting on a parallel for ran " + std::to_string(helped.load()) + " background jobs");
+}
+
+// a producer publishing packets as fast as it can and a consumer taking the newest one;
+// every packet is filled with its sequence number, so a torn read would show
+void benchTripleBuffer()
+{
+    struct Packet {
+        uint64_t sequence = 0;
+        std::vector<uint64_t> payload;
+    };
+    TripleBuffer<Packet> packets;
+    const uint64_t count = 1000000;
+    std::atomic<bool> done{ false };
+    uint64_t dropped = 0;
+
+    auto start = Clock::now();
+    std::thread producer([&]() {
+        for (uint64_t i = 1; i <= count; ++i) {
+            Packet& p = packets.back();
+            p.sequence = i;
+            p.payload.assign(64, i);
+            dropped += packets.publish() ? 0 : 1;
+        }
+        done = true;
+    });
+
+    uint64_t taken = 0, torn = 0, last = 0, backwards = 0;
+    while (true) {
+        bool finished = done.load();
+        if (packets.take()) {
+            const Packet& p = packets.front();
+            taken++;
+            torn += std::count_if(p.payload.begin(), p.payload.end(), [&p](uint64_t v) { return v != p.sequence; }) > 0 ? 1 : 0;
+            backwards += p.sequence <= last ? 1 : 0;
+            last = p.sequence;
+        } else if (finished) {
+            break;
+        }
+    }
+    producer.join();
+    double ms = elapsedMs(start);
+
+    spdlog::info("triplebuffer: {0} published in {1:.1f} ms ({2:.0f} ns each), {3} taken, {4} replaced before taken, last {5}, {6} torn, {7} out of order",
+        count, ms, ms * 1e6 / count, taken, dropped, last, torn, backwards);
+    check(torn == 0 && backwards == 0, "triplebuffer: " + std::to_string(torn) + " torn and " + std::to_string(backwards) + " out of order packets taken");
+}
+
+// transient per-frame containers from the frame allocator against fresh std::vectors
+void benchFrameArena()
+{
+    const int frames = 2000;
+    const size_t items = 5000;
+
+    auto fill = [items](auto& keys, auto& flags) {
+        keys.reserve(items);
+        flags.reserve(items);
+        for (size_t i = 0; i < items; ++i) {
+            keys.push_back(uint64_t(i) * 2654435761u);
+            flags.push_back(uint8_t(i & 1));
+        }
+        std::sort(keys.begin(), keys.end());
+    };
+
+    uint64_t heapBefore = HeapStats::threadAllocations();
+    auto start = Clock::now();
+    for (int f = 0; f < frames; ++f) {
+        std::vector<uint64_t> keys;
+        std::vector<uint8_t> flags;
+        fill(keys, flags);
+    }
+    double vectorMs = elapsedMs(start) / frames;
+    uint64_t vectorHeap = HeapStats::threadAllocations() - heapBefore;
+
+    FrameAllocator memory(4096);
+    for (int f = 0; f < 4; ++f) {
+        memory.beginFrame();
+        std::pmr::vector<uint64_t> keys(memory.resource());
+        std::pmr::vector<uint8_t> flags(memory.resource());
+        fill(keys, flags);
+    }
+    start = Clock::now();
+    for (int f = 0; f < frames; ++f) {
+        memory.beginFrame();
+        std::pmr::vector<uint64_t> keys(memory.resource());
+        std::pmr::vector<uint8_t> flags(memory.resource());
+        fill(keys, flags);
+    }
+    double arenaMs = elapsedMs(start) / frames;
+
+    // the arenas have grown to the peak by now, nothing reaches the heap
+    heapBefore = HeapStats::threadAllocations();
+    for (int f = 0; f < frames; ++f) {
+        memory.beginFrame();
+        std::pmr::vector<uint64_t> keys(memory.resource());
+        std::pmr::vector<uint8_t> flags(memory.resource());
+        fill(keys, flags);
+    }
+    uint64_t arenaHeap = HeapStats::threadAllocations() - heapBefore;
+
+    // raw bump allocation against new/delete
+    const int count = 1000000;
+    start = Clock::now();
+    for (int i = 0; i < count; i += 1000) {
+        memory.beginFrame();
+        for (int k = 0; k < 1000; ++k) {
+            volatile float* p = memory.arena().allocate<float>(16);
+            p[0] = 1.0f;
+        }
+    }
+    double bumpNs = elapsedMs(start) * 1e6 / count;
+    start = Clock::now();
+    for (int i = 0; i < count; ++i) {
+        volatile float* p = new float[16];
+        p[0] = 1.0f;
+        delete[] p;
+    }
+    double newNs = elapsedMs(start) * 1e6 / count;
+
+    // a parallel for keeps its chunk jobs on the stack
+    std::unique_ptr<JobSystem> local;
+    JobSystem* jobs = RSLib::instance()->getJobSystem();
+    if (!jobs) {
+        local = std::make_unique<JobSystem>();
+        jobs = local.get();
+    }
+    std::vector<float> data(4096, 1.0f);
+    auto body = [&data](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            data[i] *= 1.0001f;
+        }
+    };
+    // counted on the workers too, the chunks run in the scope of this thread
+    HeapStats::Scope scope;
+    HeapStats::Scope* previous = HeapStats::setScope(&scope);
+    for (int i = 0; i < 1000; ++i) {
+        jobs->parallelFor(data.size(), body, 256);
+    }
+    HeapStats::setScope(previous);
+    uint64_t jobsHeap = scope.allocations.load();
+
+    spdlog::info("framearena: {0} keys per frame: std::vector {1:.3f} ms, arena {2:.3f} ms; allocation {3:.1f} ns vs new/delete {4:.1f} ns; arena overflows {5}",
+        items, vectorMs, arenaMs, bumpNs, newNs, memory.arena().overflows());
+    if (HeapStats::enabled()) {
+        spdlog::info("framearena: heap allocations per frame: std::vector {0:.1f}, arena {1:.1f}, parallel for {2:.1f}",
+            double(vectorHeap) / frames, double(arenaHeap) / frames, double(jobsHeap) / 1000);
+        check(arenaHeap == 0 && jobsHeap == 0, "framearena: the arena frames made " + std::to_string(arenaHeap) +
+            " heap allocations, the parallel fors " + std::to_string(jobsHeap));
+    }
+}
+
+// Per-draw CPU cost of texture binding. Every mesh owning its textures (one glBindTextures
+// per draw) against the material library, where meshes reference deduplicated materials
+// and maps of equal size share an array, using the textures of data/model/common.
+void benchDraw()
+{
+    // the CPU side of a draw without a context
+    GLBackend null(GLBackend::Kind::Null);
+    null.install();
+
+    {
+        // what the cube, plan and panel models ask for, once per mesh
+        const char* files[] = { "model/common/marble.jpg", "model/common/metal.png", "model/common/grass.png", "model/common/window.png" };
+        const int meshCount = 1000;
+        MaterialLibrary library;
+        auto arena = std::make_shared<GeometryArena>();
+        std::vector<Mesh> meshes;
+        for (int i = 0; i < meshCount; ++i) {
+            MaterialDesc desc;
+            desc.diffuse = glm::vec4(0.8f, 0.8f, 0.8f, 1.0f);
+            desc.textures[SlotDiffuse] = files[i * 4 / meshCount];
+            std::vector<Vertex> vertices(3);
+            std::vector<uint32_t> indices = { 0, 1, 2 };
+            meshes.emplace_back(std::move(vertices), std::move(indices), library.add(desc), arena, AABB());
+        }
+
+        auto start = Clock::now();
+        library.upload();
+        double uploadMs = elapsedMs(start);
+        library.flush();
+
+        const int frames = 200;
+        auto run = [&](const std::function<void(Mesh&)>& draw, double& ns, double& calls) {
+            null.resetCounts();
+            auto start = Clock::now();
+            for (int f = 0; f < frames; ++f) {
+                for (auto& m : meshes) {
+                    draw(m);
+                }
+            }
+            ns = elapsedMs(start) * 1e6 / (double(frames) * meshCount);
+            calls = double(null.totalCalls()) / (double(frames) * meshCount);
+        };
+
+        // one texture object per mesh, bound on every draw
+        double ownNs, ownCalls;
+        run([](Mesh& mesh) {
+            GLuint texture = mesh.material() + 1;
+            glBindTextures(0, 1, &texture);
+            mesh.Draw();
+        }, ownNs, ownCalls);
+
+        double materialNs, materialCalls;
+        int current = -1;
+        run([&](Mesh& mesh) {
+            library.bind(mesh.material());
+            if (int(mesh.material()) != current) {
+                current = int(mesh.material());
+                glUniform1i(0, current);
+            }
+            mesh.Draw();
+        }, materialNs, materialCalls);
+
+        spdlog::info("draw: {0} meshes -> {1} materials, {2} textures in {3} arrays, decoded and packed in {4:.1f} ms",
+            library.requests(), library.size(), library.textureCount(), library.arrayCount(), uploadMs);
+        spdlog::info("draw: per draw: own textures {0:.1f} ns / {1:.2f} GL calls, material library {2:.1f} ns / {3:.3f} calls, {4:.1f} texture binds per frame",
+            ownNs, ownCalls, materialNs, materialCalls, double(library.bindsIssued()) / frames);
+    }
+
+}
+
+// GpuCuller's kernels run on the CPU against the software occlusion buffer: nothing the
+// CPU culler keeps may be culled, and every batch has to come out in cull.comp's layout
+void benchGpuCull()
+{
+    glm::mat4 proj = glm::perspective(glm::radians(45.0f), 16.0f / 10.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    cubeMesh(positions, indices);
+
+    // same occluders as the occlusion benchmark, their depth stands in for last frame's
+    std::mt19937 rng(4);
+    std::uniform_real_distribution<float> pos(-8.0f, 8.0f);
+    std::uniform_real_distribution<float> size(0.3f, 1.5f);
+    OcclusionCuller occlusion;
+    occlusion.begin(proj * view);
+    for (int i = 0; i < 500; ++i) {
+        glm::mat4 m = glm::translate(glm::mat4(1.0f), glm::vec3(pos(rng), pos(rng), pos(rng) - 10.0f));
+        occlusion.addOccluder(glm::scale(m, glm::vec3(size(rng))), positions, indices);
+    }
+    occlusion.addOccluder(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 0.0f, -2.0f)), glm::vec3(2.0f, 2.0f, 0.2f)), positions, indices);
+    occlusion.rasterize();
+
+    auto start = Clock::now();
+    HiZPyramid hiz = GpuCuller::buildHiZReference(occlusion.depth(), occlusion.width(), occlusion.height());
+    double hizMs = elapsedMs(start);
+
+    CullParams params;
+    params.frustum = extractFrustum(proj * view);
+    params.hizViewProj = proj * view;
+    params.hizSize = glm::ivec2(occlusion.width(), occlusion.height());
+    params.hizLevels = int(hiz.levels.size());
+
+    // batches of 100 commands, every fourth one ordered
+    const size_t count = 100000;
+    const size_t batchSize = 100;
+    std::vector<AABB> boxes = randomBoxes(count, 10.0f, 5);
+    std::vector<DrawElementsIndirectCommand> commands(count);
+    std::vector<DrawData> draws(count);
+    std::vector<CullInput> inputs(count);
+    std::vector<CullBatch> batches(count / batchSize);
+    for (size_t i = 0; i < count; ++i) {
+        boxes[i].min.z -= 12.0f;
+        boxes[i].max.z -= 12.0f;
+        commands[i] = { 36, 1, uint32_t(i), 0, 0 };
+        draws[i].model = glm::mat4(1.0f);
+        draws[i].material = glm::uvec4(uint32_t(i));
+        inputs[i] = { glm::vec4(boxes[i].min, 0.0f), glm::vec4(boxes[i].max, 0.0f), glm::uvec4(uint32_t(i / batchSize)) };
+    }
+    for (size_t b = 0; b < batches.size(); ++b) {
+        batches[b].info = glm::uvec4(uint32_t(b * batchSize), b % 4 == 0 ? 1 : 0, 0, 0);
+    }
+
+    std::vector<DrawElementsIndirectCommand> outCommands(count);
+    std::vector<DrawData> outDraws(count);
+    const int iterations = 10;
+    start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        std::fill(outCommands.begin(), outCommands.end(), DrawElementsIndirectCommand{});
+        GpuCuller::cullReference(commands.data(), draws.data(), inputs.data(), count, batches.data(), batches.size(),
+            params, &hiz, outCommands.data(), outDraws.data());
+    }
+    double cullMs = elapsedMs(start) / iterations;
+
+    // survivors per command, and whether each batch is laid out as cull.comp leaves it
+    std::vector<uint8_t> kept(count, 0);
+    size_t survivors = 0;
+    size_t badLayout = 0;
+    for (size_t b = 0; b < batches.size(); ++b) {
+        bool tail = false;
+        for (size_t slot = b * batchSize; slot < (b + 1) * batchSize; ++slot) {
+            if (!outCommands[slot].instanceCount) {
+                tail = true;
+                continue;
+            }
+            uint32_t i = outDraws[slot].material.x;
+            bool misplaced = batches[b].info.y ? i != slot : tail || i / batchSize != b;
+            badLayout += misplaced || outCommands[slot].firstIndex != i ? 1 : 0;
+            kept[i] = 1;
+            survivors++;
+        }
+    }
+
+    size_t wronglyCulled = 0;
+    size_t extraVisible = 0;
+    size_t cpuVisible = 0;
+    for (size_t i = 0; i < count; ++i) {
+        bool visible = isVisible(params.frustum, boxes[i]) && occlusion.isVisible(boxes[i]);
+        cpuVisible += visible ? 1 : 0;
+        wronglyCulled += visible && !kept[i] ? 1 : 0;
+        extraVisible += !visible && kept[i] ? 1 : 0;
+    }
+
+    spdlog::info("gpucull: {0} levels from {1}x{2} in {3:.3f} ms, {4} commands culled in {5:.2f} ms, {6} kept vs {7} on the CPU: {8} wrongly culled, {9} extra from coarser levels, {10} misplaced",
+        hiz.levels.size(), occlusion.width(), occlusion.height(), hizMs, count, cullMs, survivors, cpuVisible,
+        wronglyCulled, extraVisible, badLayout);
+    // conservative: the kernel may keep more than the CPU, never less
+    check(wronglyCulled == 0, "gpucull: " + std::to_string(wronglyCulled) + " visible commands culled");
+    check(badLayout == 0, "gpucull: " + std::to_string(badLayout) + " commands misplaced in their batch");
+}
+
+// the controller against a simulated GPU: a fixed cost plus one that scales with the pixels,
+// noisy, with results arriving three frames late like the timer queries, and the scene load
+// stepping up and back down
+void benchResolution()
+{
+    const int frames = 900;
+    const int latency = 3;
+    const float budget = 12.0f;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> noise(0.95f, 1.05f);
+
+    ResolutionController controller(budget, 0.5f, 1.0f);
+    std::vector<float> pending;
+    int changes = 0;
+    int over[3] = {};
+    double scaleSum[3] = {};
+    auto start = Clock::now();
+    for (int frame = 0; frame < frames; ++frame) {
+        int phase = frame / 300;
+        float load = phase == 0 ? 0.8f : (phase == 1 ? 1.6f : 0.6f);
+        glm::ivec2 viewport = controller.viewport(2560, 1600);
+        float area = float(viewport.x) * viewport.y / (2560.0f * 1600.0f);
+        float ms = (1.5f + 13.0f * area * load) * noise(rng);
+        over[phase] += ms > budget ? 1 : 0;
+        scaleSum[phase] += controller.scale();
+
+        pending.push_back(ms);
+        if (pending.size() > size_t(latency)) {
+            changes += controller.update(pending.front()) ? 1 : 0;
+            pending.erase(pending.begin());
+        }
+    }
+    double updateUs = elapsedMs(start) * 1000.0 / frames;
+
+    spdlog::info("resolution: {0} frames, {1} scale changes, mean scale {2:.2f}/{3:.2f}/{4:.2f} and frames over {5} ms {6}/{7}/{8} at load 0.8/1.6/0.6, {9:.3f} us per frame",
+        frames, changes, scaleSum[0] / 300, scaleSum[1] / 300, scaleSum[2] / 300, budget, over[0], over[1], over[2], updateUs);
+}
+
+// what an encode job does with a captured frame: a synthetic 2560x1600 render with flat
+// areas, gradients and noise, encoded both ways, then read back and compared like a golden
+// image, unchanged and with a few pixels off
+void benchCapture()
+{
+    const int width = 2560;
+    const int height = 1600;
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<int> noise(0, 255);
+    std::vector<uint8_t> frame(size_t(width) * height * 3);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            uint8_t* p = &frame[(size_t(y) * width + x) * 3];
+            if (y < height / 3) {
+                p[0] = 90; p[1] = 140; p[2] = 200;
+            } else if (x < width / 2) {
+                p[0] = uint8_t(x / 10); p[1] = uint8_t(y / 7); p[2] = 64;
+            } else {
+                p[0] = uint8_t(noise(rng)); p[1] = uint8_t(noise(rng)); p[2] = uint8_t(noise(rng));
+            }
+        }
+    }
+
+    std::vector<uint8_t> qoi, png;
+    auto start = Clock::now();
+    ImageCodec::encodeQOI(frame.data(), width, height, 3, qoi);
+    double qoiMs = elapsedMs(start);
+    start = Clock::now();
+    ImageCodec::encodePNG(frame.data(), width, height, 3, png);
+    double pngMs = elapsedMs(start);
+
+    Image decoded;
+    start = Clock::now();
+    bool ok = ImageCodec::decodeQOI(qoi.data(), qoi.size(), decoded);
+    double decodeMs = elapsedMs(start);
+
+    Image actual;
+    actual.width = width;
+    actual.height = height;
+    actual.channels = 3;
+    actual.pixels = std::shared_ptr<unsigned char>(frame.data(), [](unsigned char*) {});
+    ImageCodec::Difference same = ImageCodec::compare(actual, decoded, 2);
+
+    // two within the tolerance, three past it
+    uint8_t* expected = decoded.pixels.get();
+    const size_t touched[5] = { 0, 1000, 2000000, 3000000, size_t(width) * height - 1 };
+    for (int i = 0; i < 5; ++i) {
+        uint8_t& c = expected[touched[i] * 3 + 1];
+        c = uint8_t(c + (i < 2 ? 2 : 40));
+    }
+    ImageCodec::Difference changed = ImageCodec::compare(actual, decoded, 2);
+
+    double mb = frame.size() / (1024.0 * 1024.0);
+    spdlog::info("capture: {0}x{1} QOI {2:.2f} MB in {3:.2f} ms (decode {4:.2f} ms), PNG {5:.2f} MB in {6:.2f} ms, from {7:.2f} MB",
+        width, height, qoi.size() / (1024.0 * 1024.0), qoiMs, decodeMs, png.size() / (1024.0 * 1024.0), pngMs, mb);
+    spdlog::info("capture: round trip {0}, {1} pixels differ; after the edit {2} differ by up to {3}",
+        ok ? "decoded" : "failed", same.pixels, changed.pixels, changed.maxChannel);
+    check(ok && same.pixels == 0, "capture: QOI doesn't round-trip the frame");
+    check(changed.pixels == 3, "capture: the golden image compare found " + std::to_string(changed.pixels) + " of the 3 pixels edited past its tolerance");
+}
+
+// the stream's conversion of a 1920x1080 RGBA readback, bottom up like GL's, against the
+// scalar reference; both have to agree to the byte
+void benchYUV()
+{
+    const int width = 1920;
+    const int height = 1080;
+    const int runs = 20;
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<uint8_t> rgba(size_t(width) * height * 4);
+    for (auto& c : rgba) {
+        c = uint8_t(byte(rng));
+    }
+    ptrdiff_t stride = ptrdiff_t(width) * 4;
+    const uint8_t* top = rgba.data() + (height - 1) * stride;
+
+    std::vector<uint8_t> simd(size_t(width) * height * 3 / 2);
+    std::vector<uint8_t> reference(simd.size());
+    auto start = Clock::now();
+    for (int i = 0; i < runs; ++i) {
+        ImageCodec::rgbaToYUV420Reference(top, -stride, width, height, reference.data());
+    }
+    double referenceMs = elapsedMs(start) / runs;
+    start = Clock::now();
+    for (int i = 0; i < runs; ++i) {
+        ImageCodec::rgbaToYUV420(top, -stride, width, height, simd.data());
+    }
+    double simdMs = elapsedMs(start) / runs;
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < simd.size(); ++i) {
+        mismatches += simd[i] != reference[i] ? 1 : 0;
+    }
+    // a width that leaves a scalar tail
+    const int oddWidth = 1918;
+    std::vector<uint8_t> tailSimd(size_t(oddWidth) * height * 3 / 2);
+    std::vector<uint8_t> tailReference(tailSimd.size());
+    ImageCodec::rgbaToYUV420(top, -stride, oddWidth, height, tailSimd.data());
+    ImageCodec::rgbaToYUV420Reference(top, -stride, oddWidth, height, tailReference.data());
+    mismatches += tailSimd != tailReference ? 1 : 0;
+
+    spdlog::info("yuv: {0}x{1} to 4:2:0 in {2:.2f} ms, {3:.2f} ms scalar ({4:.1f}x), {5:.0f} frames/s per worker, {6} mismatched bytes",
+        width, height, simdMs, referenceMs, referenceMs / simdMs, 1000.0 / simdMs, mismatches);
+    check(mismatches == 0, "yuv: " + std::to_string(mismatches) + " bytes differ from the scalar conversion");
+}
+
+// a minute of synthetic input, cursor moves at a mouse's 500 Hz with jittered timing and
+// keys pressed now and then: the log's size, the round trip through the file format, and
+// two replays at a fixed step that have to hand out the same events on the same frames
+void benchInput()
+{
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> jitter(0.0015, 0.0025);
+    std::uniform_real_distribution<float> move(-4.0f, 4.0f);
+    std::uniform_int_distribution<int> keyChance(0, 199);
+    const int16_t keys[4] = { 87, 65, 83, 68 };
+
+    InputLog log;
+    float x = 640.0f, y = 400.0f;
+    int held = -1;
+    double time = 0.0;
+    while (time < 60.0) {
+        time += jitter(rng);
+        InputEvent e;
+        // the file keeps microseconds
+        e.time = std::round(time * 1e6) * 1e-6;
+        if (keyChance(rng) == 0) {
+            e.type = InputEvent::Key;
+            if (held < 0) {
+                held = keyChance(rng) % 4;
+                e.action = 1;
+            } else {
+                e.action = 0;
+            }
+            e.code = keys[held];
+            held = e.action ? held : -1;
+        } else {
+            e.type = InputEvent::CursorPos;
+            x += move(rng);
+            y += move(rng);
+            e.x = x;
+            e.y = y;
+        }
+        log.record(e);
+    }
+    log.finish(60.0);
+
+    std::vector<uint8_t> data;
+    auto start = Clock::now();
+    log.encode(data);
+    double encodeMs = elapsedMs(start);
+    InputLog loaded;
+    start = Clock::now();
+    bool ok = loaded.decode(data.data(), data.size());
+    double decodeMs = elapsedMs(start);
+    ok = ok && loaded.events() == log.events();
+
+    // what each frame gets, as a checksum over the frame number and the events
+    auto replay = [](InputLog& l, float step) {
+        std::vector<InputEvent> frame;
+        uint64_t hash = 1469598103934665603ull;
+        double t = 0.0;
+        uint64_t frames = 0;
+        l.rewind();
+        while (!l.finished()) {
+            t += step;
+            frame.clear();
+            l.replay(t, frame);
+            for (auto& e : frame) {
+                uint64_t bits = 0;
+                memcpy(&bits, &e.x, sizeof(float));
+                hash = (hash ^ (frames * 31 + e.type + uint64_t(e.code) * 7 + bits)) * 1099511628211ull;
+            }
+            frames++;
+        }
+        return std::make_pair(frames, hash);
+    };
+    auto first = replay(loaded, 1.0f / 60.0f);
+    auto second = replay(loaded, 1.0f / 60.0f);
+
+    spdlog::info("input: {0} events over {1:.0f} s in {2} bytes, {3:.1f} per event, vs {4} as structs; encode {5:.2f} ms, decode {6:.2f} ms, round trip {7}",
+        log.events().size(), log.duration(), data.size(), double(data.size()) / log.events().size(), log.events().size() * sizeof(InputEvent),
+        encodeMs, decodeMs, ok ? "exact" : "differs");
+    spdlog::info("input: replay at 60 Hz took {0} frames, twice {1}", first.first, first == second ? "identical" : "different");
+    check(ok, "input: the log doesn't decode to the events encoded");
+    check(first == second, "input: two replays of one log differ");
+}
+
+// fixed steps against jittery frame times with a hitch now and then: how far the drawn
+// position of something moving at 1 unit/s is from where it should be, interpolated and
+// not; then the pacer holding 240 fps for a second, its timing and the CPU it burns
+void benchPacing()
+{
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<double> frameMs(4.0, 10.0);
+    FixedStep interpolated(1.0 / 120.0, 8);
+    double time = 0.0;
+    double errorLerp = 0.0, errorLast = 0.0;
+    int frames = 0;
+    int maxSteps = 0;
+    for (int i = 0; i < 5000; ++i) {
+        double dt = (i % 1000 == 999 ? 120.0 : frameMs(rng)) / 1000.0;
+        time += dt;
+        int steps = interpolated.advance(dt);
+        maxSteps = std::max(maxSteps, steps);
+        // position is time at the steps, the frame draws one step behind the present
+        double current = interpolated.time();
+        double previous = current - interpolated.step();
+        double drawn = previous + (current - previous) * interpolated.alpha();
+        double ideal = time - interpolated.dropped() - interpolated.step();
+        errorLerp += (drawn - ideal) * (drawn - ideal);
+        errorLast += (current - ideal - interpolated.step()) * (current - ideal - interpolated.step());
+        frames++;
+    }
+
+    FramePacer pacer(240.0);
+    std::vector<double> intervals;
+    double slept = 0.0, spun = 0.0;
+    auto wallStart = Clock::now();
+    std::clock_t cpuStart = std::clock();
+    auto last = Clock::now();
+    pacer.wait();
+    for (int i = 0; i < 240; ++i) {
+        pacer.wait();
+        auto now = Clock::now();
+        intervals.push_back(std::chrono::duration<double, std::milli>(now - last).count());
+        last = now;
+        slept += pacer.sleptMs();
+        spun += pacer.spunMs();
+    }
+    double wallMs = elapsedMs(wallStart);
+    double cpuMs = double(std::clock() - cpuStart) * 1000.0 / CLOCKS_PER_SEC;
+    intervals.erase(intervals.begin());
+    std::vector<double> deviation;
+    double mean = 0.0;
+    for (double v : intervals) {
+        mean += v;
+        deviation.push_back(std::abs(v - 1000.0 / 240.0));
+    }
+    mean /= intervals.size();
+    std::sort(deviation.begin(), deviation.end());
+    double p99 = deviation[deviation.size() * 99 / 100];
+
+    spdlog::info("pacing: {0} frames at 4-10 ms with hitches, up to {1} steps, drawn position off by {2:.4f} rms interpolated vs {3:.4f} from the last step, {4:.2f} s dropped",
+        frames, maxSteps, std::sqrt(errorLerp / frames), std::sqrt(errorLast / frames), interpolated.dropped());
+    spdlog::info("pacing: 240 fps target, mean interval {0:.3f} ms, 99% within {1:.3f} ms, {2:.0f}% slept {3:.0f}% spun, CPU {4:.0f}% of a core, spin margin {5:.3f} ms",
+        mean, p99, slept * 100.0 / wallMs, spun * 100.0 / wallMs, cpuMs * 100.0 / wallMs, pacer.spinMarginMs());
+}
+
+void benchStats()
+{
+    // frame times around 7 ms with a long tail and rare hitches
+    std::mt19937 rng(46);
+    std::lognormal_distribution<double> frameMs(std::log(7.0), 0.15);
+    std::uniform_int_distribution<int> hitch(0, 499);
+    std::vector<double> samples(200000);
+    for (double& v : samples) {
+        v = hitch(rng) == 0 ? 40.0 + frameMs(rng) * 4.0 : frameMs(rng);
+    }
+
+    Profiler profiler("stats");
+    auto start = Clock::now();
+    for (double v : samples) {
+        profiler.sample("frame", v);
+    }
+    double addNs = elapsedMs(start) * 1e6 / samples.size();
+
+    Histogram h;
+    for (double v : samples) {
+        h.add(v);
+    }
+    std::vector<double> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    auto exact = [&](double p) { return sorted[size_t(std::ceil(p * sorted.size())) - 1]; };
+    auto exactLow = [&](double fraction) {
+        size_t n = size_t(std::ceil(fraction * sorted.size()));
+        return std::accumulate(sorted.end() - n, sorted.end(), 0.0) / n;
+    };
+    // a bucket is 2^(1/16) wide, its middle is within 2.2% of anything in it
+    double worst = 0.0;
+    const double ps[] = { 0.5, 0.9, 0.99, 0.999 };
+    for (double p : ps) {
+        double error = std::abs(h.percentile(p) / exact(p) - 1.0);
+        worst = std::max(worst, error);
+        spdlog::info("stats: p{0} {1:.3f} ms, exact {2:.3f}, {3:.2f}% off", p * 100.0, h.percentile(p), exact(p), error * 100.0);
+    }
+    const double lows[] = { 0.01, 0.001 };
+    for (double f : lows) {
+        double error = std::abs(h.lowMean(f) / exactLow(f) - 1.0);
+        worst = std::max(worst, error);
+        spdlog::info("stats: {0}% low {1:.3f} ms, exact {2:.3f}, {3:.2f}% off", f * 100.0, h.lowMean(f), exactLow(f), error * 100.0);
+    }
+
+    rapidjson::Document doc;
+    std::string json = profiler.json();
+    bool valid = !doc.Parse(json.c_str()).HasParseError() && doc["timings"]["frame"]["count"].GetUint64() == samples.size();
+
+    // every printable character is drawn, and drawn differently
+    std::set<uint64_t> glyphs;
+    for (int c = 33; c < 128; ++c) {
+        glyphs.insert(TextOverlay::glyph(char(c)));
+    }
+    spdlog::info("stats: {0} samples, {1:.1f} ns each, worst error {2:.2f}%, JSON {3} ({4} bytes), {5} distinct glyphs of 95",
+        samples.size(), addNs, worst * 100.0, valid ? "valid" : "INVALID", json.size(), glyphs.size() - glyphs.count(0));
+}
+
+// GL entry points that keep the state the command executor shadows, so what a draw sees can
+// be compared between playing a list through the executor and issuing every command
+namespace trackgl {
+
+int64_t calls = 0;
+GLuint program = 0;
+GLuint vao = 0;
+GLuint indirect = 0;
+GLuint active = 0;
+GLuint textures[2][CommandExecutor::MaxUnits] = {};
+bool caps[3] = {};
+std::map<std::pair<GLuint, GLint>, std::vector<uint32_t>> uniforms;
+std::vector<uint64_t> draws;
+
+int cap(GLenum c) { return c == GL_DEPTH_TEST ? 0 : c == GL_BLEND ? 1 : 2; }
+void setUniform(GLint location, const void* value, size_t words)
+{
+    if (location >= 0) {
+        auto& u = uniforms[{ program, location }];
+        u.assign((const uint32_t*)value, (const uint32_t*)value + words);
+    }
+}
+// FNV-1a of everything a draw depends on
+uint64_t signature()
+{
+    uint64_t h = 14695981039346656037ull;
+    auto mix = [&](uint64_t v) { h = (h ^ v) * 1099511628211ull; };
+    mix(program);
+    mix(vao);
+    mix(indirect);
+    for (auto& target : textures) {
+        for (GLuint t : target) {
+            mix(t);
+        }
+    }
+    for (bool c : caps) {
+        mix(c);
+    }
+    for (auto it = uniforms.lower_bound({ program, -1 }); it != uniforms.end() && it->first.first == program; ++it) {
+        mix(uint64_t(it->first.second));
+        for (uint32_t v : it->second) {
+            mix(v);
+        }
+    }
+    return h;
+}
+
+void APIENTRY useProgram(GLuint p) { calls++; program = p; }
+void APIENTRY bindVertexArray(GLuint v) { calls++; vao = v; }
+void APIENTRY bindBuffer(GLenum, GLuint b) { calls++; indirect = b; }
+void APIENTRY activeTexture(GLenum unit) { calls++; active = unit - GL_TEXTURE0; }
+void APIENTRY bindTexture(GLenum target, GLuint t) { calls++; textures[target == GL_TEXTURE_2D_ARRAY][active] = t; }
+// the workload only binds arrays this way
+void APIENTRY bindTextures(GLuint first, GLsizei count, const GLuint* t) { calls++; for (GLsizei i = 0; i < count; ++i) textures[1][first + i] = t[i]; }
+void APIENTRY enable(GLenum c) { calls++; caps[cap(c)] = true; }
+void APIENTRY disable(GLenum c) { calls++; caps[cap(c)] = false; }
+void APIENTRY uniform1i(GLint l, GLint v) { calls++; setUniform(l, &v, 1); }
+void APIENTRY uniform2fv(GLint l, GLsizei, const GLfloat* v) { calls++; setUniform(l, v, 2); }
+void APIENTRY uniformMatrix4fv(GLint l, GLsizei, GLboolean, const GLfloat* v) { calls++; setUniform(l, v, 16); }
+GLint APIENTRY getUniformLocation(GLuint, const GLchar* name) { calls++; return GLint(std::hash<std::string>()(name) & 0xffff); }
+void APIENTRY getIntegerv(GLenum, GLint* v) { calls++; *v = GLint(program); }
+void APIENTRY drawElementsBaseVertex(GLenum, GLsizei, GLenum, const void*, GLint) { calls++; draws.push_back(signature()); }
+void APIENTRY multiDrawElementsIndirect(GLenum, GLenum, const void*, GLsizei, GLsizei) { calls++; draws.push_back(signature()); }
+
+void reset()
+{
+    program = vao = indirect = active = 0;
+    memset(textures, 0, sizeof(textures));
+    memset(caps, 0, sizeof(caps));
+    uniforms.clear();
+    draws.clear();
+    calls = 0;
+}
+
+// every command issued as it was recorded, what engine code did before the executor
+void playReference(const CommandList& list)
+{
+    const uint32_t* data = list.data().data();
+    for (const Command& c : list.commands()) {
+        GLint location = c.name ? glGetUniformLocation(program, c.name) : c.location;
+        switch (c.op) {
+        case Command::UseProgram: glUseProgram(c.args[0]); break;
+        case Command::BindVertexArray: glBindVertexArray(c.args[0]); break;
+        case Command::BindTextures:
+            for (uint32_t i = 0; i < c.args[2]; ++i) {
+                if (data[c.args[3] + i]) {
+                    glActiveTexture(GL_TEXTURE0 + c.args[1] + i);
+                    glBindTexture(c.args[0], data[c.args[3] + i]);
+                }
+            }
+            break;
+        case Command::Enable: glEnable(c.args[0]); break;
+        case Command::Disable: glDisable(c.args[0]); break;
+        case Command::Uniform1i: glUniform1i(location, GLint(c.args[0])); break;
+        case Command::Uniform2f: glUniform2fv(location, 1, (const float*)c.args); break;
+        case Command::UniformMatrix4: glUniformMatrix4fv(location, 1, GL_FALSE, (const float*)(data + c.args[0])); break;
+        case Command::DrawElements: glDrawElementsBaseVertex(c.args[0], c.args[1], c.args[2], nullptr, 0); break;
+        case Command::MultiDrawIndirect:
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, c.args[0]);
+            glMultiDrawElementsIndirect(c.args[1], c.args[2], nullptr, c.args[4], 0);
+            break;
+        }
+    }
+}
+
+}
+
+// Recording and playing the scene pass as Model::draw records it: 2000 instances of 16
+// models in m_model order, 4 programs, 8 meshes each over 6 sets of texture arrays. The
+// draws must see the same state played through the executor as with every call issued.
+void benchCommands()
+{
+    std::unique_ptr<JobSystem> local;
+    JobSystem* jobs = RSLib::instance()->getJobSystem();
+    if (!jobs) {
+        local = std::make_unique<JobSystem>();
+        jobs = local.get();
+    }
+
+    const size_t items = 2000;
+    const size_t itemsPerList = 64;
+    const int models = 16;
+    const int meshes = 8;
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 2.0f, 8.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.6f, 0.1f, 100.0f);
+    std::array<std::array<unsigned int, SlotCount>, 6> arrays;
+    for (size_t a = 0; a < arrays.size(); ++a) {
+        for (unsigned int s = 0; s < SlotCount; ++s) {
+            arrays[a][s] = s < 2 ? unsigned(100 + a * 2 + s) : 0;
+        }
+    }
+    auto recordItem = [&](CommandList& commands, size_t i) {
+        int model = int(i * models / items);
+        glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(float(i % 40), 0.0f, float(i / 40)));
+        commands.useProgram(unsigned(1 + model % 4));
+        commands.uniform("projection", projection);
+        commands.uniform("view", view);
+        commands.uniform("model", transform);
+        commands.bindVertexArray(7);
+        int material = -1;
+        for (int m = 0; m < meshes; ++m) {
+            int mat = (model + m / 3) % int(arrays.size());
+            commands.bindTextures(GL_TEXTURE_2D_ARRAY, 0, SlotCount, arrays[mat].data());
+            if (mat != material) {
+                material = mat;
+                commands.uniform(3, material);
+            }
+            commands.drawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0, m * 24);
+        }
+    };
+
+    size_t listCount = (items + itemsPerList - 1) / itemsPerList;
+    std::vector<CommandList> lists(listCount);
+    auto record = [&](size_t begin, size_t end) {
+        for (size_t l = begin; l < end; ++l) {
+            lists[l].clear();
+            for (size_t i = l * itemsPerList; i < std::min(items, (l + 1) * itemsPerList); ++i) {
+                recordItem(lists[l], i);
+            }
+        }
+    };
+    const int frames = 50;
+    record(0, listCount);
+    auto start = Clock::now();
+    for (int f = 0; f < frames; ++f) {
+        record(0, listCount);
+    }
+    double serialMs = elapsedMs(start) / frames;
+    start = Clock::now();
+    for (int f = 0; f < frames; ++f) {
+        jobs->parallelFor(listCount, std::ref(record), 1);
+    }
+    double parallelMs = elapsedMs(start) / frames;
+    size_t recorded = 0;
+    for (auto& l : lists) {
+        recorded += l.size();
+    }
+
+    auto saved = std::make_tuple(glad_glUseProgram, glad_glBindVertexArray, glad_glBindBuffer, glad_glActiveTexture, glad_glBindTexture,
+        glad_glBindTextures, glad_glEnable, glad_glDisable, glad_glUniform1i, glad_glUniform2fv, glad_glUniformMatrix4fv,
+        glad_glGetUniformLocation, glad_glGetIntegerv, glad_glDrawElementsBaseVertex, glad_glMultiDrawElementsIndirect, GLAD_GL_VERSION_4_4);
+    glad_glUseProgram = trackgl::useProgram;
+    glad_glBindVertexArray = trackgl::bindVertexArray;
+    glad_glBindBuffer = trackgl::bindBuffer;
+    glad_glActiveTexture = trackgl::activeTexture;
+    glad_glBindTexture = trackgl::bindTexture;
+    glad_glBindTextures = trackgl::bindTextures;
+    glad_glEnable = trackgl::enable;
+    glad_glDisable = trackgl::disable;
+    glad_glUniform1i = trackgl::uniform1i;
+    glad_glUniform2fv = trackgl::uniform2fv;
+    glad_glUniformMatrix4fv = trackgl::uniformMatrix4fv;
+    glad_glGetUniformLocation = trackgl::getUniformLocation;
+    glad_glGetIntegerv = trackgl::getIntegerv;
+    glad_glDrawElementsBaseVertex = trackgl::drawElementsBaseVertex;
+    glad_glMultiDrawElementsIndirect = trackgl::multiDrawElementsIndirect;
+
+    trackgl::reset();
+    for (auto& l : lists) {
+        trackgl::playReference(l);
+    }
+    std::vector<uint64_t> reference = trackgl::draws;
+    int64_t referenceCalls = trackgl::calls;
+
+    CommandExecutor executor;
+    bool same = true;
+    int64_t calls[2] = {};
+    for (int multiBind = 0; multiBind < 2; ++multiBind) {
+        GLAD_GL_VERSION_4_4 = multiBind;
+        trackgl::reset();
+        executor.invalidate();
+        for (auto& l : lists) {
+            executor.execute(l);
+        }
+        same = same && trackgl::draws == reference;
+        calls[multiBind] = trackgl::calls;
+    }
+
+    trackgl::draws.reserve(reference.size() * frames);
+    executor.resetStats();
+    start = Clock::now();
+    for (int f = 0; f < frames; ++f) {
+        executor.invalidate();
+        for (auto& l : lists) {
+            executor.execute(l);
+        }
+    }
+    double playNs = elapsedMs(start) * 1e6 / (double(frames) * recorded);
+    CommandExecutor::Stats stats = executor.stats();
+
+    std::tie(glad_glUseProgram, glad_glBindVertexArray, glad_glBindBuffer, glad_glActiveTexture, glad_glBindTexture,
+        glad_glBindTextures, glad_glEnable, glad_glDisable, glad_glUniform1i, glad_glUniform2fv, glad_glUniformMatrix4fv,
+        glad_glGetUniformLocation, glad_glGetIntegerv, glad_glDrawElementsBaseVertex, glad_glMultiDrawElementsIndirect, GLAD_GL_VERSION_4_4) = saved;
+
+    const char* kinds[] = { "program", "vao", "texture", "buffer", "state", "uniform", "draw" };
+    std::string elided;
+    for (int k = 0; k < CommandExecutor::Kinds; ++k) {
+        if (stats.elided[k]) {
+            elided += fmt::format(" {0} {1:.0f}/{2:.0f}", kinds[k], double(stats.elided[k]) / frames, double(stats.elided[k] + stats.issued[k]) / frames);
+        }
+    }
+    spdlog::info("commands: {0} items, {1} commands in {2} lists, recorded in {3:.3f} ms on one thread, {4:.3f} ms on {5} workers",
+        items, recorded, listCount, serialMs, parallelMs, jobs->workerCount());
+    spdlog::info("commands: {0:.1f} ns per command played, {1:.0f} issued and {2:.0f} elided per frame:{3}",
+        playNs, double(stats.totalIssued()) / frames, double(stats.totalElided()) / frames, elided);
+    spdlog::info("commands: GL calls per frame {0} issuing everything, {1} through the executor, {2} without multi-bind; draw state {3}",
+        referenceCalls, calls[1], calls[0], same ? "identical" : "DIFFERENT");
+    check(same, "commands: the executor left different draw state than issuing every command");
+}
+
+// Engine code on the null backend with a tracing one over it: loading geometry, the overlay,
+// multi-draw buffers and timer queries, then frames of command lists. The trace has to see
+// every call the null backend answers, in the same order; what the trace adds per call is
+// its overhead.
+void benchGLBackend()
+{
+    GLBackend null(GLBackend::Kind::Null);
+    null.install();
+    GLBackend trace(GLBackend::Kind::Trace);
+    trace.install();
+    null.setRecording(true);
+    trace.setRecording(true);
+
+    const int meshCount = 500;
+    uint64_t loadCalls;
+    {
+        GeometryArena arena;
+        std::vector<DrawElementsIndirectCommand> commands;
+        std::vector<DrawData> draws;
+        for (int i = 0; i < meshCount; ++i) {
+            std::vector<Vertex> vertices(24);
+            std::vector<uint32_t> indices(36, 0);
+            GeometryRange range = arena.add(vertices, indices);
+            uint32_t indexSize = range.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+            commands.push_back({ range.indexCount, 1, range.indexOffset / indexSize, int32_t(range.baseVertex), 0 });
+            draws.push_back({ glm::mat4(1.0f), glm::uvec4(uint32_t(i % 6), 0, 0, 0) });
+        }
+        arena.upload();
+        MultiDrawBuffers buffers;
+        buffers.upload(commands.data(), draws.data(), commands.size());
+        TextOverlay overlay;
+        overlay.init();
+        overlay.print(0, 0, "null backend", 0xffcc00ffu);
+        overlay.draw(1280, 800, 2);
+        GpuTimer timer;
+        for (int f = 0; f < 8; ++f) {
+            timer.poll();
+            timer.begin();
+            timer.end();
+        }
+        loadCalls = trace.totalCalls();
+    }
+
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 2.0f, 8.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    unsigned int textures[SlotCount] = { 101, 102 };
+    CommandList list;
+    for (int i = 0; i < meshCount; ++i) {
+        list.useProgram(unsigned(1 + i / 100));
+        list.uniform("view", view);
+        list.uniform("model", glm::translate(glm::mat4(1.0f), glm::vec3(float(i), 0.0f, 0.0f)));
+        list.bindVertexArray(1);
+        textures[0] = unsigned(101 + i % 6);
+        list.bindTextures(GL_TEXTURE_2D_ARRAY, 0, SlotCount, textures);
+        list.uniform(3, i % 6);
+        list.drawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0, i * 24);
+    }
+    CommandExecutor executor;
+    executor.invalidate();
+    executor.execute(list);
+    bool same = trace.totalCalls() == null.totalCalls() && trace.recorded() == null.recorded();
+    for (size_t e = 0; e < GLBackend::entryCount(); ++e) {
+        same = same && trace.calls(e) == null.calls(e);
+    }
+    null.setRecording(false);
+    trace.setRecording(false);
+
+    // frames through both backends, then through the null one alone
+    const int frames = 200;
+    trace.resetCounts();
+    auto run = [&]() {
+        auto start = Clock::now();
+        for (int f = 0; f < frames; ++f) {
+            executor.invalidate();
+            executor.execute(list);
+        }
+        return elapsedMs(start);
+    };
+    null.resetCounts();
+    double tracedMs = run();
+    uint64_t frameCalls = trace.totalCalls() / frames;
+    std::string busiest = trace.summary(5);
+    trace.uninstall();
+    null.resetCounts();
+    double nullMs = run();
+    double overheadNs = (tracedMs - nullMs) * 1e6 / double(frames * frameCalls);
+
+    spdlog::info("glbackend: {0} entry points hooked, {1} calls loading {2} meshes, the overlay and timers; trace and null {3}",
+        GLBackend::entryCount(), loadCalls, meshCount, same ? "agree" : "DISAGREE");
+    spdlog::info("glbackend: {0} calls per frame; over {1} frames {2}", frameCalls, frames, busiest);
+    spdlog::info("glbackend: frame {0:.3f} ms on null, {1:.3f} ms traced, {2:.1f} ns per call for the trace",
+        nullMs / frames, tracedMs / frames, overheadNs);
+    check(same, "glbackend: the trace and null backends counted different calls");
+}
+
+// Records engine work on the null backend into a GL trace: loading geometry, multi-draw
+// buffers and the overlay, then frames of command lists, timer queries and uniform arrays.
+// Replaying it on a fresh null backend while recording again has to write the same trace
+// byte for byte, names, locations and syncs mapped back to what the replay was given.
+void benchGLTrace()
+{
+    const char* first = "bench_first.gltrace";
+    const char* second = "bench_second.gltrace";
+    const int meshCount = 200;
+    const int frames = 20;
+    GLTraceRecorder recorder;
+    double recordMs;
+    {
+        GLBackend null(GLBackend::Kind::Null);
+        null.install();
+        recorder.open(first);
+        auto start = Clock::now();
+        GeometryArena arena;
+        std::vector<DrawElementsIndirectCommand> commands;
+        std::vector<DrawData> draws;
+        for (int i = 0; i < meshCount; ++i) {
+            std::vector<Vertex> vertices(24);
+            std::vector<uint32_t> indices(36, uint32_t(i % 24));
+            GeometryRange range = arena.add(vertices, indices);
+            uint32_t indexSize = range.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+            commands.push_back({ range.indexCount, 1, range.indexOffset / indexSize, int32_t(range.baseVertex), 0 });
+            draws.push_back({ glm::mat4(float(i)), glm::uvec4(uint32_t(i % 6), 0, 0, 0) });
+        }
+        arena.upload();
+        MultiDrawBuffers buffers;
+        buffers.upload(commands.data(), draws.data(), commands.size());
+        TextOverlay overlay;
+        overlay.init();
+        GpuTimer timer;
+        CommandExecutor executor;
+        recorder.frame();
+
+        glm::vec2 offsets[4] = { { 0.5f, 0.25f }, { -1.0f, 2.0f }, { 3.0f, 0.0f }, { 0.0f, -0.5f } };
+        for (int f = 0; f < frames; ++f) {
+            timer.poll();
+            timer.begin();
+            CommandList list;
+            for (int i = 0; i < meshCount; ++i) {
+                list.useProgram(unsigned(1 + i / 50));
+                list.uniform("model", glm::translate(glm::mat4(1.0f), glm::vec3(float(i), float(f), 0.0f)));
+                list.bindVertexArray(arena.vao());
+                list.uniform(3, i % 6);
+                list.drawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0, i * 24);
+            }
+            executor.invalidate();
+            executor.execute(list);
+            glUniform2fv(7, 4, &offsets[0].x);
+            buffers.upload(commands.data(), draws.data(), commands.size() - f);
+            overlay.clear();
+            overlay.print(0, f % 4, "frame", 0x40ff80ffu);
+            overlay.draw(1280, 800, 2);
+            timer.end();
+            recorder.frame();
+        }
+        recordMs = elapsedMs(start);
+        recorder.close();
+    }
+
+    GLTracePlayer player;
+    bool loaded = player.load(first);
+    double setupMs = 0.0;
+    {
+        GLBackend null(GLBackend::Kind::Null);
+        null.install();
+        recorder.open(second);
+        player.playSetup();
+        recorder.frame();
+        for (size_t f = 0; f < player.frameCount(); ++f) {
+            player.playFrame(f);
+            recorder.frame();
+        }
+        recorder.close();
+        setupMs = player.stats().setupMs;
+    }
+
+    // the player's own cost, on a backend that does nothing
+    double playMs;
+    {
+        GLBackend null(GLBackend::Kind::Null);
+        null.install();
+        player.resetStats();
+        player.playSetup();
+        auto start = Clock::now();
+        for (int pass = 0; pass < 10; ++pass) {
+            for (size_t f = 0; f < player.frameCount(); ++f) {
+                player.playFrame(f);
+            }
+        }
+        playMs = elapsedMs(start) / (10.0 * player.frameCount());
+    }
+
+    auto read = [](const char* path) {
+        std::ifstream in(path, std::ios::binary);
+        return std::vector<char>((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    };
+    bool same = read(first) == read(second);
+    std::remove(first);
+    std::remove(second);
+
+    spdlog::info("gltrace: {0} calls, {1} frames, {2:.1f} KB recorded in {3:.2f} ms; loads {4}, replay {5}",
+        player.callCount(), player.frameCount(), player.size() / 1024.0, recordMs, loaded ? "ok" : "FAILED", same ? "re-records identically" : "DIFFERS");
+    spdlog::info("gltrace: setup played in {0:.3f} ms, a frame in {1:.3f} ms on the null backend; per entry point:\n{2}",
+        setupMs, playMs, player.report(6));
+    check(loaded, "gltrace: the recorded trace doesn't load");
+    check(same, "gltrace: replaying the trace records a different one");
+}
+
+// Texture streaming on the null backend with a simulated budget. Synthetic arrays of
+// different sizes and channel counts are looked at from distances that sweep near and far,
+// each one out of view part of the time. After every update resident bytes have to stay
+// within the budget and match the levels resident, levels requested in the frame must
+// stay, and whatever was evicted must have been requested no later than the levels left
+// alone. With room for everything every array then has to reach the level it asks for.
+void benchStreaming()
+{
+    GLBackend null(GLBackend::Kind::Null);
+    null.install();
+
+    // "w h channels value": every texel of the layer is value, so every level is too
+    std::atomic<int> decodes{ 0 };
+    auto synthetic = [&](const std::string& path) {
+        Image image;
+        int value = 0;
+        if (sscanf(path.c_str(), "%d %d %d %d", &image.width, &image.height, &image.channels, &value) == 4) {
+            size_t size = size_t(image.width) * image.height * image.channels;
+            image.pixels = std::shared_ptr<unsigned char>(new unsigned char[size], std::default_delete<unsigned char[]>());
+            memset(image.pixels.get(), value, size);
+        }
+        decodes++;
+        return image;
+    };
+
+    // the box filter: constant layers stay constant, a 2x2 block becomes its mean
+    bool filterOk = true;
+    {
+        std::vector<uint8_t> constant(5 * 3 * 2 * 2);
+        std::fill(constant.begin(), constant.begin() + constant.size() / 2, uint8_t(40));
+        std::fill(constant.begin() + constant.size() / 2, constant.end(), uint8_t(200));
+        std::vector<uint8_t> half = TextureStreamer::downsample(constant.data(), 5, 3, 2, 2);
+        filterOk = half.size() == 2 * 1 * 2 * 2 && half[0] == 40 && half[3] == 40 && half[4] == 200 && half[7] == 200;
+        uint8_t block[4] = { 0, 10, 20, 31 };
+        filterOk = filterOk && TextureStreamer::downsample(block, 2, 2, 1, 1)[0] == 15;
+        uint8_t column[3] = { 8, 16, 99 };
+        filterOk = filterOk && TextureStreamer::downsample(column, 1, 3, 1, 1) == std::vector<uint8_t>{ 12 };
+    }
+
+    TextureStreamer::Settings settings;
+    settings.budget = size_t(32) << 20;
+    settings.uploadPerFrame = size_t(4) << 20;
+    settings.tailSize = 64;
+    settings.loader = synthetic;
+    TextureStreamer streamer(settings);
+
+    struct Group { int width, height, channels, layers; };
+    const Group groups[] = { { 1024, 1024, 4, 8 }, { 512, 512, 3, 8 }, { 2048, 1024, 1, 4 }, { 256, 256, 4, 16 }, { 1024, 512, 2, 6 } };
+    std::vector<unsigned int> arrays;
+    size_t fullBytes = 0;
+    for (const Group& g : groups) {
+        std::vector<std::string> paths;
+        std::vector<Image> images;
+        for (int l = 0; l < g.layers; ++l) {
+            paths.push_back(std::to_string(g.width) + " " + std::to_string(g.height) + " " + std::to_string(g.channels) + " " + std::to_string(16 * l + 1));
+            images.push_back(synthetic(paths.back()));
+        }
+        std::vector<const Image*> layers;
+        for (auto& image : images) {
+            layers.push_back(&image);
+        }
+        arrays.push_back(streamer.create(paths, layers));
+        TextureStreamer::ArrayInfo info = streamer.info(arrays.back());
+        for (int l = 0; l < info.levels; ++l) {
+            fullBytes += TextureStreamer::levelBytes(g.width, g.height, g.layers, g.channels, l);
+        }
+    }
+    size_t tailBytes = streamer.stats().resident;
+    decodes = 0;
+
+    auto residentOf = [&]() {
+        size_t total = 0;
+        for (unsigned int array : arrays) {
+            TextureStreamer::ArrayInfo info = streamer.info(array);
+            for (int l = info.base; l < info.levels; ++l) {
+                total += TextureStreamer::levelBytes(info.width, info.height, info.layers, info.channels, l);
+            }
+        }
+        return total;
+    };
+
+    // one object per array, at a distance that sweeps between 0.5 and 40 units
+    const int frames = 2000;
+    int overBudget = 0;
+    int accounting = 0;
+    int evictedInUse = 0;
+    int lruViolations = 0;
+    int maxUploadMb = 0;
+    double updateMs = 0.0;
+    std::vector<TextureStreamer::ArrayInfo> before(arrays.size());
+    std::vector<bool> requested(arrays.size());
+    for (int f = 0; f < frames; ++f) {
+        uint64_t uploadedBefore = streamer.stats().uploadedBytes;
+        for (size_t i = 0; i < arrays.size(); ++i) {
+            before[i] = streamer.info(arrays[i]);
+            float phase = float(f) * 0.01f + float(i) * 1.3f;
+            requested[i] = std::sin(phase * 0.37f) > -0.3f;
+            if (requested[i]) {
+                float distance = 20.25f + 19.75f * std::sin(phase);
+                // a unit object seen with a 45 degree field of view on 800 lines
+                streamer.request(arrays[i], 2.0f * 2.414f * 0.5f * 800.0f / distance);
+            }
+        }
+        auto start = Clock::now();
+        streamer.update();
+        updateMs += elapsedMs(start);
+
+        const TextureStreamer::Stats& stats = streamer.stats();
+        overBudget += stats.resident + stats.reserved > stats.budget;
+        accounting += residentOf() != stats.resident;
+        maxUploadMb = std::max(maxUploadMb, int((stats.uploadedBytes - uploadedBefore) >> 20));
+        for (size_t i = 0; i < arrays.size(); ++i) {
+            TextureStreamer::ArrayInfo info = streamer.info(arrays[i]);
+            if (info.base <= before[i].base) {
+                continue;
+            }
+            evictedInUse += requested[i] && info.want <= before[i].base;
+            // every array left alone that could have given up a level instead was used later
+            for (size_t j = 0; j < arrays.size(); ++j) {
+                TextureStreamer::ArrayInfo other = streamer.info(arrays[j]);
+                bool candidate = j != i && !requested[j] && !before[j].loading && !other.loading &&
+                    other.base == before[j].base && other.base < other.tail;
+                lruViolations += candidate && before[j].lastUsed < before[i].lastUsed;
+            }
+        }
+    }
+    TextureStreamer::Stats swept = streamer.stats();
+
+    // room for everything, every array up close
+    streamer.setBudget(fullBytes);
+    int settleFrames = 0;
+    bool reached = false;
+    while (!reached && settleFrames < 1000) {
+        for (unsigned int array : arrays) {
+            streamer.request(array, 1e6f);
+        }
+        streamer.update();
+        settleFrames++;
+        reached = streamer.pending() == 0;
+        for (unsigned int array : arrays) {
+            reached = reached && streamer.info(array).base == 0;
+        }
+    }
+    bool allResident = streamer.stats().resident == fullBytes;
+
+    // the budget back down with one array in view: the others give up levels until it fits,
+    // that one keeps all of its own
+    streamer.setBudget(settings.budget);
+    uint64_t evictions = streamer.stats().evictions;
+    streamer.request(arrays[1], 1e6f);
+    streamer.update();
+    bool shrunk = streamer.stats().resident <= settings.budget && streamer.info(arrays[1]).base == 0;
+    evictions = streamer.stats().evictions - evictions;
+
+    spdlog::info("streaming: {0} arrays, {1:.1f} MB with every mip, tails {2:.2f} MB, budget {3:.0f} MB, box filter {4}",
+        arrays.size(), fullBytes / 1048576.0, tailBytes / 1048576.0, settings.budget / 1048576.0, filterOk ? "ok" : "WRONG");
+    spdlog::info("streaming: {0} frames sweeping near and far, update {1:.3f} ms; {2} loads of {3:.1f} MB, {4} evictions, {5} refused, {6} decodes, at most {7} MB uploaded in a frame",
+        frames, updateMs / frames, swept.loads, swept.uploadedBytes / 1048576.0, swept.evictions, swept.refused, decodes.load(), maxUploadMb);
+    spdlog::info("streaming: over budget {0} times, accounting off {1} times, {2} levels in use evicted, {3} LRU violations",
+        overBudget, accounting, evictedInUse, lruViolations);
+    spdlog::info("streaming: with room for all, every array at level 0 after {0} frames {1}, {2}; budget lowered again, {3} evictions {4}",
+        settleFrames, reached ? "ok" : "NOT REACHED", allResident ? "all resident" : "RESIDENT WRONG", evictions, shrunk ? "fit it" : "DID NOT FIT");
+    check(filterOk, "streaming: the box filter is wrong");
+    check(overBudget == 0 && accounting == 0, "streaming: over budget " + std::to_string(overBudget) + " times, accounting off " + std::to_string(accounting) + " times");
+    check(evictedInUse == 0 && lruViolations == 0, "streaming: " + std::to_string(evictedInUse) + " levels in use evicted, " + std::to_string(lruViolations) + " LRU violations");
+    check(reached && allResident, "streaming: with room for everything not every array reached level 0");
+    check(shrunk, "streaming: a lowered budget wasn't met by evicting the arrays out of view");
+}
+
+// Simplifies a UV sphere whose u wraps from 1 back to 0 along one meridian, so the
+// vertices there are split into two wedges. Moving a corner onto the seam has to keep
+// the triangle on its side of it: a triangle whose u spans more than half the texture
+// reaches across the seam and smears the whole texture over itself.
+void benchSimplify()
+{
+    const int rings = 64;
+    const int segments = 128;
+    std::vector<Vertex> vertices;
+    for (int r = 0; r <= rings; ++r) {
+        float theta = glm::pi<float>() * float(r) / rings;
+        for (int s = 0; s <= segments; ++s) {
+            // s == segments repeats the position of s == 0 with u = 1
+            float phi = glm::two_pi<float>() * float(s % segments) / segments;
+            Vertex v = {};
+            v.Position = glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            v.Normal = v.Position;
+            v.TexCoords = glm::vec2(float(s) / segments, float(r) / rings);
+            vertices.push_back(v);
+        }
+    }
+    std::vector<uint32_t> indices;
+    for (int r = 0; r < rings; ++r) {
+        for (int s = 0; s < segments; ++s) {
+            uint32_t a = uint32_t(r * (segments + 1) + s);
+            uint32_t b = a + segments + 1;
+            if (r > 0) {
+                indices.insert(indices.end(), { a, a + 1, b });
+            }
+            if (r + 1 < rings) {
+                indices.insert(indices.end(), { a + 1, b + 1, b });
+            }
+        }
+    }
+
+    auto across = [&](const std::vector<uint32_t>& list) {
+        int count = 0;
+        for (size_t i = 0; i + 2 < list.size(); i += 3) {
+            float lo = 1.0f, hi = 0.0f;
+            for (int k = 0; k < 3; ++k) {
+                lo = std::min(lo, vertices[list[i + k]].TexCoords.x);
+                hi = std::max(hi, vertices[list[i + k]].TexCoords.x);
+            }
+            count += hi - lo > 0.5f;
+        }
+        return count;
+    };
+
+    auto start = Clock::now();
+    LodChain chain = buildLodChain(vertices, indices, 6);
+    double chainMs = elapsedMs(start);
+
+    std::string levels = std::to_string(indices.size() / 3);
+    int acrossSeam = across(indices);
+    for (size_t l = 0; l < chain.indices.size(); ++l) {
+        levels += " " + std::to_string(chain.indices[l].size() / 3);
+        acrossSeam += across(chain.indices[l]);
+    }
+    spdlog::info("simplify: {0} vertices, lod chain {1:.1f} ms, triangles per level {2}, error of the last {3:.4f}, {4} triangles across the uv seam",
+        vertices.size(), chainMs, levels, chain.errors.empty() ? 0.0f : chain.errors.back(), acrossSeam);
+    check(acrossSeam == 0, "simplify: " + std::to_string(acrossSeam) + " triangles reach across the uv seam");
+}
+
+}
+
+int runBenchmark(const std::string& name)
+{
+    static const std::vector<std::pair<std::string, std::function<void()>>> benchmarks = {
+        { "bvh", benchBVH },
+        { "occlusion", benchOcclusion },
+        { "lights", benchLights },
+        { "scene", benchScene },
+        { "jobs", benchJobs },
+        { "triplebuffer", benchTripleBuffer },
+        { "framearena", benchFrameArena },
+        { "draw", benchDraw },
+        { "gpucull", benchGpuCull },
+        { "resolution", benchResolution },
+        { "capture", benchCapture },
+        { "yuv", benchYUV },
+        { "input", benchInput },
+        { "pacing", benchPacing },
+        { "stats", benchStats },
+        { "commands", benchCommands },
+        { "glbackend", benchGLBackend },
+        { "gltrace", benchGLTrace },
+        { "streaming", benchStreaming },
+        { "simplify", benchSimplify },
+    };
+
+    bool found = false;
+    for (auto& b : benchmarks) {
+        if (name == "all" || name == b.first) {
+            b.second();
+            found = true;
+        }
+    }
+
+    if (!found) {
+        spdlog::error("Unknown benchmark {0}", name);
+        return -1;
+    }
+    if (failedChecks > 0) {
+        spdlog::error("{0} benchmark checks failed", failedChecks);
+        return 1;
+    }
+    return 0;
+}
@@ -69,7 +69,7 @@ Config::~Config()
     //m_doc.Clear();
 }
 
-rapidjson::Document::ValueType* Config::get_obj(std::string key, std::string prefix)
+rapidjson::Document::ValueType* Config::get_obj(std::string key, std::string prefix, bool warn)
 {
     using namespace rapidjson;
 
@@ -80,8 +80,11 @@ rapidjson::Document::ValueType* Config::get_obj(std::string key, std::string pre
         for (auto& ak : r) {
             if (ak == "") {
                 continue;
-            } else if (obj->HasMember(ak.c_str())) {
+            } else if (obj->IsObject() && obj->HasMember(ak.c_str())) {
                 obj = &(*obj)[ak.c_str()];
+            } else if (obj->IsArray() && ak.find_first_not_of("0123456789") == std::string::npos && std::stoul(ak) < obj->Size()) {
+                // "lights/2/radius" walks into arrays by index
+                obj = &(*obj)[rapidjson::SizeType(std::stoul(ak))];
             } else {
                 obj = nullptr;
                 break;
@@ -95,13 +98,18 @@ rapidjson::Document::ValueType* Config::get_obj(std::string key, std::string pre
 
     auto g_obj = find_obj(key);
     auto obj = g_obj ? g_obj : find_obj(f_key);
-    if (obj == nullptr) {
+    if (obj == nullptr && warn) {
         spdlog::warn("{0} or {1} not exist in config", key, f_key);
     }
     return obj;
 
 }
 
+bool Config::has(std::string key, std::string prefix)
+{
+    return get_obj(key, prefix, false) != nullptr;
+}
+
 bool Config::get_bool(std::string key, std::string prefix)
 {
     auto v = get_obj(key, prefix);
@@ -135,6 +143,35 @@ int Config::get_uint(std::string key, std::string prefix)
     }
 }
 
+float Config::get_float(std::string key, std::string prefix)
+{
+    auto v = get_obj(key, prefix);
+    if (v && v->IsNumber()) {
+        return v->GetFloat();
+    } else {
+        spdlog::warn("{0} doesn't exist, return 0 instead", key);
+        return 0.0f;
+    }
+}
+
+std::vector<float> Config::get_floats(std::string key, std::string prefix)
+{
+    std::vector<float> result;
+    auto v = get_obj(key, prefix);
+    if (v && v->IsArray()) {
+        for (auto& e : v->GetArray()) {
+            result.push_back(e.IsNumber() ? e.GetFloat() : 0.0f);
+        }
+    }
+    return result;
+}
+
+size_t Config::get_array_size(std::string key, std::string prefix)
+{
+    auto v = get_obj(key, prefix);
+    return (v && v->IsArray()) ? v->Size() : 0;
+}
+
 std::string Config::get_string(std::string key, std::string prefix) 
 {
     auto v = get_obj(key, prefix);
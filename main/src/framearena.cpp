@@ -0,0 +1,71 @@
+#include "framearena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+FrameArena::FrameArena(size_t capacity)
+{
+    m_capacity = std::max<size_t>(capacity, 256);
+    m_block.reset(new char[m_capacity]);
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment)
+{
+    uintptr_t base = uintptr_t(m_block.get());
+    uintptr_t aligned = (base + m_used + alignment - 1) & ~uintptr_t(alignment - 1);
+    size_t end = size_t(aligned - base) + bytes;
+    if (end <= m_capacity) {
+        m_used = end;
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    // doesn't fit this frame, reset() makes sure it will next time
+    m_overflow.emplace_back(new char[bytes + alignment]);
+    m_overflowBytes += bytes + alignment;
+    m_overflows++;
+    uintptr_t p = uintptr_t(m_overflow.back().get());
+    return reinterpret_cast<void*>((p + alignment - 1) & ~uintptr_t(alignment - 1));
+}
+
+void FrameArena::reset()
+{
+    size_t peak = m_used + m_overflowBytes;
+    m_overflow.clear();
+    m_overflowBytes = 0;
+    m_used = 0;
+    if (peak > m_capacity) {
+        reserve(peak + peak / 2);
+    }
+}
+
+void FrameArena::reserve(size_t bytes)
+{
+    if (bytes <= m_capacity) {
+        return;
+    }
+    // only between frames, anything still pointing into the old block would dangle
+    m_block.reset(new char[bytes]);
+    m_capacity = bytes;
+    m_used = 0;
+}
+
+FrameAllocator::FrameAllocator(size_t capacity, size_t frames)
+{
+    for (size_t i = 0; i < std::max<size_t>(frames, 1); ++i) {
+        m_arenas.emplace_back(new FrameArena(capacity));
+        m_resources.emplace_back(new FrameResource(*m_arenas.back()));
+    }
+}
+
+void FrameAllocator::beginFrame()
+{
+    m_current = (m_current + 1) % m_arenas.size();
+    m_arenas[m_current]->reset();
+}
+
+void FrameAllocator::reserve(size_t bytes)
+{
+    for (auto& arena : m_arenas) {
+        arena->reserve(bytes);
+    }
+}
@@ -0,0 +1,114 @@
+#include "framepacing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <immintrin.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+namespace {
+
+// sleeps are requested in slices this long, each one is measured
+const double SleepMs = 1.0;
+
+double elapsedMs(FramePacer::Clock::time_point from, FramePacer::Clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+}
+
+FixedStep::FixedStep(double step, int maxSteps)
+    : m_step(step), m_maxSteps(std::max(1, maxSteps))
+{
+}
+
+int FixedStep::advance(double seconds)
+{
+    m_accumulator += std::max(0.0, seconds);
+    int steps = 0;
+    while (m_accumulator >= m_step && steps < m_maxSteps) {
+        m_accumulator -= m_step;
+        steps++;
+    }
+    if (m_accumulator >= m_step) {
+        // keep the fraction so alpha stays meaningful, drop whole steps
+        double whole = std::floor(m_accumulator / m_step) * m_step;
+        m_dropped += whole;
+        m_accumulator -= whole;
+    }
+    m_steps += steps;
+    return steps;
+}
+
+FramePacer::FramePacer(double fps)
+{
+    setTarget(fps);
+}
+
+FramePacer::~FramePacer()
+{
+    setTarget(0.0);
+}
+
+void FramePacer::setTarget(double fps)
+{
+    m_period = std::chrono::duration<double, std::milli>(fps > 0.0 ? 1000.0 / fps : 0.0);
+    m_started = false;
+#if defined(_WIN32)
+    // the default 15.6 ms scheduler tick would leave most of a frame to the spin
+    if (enabled() && !m_fineTimer) {
+        m_fineTimer = timeBeginPeriod(1) == TIMERR_NOERROR;
+    } else if (!enabled() && m_fineTimer) {
+        timeEndPeriod(1);
+        m_fineTimer = false;
+    }
+#endif
+}
+
+void FramePacer::wait()
+{
+    m_slept = 0.0;
+    m_spun = 0.0;
+    if (!enabled()) {
+        return;
+    }
+
+    Clock::time_point now = Clock::now();
+    if (!m_started) {
+        m_deadline = now;
+        m_started = true;
+    }
+    m_deadline += std::chrono::duration_cast<Clock::duration>(m_period);
+    if (now >= m_deadline) {
+        // missed it, the next frame gets a whole period from now
+        m_deadline = now;
+        return;
+    }
+
+    Clock::time_point start = now;
+    while (elapsedMs(now, m_deadline) > m_margin) {
+        std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(SleepMs));
+        Clock::time_point woke = Clock::now();
+        double observed = elapsedMs(now, woke);
+        now = woke;
+
+        m_count++;
+        double delta = observed - m_mean;
+        m_mean += delta / m_count;
+        m_m2 += delta * (observed - m_mean);
+        m_margin = m_mean + std::sqrt(m_m2 / (m_count - 1));
+    }
+    m_slept = elapsedMs(start, now);
+
+    Clock::time_point spinStart = now;
+    while (Clock::now() < m_deadline) {
+        _mm_pause();
+    }
+    m_spun = elapsedMs(spinStart, Clock::now());
+}
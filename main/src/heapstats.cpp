@@ -0,0 +1,133 @@
+#include "heapstats.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+#include "spdlog/spdlog.h"
+
+#ifdef TRACK_HEAP_ALLOCATIONS
+
+namespace {
+
+thread_local uint64_t t_allocations = 0;
+thread_local HeapStats::Scope* t_scope = nullptr;
+
+void count()
+{
+    t_allocations++;
+    if (t_scope) {
+        t_scope->allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+}
+
+void* operator new(size_t size)
+{
+    count();
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    count();
+    return std::malloc(size ? size : 1);
+}
+
+// the array forms end up in the ones above
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+bool HeapStats::enabled()
+{
+    return true;
+}
+
+uint64_t HeapStats::threadAllocations()
+{
+    return t_allocations;
+}
+
+HeapStats::Scope* HeapStats::currentScope()
+{
+    return t_scope;
+}
+
+HeapStats::Scope* HeapStats::setScope(Scope* scope)
+{
+    Scope* previous = t_scope;
+    t_scope = scope;
+    return previous;
+}
+
+#else
+
+bool HeapStats::enabled()
+{
+    return false;
+}
+
+uint64_t HeapStats::threadAllocations()
+{
+    return 0;
+}
+
+HeapStats::Scope* HeapStats::currentScope()
+{
+    return nullptr;
+}
+
+HeapStats::Scope* HeapStats::setScope(Scope*)
+{
+    return nullptr;
+}
+
+#endif
+
+FrameAllocationCheck::FrameAllocationCheck(const char* name, int warmupFrames)
+{
+    m_name = name;
+    m_warmup = warmupFrames;
+}
+
+void FrameAllocationCheck::begin()
+{
+    m_scope.allocations.store(0, std::memory_order_relaxed);
+    m_previous = HeapStats::setScope(&m_scope);
+}
+
+uint64_t FrameAllocationCheck::end(Profiler& profiler)
+{
+    HeapStats::setScope(m_previous);
+    if (!HeapStats::enabled()) {
+        return 0;
+    }
+    // the jobs of the frame were waited for, their counts are in
+    uint64_t count = m_scope.allocations.load(std::memory_order_acquire);
+    profiler.count(m_name, int64_t(count));
+    if (m_frames < m_warmup) {
+        m_frames++;
+        return count;
+    }
+    if (count > 0) {
+        spdlog::error("{0}: {1} heap allocations in a steady-state frame", m_name, count);
+        assert(!"steady-state frame allocates from the global heap");
+    }
+    return count;
+}
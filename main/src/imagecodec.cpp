@@ -0,0 +1,434 @@
+#include "imagecodec.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h>
+
+namespace {
+
+// QOI ops, see qoiformat.org
+const uint8_t QoiIndex = 0x00;
+const uint8_t QoiDiff = 0x40;
+const uint8_t QoiLuma = 0x80;
+const uint8_t QoiRun = 0xc0;
+const uint8_t QoiRGB = 0xfe;
+const uint8_t QoiRGBA = 0xff;
+const uint8_t QoiMask = 0xc0;
+const uint8_t QoiEnd[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+struct Rgba {
+    uint8_t r, g, b, a;
+    bool operator==(const Rgba& o) const { return r == o.r && g == o.g && b == o.b && a == o.a; }
+    bool operator!=(const Rgba& o) const { return !(*this == o); }
+};
+
+inline int qoiHash(const Rgba& c)
+{
+    return (c.r * 3 + c.g * 5 + c.b * 7 + c.a * 11) % 64;
+}
+
+void put32(std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back(uint8_t(v >> 24));
+    out.push_back(uint8_t(v >> 16));
+    out.push_back(uint8_t(v >> 8));
+    out.push_back(uint8_t(v));
+}
+
+uint32_t get32(const uint8_t* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+    static uint32_t table[256];
+    static bool ready = [] {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        return true;
+    }();
+    (void) ready;
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// BT.601 studio range, 8 bit fixed point
+const int YR = 66, YG = 129, YB = 25;
+const int UR = -38, UG = -74, UB = 112;
+const int VR = 112, VG = -94, VB = -18;
+
+inline uint8_t luma(const uint8_t* p)
+{
+    return uint8_t(((YR * p[0] + YG * p[1] + YB * p[2] + 128) >> 8) + 16);
+}
+
+// from the sum of four pixels' channels, so the shift takes the mean too
+inline uint8_t chroma(int r, int g, int b, int cr, int cg, int cb)
+{
+    return uint8_t(((cr * r + cg * g + cb * b + 512) >> 10) + 128);
+}
+
+// one row pair of columns [begin, end)
+void yuvPairReference(const uint8_t* row0, const uint8_t* row1, int begin, int end, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v)
+{
+    for (int x = begin; x < end; x += 2) {
+        const uint8_t* a = row0 + x * 4;
+        const uint8_t* b = row1 + x * 4;
+        y0[x] = luma(a);
+        y0[x + 1] = luma(a + 4);
+        y1[x] = luma(b);
+        y1[x + 1] = luma(b + 4);
+        int r = a[0] + a[4] + b[0] + b[4];
+        int g = a[1] + a[5] + b[1] + b[5];
+        int bl = a[2] + a[6] + b[2] + b[6];
+        u[x / 2] = chroma(r, g, bl, UR, UG, UB);
+        v[x / 2] = chroma(r, g, bl, VR, VG, VB);
+    }
+}
+
+// 8 luma values from 8 RGBA pixels
+inline __m128i luma8(__m128i p0, __m128i p1, __m128i coef)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = _mm_hadd_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(p0, zero), coef), _mm_madd_epi16(_mm_unpackhi_epi8(p0, zero), coef));
+    __m128i b = _mm_hadd_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(p1, zero), coef), _mm_madd_epi16(_mm_unpackhi_epi8(p1, zero), coef));
+    const __m128i round = _mm_set1_epi32(128);
+    const __m128i offset = _mm_set1_epi32(16);
+    a = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(a, round), 8), offset);
+    b = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(b, round), 8), offset);
+    return _mm_packs_epi32(a, b);
+}
+
+// channel sums of the two 2x2 blocks in 4 pixels of a row pair, as 16 bit RGBA RGBA
+inline __m128i blockSums(__m128i top, __m128i bottom)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+    lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+    hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+    return _mm_unpacklo_epi64(lo, hi);
+}
+
+// 4 chroma values from the sums of 4 blocks
+inline __m128i chroma4(__m128i s01, __m128i s23, __m128i coef)
+{
+    __m128i c = _mm_hadd_epi32(_mm_madd_epi16(s01, coef), _mm_madd_epi16(s23, coef));
+    c = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(c, _mm_set1_epi32(512)), 10), _mm_set1_epi32(128));
+    return _mm_packs_epi32(c, c);
+}
+
+inline void store4(uint8_t* dst, __m128i v16)
+{
+    int packed = _mm_cvtsi128_si32(_mm_packus_epi16(v16, v16));
+    memcpy(dst, &packed, 4);
+}
+
+// length, type, data and the CRC over type and data
+void pngChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size)
+{
+    put32(out, uint32_t(size));
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    put32(out, crc32(0, &out[start], size + 4));
+}
+
+}
+
+namespace ImageCodec {
+
+void encodeQOI(const uint8_t* pixels, int width, int height, int channels, std::vector<uint8_t>& out)
+{
+    out.clear();
+    out.reserve(14 + size_t(width) * height * (channels + 1) / 2 + 8);
+    out.insert(out.end(), { 'q', 'o', 'i', 'f' });
+    put32(out, uint32_t(width));
+    put32(out, uint32_t(height));
+    out.push_back(uint8_t(channels));
+    // sRGB with linear alpha
+    out.push_back(0);
+
+    Rgba index[64] = {};
+    Rgba prev = { 0, 0, 0, 255 };
+    int run = 0;
+    size_t count = size_t(width) * height;
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t* p = pixels + i * channels;
+        Rgba px = { p[0], p[1], p[2], channels == 4 ? p[3] : uint8_t(255) };
+        if (px == prev) {
+            run++;
+            if (run == 62 || i + 1 == count) {
+                out.push_back(uint8_t(QoiRun | (run - 1)));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            out.push_back(uint8_t(QoiRun | (run - 1)));
+            run = 0;
+        }
+
+        int h = qoiHash(px);
+        if (index[h] == px) {
+            out.push_back(uint8_t(QoiIndex | h));
+        } else {
+            index[h] = px;
+            if (px.a == prev.a) {
+                int8_t dr = int8_t(px.r - prev.r);
+                int8_t dg = int8_t(px.g - prev.g);
+                int8_t db = int8_t(px.b - prev.b);
+                int8_t drg = int8_t(dr - dg);
+                int8_t dbg = int8_t(db - dg);
+                if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2) {
+                    out.push_back(uint8_t(QoiDiff | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+                } else if (drg > -9 && drg < 8 && dg > -33 && dg < 32 && dbg > -9 && dbg < 8) {
+                    out.push_back(uint8_t(QoiLuma | (dg + 32)));
+                    out.push_back(uint8_t(((drg + 8) << 4) | (dbg + 8)));
+                } else {
+                    out.insert(out.end(), { QoiRGB, px.r, px.g, px.b });
+                }
+            } else {
+                out.insert(out.end(), { QoiRGBA, px.r, px.g, px.b, px.a });
+            }
+        }
+        prev = px;
+    }
+    out.insert(out.end(), QoiEnd, QoiEnd + 8);
+}
+
+bool decodeQOI(const uint8_t* data, size_t size, Image& image)
+{
+    if (size < 14 + 8 || std::memcmp(data, "qoif", 4) != 0) {
+        return false;
+    }
+    int width = int(get32(data + 4));
+    int height = int(get32(data + 8));
+    int channels = data[12];
+    if (width <= 0 || height <= 0 || (channels != 3 && channels != 4)) {
+        return false;
+    }
+
+    size_t count = size_t(width) * height;
+    uint8_t* pixels = static_cast<uint8_t*>(malloc(count * channels));
+    Rgba index[64] = {};
+    Rgba px = { 0, 0, 0, 255 };
+    int run = 0;
+    size_t p = 14;
+    size_t end = size - 8;
+    for (size_t i = 0; i < count; ++i) {
+        if (run > 0) {
+            run--;
+        } else if (p < end) {
+            uint8_t b = data[p++];
+            if (b == QoiRGB) {
+                px.r = data[p]; px.g = data[p + 1]; px.b = data[p + 2];
+                p += 3;
+            } else if (b == QoiRGBA) {
+                px.r = data[p]; px.g = data[p + 1]; px.b = data[p + 2]; px.a = data[p + 3];
+                p += 4;
+            } else if ((b & QoiMask) == QoiIndex) {
+                px = index[b];
+            } else if ((b & QoiMask) == QoiDiff) {
+                px.r += ((b >> 4) & 3) - 2;
+                px.g += ((b >> 2) & 3) - 2;
+                px.b += (b & 3) - 2;
+            } else if ((b & QoiMask) == QoiLuma) {
+                uint8_t b2 = data[p++];
+                int dg = (b & 0x3f) - 32;
+                px.r += dg - 8 + ((b2 >> 4) & 0x0f);
+                px.g += dg;
+                px.b += dg - 8 + (b2 & 0x0f);
+            } else {
+                run = b & 0x3f;
+            }
+            index[qoiHash(px)] = px;
+        }
+        uint8_t* o = pixels + i * channels;
+        o[0] = px.r; o[1] = px.g; o[2] = px.b;
+        if (channels == 4) {
+            o[3] = px.a;
+        }
+    }
+
+    image.width = width;
+    image.height = height;
+    image.channels = channels;
+    image.pixels = std::shared_ptr<unsigned char>(pixels, free);
+    return true;
+}
+
+void encodePNG(const uint8_t* pixels, int width, int height, int channels, std::vector<uint8_t>& out)
+{
+    out.clear();
+    const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    out.insert(out.end(), signature, signature + 8);
+
+    uint8_t header[13];
+    for (int i = 0; i < 4; ++i) {
+        header[i] = uint8_t(uint32_t(width) >> (24 - i * 8));
+        header[4 + i] = uint8_t(uint32_t(height) >> (24 - i * 8));
+    }
+    header[8] = 8;
+    header[9] = channels == 4 ? 6 : 2;
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+    pngChunk(out, "IHDR", header, sizeof(header));
+
+    // zlib stream of stored blocks over the rows, each with filter type 0
+    size_t rowBytes = size_t(width) * channels + 1;
+    size_t raw = rowBytes * height;
+    const size_t maxBlock = 65535;
+    std::vector<uint8_t> z;
+    z.reserve(2 + raw + (raw / maxBlock + 1) * 5 + 4);
+    z.push_back(0x78);
+    z.push_back(0x01);
+    uint32_t a = 1, b = 0;
+    size_t block = 0;
+    for (size_t i = 0; i < raw; ++i) {
+        if (block == 0) {
+            size_t len = std::min(maxBlock, raw - i);
+            z.push_back(i + len == raw ? 1 : 0);
+            z.push_back(uint8_t(len));
+            z.push_back(uint8_t(len >> 8));
+            z.push_back(uint8_t(~len));
+            z.push_back(uint8_t(~len >> 8));
+            block = len;
+        }
+        size_t row = i / rowBytes;
+        size_t col = i % rowBytes;
+        uint8_t v = col == 0 ? 0 : pixels[row * (rowBytes - 1) + col - 1];
+        z.push_back(v);
+        // adler32; 5552 bytes is the most b can take before it has to be reduced
+        a += v;
+        b += a;
+        if (i % 5552 == 5551) {
+            a %= 65521;
+            b %= 65521;
+        }
+        block--;
+    }
+    a %= 65521;
+    b %= 65521;
+    put32(z, (b << 16) | a);
+    pngChunk(out, "IDAT", z.data(), z.size());
+    pngChunk(out, "IEND", nullptr, 0);
+}
+
+bool writeImage(const std::string& path, const uint8_t* pixels, int width, int height, int channels)
+{
+    std::vector<uint8_t> data;
+    bool png = path.size() > 4 && path.compare(path.size() - 4, 4, ".png") == 0;
+    if (png) {
+        encodePNG(pixels, width, height, channels, data);
+    } else {
+        encodeQOI(pixels, width, height, channels, data);
+    }
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+    fclose(fp);
+    return ok;
+}
+
+bool readQOI(const std::string& path, Image& image)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp) {
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        data.insert(data.end(), buffer, buffer + n);
+    }
+    fclose(fp);
+    return decodeQOI(data.data(), data.size(), image);
+}
+
+void rgbaToYUV420(const uint8_t* top, ptrdiff_t stride, int width, int height, uint8_t* yuv)
+{
+    uint8_t* yPlane = yuv;
+    uint8_t* uPlane = yuv + size_t(width) * height;
+    uint8_t* vPlane = uPlane + size_t(width / 2) * (height / 2);
+    const __m128i yCoef = _mm_setr_epi16(YR, YG, YB, 0, YR, YG, YB, 0);
+    const __m128i uCoef = _mm_setr_epi16(UR, UG, UB, 0, UR, UG, UB, 0);
+    const __m128i vCoef = _mm_setr_epi16(VR, VG, VB, 0, VR, VG, VB, 0);
+    int simdWidth = width & ~7;
+
+    for (int j = 0; j < height / 2; ++j) {
+        const uint8_t* row0 = top + stride * (2 * j);
+        const uint8_t* row1 = row0 + stride;
+        uint8_t* y0 = yPlane + size_t(2 * j) * width;
+        uint8_t* y1 = y0 + width;
+        uint8_t* u = uPlane + size_t(j) * (width / 2);
+        uint8_t* v = vPlane + size_t(j) * (width / 2);
+        for (int x = 0; x < simdWidth; x += 8) {
+            __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 4));
+            __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 4 + 16));
+            __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 4));
+            __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 4 + 16));
+            __m128i l0 = luma8(a0, a1, yCoef);
+            __m128i l1 = luma8(b0, b1, yCoef);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(y0 + x), _mm_packus_epi16(l0, l0));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(y1 + x), _mm_packus_epi16(l1, l1));
+
+            __m128i s01 = blockSums(a0, b0);
+            __m128i s23 = blockSums(a1, b1);
+            store4(u + x / 2, chroma4(s01, s23, uCoef));
+            store4(v + x / 2, chroma4(s01, s23, vCoef));
+        }
+        yuvPairReference(row0, row1, simdWidth, width, y0, y1, u, v);
+    }
+}
+
+void rgbaToYUV420Reference(const uint8_t* top, ptrdiff_t stride, int width, int height, uint8_t* yuv)
+{
+    uint8_t* yPlane = yuv;
+    uint8_t* uPlane = yuv + size_t(width) * height;
+    uint8_t* vPlane = uPlane + size_t(width / 2) * (height / 2);
+    for (int j = 0; j < height / 2; ++j) {
+        const uint8_t* row0 = top + stride * (2 * j);
+        uint8_t* y0 = yPlane + size_t(2 * j) * width;
+        yuvPairReference(row0, row0 + stride, 0, width, y0, y0 + width, uPlane + size_t(j) * (width / 2), vPlane + size_t(j) * (width / 2));
+    }
+}
+
+Difference compare(const Image& a, const Image& b, int tolerance)
+{
+    Difference d;
+    if (a.width != b.width || a.height != b.height || !a.pixels || !b.pixels) {
+        d.sizeMismatch = true;
+        return d;
+    }
+    int channels = std::min(a.channels, b.channels);
+    size_t count = size_t(a.width) * a.height;
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t* pa = a.pixels.get() + i * a.channels;
+        const uint8_t* pb = b.pixels.get() + i * b.channels;
+        int worst = 0;
+        for (int c = 0; c < channels; ++c) {
+            worst = std::max(worst, std::abs(int(pa[c]) - int(pb[c])));
+        }
+        d.maxChannel = std::max(d.maxChannel, worst);
+        d.pixels += worst > tolerance ? 1 : 0;
+    }
+    return d;
+}
+
+}
@@ -0,0 +1,185 @@
+#include "inputlog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const char Magic[4] = { 'I', 'N', 'P', 'L' };
+const uint8_t Version = 1;
+
+void putVarint(std::vector<uint8_t>& out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out.push_back(uint8_t(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(uint8_t(v));
+}
+
+bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v)
+{
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// little endian, like every target this builds for
+template <class T>
+void put(std::vector<uint8_t>& out, T v)
+{
+    uint8_t bytes[sizeof(T)];
+    memcpy(bytes, &v, sizeof(T));
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <class T>
+bool get(const uint8_t*& p, const uint8_t* end, T& v)
+{
+    if (size_t(end - p) < sizeof(T)) {
+        return false;
+    }
+    memcpy(&v, p, sizeof(T));
+    p += sizeof(T);
+    return true;
+}
+
+uint64_t micros(double seconds)
+{
+    return uint64_t(std::llround(std::max(0.0, seconds) * 1e6));
+}
+
+}
+
+void InputLog::clear()
+{
+    m_events.clear();
+    m_next = 0;
+}
+
+void InputLog::finish(double time)
+{
+    InputEvent end;
+    end.type = InputEvent::End;
+    end.time = std::max(time, duration());
+    m_events.push_back(end);
+}
+
+void InputLog::encode(std::vector<uint8_t>& out) const
+{
+    out.clear();
+    out.insert(out.end(), Magic, Magic + 4);
+    out.push_back(Version);
+    putVarint(out, m_events.size());
+    // deltas of the rounded times, so rounding doesn't add up over a long session
+    uint64_t previous = 0;
+    for (auto& e : m_events) {
+        uint64_t t = std::max(micros(e.time), previous);
+        putVarint(out, t - previous);
+        previous = t;
+        out.push_back(e.type);
+        switch (e.type) {
+        case InputEvent::Key:
+        case InputEvent::MouseButton:
+            put(out, e.code);
+            put(out, e.action);
+            break;
+        case InputEvent::CursorPos:
+        case InputEvent::Scroll:
+            put(out, e.x);
+            put(out, e.y);
+            break;
+        case InputEvent::End:
+            break;
+        }
+    }
+}
+
+bool InputLog::decode(const uint8_t* data, size_t size)
+{
+    clear();
+    const uint8_t* p = data;
+    const uint8_t* end = data + size;
+    uint64_t count;
+    if (size < 5 || memcmp(p, Magic, 4) != 0 || p[4] != Version) {
+        return false;
+    }
+    p += 5;
+    if (!getVarint(p, end, count)) {
+        return false;
+    }
+
+    uint64_t time = 0;
+    m_events.reserve(size_t(std::min<uint64_t>(count, size)));
+    for (uint64_t i = 0; i < count; ++i) {
+        InputEvent e;
+        uint64_t delta;
+        uint8_t type;
+        if (!getVarint(p, end, delta) || !get(p, end, type) || type > InputEvent::End) {
+            clear();
+            return false;
+        }
+        time += delta;
+        e.time = double(time) * 1e-6;
+        e.type = InputEvent::Type(type);
+        bool ok = true;
+        if (e.type == InputEvent::Key || e.type == InputEvent::MouseButton) {
+            ok = get(p, end, e.code) && get(p, end, e.action);
+        } else if (e.type == InputEvent::CursorPos || e.type == InputEvent::Scroll) {
+            ok = get(p, end, e.x) && get(p, end, e.y);
+        }
+        if (!ok) {
+            clear();
+            return false;
+        }
+        m_events.push_back(e);
+    }
+    return true;
+}
+
+bool InputLog::save(const std::string& path) const
+{
+    std::vector<uint8_t> data;
+    encode(data);
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+    fclose(fp);
+    return ok;
+}
+
+bool InputLog::load(const std::string& path)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp) {
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        data.insert(data.end(), buffer, buffer + n);
+    }
+    fclose(fp);
+    return decode(data.data(), data.size());
+}
+
+void InputLog::replay(double time, std::vector<InputEvent>& out)
+{
+    while (m_next < m_events.size() && m_events[m_next].time <= time) {
+        if (m_events[m_next].type != InputEvent::End) {
+            out.push_back(m_events[m_next]);
+        }
+        m_next++;
+    }
+}
@@ -0,0 +1,360 @@
+#include "jobs.h"
+#include "heapstats.h"
+
+#include <algorithm>
+
+struct Job
+{
+    std::function<void()> fn;
+    JobCounter* counter;
+    // parallelFor chunks call range(begin, end) instead and live on the caller's stack
+    const std::function<void(size_t, size_t)>* range = nullptr;
+    size_t begin = 0;
+    size_t end = 0;
+    // what the job allocates counts towards the scope of the thread that scheduled it
+    HeapStats::Scope* scope = nullptr;
+};
+
+namespace {
+
+// the deque a thread works on, per job system
+thread_local const JobSystem* t_system = nullptr;
+thread_local unsigned t_index = 0;
+
+}
+
+// Chase-Lev work-stealing deque with a fixed capacity (Le et al., "Correct and efficient
+// work-stealing for weak memory models"). push/pop by the owner only, steal by anyone.
+class JobSystem::Deque
+{
+public:
+    static const int64_t Capacity = 4096;
+
+    bool push(Job* job)
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        if (b - t >= Capacity) {
+            return false;
+        }
+        m_jobs[b & (Capacity - 1)].store(job, std::memory_order_relaxed);
+        m_bottom.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    Job* pop()
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        // seq_cst store and load instead of the paper's fence, same ordering
+        m_bottom.store(b, std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_seq_cst);
+        Job* job = nullptr;
+        if (t <= b) {
+            job = m_jobs[b & (Capacity - 1)].load(std::memory_order_relaxed);
+            if (t == b) {
+                // last item, race the thieves for it
+                if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    job = nullptr;
+                }
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+            }
+        } else {
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    Job* steal()
+    {
+        int64_t t = m_top.load(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_seq_cst);
+        if (t >= b) {
+            return nullptr;
+        }
+        Job* job = m_jobs[t & (Capacity - 1)].load(std::memory_order_relaxed);
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return job;
+    }
+
+private:
+    // top and bottom on their own cache lines, thieves hammer top
+    alignas(64) std::atomic<int64_t> m_top{ 0 };
+    alignas(64) std::atomic<int64_t> m_bottom{ 0 };
+    std::atomic<Job*> m_jobs[Capacity];
+};
+
+JobSystem::JobSystem(unsigned workers)
+{
+    if (workers == 0) {
+        workers = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        workers = std::max(workers, 1u);
+    }
+    m_backgroundLimit = std::max(1, int(workers / 2));
+    t_system = this;
+    t_index = 0;
+
+    for (unsigned i = 0; i <= workers; ++i) {
+        m_deques.emplace_back(new Deque);
+    }
+    for (unsigned i = 1; i <= workers; ++i) {
+        m_workers.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepLock);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+    for (auto& t : m_workers) {
+        t.join();
+    }
+    // whatever is left was never waited for
+    while (Job* job = findJob()) {
+        delete job;
+    }
+    for (Job* job : m_background) {
+        delete job;
+    }
+    if (t_system == this) {
+        t_system = nullptr;
+    }
+}
+
+void JobSystem::run(std::function<void()> fn, JobCounter* counter)
+{
+    if (counter) {
+        counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    Job* job = new Job{ std::move(fn), counter };
+    job->scope = HeapStats::currentScope();
+    schedule(job);
+}
+
+void JobSystem::runAfter(JobCounter& dependency, std::function<void()> fn, JobCounter* counter)
+{
+    if (counter) {
+        counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    Job* job = new Job{ std::move(fn), counter };
+    job->scope = HeapStats::currentScope();
+    {
+        std::lock_guard<std::mutex> lock(dependency.m_lock);
+        if (dependency.m_pending.load(std::memory_order_acquire) > 0) {
+            dependency.m_continuations.push_back(job);
+            return;
+        }
+    }
+    schedule(job);
+}
+
+void JobSystem::runBackground(std::function<void()> fn, JobCounter* counter)
+{
+    if (counter) {
+        counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_backgroundLock);
+        m_background.push_back(new Job{ std::move(fn), counter });
+    }
+    m_backgroundQueued.fetch_add(1);
+    if (m_sleeping.load() > 0) {
+        { std::lock_guard<std::mutex> lock(m_sleepLock); }
+        m_wake.notify_one();
+    }
+}
+
+void JobSystem::schedule(Job* job)
+{
+    if (t_system != this || !m_deques[t_index]->push(job)) {
+        std::lock_guard<std::mutex> lock(m_sharedLock);
+        m_shared.push_back(job);
+    }
+
+    // seq_cst against the sleeping worker's increment then check, so one of us sees the other
+    m_queued.fetch_add(1);
+    if (m_sleeping.load() > 0) {
+        // taking the lock orders this with a worker about to sleep
+        { std::lock_guard<std::mutex> lock(m_sleepLock); }
+        m_wake.notify_one();
+    }
+}
+
+Job* JobSystem::findJob()
+{
+    Job* job = nullptr;
+    bool own = t_system == this;
+    if (own) {
+        job = m_deques[t_index]->pop();
+    }
+    if (!job) {
+        std::lock_guard<std::mutex> lock(m_sharedLock);
+        if (!m_shared.empty()) {
+            job = m_shared.front();
+            m_shared.pop_front();
+        }
+    }
+    if (!job) {
+        // start stealing next to ourselves so thieves spread over the victims
+        size_t count = m_deques.size();
+        size_t first = own ? t_index + 1 : 0;
+        for (size_t i = 0; i < count && !job; ++i) {
+            size_t victim = (first + i) % count;
+            if (!own || victim != t_index) {
+                job = m_deques[victim]->steal();
+            }
+        }
+    }
+    if (job) {
+        m_queued.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job* JobSystem::findBackgroundJob()
+{
+    if (m_backgroundQueued.load(std::memory_order_relaxed) == 0) {
+        return nullptr;
+    }
+    // claim a slot first, so that the limit holds with workers racing for it
+    if (m_backgroundRunning.fetch_add(1) >= m_backgroundLimit) {
+        m_backgroundRunning.fetch_sub(1);
+        return nullptr;
+    }
+    Job* job = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_backgroundLock);
+        if (!m_background.empty()) {
+            job = m_background.front();
+            m_background.pop_front();
+        }
+    }
+    if (!job) {
+        m_backgroundRunning.fetch_sub(1);
+        return nullptr;
+    }
+    m_backgroundQueued.fetch_sub(1);
+    return job;
+}
+
+void JobSystem::execute(Job* job)
+{
+    HeapStats::Scope* scope = HeapStats::setScope(job->scope);
+    if (job->range) {
+        // the owner waits on the counter, the job may be gone as soon as finish() drops it
+        JobCounter* counter = job->counter;
+        (*job->range)(job->begin, job->end);
+        HeapStats::setScope(scope);
+        finish(counter);
+        return;
+    }
+    job->fn();
+    // the job's own storage is freed outside its scope
+    HeapStats::setScope(scope);
+    finish(job->counter);
+    delete job;
+}
+
+void JobSystem::finish(JobCounter* counter)
+{
+    if (!counter) {
+        return;
+    }
+    std::vector<Job*> ready;
+    {
+        // decrementing under the lock lets wait() know when we're done with the counter
+        std::lock_guard<std::mutex> lock(counter->m_lock);
+        if (counter->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            ready.swap(counter->m_continuations);
+        }
+    }
+    for (Job* job : ready) {
+        schedule(job);
+    }
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+    while (counter.m_pending.load(std::memory_order_acquire) > 0) {
+        if (Job* job = findJob()) {
+            execute(job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    std::lock_guard<std::mutex> lock(counter.m_lock);
+}
+
+void JobSystem::parallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& fn, size_t grain)
+{
+    if (grain == 0) {
+        // a few chunks per thread so stealing can even out uneven chunks
+        grain = std::max<size_t>(1, count / ((m_workers.size() + 1) * 4));
+    }
+    // the chunk jobs sit in a fixed array on this frame, no heap allocation per call
+    const size_t MaxChunks = 64;
+    grain = std::max(grain, (count + MaxChunks - 1) / MaxChunks);
+    if (count <= grain) {
+        if (count > 0) {
+            fn(0, count);
+        }
+        return;
+    }
+
+    Job chunks[MaxChunks];
+    JobCounter counter;
+    HeapStats::Scope* scope = HeapStats::currentScope();
+    size_t chunk = 0;
+    for (size_t begin = grain; begin < count; begin += grain) {
+        Job& job = chunks[chunk++];
+        job.counter = &counter;
+        job.range = &fn;
+        job.begin = begin;
+        job.end = std::min(count, begin + grain);
+        job.scope = scope;
+        counter.m_pending.fetch_add(1, std::memory_order_relaxed);
+        schedule(&job);
+    }
+    fn(0, grain);
+    wait(counter);
+}
+
+ParallelFor JobSystem::asParallelFor()
+{
+    return [this](size_t count, const std::function<void(size_t begin, size_t end)>& fn) {
+        parallelFor(count, fn);
+    };
+}
+
+void JobSystem::workerLoop(unsigned index)
+{
+    t_system = this;
+    t_index = index;
+    while (!m_quit.load(std::memory_order_acquire)) {
+        if (Job* job = findJob()) {
+            execute(job);
+            continue;
+        }
+        if (Job* job = findBackgroundJob()) {
+            execute(job);
+            m_backgroundRunning.fetch_sub(1);
+            // a worker that found the limit reached may be asleep on the rest
+            if (m_backgroundQueued.load() > 0 && m_sleeping.load() > 0) {
+                { std::lock_guard<std::mutex> lock(m_sleepLock); }
+                m_wake.notify_one();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_sleepLock);
+        m_sleeping.fetch_add(1);
+        m_wake.wait(lock, [this]() {
+            return m_quit.load() || m_queued.load() > 0 ||
+                (m_backgroundQueued.load() > 0 && m_backgroundRunning.load() < m_backgroundLimit);
+        });
+        m_sleeping.fetch_sub(1);
+    }
+}
@@ -0,0 +1,24 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+void threadedFor(size_t count, const std::function<void(size_t begin, size_t end)>& fn)
+{
+    size_t workers = std::max(1u, std::thread::hardware_concurrency());
+    workers = std::min(workers, count);
+    if (workers <= 1) {
+        fn(0, count);
+        return;
+    }
+    std::vector<std::thread> threads;
+    size_t chunk = (count + workers - 1) / workers;
+    for (size_t begin = chunk; begin < count; begin += chunk) {
+        threads.emplace_back(fn, begin, std::min(count, begin + chunk));
+    }
+    fn(0, std::min(count, chunk));
+    for (auto& t : threads) {
+        t.join();
+    }
+}
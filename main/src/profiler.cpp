@@ -0,0 +1,238 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include "spdlog/spdlog.h"
+
+namespace {
+
+// the geometric middle of a bucket, never above the largest sample
+double bucketValue(int i, double max)
+{
+    return std::min(max, Histogram::bucketLow(i) * std::exp2(0.5 / Histogram::BucketsPerOctave));
+}
+
+}
+
+void Histogram::add(double ms)
+{
+    int i = ms > MinMs ? int(std::log2(ms / MinMs) * BucketsPerOctave) : 0;
+    m_buckets[std::min(i, Buckets - 1)]++;
+    m_count++;
+    m_sum += ms;
+    m_max = std::max(m_max, ms);
+}
+
+void Histogram::clear()
+{
+    *this = Histogram();
+}
+
+double Histogram::bucketLow(int i)
+{
+    return MinMs * std::exp2(double(i) / BucketsPerOctave);
+}
+
+double Histogram::percentile(double p) const
+{
+    if (!m_count) {
+        return 0.0;
+    }
+    uint64_t rank = uint64_t(std::ceil(p * m_count));
+    uint64_t seen = 0;
+    for (int i = 0; i < Buckets; ++i) {
+        seen += m_buckets[i];
+        if (seen >= rank && m_buckets[i]) {
+            return bucketValue(i, m_max);
+        }
+    }
+    return m_max;
+}
+
+double Histogram::lowMean(double fraction) const
+{
+    if (!m_count) {
+        return 0.0;
+    }
+    uint64_t wanted = std::max<uint64_t>(1, uint64_t(std::ceil(fraction * m_count)));
+    uint64_t left = wanted;
+    double sum = 0.0;
+    for (int i = Buckets - 1; i >= 0 && left > 0; --i) {
+        uint64_t n = std::min(left, m_buckets[i]);
+        sum += n * bucketValue(i, m_max);
+        left -= n;
+    }
+    return sum / wanted;
+}
+
+Profiler::Profiler(const std::string& name, double interval)
+{
+    m_name = name;
+    m_interval = interval;
+    m_frames = 0;
+    m_fps = 0;
+    m_intervalStart = std::chrono::steady_clock::now();
+    m_lastFrame = m_intervalStart;
+}
+
+void Profiler::beginFrame()
+{
+}
+
+void Profiler::endFrame()
+{
+    m_frames++;
+    m_sessionFrames++;
+
+    auto now = std::chrono::steady_clock::now();
+    sample("frame_ms", std::chrono::duration<double, std::milli>(now - m_lastFrame).count());
+    m_lastFrame = now;
+
+    double elapsed = std::chrono::duration<double>(now - m_intervalStart).count();
+    if (elapsed >= m_interval) {
+        m_fps = int(m_frames / elapsed + 0.5);
+        for (auto& c : m_counters) {
+            c.second.average = double(c.second.total) / m_frames;
+            c.second.total = 0;
+        }
+        for (auto& s : m_series) {
+            s.second.last = summarize(s.second.interval);
+            s.second.interval.clear();
+        }
+        m_reports++;
+        report();
+        m_frames = 0;
+        m_intervalStart = now;
+    }
+}
+
+void Profiler::count(const char* name, int64_t value)
+{
+    auto it = m_counters.find(name);
+    if (it == m_counters.end()) {
+        it = m_counters.emplace(name, Counter()).first;
+    }
+    it->second.total += value;
+    it->second.sessionTotal += value;
+}
+
+double Profiler::average(const char* name)
+{
+    auto it = m_counters.find(name);
+    return it == m_counters.end() ? 0.0 : it->second.average;
+}
+
+void Profiler::sample(const char* name, double ms)
+{
+    auto it = m_series.find(name);
+    if (it == m_series.end()) {
+        it = m_series.emplace(name, Series()).first;
+    }
+    it->second.interval.add(ms);
+    it->second.session.add(ms);
+}
+
+const Profiler::Summary& Profiler::summary(const char* name) const
+{
+    static const Summary none;
+    auto it = m_series.find(name);
+    return it == m_series.end() ? none : it->second.last;
+}
+
+Profiler::Summary Profiler::summarize(const Histogram& h)
+{
+    Summary s;
+    s.count = h.count();
+    s.mean = h.mean();
+    s.p50 = h.percentile(0.5);
+    s.p99 = h.percentile(0.99);
+    s.max = h.max();
+    s.low1 = h.lowMean(0.01);
+    s.low01 = h.lowMean(0.001);
+    return s;
+}
+
+std::string Profiler::json() const
+{
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    writer.StartObject();
+    writer.Key("name");
+    writer.String(m_name.c_str());
+    writer.Key("frames");
+    writer.Int64(m_sessionFrames);
+
+    // per frame over the session
+    writer.Key("counters");
+    writer.StartObject();
+    for (auto& c : m_counters) {
+        writer.Key(c.first.c_str());
+        writer.Double(m_sessionFrames ? double(c.second.sessionTotal) / m_sessionFrames : 0.0);
+    }
+    writer.EndObject();
+
+    writer.Key("timings");
+    writer.StartObject();
+    for (auto& series : m_series) {
+        const Histogram& h = series.second.session;
+        Summary s = summarize(h);
+        writer.Key(series.first.c_str());
+        writer.StartObject();
+        writer.Key("count");
+        writer.Uint64(s.count);
+        writer.Key("mean_ms");
+        writer.Double(s.mean);
+        writer.Key("p50_ms");
+        writer.Double(s.p50);
+        writer.Key("p90_ms");
+        writer.Double(h.percentile(0.9));
+        writer.Key("p99_ms");
+        writer.Double(s.p99);
+        writer.Key("p999_ms");
+        writer.Double(h.percentile(0.999));
+        writer.Key("max_ms");
+        writer.Double(s.max);
+        writer.Key("low_1pct_ms");
+        writer.Double(s.low1);
+        writer.Key("low_0_1pct_ms");
+        writer.Double(s.low01);
+        // [lower bound in ms, samples] of the buckets that have any
+        writer.Key("histogram");
+        writer.StartArray();
+        for (int i = 0; i < Histogram::Buckets; ++i) {
+            if (h.bucket(i)) {
+                writer.StartArray();
+                writer.Double(Histogram::bucketLow(i));
+                writer.Uint64(h.bucket(i));
+                writer.EndArray();
+            }
+        }
+        writer.EndArray();
+        writer.EndObject();
+    }
+    writer.EndObject();
+
+    writer.EndObject();
+    return buffer.GetString();
+}
+
+void Profiler::report()
+{
+    std::ostringstream line;
+    line << m_fps << " fps";
+    for (auto& c : m_counters) {
+        line << ", " << c.first << " " << c.second.average;
+    }
+    const Summary& frame = summary("frame_ms");
+    if (frame.count) {
+        line << ", 1% low " << int(1000.0 / frame.low1 + 0.5) << " fps, 0.1% low " << int(1000.0 / frame.low01 + 0.5) << " fps";
+    }
+    for (auto& s : m_series) {
+        line << ", " << s.first << " " << s.second.last.mean << " (p99 " << s.second.last.p99 << ")";
+    }
+    spdlog::info("{0}: {1}", m_name, line.str());
+}
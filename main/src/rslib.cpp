@@ -2,6 +2,7 @@
 
 #if defined(_WIN32)
 #include <windows.h>
+#include <psapi.h>
 #include <locale>
 #include <codecvt>
 #elif defined (LINUX)
@@ -14,9 +15,9 @@
 #include <fstream>
 #include <sstream>
 #include <streambuf>
-#include <mutex>
 
 #include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
 
 #include "getopt.h"
 #include "config.h"
@@ -26,22 +27,19 @@
 
 RSLib* RSLib::instance()
 { 
-    std::mutex inst_m;
-    std::lock_guard<std::mutex> l(inst_m);
-
-    static std::unique_ptr<RSLib> thisPtr(new RSLib);
-    static bool isInit = false;
-    if (isInit == false) {
-        isInit = true;
-        thisPtr->init();
-    }
+    // a function-local static is initialized exactly once, even with concurrent callers
+    static std::unique_ptr<RSLib> thisPtr = []() {
+        std::unique_ptr<RSLib> p(new RSLib);
+        p->init();
+        return p;
+    }();
 
     return thisPtr.get();
 }
 
 RSLib::RSLib() 
 {
-    resTypeStrings.assign({ "config", "shader", "texture", "model" });
+    resTypeStrings.assign({ "config", "shader", "texture", "model", "reference" });
     m_arg.config = "default.json";
     m_enableSPVDump = false;
 }
@@ -103,6 +101,10 @@ std::shared_ptr<Config> RSLib::initConfig(int argc, char** argv)
         /* These options dont set a flag.
          We distinguish them by their indices. */
         { "config", required_argument, 0, 'c' },
+        { "bench", required_argument, 0, 'b' },
+        { "offline", required_argument, 0, 'o' },
+        { "record", required_argument, 0, 'r' },
+        { "replay", required_argument, 0, 'p' },
         //{ "n", required_argument, 0, 'n' },
         //{ "k", required_argument, 0, 'k' },
         { 0, 0, 0, 0 }
@@ -112,7 +114,7 @@ std::shared_ptr<Config> RSLib::initConfig(int argc, char** argv)
         /* getopt_long stores the option index here. */
         int option_index = 0;
 
-        int c = getopt_long(argc, argv, "c:",
+        int c = getopt_long(argc, argv, "c:b:o:r:p:",
             long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -134,6 +136,26 @@ std::shared_ptr<Config> RSLib::initConfig(int argc, char** argv)
             m_arg.config = std::string(optarg);
             break;
 
+        case 'b':
+            m_arg.bench = std::string(optarg);
+            break;
+
+        case 'o':
+            m_arg.offline = std::string(optarg);
+            // stdout carries the video, the log goes to stderr
+            if (m_arg.offline == "-") {
+                spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
+            }
+            break;
+
+        case 'r':
+            m_arg.record = std::string(optarg);
+            break;
+
+        case 'p':
+            m_arg.replay = std::string(optarg);
+            break;
+
         case 'k':
             m_arg.k = std::stoi(optarg, nullptr);
             break;
@@ -192,6 +214,13 @@ std::string RSLib::getTextureFileName(const char* fileName) {
         return getResourceFileName(fileName, "texture");
 }
 
+std::string RSLib::getReferenceFileName(const char* fileName) {
+    if (fileName == nullptr)
+        return std::string();
+    else
+        return getResourceFileName(fileName, "reference");
+}
+
 std::string RSLib::loadFile(std::string filename)
 {
     std::ifstream ifs(filename);
@@ -409,3 +438,24 @@ int RSLib::execCmd(std::string& cmd)
     return rtnVal;
 }
 
+size_t RSLib::residentMemory()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.WorkingSetSize;
+    }
+#elif defined(LINUX)
+    long pages = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        if (fscanf(fp, "%*s %ld", &pages) != 1) {
+            pages = 0;
+        }
+        fclose(fp);
+        return size_t(pages) * size_t(sysconf(_SC_PAGESIZE));
+    }
+#endif
+    return 0;
+}
+
@@ -0,0 +1,179 @@
+// replay: plays a GL trace recorded with "gl_trace" in the config and reports what the
+// driver costs per entry point and per frame. Run it against different drivers to tell
+// engine overhead from driver overhead, e.g. with Mesa:
+//   LIBGL_ALWAYS_SOFTWARE=1 GALLIUM_DRIVER=llvmpipe replay frames.gltrace
+//   LIBGL_ALWAYS_SOFTWARE=1 GALLIUM_DRIVER=softpipe replay frames.gltrace
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "glad/glad.h"
+#define GLFW_DLL
+#include "glfw/glfw3.h"
+#include "spdlog/spdlog.h"
+
+#include "getopt.h"
+#include "gltrace.h"
+
+namespace {
+
+void usage()
+{
+    printf("usage: replay [--loops n] [--top n] [--size wxh] [--visible] <trace>\n");
+}
+
+double mean(const std::vector<double>& values)
+{
+    return values.empty() ? 0.0 : std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+}
+
+double percentile(std::vector<double> values, double p)
+{
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, size_t(p * values.size()))];
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    struct option long_options[] = {
+        { "loops", required_argument, 0, 'l' },
+        { "top", required_argument, 0, 't' },
+        { "size", required_argument, 0, 's' },
+        { "visible", no_argument, 0, 'v' },
+        { 0, 0, 0, 0 }
+    };
+    int loops = 10;
+    int top = 16;
+    int width = 1280;
+    int height = 800;
+    bool visible = false;
+    while (1) {
+        int option_index = 0;
+        int c = getopt_long(argc, argv, "l:t:s:v", long_options, &option_index);
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+        case 'l':
+            loops = std::max(1, std::stoi(optarg));
+            break;
+        case 't':
+            top = std::max(1, std::stoi(optarg));
+            break;
+        case 's':
+            if (sscanf(optarg, "%dx%d", &width, &height) != 2) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'v':
+            visible = true;
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage();
+        return 1;
+    }
+    std::string path = argv[optind];
+
+    GLTracePlayer player;
+    if (!player.load(path)) {
+        spdlog::error("replay: {0} is not a GL trace", path);
+        return 1;
+    }
+    if (!player.frameCount()) {
+        spdlog::error("replay: {0} has no complete frame", path);
+        return 1;
+    }
+
+    // the same context the engine asks for
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(width, height, "replay", NULL, NULL);
+    if (!window) {
+        spdlog::error("replay: failed to create a GL context");
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        spdlog::error("replay: failed to load GL");
+        glfwTerminate();
+        return 1;
+    }
+    spdlog::info("replay: {0}, {1} on {2}", path, (const char*)glGetString(GL_VERSION), (const char*)glGetString(GL_RENDERER));
+    spdlog::info("replay: {0} calls, {1} frames, {2:.1f} MB", player.callCount(), player.frameCount(), player.size() / 1048576.0);
+
+    using Clock = std::chrono::steady_clock;
+    auto ms = [](Clock::time_point from, Clock::time_point to) { return std::chrono::duration<double, std::milli>(to - from).count(); };
+
+    if (!player.playSetup()) {
+        spdlog::error("replay: the trace is broken in its setup");
+        return 1;
+    }
+    auto start = Clock::now();
+    glFinish();
+    double setupMs = player.stats().setupMs + ms(start, Clock::now());
+
+    // the first loop warms up shader caches and allocations, it isn't counted
+    std::vector<double> cpuMs;
+    std::vector<double> frameMs;
+    for (int loop = 0; loop <= loops; ++loop) {
+        if (loop == 1) {
+            player.resetStats();
+            cpuMs.clear();
+            frameMs.clear();
+        }
+        for (size_t f = 0; f < player.frameCount(); ++f) {
+            auto frameStart = Clock::now();
+            if (!player.playFrame(f)) {
+                spdlog::error("replay: the trace is broken in frame {0}", f);
+                return 1;
+            }
+            auto submitted = Clock::now();
+            glFinish();
+            auto finished = Clock::now();
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+            cpuMs.push_back(ms(frameStart, submitted));
+            frameMs.push_back(ms(frameStart, finished));
+        }
+    }
+
+    const GLTracePlayer::Stats& stats = player.stats();
+    uint64_t calls = 0;
+    double callMs = 0.0;
+    for (size_t e = 0; e < stats.calls.size(); ++e) {
+        calls += stats.calls[e];
+        callMs += stats.ns[e] * 1e-6;
+    }
+    size_t frames = frameMs.size();
+    spdlog::info("replay: setup {0:.1f} ms; {1} frames of {2} calls", setupMs, frames, calls / std::max<size_t>(1, frames));
+    spdlog::info("replay: submit {0:.3f} ms per frame (p50 {1:.3f}, p99 {2:.3f}), {3:.3f} ms of it in GL calls; with glFinish {4:.3f} ms (p50 {5:.3f}, p99 {6:.3f})",
+        mean(cpuMs), percentile(cpuMs, 0.5), percentile(cpuMs, 0.99), callMs / std::max<size_t>(1, frames),
+        mean(frameMs), percentile(frameMs, 0.5), percentile(frameMs, 0.99));
+    printf("%s", player.report(size_t(top)).c_str());
+
+    glfwTerminate();
+    return 0;
+}